@@ -0,0 +1,262 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Header file */
+#include "arena.h"
+/* C library */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* POSIX */
+#include <unistd.h>
+#include <sys/mman.h>
+/* e-type */
+#include "log.h"
+
+struct arena engine_arena;
+
+/* -==+ Arena +==- */
+
+int
+arena_init(struct arena *a, size_t size)
+{
+	void *base;
+
+	size = (size + 4095) & ~(size_t)4095;
+	base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (base == MAP_FAILED) {
+		log_error("Can't reserve a %zu byte arena\n", size);
+		return -1;
+	}
+
+	a->base = base;
+	a->size = size;
+	a->used = 0;
+
+	return 0;
+}
+
+/*
+ * Zeroed, as the pages are fresh. NULL once the arena is spent, it
+ * was sized for everything so that's a bug in the sizing.
+ */
+void *
+arena_alloc(struct arena *a, size_t size, size_t align)
+{
+	size_t at;
+
+	at = (a->used + align - 1) & ~(align - 1);
+	if (!a->base || at > a->size || size > a->size - at) {
+		log_error("Arena out of space for %zu bytes\n", size);
+		return NULL;
+	}
+
+	a->used = at + size;
+
+	return a->base + at;
+}
+
+void
+arena_free(struct arena *a)
+{
+	if (a->base) {
+		munmap(a->base, a->size);
+	}
+
+	memset(a, 0, sizeof (*a));
+}
+
+/* -==+ Pools +==- */
+
+int
+pool_init(struct pool *p, struct arena *a, const char *name, size_t size, uint32_t count)
+{
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	if ((p->base = arena_alloc(a, size * count, ARENA_ALIGN)) == NULL) {
+		log_error("Can't carve the %s pool\n", name);
+		return -1;
+	}
+
+	p->name = name;
+	p->size = size;
+	p->count = count;
+	p->carved = 0;
+	p->used = 0;
+	p->free = NULL;
+
+	return 0;
+}
+
+/*
+ * NULL when every object is taken. The object is as its last owner
+ * left it, except for its first pointer, or zeroed the first time.
+ */
+void *
+pool_get(struct pool *p)
+{
+	void *obj;
+
+	if ((obj = p->free)) {
+		p->free = *(void **)obj;
+
+	} else if (p->carved != p->count) {
+		obj = p->base + (size_t)p->carved++ * p->size;
+
+	} else {
+		return NULL;
+	}
+
+	++p->used;
+
+	return obj;
+}
+
+void
+pool_put(struct pool *p, void *obj)
+{
+	*(void **)obj = p->free;
+	p->free = obj;
+	--p->used;
+}
+
+/* -==+ Allocation checks +==- */
+
+#ifdef ALLOC_DEBUG
+
+#include <execinfo.h>
+
+/*
+ * Built with 'make OPT=-DALLOC_DEBUG' the heap goes through here: every
+ * allocation is counted, and one made by a thread between
+ * alloc_freeze() and alloc_thaw() aborts the game right there with the
+ * stack on stderr. glibc keeps its own entry points around under these
+ * names.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t align, size_t size);
+
+static uint64_t alloc_total;
+static __thread int alloc_frozen;
+
+static void
+alloc_note(void)
+{
+	void *stack[32];
+	char msg[80];
+	uint64_t n;
+	int len;
+
+	n = __atomic_add_fetch(&alloc_total, 1, __ATOMIC_RELAXED);
+
+	if (alloc_frozen) {
+		alloc_frozen = 0;
+		len = snprintf(msg, sizeof msg, "e-type: heap allocation #%llu after the game started\n",
+			       (unsigned long long)n);
+		if (write(STDERR_FILENO, msg, len) == len) {
+			backtrace_symbols_fd(stack, backtrace(stack, 32), STDERR_FILENO);
+		}
+		abort();
+	}
+}
+
+void *
+malloc(size_t size)
+{
+	alloc_note();
+	return __libc_malloc(size);
+}
+
+void *
+calloc(size_t n, size_t size)
+{
+	alloc_note();
+	return __libc_calloc(n, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+	alloc_note();
+	return __libc_realloc(ptr, size);
+}
+
+int
+posix_memalign(void **ptr, size_t align, size_t size)
+{
+	void *p;
+
+	alloc_note();
+	if ((p = __libc_memalign(align, size)) == NULL) {
+		return ENOMEM;
+	}
+
+	*ptr = p;
+
+	return 0;
+}
+
+void *
+aligned_alloc(size_t align, size_t size)
+{
+	alloc_note();
+	return __libc_memalign(align, size);
+}
+
+void
+alloc_freeze(void)
+{
+	alloc_frozen = 1;
+}
+
+void
+alloc_thaw(void)
+{
+	alloc_frozen = 0;
+}
+
+/* Heap allocations made since startup, by every thread */
+uint64_t
+alloc_count(void)
+{
+	return __atomic_load_n(&alloc_total, __ATOMIC_RELAXED);
+}
+
+#else
+
+void
+alloc_freeze(void)
+{
+}
+
+void
+alloc_thaw(void)
+{
+}
+
+/* Not counted without ALLOC_DEBUG */
+uint64_t
+alloc_count(void)
+{
+	return 0;
+}
+
+#endif /* ALLOC_DEBUG */
@@ -0,0 +1,79 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#define ARENA_ALIGN	64	/* Default alignment, a cache line */
+
+/* C library */
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * -==+ Arena +==-
+ * One block of address space reserved at startup, handed out front to
+ * back and never given back. Pages are only committed when touched,
+ * so reserving for the worst case costs nothing.
+ */
+struct arena {
+	uint8_t *base;
+	size_t size;
+	size_t used;
+};
+
+/*
+ * -==+ Pool +==-
+ * 'count' objects of one type reserved from an arena at startup, free
+ * ones are linked through their first bytes. Objects never handed out
+ * are taken from 'base' in order, so a pool sized for the worst case
+ * only commits the pages it ever used.
+ */
+struct pool {
+	const char *name;
+	void *free;
+	uint8_t *base;
+	size_t size;
+	uint32_t count;
+	uint32_t carved;
+	uint32_t used;
+};
+
+/* What pool_init() takes from the arena, for sizing it */
+#define POOL_BYTES(size, count)	((count) * (((size) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1)) + ARENA_ALIGN)
+
+/* The engine's memory, sized and carved up by main() */
+extern struct arena engine_arena;
+
+/* -==+ Arena +==- */
+int   arena_init(struct arena *a, size_t size);
+void *arena_alloc(struct arena *a, size_t size, size_t align);
+void  arena_free(struct arena *a);
+
+/* -==+ Pools +==- */
+int   pool_init(struct pool *p, struct arena *a, const char *name, size_t size, uint32_t count);
+void *pool_get(struct pool *p);
+void  pool_put(struct pool *p, void *obj);
+
+/* -==+ Allocation checks, see ALLOC_DEBUG in arena.c +==- */
+void alloc_freeze(void);
+void alloc_thaw(void);
+uint64_t alloc_count(void);
+
+#endif /* ARENA_H */
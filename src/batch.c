@@ -0,0 +1,712 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Header file */
+#include "batch.h"
+/* C library */
+#include <stdlib.h>
+#include <string.h>
+/* POSIX */
+#include <pthread.h>
+/* e-type */
+#include "log.h"
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+/* Row layout: cell 'x' is bit 'x + 4', everything else is wall */
+#define CELL_SHIFT	4
+#define ROW_WALL	(~(((1u << BOARD_W) - 1) << CELL_SHIFT))
+#define ROW_FULL	(~0u)
+#define SPAWN_X		((BOARD_W - 1) / 2)
+
+/* Shape rows are built with 'x + 2' at bit 0 */
+#define SHAPE_SHIFT	(CELL_SHIFT - 2)
+
+/* -==+ Rotation states +==- */
+
+uint32_t batch_shape[BATCH_STATES][4];
+int32_t batch_top[BATCH_STATES];
+int32_t batch_cw[BATCH_STATES], batch_ccw[BATCH_STATES];
+
+int  batch_scalar_supported(void);
+void batch_step_scalar(struct batch *b, const uint8_t *actions, int lo, int hi);
+int  batch_avx2_supported(void);
+void batch_step_avx2(struct batch *b, const uint8_t *actions, int lo, int hi);
+
+/* Fastest first, batch_init() picks the first supported */
+const struct batch_kernel batch_kernels[] = { { "avx2",
+						batch_avx2_supported, batch_step_avx2 },
+
+					      { "scalar",
+						batch_scalar_supported, batch_step_scalar } };
+
+const struct batch_kernel *batch_kernel;
+
+/*
+ * Rotate the blocks of 'm' the way rotate_mino() does.
+ */
+static void
+rotate_blocks(struct mino *m, int dir)
+{
+	struct point *p;
+	int i, z;
+
+	for (i = 0; i != 4; ++i) {
+		p = &m->block_pos[i];
+		p->x -= m->pivot.x;
+		p->y -= m->pivot.y;
+
+		if (dir == CLOCKWISE) {
+			z = p->x;
+			p->x = -p->y;
+			p->y = z;
+
+		} else {
+			z = p->y;
+			p->y = -p->x;
+			p->x = z;
+		}
+
+		p->x += m->pivot.x;
+		p->y += m->pivot.y;
+	}
+}
+
+static void
+build_state(int s, const struct mino *m)
+{
+	int i, top;
+
+	top = m->block_pos[0].y;
+	for (i = 1; i != 4; ++i) {
+		top = MIN(top, m->block_pos[i].y);
+	}
+
+	batch_top[s] = top;
+	memset(batch_shape[s], 0, sizeof batch_shape[s]);
+	for (i = 0; i != 4; ++i) {
+		batch_shape[s][m->block_pos[i].y - top] |= 1u << (m->block_pos[i].x + 2);
+	}
+}
+
+/*
+ * Follow each tetromino through its rotations, ROTATE_TWICE ones flip
+ * between two states and ROTATE_NONE ones stay put, as in the game.
+ */
+static void
+build_states(void)
+{
+	struct mino m;
+	int id, r, s;
+
+	for (id = 0; id != 7; ++id) {
+		m = minos[id];
+		s = id * 4;
+
+		for (r = 0; r != 4; ++r) {
+			build_state(s + r, &m);
+			batch_cw[s + r] = s + (r + 1) % 4;
+			batch_ccw[s + r] = s + (r + 3) % 4;
+			rotate_blocks(&m, CLOCKWISE);
+		}
+
+		if (minos[id].flags & BIT(ROTATE_NONE)) {
+			batch_cw[s] = batch_ccw[s] = s;
+
+		} else if (minos[id].flags & BIT(ROTATE_TWICE)) {
+			/* The first turn is always counter clockwise */
+			m = minos[id];
+			rotate_blocks(&m, COUNTER_CLOCKWISE);
+			build_state(s + 1, &m);
+			batch_cw[s] = batch_ccw[s] = s + 1;
+			batch_cw[s + 1] = batch_ccw[s + 1] = s;
+		}
+	}
+}
+
+/*
+ * Only the first call builds the tables, from any thread. Callers that
+ * come in meanwhile wait until they're complete.
+ */
+void
+batch_states(void)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+	pthread_once(&once, build_states);
+}
+
+/* -==+ Per game helpers, shared by every kernel +==- */
+
+static inline uint32_t *
+row_at(const struct batch *b, int y, int g)
+{
+	return b->rows + (y + BATCH_PAD) * b->n + g;
+}
+
+static inline int
+lane_fits(const struct batch *b, int g, int x, int y, int s)
+{
+	const uint32_t *row;
+	uint32_t hit;
+	int r;
+
+	row = row_at(b, y + batch_top[s], g);
+	hit = 0;
+	for (r = 0; r != 4; ++r) {
+		hit |= row[r * b->n] & (batch_shape[s][r] << (x + SHAPE_SHIFT));
+	}
+
+	return !hit;
+}
+
+static void
+lane_spawn(struct batch *b, int g)
+{
+	b->state[g] = queue_next(&b->queue[g]) * 4;
+	b->x[g] = SPAWN_X;
+	b->y[g] = 0;
+}
+
+void
+batch_reset(struct batch *b, int g)
+{
+	int y;
+
+	for (y = -BATCH_PAD; y != BOARD_H; ++y) {
+		*row_at(b, y, g) = ROW_WALL;
+	}
+
+	for (; y != BOARD_H + BATCH_FLOOR; ++y) {
+		*row_at(b, y, g) = ROW_FULL;
+	}
+
+	b->lines[g] = 0;
+	lane_spawn(b, g);
+}
+
+/*
+ * Write the current tetromino into the board, returns -1 if part of it
+ * is left above the board.
+ */
+static int
+lane_lock(struct batch *b, int g)
+{
+	int r, s, y;
+
+	s = b->state[g];
+	y = b->y[g] + batch_top[s];
+
+	for (r = 0; r != 4 && batch_shape[s][r]; ++r) {
+		if (y + r < 0) {
+			return -1;
+		}
+
+		*row_at(b, y + r, g) |= batch_shape[s][r] << (b->x[g] + SHAPE_SHIFT);
+	}
+
+	return 0;
+}
+
+/*
+ * Return if a row the current tetromino sits on is full, no other
+ * row can have become full.
+ */
+static inline int
+lane_full(const struct batch *b, int g)
+{
+	int r, y, full;
+
+	y = b->y[g] + batch_top[b->state[g]];
+	full = 0;
+	for (r = 0; r != 4 && y + r < BOARD_H; ++r) {
+		full |= *row_at(b, y + r, g) == ROW_FULL;
+	}
+
+	return full;
+}
+
+/*
+ * Drop the full lines of a single board, returns how many.
+ */
+static int
+lane_clear(struct batch *b, int g)
+{
+	int src, dst, cleared;
+
+	for (src = dst = BOARD_H - 1; src >= 0; --src) {
+		if (*row_at(b, src, g) != ROW_FULL) {
+			*row_at(b, dst--, g) = *row_at(b, src, g);
+		}
+	}
+
+	for (cleared = dst + 1; dst >= 0; --dst) {
+		*row_at(b, dst, g) = ROW_WALL;
+	}
+
+	return cleared;
+}
+
+/*
+ * Score the cleared lines like clear_lines() and bring in the next
+ * tetromino.
+ */
+static void
+lane_score(struct batch *b, int g, int cleared)
+{
+	if (cleared) {
+		b->reward[g] += (b->lines[g] / 10 + 1) * score_mult[cleared - 1];
+		b->lines[g] += cleared;
+	}
+
+	lane_spawn(b, g);
+}
+
+/*
+ * A blocked spawn ends the game and starts a new one.
+ */
+static void
+lane_over(struct batch *b, int g)
+{
+	b->done[g] = 1;
+	batch_reset(b, g);
+}
+
+/* -==+ Scalar kernel +==- */
+
+int
+batch_scalar_supported(void)
+{
+	return 1;
+}
+
+void
+batch_step_scalar(struct batch *b, const uint8_t *actions, int lo, int hi)
+{
+	int g, x, y, s, y0, lock;
+
+	for (g = lo; g != hi; ++g) {
+		x = b->x[g];
+		y0 = y = b->y[g];
+		s = b->state[g];
+		lock = 0;
+
+		b->done[g] = 0;
+
+		switch (actions[g]) {
+		case BA_LEFT:  --x;              break;
+		case BA_RIGHT: ++x;              break;
+		case BA_ROTATE_CW:  s = batch_cw[s];  break;
+		case BA_ROTATE_CCW: s = batch_ccw[s]; break;
+		case BA_SOFT_DROP:  ++y;         break;
+		case BA_HARD_DROP:
+			while (lane_fits(b, g, x, y + 1, s)) {
+				++y;
+			}
+
+			lock = 1;
+			break;
+		}
+
+		if (lane_fits(b, g, x, y, s)) {
+			b->x[g] = x;
+			b->y[g] = y;
+			b->state[g] = s;
+
+		} else if (actions[g] == BA_SOFT_DROP) {
+			lock = 1;
+		}
+
+		b->reward[g] = b->y[g] - y0;
+
+		if (lock) {
+			if (lane_lock(b, g) == -1) {
+				lane_over(b, g);
+				continue;
+			}
+
+			lane_score(b, g, lane_full(b, g) ? lane_clear(b, g) : 0);
+
+			if (!lane_fits(b, g, b->x[g], b->y[g], b->state[g])) {
+				lane_over(b, g);
+			}
+		}
+	}
+}
+
+/* -==+ AVX2 kernel +==- */
+
+#ifdef __x86_64__
+
+int
+batch_avx2_supported(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+/*
+ * Rows of eight tetrominos in state 's' moved to column 'x'.
+ */
+__attribute__ ((target("avx2")))
+static inline void
+shape_avx2(__m256i x, __m256i s, __m256i *shape)
+{
+	__m256i shift;
+	int r;
+
+	shift = _mm256_add_epi32(x, _mm256_set1_epi32(SHAPE_SHIFT));
+	s = _mm256_slli_epi32(s, 2);
+
+	for (r = 0; r != 4; ++r) {
+		shape[r] = _mm256_sllv_epi32(_mm256_i32gather_epi32((const int *)batch_shape[0] + r, s, 4), shift);
+	}
+}
+
+/*
+ * Index into 'rows' of the topmost row of eight tetrominos.
+ */
+__attribute__ ((target("avx2")))
+static inline __m256i
+index_avx2(const struct batch *b, int g, __m256i y, __m256i s)
+{
+	__m256i idx;
+
+	idx = _mm256_add_epi32(y, _mm256_i32gather_epi32(batch_top, s, 4));
+	idx = _mm256_add_epi32(idx, _mm256_set1_epi32(BATCH_PAD));
+
+	return _mm256_add_epi32(_mm256_mullo_epi32(idx, _mm256_set1_epi32(b->n)),
+				_mm256_add_epi32(_mm256_set1_epi32(g), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+}
+
+/*
+ * Collision test of eight games at once, all-ones lanes fit.
+ */
+__attribute__ ((target("avx2")))
+static inline __m256i
+fits_avx2(const struct batch *b, int g, __m256i x, __m256i y, __m256i s)
+{
+	__m256i shape[4], idx, n, hit;
+	int r;
+
+	shape_avx2(x, s, shape);
+	idx = index_avx2(b, g, y, s);
+	n = _mm256_set1_epi32(b->n);
+
+	hit = _mm256_setzero_si256();
+	for (r = 0; r != 4; ++r) {
+		hit = _mm256_or_si256(hit, _mm256_and_si256(shape[r],
+			_mm256_i32gather_epi32((const int *)b->rows, idx, 4)));
+		idx = _mm256_add_epi32(idx, n);
+	}
+
+	return _mm256_cmpeq_epi32(hit, _mm256_setzero_si256());
+}
+
+/*
+ * Lower the 'drop' lanes until they land. The four rows under the
+ * tetromino slide down one row per step, so each step is a single
+ * gather however tall the drop.
+ */
+__attribute__ ((target("avx2")))
+static __m256i
+drop_avx2(const struct batch *b, int g, __m256i x, __m256i y, __m256i s, __m256i drop)
+{
+	__m256i shape[4], row[4], idx, n, hit, one;
+	int r;
+
+	shape_avx2(x, s, shape);
+	idx = index_avx2(b, g, y, s);
+	n = _mm256_set1_epi32(b->n);
+	one = _mm256_set1_epi32(1);
+
+	for (r = 0; r != 4; ++r) {
+		idx = _mm256_add_epi32(idx, n);
+		row[r] = _mm256_i32gather_epi32((const int *)b->rows, idx, 4);
+	}
+
+	for (;;) {
+		hit = _mm256_setzero_si256();
+		for (r = 0; r != 4; ++r) {
+			hit = _mm256_or_si256(hit, _mm256_and_si256(shape[r], row[r]));
+		}
+
+		drop = _mm256_and_si256(drop, _mm256_cmpeq_epi32(hit, _mm256_setzero_si256()));
+		if (_mm256_testz_si256(drop, drop)) {
+			return y;
+		}
+
+		/* Landed lanes stay put, their window could leave the floor */
+		y = _mm256_add_epi32(y, _mm256_and_si256(drop, one));
+		idx = _mm256_add_epi32(idx, _mm256_and_si256(drop, n));
+		row[0] = row[1];
+		row[1] = row[2];
+		row[2] = row[3];
+		row[3] = _mm256_i32gather_epi32((const int *)b->rows, idx, 4);
+	}
+}
+
+/*
+ * Drop the full lines of eight boards at once, bottom up. Each game
+ * keeps its own source row, which skips over full rows, so every
+ * destination row is one gather and one contiguous store. Returns
+ * the lines cleared per game.
+ */
+__attribute__ ((target("avx2")))
+static __m256i
+clear_avx2(struct batch *b, int g)
+{
+	__m256i src, idx, row, full, n, base, one, floor, wall;
+	int dst;
+
+	n = _mm256_set1_epi32(b->n);
+	one = _mm256_set1_epi32(1);
+	wall = _mm256_set1_epi32(ROW_WALL);
+	floor = _mm256_set1_epi32(BATCH_PAD - 1);
+	base = _mm256_add_epi32(_mm256_set1_epi32(g), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	src = _mm256_set1_epi32(BATCH_PAD + BOARD_H - 1);
+
+	for (dst = BATCH_PAD + BOARD_H - 1; dst >= BATCH_PAD; --dst) {
+		do {
+			idx = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_max_epi32(src, floor), n), base);
+			row = _mm256_i32gather_epi32((const int *)b->rows, idx, 4);
+			full = _mm256_and_si256(_mm256_cmpeq_epi32(row, _mm256_set1_epi32(ROW_FULL)),
+						_mm256_cmpgt_epi32(src, floor));
+			src = _mm256_add_epi32(src, full);
+		} while (!_mm256_testz_si256(full, full));
+
+		/* Above the board is empty */
+		row = _mm256_blendv_epi8(wall, row, _mm256_cmpgt_epi32(src, floor));
+		_mm256_storeu_si256((__m256i *)(b->rows + dst * b->n + g), row);
+		src = _mm256_sub_epi32(src, one);
+	}
+
+	return _mm256_sub_epi32(floor, src);
+}
+
+__attribute__ ((target("avx2")))
+void
+batch_step_avx2(struct batch *b, const uint8_t *actions, int lo, int hi)
+{
+	__m256i x, y, s, y0, a, nx, ny, ns, ok, lock;
+	__m256i left, right, cw, ccw, soft, hard;
+	int32_t counts[BATCH_LANES];
+	int g, i, m, full;
+
+	for (g = lo; g < hi; g += BATCH_LANES) {
+		x = _mm256_loadu_si256((const __m256i *)(b->x + g));
+		y0 = y = _mm256_loadu_si256((const __m256i *)(b->y + g));
+		s = _mm256_loadu_si256((const __m256i *)(b->state + g));
+		a = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(actions + g)));
+
+		left = _mm256_cmpeq_epi32(a, _mm256_set1_epi32(BA_LEFT));
+		right = _mm256_cmpeq_epi32(a, _mm256_set1_epi32(BA_RIGHT));
+		cw = _mm256_cmpeq_epi32(a, _mm256_set1_epi32(BA_ROTATE_CW));
+		ccw = _mm256_cmpeq_epi32(a, _mm256_set1_epi32(BA_ROTATE_CCW));
+		soft = _mm256_cmpeq_epi32(a, _mm256_set1_epi32(BA_SOFT_DROP));
+		hard = _mm256_cmpeq_epi32(a, _mm256_set1_epi32(BA_HARD_DROP));
+
+		/* Masks are -1, so subtracting one adds 1 */
+		nx = _mm256_add_epi32(_mm256_sub_epi32(x, right), left);
+		ny = _mm256_sub_epi32(y, soft);
+		ns = _mm256_blendv_epi8(s, _mm256_i32gather_epi32(batch_cw, s, 4), cw);
+		ns = _mm256_blendv_epi8(ns, _mm256_i32gather_epi32(batch_ccw, s, 4), ccw);
+
+		ok = fits_avx2(b, g, nx, ny, ns);
+		x = _mm256_blendv_epi8(x, nx, ok);
+		y = _mm256_blendv_epi8(y, ny, ok);
+		s = _mm256_blendv_epi8(s, ns, ok);
+
+		if (!_mm256_testz_si256(hard, hard)) {
+			y = drop_avx2(b, g, x, y, s, hard);
+		}
+
+		_mm256_storeu_si256((__m256i *)(b->x + g), x);
+		_mm256_storeu_si256((__m256i *)(b->y + g), y);
+		_mm256_storeu_si256((__m256i *)(b->state + g), s);
+		_mm256_storeu_si256((__m256i *)(b->reward + g), _mm256_sub_epi32(y, y0));
+		memset(b->done + g, 0, BATCH_LANES);
+
+		lock = _mm256_or_si256(hard, _mm256_andnot_si256(ok, soft));
+		if (!(m = _mm256_movemask_ps(_mm256_castsi256_ps(lock)))) {
+			continue;
+		}
+
+		/* Writing the tetrominos is a scatter, no way around scalar */
+		full = 0;
+		for (i = 0; i != BATCH_LANES; ++i) {
+			if (!(m & BIT(i))) {
+				continue;
+			}
+
+			if (lane_lock(b, g + i) == -1) {
+				lane_over(b, g + i);
+				m &= ~BIT(i);
+
+			} else {
+				full |= lane_full(b, g + i);
+			}
+		}
+
+		/* Clearing is the expensive part, and it's contiguous */
+		if (full) {
+			_mm256_storeu_si256((__m256i *)counts, clear_avx2(b, g));
+		} else {
+			memset(counts, 0, sizeof counts);
+		}
+
+		for (i = 0; i != BATCH_LANES; ++i) {
+			if (m & BIT(i)) {
+				lane_score(b, g + i, counts[i]);
+			}
+		}
+
+		for (i = 0; i != BATCH_LANES; ++i) {
+			if ((m & BIT(i)) && !lane_fits(b, g + i, b->x[g + i], b->y[g + i], b->state[g + i])) {
+				lane_over(b, g + i);
+			}
+		}
+	}
+}
+
+#else
+
+int
+batch_avx2_supported(void)
+{
+	return 0;
+}
+
+void
+batch_step_avx2(struct batch *b, const uint8_t *actions, int lo, int hi)
+{
+	batch_step_scalar(b, actions, lo, hi);
+}
+
+#endif /* __x86_64__ */
+
+/* -==+ Setup +==- */
+
+static void *
+alloc_lanes(size_t size)
+{
+	void *p;
+
+	return posix_memalign(&p, 32, size) ? NULL : p;
+}
+
+/*
+ * Allocate 'n' games, rounded up to a whole number of vectors, and
+ * start them all. Game 'g' draws its pieces from 'seed + g'.
+ */
+int
+batch_init(struct batch *b, int n, int rng_ind, uint32_t seed)
+{
+	int g;
+
+	if (batch_kernel == NULL) {
+		batch_states();
+		for (g = 0; !batch_kernels[g].supported(); ++g)
+			;
+		batch_kernel = &batch_kernels[g];
+	}
+
+	memset(b, 0, sizeof (*b));
+	b->n = n = (n + BATCH_LANES - 1) / BATCH_LANES * BATCH_LANES;
+
+	b->rows = alloc_lanes(BATCH_ROWS * n * sizeof (uint32_t));
+	b->x = alloc_lanes(n * sizeof (int32_t));
+	b->y = alloc_lanes(n * sizeof (int32_t));
+	b->state = alloc_lanes(n * sizeof (int32_t));
+	b->lines = alloc_lanes(n * sizeof (uint32_t));
+	b->reward = alloc_lanes(n * sizeof (int32_t));
+	b->done = alloc_lanes(n);
+	b->queue = malloc(n * sizeof (struct piece_queue));
+
+	if (!b->rows || !b->x || !b->y || !b->state || !b->lines || !b->reward || !b->done || !b->queue) {
+		log_error("Can't allocate %d games\n", n);
+		batch_free(b);
+		return -1;
+	}
+
+	for (g = 0; g != n; ++g) {
+		queue_init(&b->queue[g], rng_ind, seed + g);
+		batch_reset(b, g);
+		b->reward[g] = 0;
+		b->done[g] = 0;
+	}
+
+	return 0;
+}
+
+void
+batch_free(struct batch *b)
+{
+	free(b->rows);
+	free(b->x);
+	free(b->y);
+	free(b->state);
+	free(b->lines);
+	free(b->reward);
+	free(b->done);
+	free(b->queue);
+	memset(b, 0, sizeof (*b));
+}
+
+/*
+ * Force a kernel by name, -1 if it doesn't exist or this CPU can't
+ * run it. Call after batch_init().
+ */
+int
+batch_use(const char *name)
+{
+	int i;
+
+	for (i = 0; i != sizeof batch_kernels / sizeof batch_kernels[0]; ++i) {
+		if (strcmp(batch_kernels[i].name, name) == 0 && batch_kernels[i].supported()) {
+			batch_kernel = &batch_kernels[i];
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+const char *
+batch_kernel_name(void)
+{
+	return batch_kernel ? batch_kernel->name : "none";
+}
+
+/* -==+ Stepping +==- */
+
+/*
+ * Apply one action to each game in ['lo', 'hi'), both multiples of
+ * BATCH_LANES. 'reward' gets the cells dropped plus the line score,
+ * 'done' flags games that ended and were restarted. Disjoint ranges
+ * can be stepped from different threads, ranges that are a multiple
+ * of 16 games don't share cache lines.
+ */
+void
+batch_step(struct batch *b, const uint8_t *actions, int lo, int hi)
+{
+	batch_kernel->step(b, actions, lo, hi);
+}
@@ -0,0 +1,91 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#define BATCH_LANES	8	/* Games per vector, batches are a multiple of it */
+#define BATCH_PAD	2	/* Empty rows above the board, rotations poke out */
+#define BATCH_FLOOR	4	/* Solid rows below it */
+#define BATCH_ROWS	(BATCH_PAD + BOARD_H + BATCH_FLOOR)
+#define BATCH_STATES	28	/* Tetromino id * 4 + rotation */
+
+/* C library */
+#include <stdint.h>
+
+/* e-type */
+#include "tetris.h"
+#include "queue.h"
+
+/* One per game and step */
+typedef enum { BA_NONE, BA_LEFT, BA_RIGHT, BA_ROTATE_CW, BA_ROTATE_CCW, BA_SOFT_DROP,
+	       BA_HARD_DROP, BA_COUNT } batch_action;
+
+/*
+ * -==+ Batch of games +==-
+ * Many standard games stepped together, laid out so that the same row
+ * (or field) of consecutive games is contiguous. Rows are bit masks
+ * with the walls and floor set, so a collision is a single AND and a
+ * full line is all ones.
+ */
+struct batch {
+	int n;
+	/* [Boards] rows[y * n + game] */
+	uint32_t *rows;
+	/* [Current tetromino] */
+	int32_t *x, *y;
+	int32_t *state;
+	/* [Per game] */
+	uint32_t *lines;
+	struct piece_queue *queue;
+	/* [Result of the last step] */
+	int32_t *reward;
+	uint8_t *done;
+};
+
+/*
+ * -==+ Step kernel +==-
+ * Same rules, different instruction sets, see batch_use().
+ */
+struct batch_kernel {
+	const char *name;
+	int (*supported)(void);
+	void (*step)(struct batch*, const uint8_t*, int, int);
+};
+
+/*
+ * Rotation states of every tetromino, shared with the solver. Four rows
+ * of cells per state starting at the topmost block, 'x + 2' at bit 0.
+ */
+extern uint32_t batch_shape[BATCH_STATES][4];
+extern int32_t batch_top[BATCH_STATES];
+extern int32_t batch_cw[BATCH_STATES], batch_ccw[BATCH_STATES];
+
+/* -==+ Setup +==- */
+void batch_states(void);
+int  batch_init(struct batch *b, int n, int rng_ind, uint32_t seed);
+void batch_free(struct batch *b);
+void batch_reset(struct batch *b, int g);
+int  batch_use(const char *name);
+const char *batch_kernel_name(void);
+
+/* -==+ Stepping +==- */
+void batch_step(struct batch *b, const uint8_t *actions, int lo, int hi);
+
+#endif /* BATCH_H */
@@ -0,0 +1,439 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Header file */
+#include "bigboard.h"
+/* C library */
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+/* e-type */
+#include "log.h"
+#include "replay.h"
+#include "trace.h"
+
+#define VEC_WORDS	4	/* uint64_t per AVX2 vector */
+#define VIEW_MARGIN	4	/* Cells kept between the tetromino and the edge of the view */
+
+/* Row kernel picked by the first big_alloc() */
+static int (*big_full)(const uint64_t *row, int words);
+
+/* -==+ Rows +==- */
+
+static inline uint64_t *
+row_bits(const struct big_board *b, int y)
+{
+	return b->bits + (size_t)b->row[y] * b->words;
+}
+
+static inline uint8_t *
+row_color(const struct big_board *b, int y)
+{
+	return b->color + (size_t)b->row[y] * b->w;
+}
+
+static inline int
+big_cell(const struct big_board *b, int x, int y)
+{
+	return row_bits(b, y)[x / 64] >> (x % 64) & 1;
+}
+
+/*
+ * Find the surface of the columns in 'pending' looking down from row
+ * 'y', a whole row of columns per step.
+ */
+static void
+big_surface(struct big_board *b, int y, uint64_t *pending)
+{
+	const uint64_t *row;
+	uint64_t found, any;
+	int i;
+
+	for (any = 1; any && y != b->h; ++y) {
+		row = row_bits(b, y);
+		any = 0;
+
+		for (i = 0; i != b->words; ++i) {
+			for (found = pending[i] & row[i]; found; found &= found - 1) {
+				b->surface[i * 64 + __builtin_ctzll(found)] = y;
+			}
+
+			pending[i] &= ~row[i];
+			any |= pending[i];
+		}
+	}
+
+	for (i = 0; i != b->words; ++i) {
+		for (; pending[i]; pending[i] &= pending[i] - 1) {
+			b->surface[i * 64 + __builtin_ctzll(pending[i])] = b->h;
+		}
+	}
+}
+
+static inline void
+big_set(struct big_board *b, int x, int y, int c)
+{
+	uint64_t pending[BIG_MAX_W / 64] = { 0 };
+
+	if (c) {
+		row_bits(b, y)[x / 64] |= 1ull << (x % 64);
+		b->surface[x] = MIN(b->surface[x], y);
+
+	} else {
+		row_bits(b, y)[x / 64] &= ~(1ull << (x % 64));
+
+		if (b->surface[x] == y) {
+			pending[x / 64] = 1ull << (x % 64);
+			big_surface(b, y, pending);
+		}
+	}
+
+	row_color(b, y)[x] = c;
+}
+
+/*
+ * Rows 'm' can fall from 'x', 'y' before landing. Blocks above the
+ * surface of their column land on it, the others were tucked under
+ * an overhang and look down their column.
+ */
+static int
+big_drop(const struct big_board *b, const struct mino *m, int x, int y)
+{
+	int i, d, bx, by, land;
+
+	d = b->h;
+	for (i = 0; i != 4; ++i) {
+		bx = x + m->block_pos[i].x;
+		by = y + m->block_pos[i].y;
+
+		if (by < b->surface[bx]) {
+			land = b->surface[bx];
+
+		} else {
+			for (land = by + 1; land != b->h && !big_cell(b, bx, land); ++land)
+				;
+		}
+
+		d = MIN(d, land - 1 - by);
+	}
+
+	return d;
+}
+
+/* -==+ Row kernels +==- */
+
+static int
+full_scalar(const uint64_t *row, int words)
+{
+	int i;
+
+	for (i = 0; i != words; ++i) {
+		if (~row[i]) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+#ifdef __x86_64__
+
+/*
+ * A whole vector of the row per test, the padding past 'w' is already
+ * set so there's no mask to apply.
+ */
+__attribute__ ((target("avx2")))
+static int
+full_avx2(const uint64_t *row, int words)
+{
+	__m256i ones;
+	int i;
+
+	ones = _mm256_set1_epi64x(-1);
+	for (i = 0; i != words; i += VEC_WORDS) {
+		if (!_mm256_testc_si256(_mm256_load_si256((const __m256i *)(row + i)), ones)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+#endif /* __x86_64__ */
+
+static inline int
+big_row_full(const struct big_board *b, int y)
+{
+	return big_full(row_bits(b, y), b->words);
+}
+
+/*
+ * Drop the sorted rows 'lines' and let everything above fall, only
+ * the slot numbers up to the lowest cleared row move. The freed slots
+ * come back blank at the top.
+ */
+static void
+big_clear_rows(struct big_board *b, const int *lines, int count)
+{
+	uint64_t pending[BIG_MAX_W / 64] = { 0 };
+	uint32_t freed[4];
+	int src, dst, k, n, x;
+
+	k = count - 1;
+	n = 0;
+	for (src = dst = lines[count - 1]; src >= 0; --src) {
+		if (k >= 0 && lines[k] == src) {
+			freed[n++] = b->row[src];
+			--k;
+
+		} else {
+			b->row[dst--] = b->row[src];
+		}
+	}
+
+	for (n = 0; n != count; ++n) {
+		b->row[n] = freed[n];
+		memcpy(row_bits(b, n), b->blank, b->words * sizeof (uint64_t));
+		memset(row_color(b, n), 0, b->w);
+	}
+
+	/*
+	 * Full rows reach every column, so each surface was at or above
+	 * the top one: it falls with the stack or, if it was that row,
+	 * has to be found again.
+	 */
+	for (x = 0; x != b->w; ++x) {
+		if (b->surface[x] < lines[0]) {
+			b->surface[x] += count;
+
+		} else {
+			pending[x / 64] |= 1ull << (x % 64);
+		}
+	}
+
+	big_surface(b, count, pending);
+}
+
+/* -==+ Drawing +==- */
+
+/*
+ * First row (or column) of a 'view' wide window on 'size' cells that
+ * keeps 'at' away from the edges, moving 'first' as little as possible.
+ */
+static int
+follow(int first, int at, int view, int size)
+{
+	int margin;
+
+	margin = MIN(VIEW_MARGIN, view / 4);
+	if (at - margin < first) {
+		first = at - margin;
+
+	} else if (at + margin >= first + view) {
+		first = at + margin - view + 1;
+	}
+
+	return MAX(0, MIN(first, size - view));
+}
+
+/*
+ * Only the rows and columns in view are drawn, the view scrolls along
+ * with the tetromino.
+ */
+static void
+big_draw(struct game_state *gs)
+{
+	struct big_board *b;
+	const uint8_t *row;
+	int i, j, c, x, y;
+
+	b = gs->big;
+	b->top = follow(b->top, gs->curr_mino_pos.y, b->view_h, b->h);
+	b->left = follow(b->left, gs->curr_mino_pos.x, b->view_w, b->w);
+
+	for (i = 0; i != b->view_h; ++i) {
+		wmove(gs->board_win, i + 1, 1);
+		row = row_color(b, b->top + i) + b->left;
+
+		for (j = 0; j != b->view_w; ++j) {
+			if ((c = row[j])) {
+				wattron(gs->board_win, COLOR_PAIR(c));
+				wprintw(gs->board_win, "%c%c", minos[c - 1].block_left,
+					minos[c - 1].block_right);
+				wattroff(gs->board_win, COLOR_PAIR(c));
+
+			} else {
+				wprintw(gs->board_win, "%s", "  ");
+			}
+		}
+	}
+
+	if (!(gs->flags & BIT(LBREAK))) {
+		x = (gs->curr_mino_pos.x - b->left) * 2 + 1;
+		y = gs->curr_mino_pos.y - b->top + 1;
+
+		if (gs->engine->ghost) {
+			draw_mino(gs->board_win, &gs->curr_mino, x, gs->ghost_pos - b->top + 1, BIT(DRAW_GHOST));
+		}
+		draw_mino(gs->board_win, &gs->curr_mino, x, y, 0);
+	}
+
+	box(gs->board_win, 0, 0);
+
+	/* Where the view is, when it doesn't show everything */
+	if (b->view_h != b->h || b->view_w != b->w) {
+		mvwprintw(gs->board_win, 0, 1, "%d,%d", b->left, b->top);
+	}
+
+	wnoutrefresh(gs->board_win);
+}
+
+/*
+ * Fit the view in 'cols' x 'rows' cells of the screen.
+ */
+void
+big_viewport(struct big_board *b, int cols, int rows)
+{
+	b->view_w = MIN(b->w, MAX(cols, BIG_MIN_W));
+	b->view_h = MIN(b->h, MAX(rows, BIG_MIN_H));
+	b->top = MIN(b->top, b->h - b->view_h);
+	b->left = MIN(b->left, b->w - b->view_w);
+}
+
+/* -==+ Variants +==- */
+
+#define E_CELL(gs, x, y)	big_cell((gs)->big, x, y)
+#define E_SET(gs, x, y, c)	big_set((gs)->big, x, y, c)
+#define E_NAME	big
+#define E_W	(gs->big->w)
+#define E_H	(gs->big->h)
+#define E_GHOST	1
+#define E_BIG	1
+#include "engine_tmpl.h"
+
+#define E_CELL(gs, x, y)	big_cell((gs)->big, x, y)
+#define E_SET(gs, x, y, c)	big_set((gs)->big, x, y, c)
+#define E_NAME	big_noghost
+#define E_W	(gs->big->w)
+#define E_H	(gs->big->h)
+#define E_GHOST	0
+#define E_BIG	1
+#include "engine_tmpl.h"
+
+/* -==+ Allocation +==- */
+
+static void
+big_reset(struct big_board *b)
+{
+	int y;
+
+	for (y = 0; y != b->h; ++y) {
+		b->row[y] = y;
+		memcpy(row_bits(b, y), b->blank, b->words * sizeof (uint64_t));
+	}
+
+	for (y = 0; y != b->w; ++y) {
+		b->surface[y] = b->h;
+	}
+
+	memset(b->color, 0, (size_t)b->w * b->h);
+	b->top = b->left = 0;
+}
+
+/*
+ * An empty 'w' x 'h' board, reusing 'b' when it already has that size
+ * and freeing it otherwise. NULL if there's no memory for it.
+ */
+struct big_board *
+big_alloc(struct big_board *b, int w, int h)
+{
+	void *bits, *blank;
+	int x;
+
+	if (!big_full) {
+#ifdef __x86_64__
+		__builtin_cpu_init();
+		big_full = __builtin_cpu_supports("avx2") ? full_avx2 : full_scalar;
+#else
+		big_full = full_scalar;
+#endif
+	}
+
+	if (b && b->w == w && b->h == h) {
+		big_reset(b);
+		return b;
+	}
+
+	big_free(b);
+
+	if ((b = calloc(1, sizeof (*b))) == NULL) {
+		log_error("Can't allocate a %dx%d board\n", w, h);
+		return NULL;
+	}
+
+	b->w = w;
+	b->h = h;
+	b->words = (w + 64 * VEC_WORDS - 1) / (64 * VEC_WORDS) * VEC_WORDS;
+	b->view_w = w;
+	b->view_h = h;
+
+	if (posix_memalign(&bits, 32, (size_t)h * b->words * sizeof (uint64_t))) {
+		bits = NULL;
+	}
+	if (posix_memalign(&blank, 32, b->words * sizeof (uint64_t))) {
+		blank = NULL;
+	}
+	b->bits = bits;
+	b->blank = blank;
+	b->color = malloc((size_t)w * h);
+	b->row = malloc(h * sizeof (uint32_t));
+	b->surface = malloc(w * sizeof (uint16_t));
+
+	if (!b->bits || !b->blank || !b->color || !b->row || !b->surface) {
+		log_error("Can't allocate a %dx%d board\n", w, h);
+		big_free(b);
+		return NULL;
+	}
+
+	/* Padding past the last column counts as filled */
+	memset(b->blank, 0xff, b->words * sizeof (uint64_t));
+	for (x = 0; x != w; ++x) {
+		b->blank[x / 64] &= ~(1ull << (x % 64));
+	}
+
+	big_reset(b);
+
+	return b;
+}
+
+void
+big_free(struct big_board *b)
+{
+	if (b) {
+		free(b->bits);
+		free(b->blank);
+		free(b->color);
+		free(b->row);
+		free(b->surface);
+		free(b);
+	}
+}
@@ -0,0 +1,66 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BIGBOARD_H
+#define BIGBOARD_H
+
+/* Sizes the large engine takes, past the compiled ones */
+#define BIG_MIN_W	4
+#define BIG_MIN_H	4
+#define BIG_MAX_W	1024
+#define BIG_MAX_H	16384
+
+/* C library */
+#include <stdint.h>
+
+/* e-type */
+#include "engine.h"
+
+/*
+ * -==+ Large board +==-
+ * Rows are bitsets of 64 bit words padded to whole AVX2 vectors, with
+ * every bit past 'w' set so a full row is all ones. Row 'y' lives in
+ * slot 'row[y]': clearing a line moves slot numbers around instead of
+ * the rows themselves. Colors are kept per slot, only for drawing.
+ * 'surface' is the first filled row of each column, 'h' when empty,
+ * so drops don't have to walk down thousands of empty rows.
+ */
+struct big_board {
+	int w, h;
+	int words;
+	uint64_t *bits;
+	uint64_t *blank;
+	uint8_t *color;
+	uint32_t *row;
+	uint16_t *surface;
+	/* [Viewport, in cells] */
+	int view_w, view_h;
+	int top, left;
+};
+
+extern const struct engine engine_big_engine, engine_big_noghost_engine;
+
+/* -==+ Allocation +==- */
+struct big_board *big_alloc(struct big_board *b, int w, int h);
+void big_free(struct big_board *b);
+
+/* -==+ Drawing +==- */
+void big_viewport(struct big_board *b, int cols, int rows);
+
+#endif /* BIGBOARD_H */
@@ -0,0 +1,306 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Header file */
+#include "bot.h"
+/* C library */
+#include <string.h>
+/* e-type */
+#include "batch.h"
+#include "queue.h"
+#include "utils.h"
+
+#define CELL_SHIFT	4
+#define CELLS		(((1u << BOARD_W) - 1) << CELL_SHIFT)
+#define ROW_WALL	(~CELLS)
+#define ROW_FULL	(~0u)
+/* Neighbouring cell pairs of a row, walls included */
+#define ROW_PAIRS	(((1u << (BOARD_W + 1)) - 1) << (CELL_SHIFT - 1))
+/* Shape rows are built with 'x + 2' at bit 0 */
+#define SHAPE_SHIFT	(CELL_SHIFT - 2)
+/* Bit planes of the column counters, enough for BOARD_H */
+#define PLANES		5
+
+const char *bot_feature_names[BF_COUNT] = { "landing", "eroded", "row_trans", "col_trans", "holes", "wells",
+					    "hole_depth", "hole_rows" };
+
+/*
+ * Dellacherie's features plus hole depth and rows with holes, with
+ * the weights Thiery and Scherrer found for them. e-type-tune starts
+ * from these.
+ */
+const double bot_default_weights[BF_COUNT] = { -12.63, 6.60, -9.22, -19.77, -13.08, -10.49, -1.61, -24.04 };
+
+/* -==+ Board +==- */
+
+void
+bot_clear(struct bot_board *b)
+{
+	int y;
+
+	batch_states();
+
+	for (y = 0; y != BOT_PAD + BOARD_H; ++y) {
+		b->rows[y] = ROW_WALL;
+	}
+
+	for (; y != BOT_ROWS; ++y) {
+		b->rows[y] = ROW_FULL;
+	}
+}
+
+static inline int
+fits(const uint32_t *rows, int s, int x, int y)
+{
+	uint32_t hit;
+	int r;
+
+	rows += BOT_PAD + y + batch_top[s];
+	hit = 0;
+	for (r = 0; r != 4; ++r) {
+		hit |= rows[r] & (batch_shape[s][r] << (x + SHAPE_SHIFT));
+	}
+
+	return !hit;
+}
+
+/*
+ * Lock state 's' at 'x', 'y' and drop the full lines. Returns how
+ * many, 'eroded' gets the cells of the tetromino that went with them.
+ */
+static int
+lock(uint32_t *rows, int s, int x, int y, int *eroded)
+{
+	uint32_t *at, cells;
+	int r, src, dst, cleared;
+
+	at = rows + BOT_PAD + y + batch_top[s];
+	cleared = *eroded = 0;
+	for (r = 0; r != 4 && batch_shape[s][r]; ++r) {
+		cells = batch_shape[s][r] << (x + SHAPE_SHIFT);
+		at[r] |= cells;
+
+		if (at[r] == ROW_FULL) {
+			*eroded += __builtin_popcount(cells);
+			++cleared;
+		}
+	}
+
+	if (!cleared) {
+		return 0;
+	}
+
+	for (src = dst = BOT_PAD + BOARD_H - 1; src >= 0; --src) {
+		if (rows[src] != ROW_FULL) {
+			rows[dst--] = rows[src];
+		}
+	}
+
+	for (; dst >= 0; --dst) {
+		rows[dst] = ROW_WALL;
+	}
+
+	return cleared;
+}
+
+/* -==+ Features +==- */
+
+/* Add one to the counters of the cells in 'm', kept in bit planes */
+static inline void
+count_add(uint32_t *c, uint32_t m)
+{
+	uint32_t carry;
+	int k;
+
+	for (k = 0; k != PLANES && m; ++k) {
+		carry = c[k] & m;
+		c[k] ^= m;
+		m = carry;
+	}
+}
+
+/* Sum of the counters of the cells in 'm' */
+static inline int
+count_sum(const uint32_t *c, uint32_t m)
+{
+	int k, sum;
+
+	sum = 0;
+	for (k = 0; k != PLANES; ++k) {
+		sum += __builtin_popcount(c[k] & m) << k;
+	}
+
+	return sum;
+}
+
+/*
+ * The features that only depend on the board, top row first from row
+ * 'y', everything above it is empty. Row transitions count every row
+ * like Dellacherie's, an empty one has two against the walls. A hole
+ * is as deep as the filled cells above it, and wells are cumulative:
+ * one 'd' cells deep counts 1 + 2 + ... + d.
+ */
+static void
+board_features(const uint32_t *rows, int y, double *f)
+{
+	uint32_t row, holes, wells, above, filled[PLANES], run[PLANES];
+	int k, row_trans, col_trans, hole_count, hole_depth, hole_rows, well_sum;
+
+	memset(filled, 0, sizeof filled);
+	memset(run, 0, sizeof run);
+	row_trans = 2 * y;
+	col_trans = hole_count = hole_depth = hole_rows = well_sum = 0;
+	above = 0;
+
+	rows += BOT_PAD;
+	for (; y != BOARD_H; ++y) {
+		row = rows[y];
+		col_trans += __builtin_popcount((row ^ rows[y + 1]) & CELLS);
+
+		row_trans += __builtin_popcount((row ^ row >> 1) & ROW_PAIRS);
+
+		holes = ~row & above;
+		if (holes) {
+			hole_count += __builtin_popcount(holes);
+			hole_depth += count_sum(filled, holes);
+			++hole_rows;
+		}
+
+		above |= row & CELLS;
+		count_add(filled, row & CELLS);
+
+		wells = ~row & row << 1 & row >> 1 & CELLS;
+		for (k = 0; k != PLANES; ++k) {
+			run[k] &= wells;
+		}
+		count_add(run, wells);
+		well_sum += count_sum(run, wells);
+	}
+
+	f[BF_ROW_TRANS] = row_trans;
+	f[BF_COL_TRANS] = col_trans;
+	f[BF_HOLES] = hole_count;
+	f[BF_WELLS] = well_sum;
+	f[BF_HOLE_DEPTH] = hole_depth;
+	f[BF_HOLE_ROWS] = hole_rows;
+}
+
+/* -==+ Evaluator +==- */
+
+/*
+ * Try every rotation of tetromino 'id' dropped straight down from the
+ * top of each column and keep the placement 'w' values most. Returns
+ * 0 when nothing fits, which ends the game.
+ */
+int
+bot_best(const struct bot_board *b, int id, const double *w, struct bot_move *m)
+{
+	struct bot_board t;
+	double f[BF_COUNT], v, best;
+	int s, k, i, x, y, h, eroded, found, stack;
+
+	/* Topmost row with blocks, the tetromino can only go one above */
+	for (stack = 0; stack != BOARD_H && !(b->rows[BOT_PAD + stack] & CELLS); ++stack)
+		;
+
+	found = 0;
+	best = 0;
+	for (k = 0, s = id * 4; k != 4; ++k, s = batch_cw[s]) {
+		/* O, I, S and Z come back to their first state early */
+		if (k && s == id * 4) {
+			break;
+		}
+
+		for (h = 0; h != 4 && batch_shape[s][h]; ++h)
+			;
+
+		for (x = -2; x != BOARD_W; ++x) {
+			y = -batch_top[s];
+			if (!fits(b->rows, s, x, y)) {
+				continue;
+			}
+
+			while (fits(b->rows, s, x, y + 1)) {
+				++y;
+			}
+
+			t = *b;
+			f[BF_ERODED] = lock(t.rows, s, x, y, &eroded) * eroded;
+			/* Height of the tetromino's middle, the bottom row is 1 */
+			f[BF_LANDING] = BOARD_H - (y + batch_top[s]) - (h - 1) / 2.0;
+			board_features(t.rows, MAX(0, MIN(stack, y + batch_top[s]) - 1), f);
+
+			v = 0;
+			for (i = 0; i != BF_COUNT; ++i) {
+				v += w[i] * f[i];
+			}
+
+			if (!found || v > best) {
+				found = 1;
+				best = v;
+				m->state = s;
+				m->x = x;
+				m->y = y;
+			}
+		}
+	}
+
+	return found;
+}
+
+/*
+ * Lock 'm' into 'b', returns the lines it cleared.
+ */
+int
+bot_place(struct bot_board *b, const struct bot_move *m)
+{
+	int eroded;
+
+	return lock(b->rows, m->state, m->x, m->y, &eroded);
+}
+
+/* -==+ Playing +==- */
+
+/*
+ * A whole game of 'w' with the pieces of RNG profile 'rng_ind',
+ * scored like clear_lines() does, until it tops out or has played
+ * 'max_pieces'.
+ */
+void
+bot_play(const double *w, int rng_ind, uint32_t seed, uint64_t max_pieces, struct bot_game *g)
+{
+	struct piece_queue q;
+	struct bot_board b;
+	struct bot_move m;
+	int cleared;
+
+	memset(g, 0, sizeof (*g));
+	queue_init(&q, rng_ind, seed);
+	bot_clear(&b);
+
+	while (g->pieces != max_pieces && bot_best(&b, queue_next(&q), w, &m)) {
+		cleared = bot_place(&b, &m);
+		++g->pieces;
+
+		if (cleared) {
+			g->score += (g->lines / 10 + 1) * score_mult[cleared - 1];
+			g->lines += cleared;
+		}
+	}
+}
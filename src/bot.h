@@ -0,0 +1,71 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BOT_H
+#define BOT_H
+
+#define BOT_PAD		2	/* Rows above the board, like the batches */
+#define BOT_FLOOR	4
+#define BOT_ROWS	(BOT_PAD + BOARD_H + BOT_FLOOR)
+
+/* C library */
+#include <stdint.h>
+
+/* e-type */
+#include "tetris.h"
+
+/* Board features the evaluator weighs, see bot.c */
+typedef enum { BF_LANDING, BF_ERODED, BF_ROW_TRANS, BF_COL_TRANS, BF_HOLES, BF_WELLS,
+	       BF_HOLE_DEPTH, BF_HOLE_ROWS, BF_COUNT } bot_feature;
+
+/*
+ * -==+ Bot board +==-
+ * A standard board as row bit masks in the batches' layout, cell 'x'
+ * is bit 'x + 4' and everything else is wall. 'rows[BOT_PAD]' is the
+ * top row of the board.
+ */
+struct bot_board {
+	uint32_t rows[BOT_ROWS];
+};
+
+/* Where a tetromino locks, 'state' as in batch.h */
+struct bot_move {
+	uint8_t state;
+	int8_t x, y;
+};
+
+/* -==+ Headless game +==- */
+struct bot_game {
+	uint64_t pieces;
+	uint64_t score;
+	uint32_t lines;
+};
+
+extern const char *bot_feature_names[BF_COUNT];
+extern const double bot_default_weights[BF_COUNT];
+
+/* -==+ Evaluator +==- */
+void bot_clear(struct bot_board *b);
+int  bot_best(const struct bot_board *b, int id, const double *w, struct bot_move *m);
+int  bot_place(struct bot_board *b, const struct bot_move *m);
+
+/* -==+ Playing +==- */
+void bot_play(const double *w, int rng_ind, uint32_t seed, uint64_t max_pieces, struct bot_game *g);
+
+#endif /* BOT_H */
@@ -0,0 +1,464 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Header file */
+#include "client.h"
+/* C library */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* POSIX */
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+/* Sockets */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+/* e-type */
+#include "log.h"
+#include "utils.h"
+
+static void
+client_fail(struct net_client *c, const char *what, int err)
+{
+	log_warn("Match client: %s: %s\n", what, strerror(err));
+	client_close(c);
+	c->state = CLIENT_FAILED;
+}
+
+/*
+ * -==+ Name lookup +==-
+ * getaddrinfo() on a name can take seconds, so it runs on a thread
+ * of its own while the game goes on. Whichever of the thread and
+ * client_close() is done with it last frees the lookup, 'state'
+ * settles which: it leaves LOOKUP_RUNNING only once.
+ */
+enum { LOOKUP_RUNNING, LOOKUP_DONE, LOOKUP_ABANDONED };
+
+struct client_lookup {
+	char host[256], port[32];
+	struct addrinfo *res;
+	int err, state;
+};
+
+static void
+lookup_hints(struct addrinfo *hints, int flags)
+{
+	memset(hints, 0, sizeof (*hints));
+	hints->ai_family = AF_INET;
+	hints->ai_socktype = SOCK_STREAM;
+	hints->ai_flags = flags;
+}
+
+static void
+lookup_free(struct client_lookup *l)
+{
+	if (l->res) {
+		freeaddrinfo(l->res);
+	}
+	free(l);
+}
+
+static void *
+lookup_thread(void *arg)
+{
+	struct client_lookup *l;
+	struct addrinfo hints;
+	int expect;
+
+	l = arg;
+	lookup_hints(&hints, 0);
+	l->err = getaddrinfo(l->host, l->port, &hints, &l->res);
+
+	expect = LOOKUP_RUNNING;
+	if (!__atomic_compare_exchange_n(&l->state, &expect, LOOKUP_DONE, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		lookup_free(l);
+	}
+
+	return NULL;
+}
+
+/* Zero, or the error it couldn't start with */
+static int
+lookup_start(struct net_client *c, const char *host, const char *port)
+{
+	struct client_lookup *l;
+	pthread_t tid;
+	int err;
+
+	if ((l = calloc(1, sizeof (*l))) == NULL) {
+		return ENOMEM;
+	}
+
+	snprintf(l->host, sizeof l->host, "%s", host);
+	snprintf(l->port, sizeof l->port, "%s", port);
+
+	if ((err = pthread_create(&tid, NULL, lookup_thread, l))) {
+		free(l);
+		return err;
+	}
+	pthread_detach(tid);
+
+	c->lookup = l;
+
+	return 0;
+}
+
+/* -==+ Connection +==- */
+
+static int
+client_connect(struct net_client *c, const struct addrinfo *res)
+{
+	int one;
+
+	if ((c->fd = socket(res->ai_family, res->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, res->ai_protocol)) == -1) {
+		client_fail(c, "socket", errno);
+		return -1;
+	}
+
+	one = 1;
+	setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+	if (connect(c->fd, res->ai_addr, res->ai_addrlen) == -1 && errno != EINPROGRESS) {
+		client_fail(c, "connect", errno);
+		return -1;
+	}
+
+	c->out_len = net_hello(c->out, c->match);
+	c->state = CLIENT_CONNECTING;
+
+	return 0;
+}
+
+/*
+ * Start connecting to 'host' and queue the hello for 'match'. An
+ * address connects right away, a name is looked up in the background
+ * first (CLIENT_RESOLVING), client_step() takes it from there.
+ */
+int
+client_open(struct net_client *c, const char *host, const char *port, uint32_t match)
+{
+	struct addrinfo hints, *res;
+	int err, ret;
+
+	memset(c, 0, sizeof (*c));
+	c->fd = c->udp_fd = -1;
+	c->match = match;
+	c->winner = NET_NO_WINNER;
+
+	lookup_hints(&hints, AI_NUMERICHOST);
+	if ((err = getaddrinfo(host, port, &hints, &res)) == EAI_NONAME) {
+		if ((err = lookup_start(c, host, port))) {
+			client_fail(c, "lookup", err);
+			return -1;
+		}
+		c->state = CLIENT_RESOLVING;
+		return 0;
+	}
+
+	if (err) {
+		log_warn("Match client: %s: %s\n", host, gai_strerror(err));
+		c->state = CLIENT_FAILED;
+		return -1;
+	}
+
+	ret = client_connect(c, res);
+	freeaddrinfo(res);
+
+	return ret;
+}
+
+/* Connect once the lookup is in, until then nothing to do */
+static void
+client_resolved(struct net_client *c)
+{
+	struct client_lookup *l;
+
+	l = c->lookup;
+	if (__atomic_load_n(&l->state, __ATOMIC_ACQUIRE) != LOOKUP_DONE) {
+		return;
+	}
+
+	c->lookup = NULL;
+	if (l->err) {
+		log_warn("Match client: %s: %s\n", l->host, gai_strerror(l->err));
+		c->state = CLIENT_FAILED;
+	} else {
+		client_connect(c, l->res);
+	}
+
+	lookup_free(l);
+}
+
+void
+client_close(struct net_client *c)
+{
+	int expect;
+
+	if (c->lookup) {
+		expect = LOOKUP_RUNNING;
+		if (!__atomic_compare_exchange_n(&c->lookup->state, &expect, LOOKUP_ABANDONED, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			lookup_free(c->lookup);
+		}
+		c->lookup = NULL;
+	}
+	if (c->fd != -1) {
+		close(c->fd);
+		c->fd = -1;
+	}
+	if (c->udp_fd != -1) {
+		close(c->udp_fd);
+		c->udp_fd = -1;
+	}
+}
+
+/*
+ * Same host as the TCP connection, the port 'offset' further. Any
+ * failure just leaves the keys on TCP.
+ */
+static void
+client_udp_open(struct net_client *c, int offset)
+{
+	struct sockaddr_storage addr;
+	socklen_t len;
+	uint16_t *port;
+
+	len = sizeof addr;
+	if (getpeername(c->fd, (struct sockaddr *)&addr, &len) == -1) {
+		return;
+	}
+
+	if (addr.ss_family == AF_INET) {
+		port = &((struct sockaddr_in *)&addr)->sin_port;
+	} else if (addr.ss_family == AF_INET6) {
+		port = &((struct sockaddr_in6 *)&addr)->sin6_port;
+	} else {
+		return;
+	}
+	*port = htons(ntohs(*port) + offset);
+
+	if ((c->udp_fd = socket(addr.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1) {
+		return;
+	}
+
+	if (connect(c->udp_fd, (struct sockaddr *)&addr, len) == -1) {
+		log_warn("Match client: UDP: %s\n", strerror(errno));
+		close(c->udp_fd);
+		c->udp_fd = -1;
+	}
+}
+
+/* Every key in flight, or a probe while there are none */
+static void
+client_udp_send(struct net_client *c)
+{
+	uint8_t buf[NET_UDP_MAX];
+	int len;
+
+	len = net_pack_inputs(buf, &c->inputs, c->match, c->player, c->token);
+	send(c->udp_fd, buf, len, MSG_DONTWAIT);
+	c->sent = time_ns();
+}
+
+/*
+ * Keys only go out during the match, the ones that don't fit are
+ * dropped rather than waited for.
+ */
+int
+client_key(struct net_client *c, uint8_t key)
+{
+	if (c->state != CLIENT_PLAYING) {
+		return -1;
+	}
+
+	if (c->udp_ok) {
+		if (net_inputs_push(&c->inputs, key) == -1) {
+			return -1;
+		}
+		client_udp_send(c);
+		return 0;
+	}
+
+	if (c->out_len == CLIENT_OUT_SIZE) {
+		return -1;
+	}
+
+	c->out[c->out_len++] = key;
+
+	return 0;
+}
+
+static void
+client_msg(struct net_client *c, int type, const uint8_t *payload, int len)
+{
+	struct net_board nb;
+
+	switch (type) {
+	case NET_WAIT:
+		if (len >= 1) {
+			c->player = payload[0] & 1;
+			c->state = CLIENT_WAITING;
+		}
+		break;
+
+	case NET_START:
+		if (len >= 5) {
+			c->player = payload[0] & 1;
+			c->seed = (uint32_t)payload[1] << 24 | payload[2] << 16 | payload[3] << 8 | payload[4];
+			c->state = CLIENT_PLAYING;
+		}
+		if (len >= NET_START_SIZE && payload[5] != NET_NO_UDP && c->udp_fd == -1) {
+			c->token = (uint32_t)payload[6] << 24 | payload[7] << 16 | payload[8] << 8 | payload[9];
+			client_udp_open(c, payload[5]);
+		}
+		break;
+
+	case NET_BOARD:
+		if (net_unpack_board(&nb, payload, len) == 0) {
+			nb.player &= 1;
+			c->boards[nb.player] = nb;
+			c->fresh |= BIT(nb.player);
+		}
+		break;
+
+	case NET_OVER:
+		c->winner = len >= 1 ? payload[0] : NET_NO_WINNER;
+		c->state = CLIENT_OVER;
+		break;
+	}
+}
+
+/*
+ * Boards that come in over UDP, older than the last one of the same
+ * player are dropped. Whatever comes in means UDP works, and keys
+ * that aren't acknowledged for a while go out again.
+ */
+static void
+client_udp_step(struct net_client *c)
+{
+	uint8_t buf[NET_UDP_MAX];
+	uint32_t seq, ack;
+	ssize_t n;
+	int off, p;
+
+	while ((n = recv(c->udp_fd, buf, sizeof buf, MSG_DONTWAIT)) > 0) {
+		if ((off = net_unpack_udp_board(buf, n, &seq, &ack)) == -1 || buf[off] != NET_BOARD) {
+			continue;
+		}
+
+		c->udp_ok = 1;
+		net_inputs_ack(&c->inputs, ack);
+
+		p = buf[off + NET_HEADER] & 1;
+		if ((int32_t)(seq - c->board_seq[p]) > 0) {
+			c->board_seq[p] = seq;
+			client_msg(c, NET_BOARD, buf + off + NET_HEADER, n - off - NET_HEADER);
+		}
+	}
+
+	if ((!c->udp_ok || c->inputs.next != c->inputs.acked) && time_ns() - c->sent >= NET_RESEND_NS) {
+		client_udp_send(c);
+	}
+}
+
+/*
+ * Advance the connection as far as it goes without waiting: finish
+ * connecting, send what's queued and take in every whole message.
+ * Returns the state it's left in.
+ */
+int
+client_step(struct net_client *c)
+{
+	struct pollfd pfd;
+	ssize_t n;
+	int err, off, len;
+	socklen_t size;
+
+	if (c->state == CLIENT_RESOLVING) {
+		client_resolved(c);
+	}
+
+	if (c->fd == -1) {
+		return c->state;
+	}
+
+	if (c->state == CLIENT_CONNECTING) {
+		pfd.fd = c->fd;
+		pfd.events = POLLOUT;
+		if (poll(&pfd, 1, 0) != 1) {
+			return c->state;
+		}
+
+		size = sizeof err;
+		if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &size) == -1 || err) {
+			client_fail(c, "connect", err ? err : errno);
+			return c->state;
+		}
+
+		c->state = CLIENT_WAITING;
+	}
+
+	if (c->out_len) {
+		if ((n = send(c->fd, c->out, c->out_len, MSG_NOSIGNAL | MSG_DONTWAIT)) == -1) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				client_fail(c, "send", errno);
+				return c->state;
+			}
+			n = 0;
+		}
+
+		memmove(c->out, c->out + n, c->out_len - n);
+		c->out_len -= n;
+	}
+
+	if (c->udp_fd != -1 && c->state == CLIENT_PLAYING) {
+		client_udp_step(c);
+	}
+
+	while ((n = recv(c->fd, c->in + c->in_len, sizeof c->in - c->in_len, MSG_DONTWAIT)) > 0) {
+		c->in_len += n;
+
+		for (off = 0; c->in_len - off >= NET_HEADER; off += len) {
+			len = NET_HEADER + c->in[off + 1];
+			if (c->in_len - off < len) {
+				break;
+			}
+
+			client_msg(c, c->in[off], c->in + off + NET_HEADER, len - NET_HEADER);
+		}
+
+		memmove(c->in, c->in + off, c->in_len - off);
+		c->in_len -= off;
+	}
+
+	/* The server closes right after the result */
+	if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+		if (c->state == CLIENT_OVER) {
+			client_close(c);
+		} else {
+			client_fail(c, "recv", n == 0 ? ECONNRESET : errno);
+		}
+	}
+
+	return c->state;
+}
@@ -0,0 +1,77 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#define CLIENT_OUT_SIZE	256
+#define CLIENT_IN_SIZE	(4 * NET_MSG_MAX)
+
+/* C library */
+#include <stdint.h>
+
+/* e-type */
+#include "net.h"
+
+struct client_lookup;
+
+/* Where a connection is at, see client_step() */
+typedef enum { CLIENT_IDLE, CLIENT_RESOLVING, CLIENT_CONNECTING, CLIENT_WAITING, CLIENT_PLAYING, CLIENT_OVER, CLIENT_FAILED } client_state;
+
+/*
+ * -==+ Match client +==-
+ * A non-blocking connection to a match server. Nothing here ever
+ * waits: client_step() does whatever the socket allows right now and
+ * returns, so it can run once per frame next to input and drawing.
+ * 'fresh' has a bit per player whose board came in since it was last
+ * cleared. A host name is looked up on a thread ('lookup') before
+ * connecting. Keys go over UDP once the server answers a probe there
+ * ('udp_ok'), see net.h.
+ */
+struct net_client {
+	int fd;
+	client_state state;
+	struct client_lookup *lookup;
+	uint32_t match;
+	uint8_t player, winner;
+	uint32_t seed;
+	uint8_t out[CLIENT_OUT_SIZE];
+	int out_len;
+	uint8_t in[CLIENT_IN_SIZE];
+	int in_len;
+	struct net_board boards[2];
+	uint8_t fresh;
+	/* [UDP] */
+	int udp_fd;
+	uint8_t udp_ok;
+	uint32_t token;
+	uint32_t board_seq[2];
+	struct net_inputs inputs;
+	uint64_t sent;
+};
+
+/* -==+ Connection +==- */
+int  client_open(struct net_client *c, const char *host, const char *port, uint32_t match);
+int  client_step(struct net_client *c);
+void client_close(struct net_client *c);
+
+/* -==+ Playing +==- */
+int  client_key(struct net_client *c, uint8_t key);
+
+#endif /* CLIENT_H */
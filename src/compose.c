@@ -0,0 +1,402 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Header file */
+#include "compose.h"
+/* C library */
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+/* POSIX */
+#include <unistd.h>
+#include <sys/ioctl.h>
+/* e-type */
+#include "perf.h"
+#include "utils.h"
+
+/* Frame cells: the character, its color pair and line drawing */
+#define CELL(ch, pair)	((uint16_t)((uint8_t)(ch) | (pair) << 8))
+#define CELL_ACS	0x1000
+#define CELL_STALE	0xffff	/* Never drawn, forces a cell out */
+
+/* Set by SIGWINCH while comp_watch() is on */
+static volatile sig_atomic_t resized;
+static struct sigaction prev_winch;
+
+/* -==+ Tiles +==- */
+
+static void
+tile_label(struct comp_tile *t, const char *label, uint32_t score, int over)
+{
+	snprintf(t->label, sizeof t->label, "%s", label);
+	t->score = score;
+	t->over = over;
+}
+
+/*
+ * The board of 'gs' with the tetromino in play and its ghost, only
+ * for boards that fit in 'board'.
+ */
+void
+comp_tile_game(struct comp_tile *t, const struct game_state *gs, const char *label)
+{
+	struct comp_tile n;
+	int i, x, y, g;
+
+	memset(&n, 0, sizeof n);
+	n.w = MIN(gs->board_w, BOARD_MAX_W);
+	n.h = MIN(gs->board_h, BOARD_MAX_H);
+	tile_label(&n, gs->flags & BIT(PAUSE) ? "PAUSE" : label, gs->score, !!(gs->flags & BIT(QUIT)));
+
+	if (!gs->big && !(gs->flags & BIT(PAUSE))) {
+		memcpy(n.cells, gs->board, sizeof n.cells);
+
+		for (i = 0; !(gs->flags & BIT(LBREAK)) && i != 4; ++i) {
+			x = gs->curr_mino_pos.x + gs->curr_mino.block_pos[i].x;
+			y = gs->curr_mino_pos.y + gs->curr_mino.block_pos[i].y;
+			g = gs->ghost_pos + gs->curr_mino.block_pos[i].y;
+
+			if (gs->prof.flags & BIT(CONFIG_FGHOST) && g >= 0 && g < n.h && x >= 0 && x < n.w && !n.cells[g][x]) {
+				n.cells[g][x] = COMP_GHOST | gs->curr_mino.color;
+			}
+
+			if (y >= 0 && y < n.h && x >= 0 && x < n.w) {
+				n.cells[y][x] = gs->curr_mino.color;
+			}
+		}
+	}
+
+	n.dirty = t->dirty || memcmp(&n, t, sizeof n) != 0;
+	*t = n;
+}
+
+/*
+ * A bot's board, all in 'color' as it doesn't keep them.
+ */
+void
+comp_tile_bot(struct comp_tile *t, const struct bot_board *b, const struct bot_game *g,
+	      const char *label, uint8_t color, int over)
+{
+	struct comp_tile n;
+	uint32_t row;
+	int x, y;
+
+	memset(&n, 0, sizeof n);
+	n.w = BOARD_W;
+	n.h = BOARD_H;
+	tile_label(&n, label, g->score, over);
+
+	for (y = 0; y != BOARD_H; ++y) {
+		row = b->rows[BOT_PAD + y] >> 4;
+		for (x = 0; x != BOARD_W; ++x) {
+			n.cells[y][x] = row >> x & 1 ? color : 0;
+		}
+	}
+
+	n.dirty = t->dirty || memcmp(&n, t, sizeof n) != 0;
+	*t = n;
+}
+
+/* -==+ Layout +==- */
+
+static void
+tile_size(comp_glyph glyph, int w, int h, int *tw, int *th)
+{
+	switch (glyph) {
+	case GLYPH_FULL:
+		*tw = w * 2 + 2;
+		*th = h + 3;
+		break;
+
+	case GLYPH_COMPACT:
+		*tw = w + 2;
+		*th = h + 3;
+		break;
+
+	default:
+		*tw = MAX(w + 2, 8);
+		*th = (h + 1) / 2 + 2;
+		break;
+	}
+}
+
+/*
+ * Pick the largest glyphs that fit 'count' tiles on a 'lines' by
+ * 'cols' screen, as many per row as fit. When not even the smallest
+ * do, whatever falls off the screen isn't drawn. Tiles must be filled
+ * first, the largest one sets the size of all.
+ */
+void
+comp_layout(struct compositor *c, int count, int lines, int cols)
+{
+	int i, w, h, rows, x, y;
+
+	c->count = MIN(count, COMP_MAX);
+	c->lines = MIN(lines, COMP_LINES);
+	c->cols = MIN(cols, COMP_COLS);
+
+	w = BOARD_W;
+	h = BOARD_H;
+	for (i = 0; i != c->count; ++i) {
+		w = MAX(w, c->tiles[i].w);
+		h = MAX(h, c->tiles[i].h);
+		c->tiles[i].dirty = 1;
+	}
+
+	for (c->glyph = GLYPH_FULL; c->glyph != GLYPH_COUNT; ++c->glyph) {
+		tile_size(c->glyph, w, h, &c->tile_w, &c->tile_h);
+		c->per_row = MAX(1, MIN(c->count, (c->cols + 1) / (c->tile_w + 1)));
+		rows = (c->count + c->per_row - 1) / c->per_row;
+
+		if (c->tile_w <= c->cols && rows * c->tile_h <= c->lines) {
+			break;
+		}
+	}
+
+	if (c->glyph == GLYPH_COUNT) {
+		c->glyph = GLYPH_DENSE;
+		tile_size(c->glyph, w, h, &c->tile_w, &c->tile_h);
+	}
+
+	rows = (c->count + c->per_row - 1) / c->per_row;
+	c->x0 = MAX(0, (c->cols - c->per_row * (c->tile_w + 1) + 1) / 2);
+	c->y0 = MAX(0, (c->lines - rows * c->tile_h) / 2);
+
+	/* Everything goes out again, the caller clears the screen */
+	for (y = 0; y != COMP_LINES; ++y) {
+		for (x = 0; x != COMP_COLS; ++x) {
+			c->frame[y][x] = CELL(' ', 0);
+			c->shown[y][x] = CELL_STALE;
+		}
+	}
+}
+
+/* -==+ Drawing +==- */
+
+static inline void
+put(struct compositor *c, int y, int x, uint16_t v)
+{
+	if (y >= 0 && y < c->lines && x >= 0 && x < c->cols) {
+		c->frame[y][x] = v;
+	}
+}
+
+static void
+put_str(struct compositor *c, int y, int x, const char *s, int max)
+{
+	for (; *s && max > 0; ++s, ++x, --max) {
+		put(c, y, x, CELL(*s, 0));
+	}
+}
+
+static void
+put_box(struct compositor *c, int y, int x, int w, int h)
+{
+	int i;
+
+	for (i = 1; i != w - 1; ++i) {
+		put(c, y, x + i, CELL('q', 0) | CELL_ACS);
+		put(c, y + h - 1, x + i, CELL('q', 0) | CELL_ACS);
+	}
+
+	for (i = 1; i != h - 1; ++i) {
+		put(c, y + i, x, CELL('x', 0) | CELL_ACS);
+		put(c, y + i, x + w - 1, CELL('x', 0) | CELL_ACS);
+	}
+
+	put(c, y, x, CELL('l', 0) | CELL_ACS);
+	put(c, y, x + w - 1, CELL('k', 0) | CELL_ACS);
+	put(c, y + h - 1, x, CELL('m', 0) | CELL_ACS);
+	put(c, y + h - 1, x + w - 1, CELL('j', 0) | CELL_ACS);
+}
+
+/* Ghost cells keep the tetromino's characters but not its color */
+static void
+put_cells(struct compositor *c, int y, int x, uint8_t v)
+{
+	const struct mino *m;
+	int pair;
+
+	if (!v) {
+		put(c, y, x, CELL(' ', 0));
+		if (c->glyph == GLYPH_FULL) {
+			put(c, y, x + 1, CELL(' ', 0));
+		}
+		return;
+	}
+
+	m = &minos[(v & ~COMP_GHOST) - 1];
+	pair = v & COMP_GHOST ? 0 : v;
+
+	if (c->glyph == GLYPH_FULL) {
+		put(c, y, x, CELL(m->block_left, pair));
+		put(c, y, x + 1, CELL(m->block_right, pair));
+
+	} else {
+		put(c, y, x, CELL(v & COMP_GHOST ? '.' : m->block_left, pair));
+	}
+}
+
+/* Two rows per character, colored like the upper block */
+static void
+put_dense(struct compositor *c, int y, int x, uint8_t top, uint8_t bottom)
+{
+	top = top & COMP_GHOST ? 0 : top;
+	bottom = bottom & COMP_GHOST ? 0 : bottom;
+
+	put(c, y, x, CELL(top ? bottom ? ':' : '\'' : bottom ? '.' : ' ', top ? top : bottom));
+}
+
+static void
+draw_tile(struct compositor *c, const struct comp_tile *t, int oy, int ox)
+{
+	char score[12];
+	int x, y, cw;
+
+	snprintf(score, sizeof score, "%u", t->score);
+
+	if (c->glyph == GLYPH_DENSE) {
+		put_box(c, oy, ox, c->tile_w, c->tile_h);
+		put_str(c, oy, ox + 1, t->over ? "OVER" : t->label, c->tile_w - 2);
+		put_str(c, oy + c->tile_h - 1, ox + 1, score, c->tile_w - 2);
+
+		for (y = 0; y < t->h; y += 2) {
+			for (x = 0; x != t->w; ++x) {
+				put_dense(c, oy + 1 + y / 2, ox + 1 + x, t->cells[y][x], y + 1 < t->h ? t->cells[y + 1][x] : 0);
+			}
+		}
+		return;
+	}
+
+	/* Label on the left, score on the right */
+	for (x = 0; x != c->tile_w; ++x) {
+		put(c, oy, ox + x, CELL(' ', 0));
+	}
+	put_str(c, oy, ox, t->over ? "OVER" : t->label, c->tile_w);
+	put_str(c, oy, ox + MAX(0, c->tile_w - (int)strlen(score)), score, c->tile_w);
+
+	cw = c->glyph == GLYPH_FULL ? 2 : 1;
+	put_box(c, oy + 1, ox, t->w * cw + 2, t->h + 2);
+	for (y = 0; y != t->h; ++y) {
+		for (x = 0; x != t->w; ++x) {
+			put_cells(c, oy + 2 + y, ox + 1 + x * cw, t->cells[y][x]);
+		}
+	}
+}
+
+/*
+ * Draw the tiles that changed and send the terminal the cells that
+ * differ from what it shows, in a single update. Returns how many.
+ */
+int
+comp_draw(struct compositor *c)
+{
+	uint16_t v;
+	chtype ch;
+	int i, oy, ox, x, y, y1, x1, n;
+
+	n = 0;
+	for (i = 0; i != c->count; ++i) {
+		if (!c->tiles[i].dirty) {
+			continue;
+		}
+
+		oy = c->y0 + i / c->per_row * c->tile_h;
+		ox = c->x0 + i % c->per_row * (c->tile_w + 1);
+		draw_tile(c, &c->tiles[i], oy, ox);
+		c->tiles[i].dirty = 0;
+
+		y1 = MIN(oy + c->tile_h, c->lines);
+		x1 = MIN(ox + c->tile_w, c->cols);
+		for (y = MAX(oy, 0); y < y1; ++y) {
+			for (x = MAX(ox, 0); x < x1; ++x) {
+				if ((v = c->frame[y][x]) == c->shown[y][x]) {
+					continue;
+				}
+
+				ch = v & CELL_ACS ? NCURSES_ACS(v & 0xff) : (chtype)(v & 0xff);
+				mvaddch(y, x, ch | COLOR_PAIR(v >> 8 & 0xf));
+				c->shown[y][x] = v;
+				++n;
+			}
+		}
+	}
+
+	if (n) {
+		wnoutrefresh(stdscr);
+		perf_refresh();
+	}
+
+	c->sent += n;
+
+	return n;
+}
+
+/* -==+ Resizing +==- */
+
+static void
+on_winch(int sig)
+{
+	(void)sig;
+	resized = 1;
+}
+
+/*
+ * Games read the terminal themselves, so the KEY_RESIZE of curses
+ * never comes. While 'on' SIGWINCH is caught here instead, and curses
+ * gets its own handler back afterwards.
+ */
+void
+comp_watch(int on)
+{
+	struct sigaction sa;
+
+	if (on) {
+		memset(&sa, 0, sizeof sa);
+		sa.sa_handler = on_winch;
+		sigemptyset(&sa.sa_mask);
+		sa.sa_flags = SA_RESTART;
+		resized = 0;
+		sigaction(SIGWINCH, &sa, &prev_winch);
+
+	} else {
+		sigaction(SIGWINCH, &prev_winch, NULL);
+	}
+}
+
+/*
+ * Returns 1 once the terminal changed size since the last call, with
+ * LINES and COLS already updated. The caller lays the screen out again.
+ */
+int
+comp_resized(void)
+{
+	struct winsize ws;
+
+	if (!resized) {
+		return 0;
+	}
+
+	resized = 0;
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row && ws.ws_col) {
+		resizeterm(ws.ws_row, ws.ws_col);
+	}
+
+	return 1;
+}
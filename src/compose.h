@@ -0,0 +1,88 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef COMPOSE_H
+#define COMPOSE_H
+
+#define COMP_MAX	8	/* Boards on screen */
+#define COMP_LINES	128	/* Largest screen drawn, the rest is left blank */
+#define COMP_COLS	256
+#define COMP_GHOST	0x80	/* Tile cell flag, the rest is the mino id + 1 */
+
+/* C library */
+#include <stdint.h>
+
+/* Ncurses */
+#include <ncurses.h>
+
+/* e-type */
+#include "bot.h"
+#include "tetris.h"
+
+/*
+ * Board cell sizes, largest first: "[]" per cell like the game, one
+ * character per cell, and one character per two rows.
+ */
+typedef enum { GLYPH_FULL, GLYPH_COMPACT, GLYPH_DENSE, GLYPH_COUNT } comp_glyph;
+
+/*
+ * -==+ Tile +==-
+ * A board as the compositor shows it, cells hold colors like 'board'
+ * of struct game_state. 'dirty' when it changed since the last frame.
+ */
+struct comp_tile {
+	char label[12];
+	uint32_t score;
+	uint16_t w, h;
+	uint8_t cells[BOARD_MAX_H][BOARD_MAX_W];
+	uint8_t over;
+	uint8_t dirty;
+};
+
+/*
+ * -==+ Compositor +==-
+ * Changed tiles are drawn into 'frame' and compared against what the
+ * terminal shows, 'shown', so only the cells that differ are sent.
+ * 'sent' counts them.
+ */
+struct compositor {
+	int count;
+	struct comp_tile tiles[COMP_MAX];
+	/* [Layout] */
+	int lines, cols;
+	comp_glyph glyph;
+	int tile_w, tile_h, per_row, x0, y0;
+	/* [Frames] */
+	uint16_t frame[COMP_LINES][COMP_COLS];
+	uint16_t shown[COMP_LINES][COMP_COLS];
+	uint64_t sent;
+};
+
+/* -==+ Tiles +==- */
+void comp_tile_game(struct comp_tile *t, const struct game_state *gs, const char *label);
+void comp_tile_bot(struct comp_tile *t, const struct bot_board *b, const struct bot_game *g,
+		   const char *label, uint8_t color, int over);
+
+/* -==+ Screen +==- */
+void comp_layout(struct compositor *c, int count, int lines, int cols);
+int  comp_draw(struct compositor *c);
+void comp_watch(int on);
+int  comp_resized(void);
+
+#endif /* COMPOSE_H */
@@ -24,33 +24,39 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+/* POSIX */
+#include <unistd.h>
+#include <libgen.h>
+#include <sys/inotify.h>
 /* e-type */
-#include "rng_bag.h"
-#include "rng_simple.h"
 #include "utils.h"
+#include "queue.h"
 #include "log.h"
+#include "engine.h"
+#include "input.h"
+#include "net.h"
 
 #define LINE_SIZE	64
+#define EVENT_BUF_SIZE	(sizeof (struct inotify_event) + NAME_MAX + 1)
+
+const struct rand_prof rand_profiles[RAND_COUNT] = { { "simple",
+						       simple_init, simple_fill },
+						     
+						     { "bag",
+						       bag_init, bag_fill } };
+
+/* Profile parsed from the config file, games only ever get copies */
+struct config_prof config_cache;
+char config_path[PATH_MAX];
+char config_name[NAME_MAX + 1];
+int config_fd = -1;
 
-const struct rand_prof rand_profiles[2] = { { "simple",
-					      simple_init, simple_next, simple_peek,
-					      sizeof(struct rng_simple) },
-					    
-					    { "bag",
-					      bag_init, bag_next, bag_peek,
-					      sizeof(struct rng_bag) } };
 void
 load_rng(struct config_prof *prof, int rng_ind)
 {
-	prof->rand_init = rand_profiles[rng_ind].init;
-	prof->rand_next = rand_profiles[rng_ind].next;
-	prof->rand_peek = rand_profiles[rng_ind].peek;
-	
-	if (prof->rng) {
-		free(prof->rng);
-	}
-
-	prof->rng = malloc(rand_profiles[rng_ind].mem_size);
+	prof->rng_ind = rng_ind;
 }
 
 int
@@ -71,18 +77,116 @@ grab_word(const char *str, const char **word)
 	}
 
 	*word = str;
-	while (isalpha(*str) || *str == '_') {
+	while (isalnum(*str) || *str == '_') {
 		++str;
 	}
 
 	return str - *word;
 }
 
+/*
+ * Parse 'path' once and watch its directory, editors usually replace
+ * the file instead of writing to it so watching the file itself would
+ * lose track of it after the first edit.
+ */
+int
+config_init(const char *path)
+{
+	char buf[PATH_MAX];
+
+	snprintf(config_path, sizeof config_path, "%s", path);
+	snprintf(buf, sizeof buf, "%s", path);
+	snprintf(config_name, sizeof config_name, "%s", basename(buf));
+
+	config_default(&config_cache);
+	config_read(config_path, &config_cache);
+
+	if ((config_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) {
+		log_warn("inotify_init1: %s\n", strerror(errno));
+		return -1;
+	}
+
+	snprintf(buf, sizeof buf, "%s", path);
+	if (inotify_add_watch(config_fd, dirname(buf), IN_CLOSE_WRITE | IN_MOVED_TO |
+			      IN_CREATE | IN_DELETE | IN_MOVED_FROM) == -1) {
+		log_warn("inotify_add_watch: %s\n", strerror(errno));
+		close(config_fd);
+		config_fd = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Reparse the config file if it changed since the last call, costs a
+ * single non-blocking read() otherwise. Returns 1 after reloading.
+ */
+int
+config_poll(void)
+{
+	char buf[16 * EVENT_BUF_SIZE] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *ev;
+	struct config_prof prof;
+	ssize_t len, i;
+	int changed;
+
+	if (config_fd == -1) {
+		return 0;
+	}
+
+	changed = 0;
+	while ((len = read(config_fd, buf, sizeof buf)) > 0) {
+		for (i = 0; i < len; i += sizeof (struct inotify_event) + ev->len) {
+			ev = (const struct inotify_event *)(buf + i);
+
+			if (ev->len && strcmp(ev->name, config_name) == 0) {
+				changed = 1;
+			}
+		}
+	}
+
+	if (changed) {
+		config_default(&prof);
+		if (config_read(config_path, &prof) == 0) {
+			config_cache = prof;
+			log_info("Reloaded %s\n", config_path);
+
+		} else {
+			log_warn("Keeping the previous configuration\n");
+		}
+	}
+
+	return changed;
+}
+
+/*
+ * Copy of the current profile, picking up any pending edit first.
+ */
+void
+config_get(struct config_prof *prof)
+{
+	config_poll();
+	*prof = config_cache;
+}
+
 void
 config_default(struct config_prof *prof)
 {
+	memset(prof, 0, sizeof (*prof));
 	load_rng(prof, 0);
+	prof->preview = 1;
+	prof->bots = 3;
+	prof->board_w = BOARD_W;
+	prof->board_h = BOARD_H;
+	prof->das = INPUT_DAS;
+	prof->arr = INPUT_ARR;
+	prof->key_timeout = INPUT_KEY_TIMEOUT;
+	snprintf(prof->host, sizeof prof->host, "localhost");
+	snprintf(prof->port, sizeof prof->port, NET_PORT);
+	prof->flags |= BIT(CONFIG_FKITTY);
 	prof->flags |= BIT(CONFIG_FGHOST);
+	prof->flags |= BIT(CONFIG_FTHREADS);
 }
 
 
@@ -91,38 +195,30 @@ config_read(const char *path, struct config_prof *prof)
 {
 	FILE *fp;
 	char buf[LINE_SIZE];
+	int ret;
 
 	if ((fp = fopen(path, "r")) == NULL) {
-		perror("fopen");
+		log_info("%s: %s\n", path, strerror(errno));
 		return -1;
 	}
 
-	while (fgets(buf, LINE_SIZE, fp)) {
+	ret = 0;
+	while (ret == 0 && fgets(buf, LINE_SIZE, fp)) {
 		if (!line_empty(buf) && parse_line(buf, prof) == -1) {
-			return -1;
+			ret = -1;
 		}
 	}
 
-	return 0;
-}
-
-void
-config_free(struct config_prof *prof)
-{
-	prof->rand_init = NULL;
-	prof->rand_next = NULL;
-	prof->rand_peek = NULL;
+	fclose(fp);
 
-	if (prof->rng) {
-		free(prof->rng);
-	}
+	return ret;
 }
 
 int
 parse_line(const char *line, struct config_prof *prof)
 {
 	const char *split, *var, *value;
-	int var_size, value_size, i;
+	int var_size, value_size, i, w, h;
 	
 	if ((split = strchr(line, ':'))) {
 		var = value = NULL;
@@ -144,16 +240,124 @@ parse_line(const char *line, struct config_prof *prof)
 					prof->flags &= ~BIT(CONFIG_FGHOST);
 
 				} else {
-					log_write("Invalid value %s in ghost_piece\n", value);
+					log_error("Invalid value %s in ghost_piece\n", value);
+					return -1;
+				}
+
+			} else if (strncmp(var, "preview", var_size) == 0) {
+				i = atoi(value);
+				if (i < 0 || i > PREVIEW_MAX) {
+					log_error("Invalid value %s in preview\n", value);
+					return -1;
+				}
+
+				prof->preview = i;
+
+			} else if (strncmp(var, "bots", var_size) == 0) {
+				i = atoi(value);
+				if (i < 1 || i > CONFIG_MAX_BOTS) {
+					log_error("Invalid value %s in bots\n", value);
+					return -1;
+				}
+
+				prof->bots = i;
+
+			} else if (strncmp(var, "board", var_size) == 0) {
+				/* Compiled sizes, or anything the large engine takes */
+				if (sscanf(value, "%dx%d", &w, &h) != 2 || engine_find(w, h, 1) == NULL) {
+					log_error("Invalid value %s in board\n", value);
+					return -1;
+				}
+
+				prof->board_w = w;
+				prof->board_h = h;
+
+			} else if (strncmp(var, "das", var_size) == 0 ||
+				   strncmp(var, "arr", var_size) == 0 ||
+				   strncmp(var, "key_timeout", var_size) == 0) {
+				i = atoi(value);
+				if (!isdigit(*value) || i > UINT16_MAX) {
+					log_error("Invalid value %s in %.*s\n", value, var_size, var);
+					return -1;
+				}
+
+				if (*var == 'd') {
+					prof->das = i;
+				} else if (*var == 'a') {
+					prof->arr = i;
+				} else {
+					prof->key_timeout = i;
+				}
+
+			} else if (strncmp(var, "kitty_keys", var_size) == 0) {
+				if (strncmp(value, "on", value_size) == 0) {
+					prof->flags |= BIT(CONFIG_FKITTY);
+
+				} else if (strncmp(value, "off", value_size) == 0) {
+					prof->flags &= ~BIT(CONFIG_FKITTY);
+
+				} else {
+					log_error("Invalid value %s in kitty_keys\n", value);
 					return -1;
 				}
+
+			} else if (strncmp(var, "threads", var_size) == 0) {
+				if (strncmp(value, "on", value_size) == 0) {
+					prof->flags |= BIT(CONFIG_FTHREADS);
+
+				} else if (strncmp(value, "off", value_size) == 0) {
+					prof->flags &= ~BIT(CONFIG_FTHREADS);
+
+				} else {
+					log_error("Invalid value %s in threads\n", value);
+					return -1;
+				}
+
+			} else if (strncmp(var, "replays", var_size) == 0) {
+				if (strncmp(value, "on", value_size) == 0) {
+					prof->flags |= BIT(CONFIG_FREPLAY);
+
+				} else if (strncmp(value, "off", value_size) == 0) {
+					prof->flags &= ~BIT(CONFIG_FREPLAY);
+
+				} else {
+					log_error("Invalid value %s in replays\n", value);
+					return -1;
+				}
+
+			} else if (strncmp(var, "host", var_size) == 0) {
+				/* Names and addresses have dots and dashes in them */
+				value_size = strcspn(value, " \t\r\n#");
+				if (value_size >= (int)sizeof prof->host) {
+					log_error("Invalid value %s in host\n", value);
+					return -1;
+				}
+
+				snprintf(prof->host, sizeof prof->host, "%.*s", value_size, value);
+
+			} else if (strncmp(var, "port", var_size) == 0) {
+				value_size = strspn(value, "0123456789");
+				if (value_size == 0 || value_size >= (int)sizeof prof->port || atoi(value) > 65535) {
+					log_error("Invalid value %s in port\n", value);
+					return -1;
+				}
+
+				snprintf(prof->port, sizeof prof->port, "%.*s", value_size, value);
+
+			} else if (strncmp(var, "log_level", var_size) == 0) {
+				if ((i = log_parse_level(value, value_size)) == -1) {
+					log_error("Invalid value %s in log_level\n", value);
+					return -1;
+				}
+
+				log_level = i;
 			}
 		}
 
 		return 0;
 
 	} else {
-		log_write("Wrong format; expected ':'\n");
+		log_error("Wrong format; expected ':'\n");
 		return -1;
 	}
 }
@@ -21,44 +21,74 @@
 #define CONFIG_H
 
 #define RAND_COUNT	2
+#define CONFIG_PATH	"e-type.conf"
 
 /* Config flags */
-#define CONFIG_FGHOST	0
+#define CONFIG_FGHOST		0
+#define CONFIG_FHEADLESS	1	/* No animations, no score file (bots, tools) */
+#define CONFIG_FKITTY		2	/* Use the kitty keyboard protocol if available */
+#define CONFIG_FTHREADS		3	/* Input, simulation and drawing on their own threads */
+#define CONFIG_FREPLAY		4	/* Record single player games, off unless asked for */
+
+#define CONFIG_MAX_BOTS		7	/* Versus opponents */
 
 /* C library */
 #include <stdint.h>
 #include <stddef.h>
 
+/* e-type */
+#include "rng_bag.h"
+#include "rng_simple.h"
+
 /* -==+ Blueprint for a RNG profile +==- */
 struct rand_prof {
 	const char *name;
-	void (*init)(void*);
-	int (*next)(void*);
-	int (*peek)(void*);
-	size_t mem_size;
+	void (*init)(void*, unsigned int);
+	void (*fill)(void*, uint8_t*, int);
+};
+
+/* -==+ Storage big enough for any RNG profile's state +==- */
+union rng_state {
+	struct rng_simple simple;
+	struct rng_bag bag;
 };
 
 /*
  * -==+ Custom information +==-
- * Contains the player's profile information.
+ * Contains the player's profile information. It holds no pointers
+ * to itself, so games get their own copy with a plain assignment.
  */
 struct config_prof {
 	/* [Random Number Generator] */
-	void *rng;
-	void (*rand_init)(void*);
-	int (*rand_next)(void*);
-	int (*rand_peek)(void*);
+	uint8_t rng_ind;
+	uint8_t preview;
+	/* [Auto-shift, milliseconds] */
+	uint16_t das, arr;
+	uint16_t key_timeout;
+	/* [Board] */
+	uint16_t board_w, board_h;
+	/* [Versus] */
+	uint8_t bots;
+	/* [Multiplayer, server to join and port to host on] */
+	char host[64];
+	char port[8];
 	/* [Flags] */
 	uint8_t flags;
 };
 
+extern const struct rand_prof rand_profiles[RAND_COUNT];
+
 /* -==+ Loaders +==- */
 void load_rng(struct config_prof *prof, int rng_ind);
+
+/* -==+ Parsed configuration cache +==- */
+int  config_init(const char *path);
+int  config_poll(void);
+void config_get(struct config_prof *prof);
        
 /* -==+ Configuration loading +==- */
 void config_default(struct config_prof *prof);
 int  config_read(const char *path, struct config_prof *prof);
-void config_free(struct config_prof *prof);
 
 /* -==+ Parsing +==- */
 int  line_empty(const char *str);
@@ -24,22 +24,37 @@
 /* POSIX */
 #include <unistd.h>
 
-/* Sockets */
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <netdb.h>
-#include <arpa/inet.h>
-#include <netinet/in.h>
-
 /* e-type */
 #include "tetris.h"
+#include "arena.h"
 #include "log.h"
+#include "trace.h"
+#include "perf.h"
+#include "scores.h"
+#include "history.h"
+#include "input.h"
+#include "pcsolve.h"
+#include "bigboard.h"
+#include "client.h"
+#include "compose.h"
+#include "live.h"
+#include "pipeline.h"
+#include "replay.h"
+#include "server.h"
 
 
 #define MENU_ROOT	0
 #define MENU_DRAW	1
 #define MENU_QUIT	2
 
+/* Time a versus bot takes per tetromino, shorter every level */
+#define VERSUS_PACE	600000000
+#define VERSUS_PACE_MIN	100000000
+#define VERSUS_PACE_STEP 40000000
+
+/* The hint is looked for on the game's thread, a frame at most */
+#define HINT_BUDGET	16000000
+
 
 struct selection {
 	char *title;
@@ -49,9 +64,24 @@ struct selection {
 	void (*func) (struct game_state*);
 };
 
+/* -==+ Versus opponent +==- */
+struct versus_bot {
+	struct bot_board board;
+	struct bot_game game;
+	struct piece_queue queue;
+	uint64_t next;
+	int over;
+};
+
 
 int  init_ncurses(struct game_state *gs);
+void handle_event(struct game_state *gs, const struct input_event *ev);
 void handle_input(struct game_state *gs);
+void show_hint(struct game_state *gs);
+
+void multi_player(struct game_state *gs, int host);
+int  match_input(struct game_state *gs, struct net_client *nc);
+void match_board(struct game_state *gs, const struct net_board *nb);
 
 void print_logo(void);
 int  print_menu(struct selection *menu, int y, int x);
@@ -59,11 +89,27 @@ void input_menu(struct selection *menu, struct game_state *gs, uint8_t *flags);
 
 /* Menu selection functions */
 void single_player(struct game_state *gs);
+void versus_game(struct game_state *gs);
+int  versus_step(struct versus_bot *bot, uint64_t now);
+void local_game(struct game_state *gs);
 void join_game(struct game_state *gs);
 void host_game(struct game_state *gs);
 void quit(struct game_state *gs);
 
 
+/* Keyboard decoding state, kept between frames */
+struct input_decoder decoder;
+
+/* Versus screen, too big for the stack */
+struct compositor compositor;
+
+/* Second player of a local match, it never has windows of its own */
+struct game_state rival;
+
+/* Single player games are recorded through this */
+struct replay_rec recorder;
+
+
 int
 main(int argc, char **argv)
 {
@@ -72,14 +118,47 @@ main(int argc, char **argv)
 	 * passing easier to handle.
 	 */
 	struct game_state gs;
-	struct selection menu, sub_menu[3], sub_mp[2];
+	struct selection menu, sub_menu[4], sub_vs[2], sub_mp[2];
 	uint8_t flags;
+	long threads;
 
 	/* Initialize everything */
+	memset(&gs, 0, sizeof (gs));
 	log_init("e-type.log");
+	trace_init(TRACE_PATH);
+	live_init(LIVE_NAME);
+	config_init(CONFIG_PATH);
+	scores_open(HI_SCORES);
+	history_init(HISTORY_PATH);
+	perf_init();
 	srand(time(NULL));
+
+	/* Everything a game needs past its start, so playing never touches the heap */
+	threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (arena_init(&engine_arena, pc_reserve(threads) + POOL_BYTES(sizeof (struct pipeline), 1)) == 0) {
+		pc_init(&engine_arena, threads);
+		pipeline_init(&engine_arena);
+	}
+
 	init_ncurses(&gs);
 
+	/* Create sub-menu for the 'Versus' option */
+	sub_vs[0].title = "Bots";
+	sub_vs[0].dropdown = NULL;
+	sub_vs[0].parent = NULL;
+	sub_vs[0].cnt = 0;
+	sub_vs[0].opt_i = 0;
+	sub_vs[0].select = 0;
+	sub_vs[0].func = versus_game;
+
+	sub_vs[1].title = "Local";
+	sub_vs[1].dropdown = NULL;
+	sub_vs[1].parent = NULL;
+	sub_vs[1].cnt = 0;
+	sub_vs[1].opt_i = 0;
+	sub_vs[1].select = 0;
+	sub_vs[1].func = local_game;
+
 	/* Create sub-menu for the 'Multiplayer' option */
 	sub_mp[0].title = "Join";
 	sub_mp[0].dropdown = NULL;
@@ -106,8 +185,8 @@ main(int argc, char **argv)
 	sub_menu[0].select = 0;
 	sub_menu[0].func = single_player;
 
-	sub_menu[1].title = "Multiplayer";
-	sub_menu[1].dropdown = sub_mp;
+	sub_menu[1].title = "Versus";
+	sub_menu[1].dropdown = sub_vs;
 	sub_menu[1].parent = &menu;
 	sub_menu[1].cnt = 2;
 	sub_menu[1].opt_i = 0;
@@ -115,18 +194,27 @@ main(int argc, char **argv)
 	sub_menu[1].drop_color = BLUE;
 	sub_menu[1].func = NULL;
 
-	sub_menu[2].title = "Quit";
-	sub_menu[2].dropdown = NULL;
+	sub_menu[2].title = "Multiplayer";
+	sub_menu[2].dropdown = sub_mp;
 	sub_menu[2].parent = &menu;
-	sub_menu[2].cnt = 0;
+	sub_menu[2].cnt = 2;
 	sub_menu[2].opt_i = 0;
 	sub_menu[2].select = 0;
-	sub_menu[2].func = quit;
+	sub_menu[2].drop_color = BLUE;
+	sub_menu[2].func = NULL;
+
+	sub_menu[3].title = "Quit";
+	sub_menu[3].dropdown = NULL;
+	sub_menu[3].parent = &menu;
+	sub_menu[3].cnt = 0;
+	sub_menu[3].opt_i = 0;
+	sub_menu[3].select = 0;
+	sub_menu[3].func = quit;
 
 	menu.title = "Main menu";
 	menu.dropdown = sub_menu;
 	menu.parent = NULL;
-	menu.cnt = 3;
+	menu.cnt = 4;
 	menu.opt_i = 1;
 	menu.select = 0;
 	menu.drop_color = GREEN;
@@ -137,7 +225,7 @@ main(int argc, char **argv)
 	gs.board_win = newwin(BOARD_H + 2, BOARD_W * 2 + 2, (LINES - BOARD_H - 2) / 2, COLS / 2 - 14);
 	gs.stats_win = newwin(BOARD_H + 2, BOARD_W * 2 + 2, (LINES - BOARD_H - 2) / 2, COLS / 2 + BOARD_W * 2 - 12);
 
-	flags |= BIT(MENU_DRAW);
+	flags = BIT(MENU_DRAW);
 
 	/* Main loop */
 	while (!(flags & BIT(MENU_QUIT))) {
@@ -183,63 +271,117 @@ init_ncurses(struct game_state *gs)
 
 /* TODO: Allow for customizable keys */
 void
-handle_input(struct game_state *gs)
+handle_event(struct game_state *gs, const struct input_event *ev)
 {
-	int c;
-
-	c = getch();
-
 	if (gs->flags & BIT(PAUSE)) {
-		if (c == 'P' || c == 'p') {
+		if (ev->key == IN_PAUSE && ev->type != IN_RELEASE) {
 			resume_game(gs);
 		}
 
-	} else {
-		switch (c) {
-		case 'W': case 'w':
-			move_mino(gs, 0, -1, SOFT_DROP);
-			break;
+		return;
+	}
 
-		case 'S': case 's':
-			move_mino(gs, 0, 1, SOFT_DROP);
-			break;
+	if (ev->key == IN_LEFT || ev->key == IN_RIGHT) {
+		input_shift(gs, ev);
+		return;
+	}
 
-		case 'A': case 'a':
-			move_mino(gs, -1, 0, SOFT_DROP);
-			break;
+	if (ev->type == IN_RELEASE) {
+		return;
+	}
 
-		case 'D': case 'd':
-			move_mino(gs, 1, 0, SOFT_DROP);
-			break;
+	switch (ev->key) {
+	case IN_UP:
+		move_mino(gs, 0, -1, SOFT_DROP);
+		break;
 
-		case 'J': case 'j':
-			rotate_mino(gs, CLOCKWISE);
-			break;
+	case IN_SOFT_DROP:
+		move_mino(gs, 0, 1, SOFT_DROP);
+		break;
 
-		case 'K': case 'k':
-			rotate_mino(gs, COUNTER_CLOCKWISE);
-			break;
+	case IN_ROTATE_CW:
+		rotate_mino(gs, CLOCKWISE);
+		break;
 
-		case 'R': case 'r':
-			spawn_mino(gs);
-			break;
+	case IN_ROTATE_CCW:
+		rotate_mino(gs, COUNTER_CLOCKWISE);
+		break;
 
-		case 'L': case 'l':
-			hold_mino(gs);
-			break;
+	case IN_RESPAWN:
+		spawn_mino(gs);
+		break;
 
-		case ' ':
-			hard_drop(gs);
-			break;
+	case IN_HOLD:
+		hold_mino(gs);
+		break;
 
-		case 'P': case 'p':
-			pause_game(gs);
-			break;
+	case IN_HARD_DROP:
+		hard_drop(gs);
+		break;
 
-		case 'Q': case 'q':
-			game_over(gs);
-			break;
-		}
+	case IN_PAUSE:
+		pause_game(gs);
+		break;
+
+	case IN_OVERLAY:
+		perf_overlay = !perf_overlay;
+		gs->flags |= BIT(DRAW_STATS);
+		break;
+
+	case IN_HINT:
+		show_hint(gs);
+		break;
+
+	case IN_QUIT:
+		game_over(gs);
+		break;
+	}
+}
+
+/*
+ * Ask the solver for a perfect clear with what the player can see, and
+ * show where the tetromino in play goes. It gets HINT_BUDGET to find
+ * one so the game doesn't stall.
+ */
+void
+show_hint(struct game_state *gs)
+{
+	struct pc_problem p;
+	struct pc_result r;
+	const struct pc_move *m;
+
+	if (pc_from_game(&p, gs, gs->prof.preview + 1) == -1) {
+		snprintf(gs->hint, sizeof gs->hint, "pc: too tall");
+
+	} else if (pc_solve(&p, 4, sysconf(_SC_NPROCESSORS_ONLN), HINT_BUDGET, &r) != 1) {
+		snprintf(gs->hint, sizeof gs->hint, r.expired ? "pc: gave up" : "pc: none in view");
+
+	} else {
+		m = &r.moves[0];
+		snprintf(gs->hint, sizeof gs->hint, "pc: %s%c%c%c x%d r%d", m->hold ? "hold " : "",
+			 minos[m->id].block_left, minos[m->id].symbol, minos[m->id].block_right,
+			 m->x, m->state % 4);
+	}
+
+	gs->hint_piece = pieces_played(gs);
+	gs->flags |= BIT(DRAW_STATS);
+}
+
+void
+handle_input(struct game_state *gs)
+{
+	struct input_event ev[INPUT_EVENTS_MAX];
+	int i, n;
+
+	/* The whole batch lands before the next frame is drawn */
+	n = input_read(&decoder, ev);
+	for (i = 0; i != n; ++i) {
+		handle_event(gs, &ev[i]);
+	}
+
+	/* Auto-shift waits out pauses and line clears */
+	if (!(gs->flags & (BIT(PAUSE) | BIT(LBREAK)))) {
+		input_update(gs, time_ns());
 	}
 }
 
@@ -358,11 +500,40 @@ input_menu(struct selection *menu, struct game_state *gs, uint8_t *flags)
 void
 single_player(struct game_state *gs)
 {
+	uint64_t t[4];
+	int presented;
+
 	new_game(gs);
+	input_start(&decoder, gs->prof.flags & BIT(CONFIG_FKITTY));
+
+	if (gs->prof.flags & BIT(CONFIG_FREPLAY)) {
+		replay_record(&recorder, gs, REPLAY_DIR);
+	}
 
+	/* Large boards live on the heap, frames can't be copied for another thread */
+	if (!gs->big && gs->prof.flags & BIT(CONFIG_FTHREADS) && pipeline_run(gs, &decoder, handle_event) == 0) {
+		replay_finish(gs);
+		input_stop(&decoder);
+		return;
+	}
+
+	alloc_freeze();
 	while (!(gs->flags & BIT(QUIT))) {
+		trace_loop();
+		presented = gs->flags & (BIT(DRAW_BOARD) | BIT(DRAW_STATS) | BIT(DRAW_HOLD));
+
+		t[0] = time_ns();
+		/* ncurses fills its own caches as it meets new attributes */
+		alloc_thaw();
 		draw_game(gs);
+		alloc_freeze();
+		if (presented) {
+			live_publish(gs);
+		}
+		t[1] = time_ns();
+		replay_tick(gs, t[1]);
 		handle_input(gs);
+		t[2] = time_ns();
 		
 		if (!(gs->flags & BIT(PAUSE))) {
 			if (gs->flags & BIT(LBREAK)) {
@@ -371,107 +542,522 @@ single_player(struct game_state *gs)
 				update_timing(gs);
 			}
 		}
+
+		t[3] = time_ns();
+		if (perf_frame(t, presented) && perf_overlay) {
+			gs->flags |= BIT(DRAW_STATS);
+		}
 	}
+	alloc_thaw();
+
+	replay_finish(gs);
+	input_stop(&decoder);
 }
 
+/*
+ * The player against 'bots' opponents playing the same pieces, all on
+ * one screen. The game ends when the player's does.
+ */
 void
-join_game(struct game_state *gs)
+versus_game(struct game_state *gs)
 {
-	struct addrinfo *res, hints;
-	int host_fd, err;
-	char ch, host_in, host_ip[] = "localhost";
+	struct versus_bot bots[CONFIG_MAX_BOTS];
+	char label[12];
+	uint64_t now, paused;
+	int i, n;
+
+	new_game(gs);
+
+	/* Large boards need the whole screen */
+	if (gs->big) {
+		single_player(gs);
+		return;
+	}
+
+	n = MIN(gs->prof.bots, COMP_MAX - 1);
+	now = time_ns();
+	for (i = 0; i != n; ++i) {
+		bot_clear(&bots[i].board);
+		memset(&bots[i].game, 0, sizeof bots[i].game);
+		queue_init(&bots[i].queue, gs->prof.rng_ind, gs->seed);
+		bots[i].next = now + VERSUS_PACE;
+		bots[i].over = 0;
+
+		snprintf(label, sizeof label, "bot %c", '1' + i);
+		comp_tile_bot(&compositor.tiles[i + 1], &bots[i].board, &bots[i].game, label, 1 + i % 7, 0);
+	}
 
+	comp_tile_game(&compositor.tiles[0], gs, "you");
+	comp_layout(&compositor, n + 1, LINES, COLS);
 	clear();
 	refresh();
 
-	memset(&hints, 0, sizeof (struct addrinfo));
-	hints.ai_flags = AF_UNSPEC;
-	hints.ai_family = AF_INET;
-	hints.ai_socktype = SOCK_STREAM;
+	input_start(&decoder, gs->prof.flags & BIT(CONFIG_FKITTY));
+	comp_watch(1);
+	paused = 0;
 
-	if ((err = getaddrinfo(host_ip, "1234", &hints, &res))) {
-		fprintf(stderr, "%s", gai_strerror(err));
-		return;
+	alloc_freeze();
+	while (!(gs->flags & BIT(QUIT))) {
+		trace_loop();
+		handle_input(gs);
+
+		if (!(gs->flags & BIT(PAUSE))) {
+			if (gs->flags & BIT(LBREAK)) {
+				update_lbreak(gs);
+			} else {
+				update_timing(gs);
+			}
+		}
+
+		/* The bots wait out pauses too */
+		now = time_ns();
+		if (gs->flags & BIT(PAUSE)) {
+			paused = paused ? paused : now;
+			gs->flags |= BIT(DRAW_BOARD);
+
+		} else if (paused) {
+			for (i = 0; i != n; ++i) {
+				bots[i].next += now - paused;
+			}
+			paused = 0;
+		}
+
+		for (i = 0; !paused && i != n; ++i) {
+			if (versus_step(&bots[i], now)) {
+				snprintf(label, sizeof label, "bot %c", '1' + i);
+				comp_tile_bot(&compositor.tiles[i + 1], &bots[i].board, &bots[i].game, label, 1 + i % 7,
+					      bots[i].over);
+			}
+		}
+
+		if (gs->flags & (BIT(DRAW_BOARD) | BIT(DRAW_STATS) | BIT(DRAW_HOLD))) {
+			comp_tile_game(&compositor.tiles[0], gs, "you");
+			gs->flags &= ~(BIT(DRAW_BOARD) | BIT(DRAW_STATS) | BIT(DRAW_HOLD));
+		}
+
+		/* ncurses fills its own caches as it meets new attributes */
+		alloc_thaw();
+		if (comp_resized()) {
+			comp_layout(&compositor, n + 1, LINES, COLS);
+			clear();
+		}
+		comp_draw(&compositor);
+		alloc_freeze();
 	}
+	alloc_thaw();
+
+	comp_watch(0);
+	input_stop(&decoder);
+}
+
+/*
+ * Two players on one keyboard with the same pieces, the second has
+ * the arrows, ',' '.' '/' and enter (see input.c). Pause and quit are
+ * shared. The first to top out loses and the boards stop there.
+ */
+void
+local_game(struct game_state *gs)
+{
+	struct input_event ev[INPUT_EVENTS_MAX];
+	struct game_state *p[2];
+	uint64_t now;
+	int i, n, over;
 
-	if ((host_fd = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
-		perror("socket");
+	new_game(gs);
+
+	/* Large boards need the whole screen */
+	if (gs->big) {
+		single_player(gs);
 		return;
 	}
 
-	if ((connect(host_fd, res->ai_addr, res->ai_addrlen)) == -1) {
-		perror("connect");
-		return;
+	init_game(&rival, &gs->prof, gs->seed);
+	rival.hi_score = gs->hi_score;
+	spawn_mino(&rival);
+
+	p[0] = gs;
+	p[1] = &rival;
+	comp_tile_game(&compositor.tiles[0], gs, "player 1");
+	comp_tile_game(&compositor.tiles[1], &rival, "player 2");
+	comp_layout(&compositor, 2, LINES, COLS);
+	clear();
+	refresh();
+
+	input_start(&decoder, gs->prof.flags & BIT(CONFIG_FKITTY));
+	comp_watch(1);
+	over = 0;
+
+	alloc_freeze();
+	while (1) {
+		trace_loop();
+
+		n = input_read(&decoder, ev);
+		for (i = 0; i != n; ++i) {
+			if (ev[i].type == IN_RELEASE && ev[i].key != IN_LEFT && ev[i].key != IN_RIGHT) {
+				continue;
+			}
+
+			if (ev[i].key == IN_QUIT) {
+				break;
+
+			} else if (over || ev[i].key == IN_HINT) {
+				/* The solver only shows hints in the stats window */
+				continue;
+
+			} else if (ev[i].key == IN_PAUSE) {
+				if (gs->flags & BIT(PAUSE)) {
+					resume_game(gs);
+					resume_game(&rival);
+				} else {
+					pause_game(gs);
+					pause_game(&rival);
+				}
+
+			} else {
+				handle_event(p[ev[i].player], &ev[i]);
+			}
+		}
+
+		if (i != n) {
+			break;
+		}
+
+		now = time_ns();
+		for (i = 0; !over && i != 2; ++i) {
+			if (p[i]->flags & BIT(PAUSE)) {
+				continue;
+			}
+
+			if (p[i]->flags & BIT(LBREAK)) {
+				update_lbreak(p[i]);
+			} else {
+				input_update(p[i], now);
+				update_timing(p[i]);
+			}
+		}
+
+		/* Topping out sets QUIT, the other player won */
+		if (!over && (gs->flags | rival.flags) & BIT(QUIT)) {
+			over = 1;
+			gs->flags |= BIT(DRAW_BOARD);
+			rival.flags |= BIT(DRAW_BOARD);
+		}
+
+		for (i = 0; i != 2; ++i) {
+			if (p[i]->flags & (BIT(DRAW_BOARD) | BIT(DRAW_STATS) | BIT(DRAW_HOLD))) {
+				comp_tile_game(&compositor.tiles[i], p[i],
+					       over && !(p[i]->flags & BIT(QUIT)) ? "wins (q)" : i ? "player 2" : "player 1");
+				p[i]->flags &= ~(BIT(DRAW_BOARD) | BIT(DRAW_STATS) | BIT(DRAW_HOLD));
+			}
+		}
+
+		/* ncurses fills its own caches as it meets new attributes */
+		alloc_thaw();
+		if (comp_resized()) {
+			comp_layout(&compositor, 2, LINES, COLS);
+			clear();
+		}
+		comp_draw(&compositor);
+		alloc_freeze();
+	}
+	alloc_thaw();
+
+	comp_watch(0);
+	input_stop(&decoder);
+
+	/* Both scores are kept, whoever didn't top out gets theirs now */
+	for (i = 0; i != 2; ++i) {
+		if (!(p[i]->flags & BIT(QUIT))) {
+			game_over(p[i]);
+		}
 	}
+}
 
-	while ((ch = getch())) {
-		if (ch != ERR && send(host_fd, &ch, 1, 0) == -1) {
-			perror("send");
+/*
+ * Play the bot's tetrominos that are due, returns 1 if its board
+ * changed.
+ */
+int
+versus_step(struct versus_bot *bot, uint64_t now)
+{
+	struct bot_move m;
+	int cleared, changed;
+
+	changed = 0;
+	while (!bot->over && now >= bot->next) {
+		changed = 1;
+		if (!bot_best(&bot->board, queue_next(&bot->queue), bot_default_weights, &m)) {
+			bot->over = 1;
 			break;
 		}
+
+		if ((cleared = bot_place(&bot->board, &m))) {
+			bot->game.score += (bot->game.lines / 10 + 1) * score_mult[cleared - 1];
+			bot->game.lines += cleared;
+		}
+
+		++bot->game.pieces;
+		bot->next += MAX(VERSUS_PACE_MIN, VERSUS_PACE - VERSUS_PACE_STEP * (int64_t)(bot->game.lines / 10));
 	}
 
-	close(host_fd);
+	return changed;
+}
+
+void
+join_game(struct game_state *gs)
+{
+	multi_player(gs, 0);
 }
 
 void
 host_game(struct game_state *gs)
 {
-	struct addrinfo *res, hints;
-	int sock_fd, client_fd, err;
-	char client_in;
+	multi_player(gs, 1);
+}
 
-	clear();
-	refresh();
+/*
+ * Everything the networking needs happens a little every frame, so
+ * the game never stops for it: the host's server is polled without
+ * waiting and the connection is a state machine (see client.h).
+ * Until the opponent shows up the player practices, then both boards
+ * come from the server and share the compositor, and keys go to the
+ * server. Once the match is over or the connection failed only
+ * IN_QUIT does anything, which leaves at any point.
+ */
+void
+multi_player(struct game_state *gs, int host)
+{
+	struct game_state opp;
+	struct config_prof prof;
+	struct net_client nc;
+	struct server *srv;
+	char label[12], opp_label[12];
+	int state, prev, match, i;
 
-	memset(&hints, 0, sizeof (struct addrinfo));
-	hints.ai_flags = AF_UNSPEC;
-	hints.ai_family = AF_INET;
-	hints.ai_socktype = SOCK_STREAM;
+	memset(&opp, 0, sizeof opp);
+	srv = NULL;
+	match = 0;
 
-	if ((err = getaddrinfo(NULL, "1234", &hints, &res))) {
-		fprintf(stderr, "%s\n", gai_strerror(err));
-		return;
-	}
+	new_game(gs);
+	input_start(&decoder, gs->prof.flags & BIT(CONFIG_FKITTY));
+	comp_watch(1);
 
-	if ((sock_fd = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
-		perror("socket");
-		return;
+	if (host && (srv = server_new(gs->prof.port, 1)) == NULL) {
+		memset(&nc, 0, sizeof nc);
+		nc.fd = -1;
+		nc.state = CLIENT_FAILED;
+
+	} else {
+		client_open(&nc, host ? "localhost" : gs->prof.host, gs->prof.port, 0);
 	}
 
-	err = 1;
-	if (setsockopt(sock_fd, SOL_SOCKET, SO_REUSEADDR, &err, sizeof err) == -1) {
-		perror("setsockopt");
-		return;
+	prev = CLIENT_IDLE;
+	while (1) {
+		if (srv) {
+			server_poll(srv, 0);
+		}
+
+		if ((state = client_step(&nc)) != prev) {
+			switch (state) {
+			case CLIENT_RESOLVING:
+				snprintf(gs->status, sizeof gs->status, "looking up...");
+				break;
+
+			case CLIENT_CONNECTING:
+				snprintf(gs->status, sizeof gs->status, "connecting...");
+				break;
+
+			case CLIENT_WAITING:
+				snprintf(gs->status, sizeof gs->status, "waiting, %s", host ? "hosting" : "joined");
+				break;
+
+			case CLIENT_PLAYING:
+				/* Same board as the server's, the preview isn't sent */
+				config_get(&prof);
+				prof.board_w = BOARD_W;
+				prof.board_h = BOARD_H;
+				prof.preview = 0;
+				init_game(gs, &prof, nc.seed);
+				init_game(&opp, &prof, nc.seed);
+				snprintf(label, sizeof label, "you");
+				snprintf(opp_label, sizeof opp_label, "player %d", !nc.player + 1);
+
+				comp_tile_game(&compositor.tiles[0], gs, label);
+				comp_tile_game(&compositor.tiles[1], &opp, opp_label);
+				comp_layout(&compositor, 2, LINES, COLS);
+				clear();
+				match = 1;
+				break;
+
+			case CLIENT_OVER:
+				snprintf(gs->status, sizeof gs->status, "%s (q)",
+					 nc.winner == nc.player ? "you win" : nc.winner == NET_NO_WINNER ? "no contest" : "you lose");
+				snprintf(label, sizeof label, "%s (q)",
+					 nc.winner == nc.player ? "won" : nc.winner == NET_NO_WINNER ? "even" : "lost");
+				break;
+
+			case CLIENT_FAILED:
+				snprintf(gs->status, sizeof gs->status, "%s (q)",
+					 match ? "cut off" : srv || !host ? "no server" : "can't host");
+				snprintf(label, sizeof label, "cut off (q)");
+				break;
+			}
+
+			gs->flags |= BIT(DRAW_STATS);
+			prev = state;
+		}
+
+		trace_loop();
+
+		if (comp_resized()) {
+			if (match) {
+				comp_layout(&compositor, 2, LINES, COLS);
+				clear();
+			} else {
+				place_windows(gs);
+				gs->flags |= BIT(DRAW_BOARD) | BIT(DRAW_STATS) | BIT(DRAW_HOLD);
+			}
+		}
+
+		if (state == CLIENT_RESOLVING || state == CLIENT_CONNECTING || state == CLIENT_WAITING) {
+			/* Practice, topping out only starts over */
+			if (gs->flags & (BIT(DRAW_BOARD) | BIT(DRAW_STATS) | BIT(DRAW_HOLD))) {
+				draw_game(gs);
+				live_publish(gs);
+			}
+			if (match_input(gs, NULL) == -1) {
+				break;
+			}
+
+			if (!(gs->flags & BIT(PAUSE))) {
+				if (gs->flags & BIT(LBREAK)) {
+					update_lbreak(gs);
+				} else {
+					update_timing(gs);
+				}
+			}
+
+			if (gs->flags & BIT(QUIT)) {
+				new_game(gs);
+				snprintf(gs->status, sizeof gs->status, "waiting, %s", host ? "hosting" : "joined");
+			}
+
+		} else if (!match) {
+			/* Failed before the match, the status says why */
+			draw_game(gs);
+			if (match_input(NULL, NULL) == -1) {
+				break;
+			}
+
+		} else {
+			for (i = 0; i != 2; ++i) {
+				if (nc.fresh & BIT(i)) {
+					match_board(i == nc.player ? gs : &opp, &nc.boards[i]);
+				}
+			}
+			nc.fresh = 0;
+
+			if (gs->flags & (BIT(DRAW_BOARD) | BIT(DRAW_STATS) | BIT(DRAW_HOLD))) {
+				live_publish(gs);
+			}
+			comp_tile_game(&compositor.tiles[0], gs, label);
+			comp_tile_game(&compositor.tiles[1], &opp, opp_label);
+			gs->flags &= ~(BIT(DRAW_BOARD) | BIT(DRAW_STATS) | BIT(DRAW_HOLD));
+			opp.flags &= ~(BIT(DRAW_BOARD) | BIT(DRAW_STATS) | BIT(DRAW_HOLD));
+			comp_draw(&compositor);
+
+			if (match_input(NULL, state == CLIENT_PLAYING ? &nc : NULL) == -1) {
+				break;
+			}
+		}
 	}
 
-	if (bind(sock_fd, res->ai_addr, res->ai_addrlen) == -1) {
-		perror("bind");
-		return;
+	comp_watch(0);
+	input_stop(&decoder);
+	client_close(&nc);
+	server_free(srv);
+
+	gs->status[0] = '\0';
+	gs->flags &= ~BIT(QUIT);
+}
+
+/*
+ * Keys of a frame: the practice game 'gs' gets them while 'nc' is
+ * NULL, the server otherwise, and with neither they are dropped. -1
+ * when the player wants out.
+ */
+int
+match_input(struct game_state *gs, struct net_client *nc)
+{
+	struct input_event ev[INPUT_EVENTS_MAX];
+	int i, n;
+
+	n = input_read(&decoder, ev);
+	for (i = 0; i != n; ++i) {
+		if (ev[i].key == IN_QUIT && ev[i].type != IN_RELEASE) {
+			return -1;
+		}
+
+		if (nc) {
+			/* The terminal's own repeat stands in for auto-shift */
+			if (ev[i].type != IN_RELEASE) {
+				client_key(nc, ev[i].key);
+			}
+
+		} else if (gs) {
+			handle_event(gs, &ev[i]);
+		}
 	}
 
-	if (listen(sock_fd, 5) == -1) {
-		perror("listen");
-		return;
+	if (gs && !(gs->flags & (BIT(PAUSE) | BIT(LBREAK)))) {
+		input_update(gs, time_ns());
 	}
 
-	if ((client_fd = accept(sock_fd, NULL, NULL)) == -1) {
-		perror("accept");
-		return;
+	return 0;
+}
+
+/*
+ * Show a board from the server in 'gs', the local engine only draws
+ * it and works out the ghost.
+ */
+void
+match_board(struct game_state *gs, const struct net_board *nb)
+{
+	int i, y;
+
+	for (y = 0; y != BOARD_H; ++y) {
+		memcpy(gs->board[y], nb->board[y], BOARD_W);
 	}
 
-	while (recv(client_fd, &client_in, 1, 0) > 0) {
-		mvprintw(LINES / 2, COLS / 2, "%c", client_in);
-		refresh();
+	gs->curr_mino = minos[nb->mino];
+	for (i = 0; i != 4; ++i) {
+		gs->curr_mino.block_pos[i] = nb->blocks[i];
 	}
+	gs->curr_mino_pos = nb->pos;
+	gs->score = nb->score;
+	gs->lines = nb->lines;
 
-	close(sock_fd);
+	update_ghost(gs);
+	gs->flags |= BIT(DRAW_BOARD) | BIT(DRAW_STATS);
 }
 
 void
 quit(struct game_state *gs)
 {
+	FILE *fp;
+
 	endwin();
+
+	if ((fp = fopen(PERF_PATH, "w"))) {
+		perf_dump(fp);
+		fclose(fp);
+	}
+
+	history_close();
+	scores_close();
+	live_close();
+	trace_close();
+	log_close();
 	exit(0);
 }
 
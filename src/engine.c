@@ -0,0 +1,113 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Header file */
+#include "engine.h"
+/* C library */
+#include <stddef.h>
+#include <string.h>
+/* e-type */
+#include "bigboard.h"
+#include "log.h"
+#include "replay.h"
+#include "trace.h"
+
+/* -==+ Variants +==- */
+
+/* Standard Tetris, the one everybody plays, tetris.c calls it directly */
+#define E_NAME	std
+#define E_W	BOARD_W
+#define E_H	BOARD_H
+#define E_GHOST	1
+#define E_EXPORT	1
+#include "engine_tmpl.h"
+
+#define E_NAME	std_noghost
+#define E_W	BOARD_W
+#define E_H	BOARD_H
+#define E_GHOST	0
+#include "engine_tmpl.h"
+
+#define E_NAME	narrow
+#define E_W	6
+#define E_H	20
+#define E_GHOST	1
+#include "engine_tmpl.h"
+
+#define E_NAME	narrow_noghost
+#define E_W	6
+#define E_H	20
+#define E_GHOST	0
+#include "engine_tmpl.h"
+
+#define E_NAME	wide
+#define E_W	16
+#define E_H	20
+#define E_GHOST	1
+#include "engine_tmpl.h"
+
+#define E_NAME	wide_noghost
+#define E_W	16
+#define E_H	20
+#define E_GHOST	0
+#include "engine_tmpl.h"
+
+#define E_NAME	tall
+#define E_W	10
+#define E_H	24
+#define E_GHOST	1
+#include "engine_tmpl.h"
+
+#define E_NAME	tall_noghost
+#define E_W	10
+#define E_H	24
+#define E_GHOST	0
+#include "engine_tmpl.h"
+
+/* Standard variants first, they are the usual lookup */
+const struct engine *const engines[ENGINE_COUNT] = { &engine_std_engine,
+						     &engine_std_noghost_engine,
+						     &engine_narrow_engine,
+						     &engine_narrow_noghost_engine,
+						     &engine_wide_engine,
+						     &engine_wide_noghost_engine,
+						     &engine_tall_engine,
+						     &engine_tall_noghost_engine };
+
+/*
+ * Variant compiled for a 'w' x 'h' board with or without ghost, else
+ * the large engine if it takes that size, NULL if nothing does.
+ */
+const struct engine *
+engine_find(int w, int h, int ghost)
+{
+	int i;
+
+	for (i = 0; i != ENGINE_COUNT; ++i) {
+		if (engines[i]->w == w && engines[i]->h == h && engines[i]->ghost == !!ghost) {
+			return engines[i];
+		}
+	}
+
+	if (w >= BIG_MIN_W && w <= BIG_MAX_W && h >= BIG_MIN_H && h <= BIG_MAX_H) {
+		return ghost ? &engine_big_engine : &engine_big_noghost_engine;
+	}
+
+	return NULL;
+}
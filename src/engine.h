@@ -0,0 +1,78 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+/* Number of compiled variants, see engine.c */
+#define ENGINE_COUNT	8
+
+/* C library */
+#include <stdint.h>
+
+/* e-type */
+#include "tetris.h"
+
+/*
+ * -==+ Engine variant +==-
+ * Board logic compiled for a fixed board size and ruleset, the
+ * public functions in tetris.c forward to the variant the game
+ * was started with.
+ */
+struct engine {
+	const char *name;
+	uint16_t w, h;	/* 0 when set at run time, see bigboard.h */
+	uint8_t ghost;
+	void (*draw_board)(struct game_state*);
+	void (*update_lbreak)(struct game_state*);
+	void (*clear_lines)(struct game_state*);
+	void (*hard_drop)(struct game_state*);
+	void (*update_ghost)(struct game_state*);
+	void (*spawn_mino)(struct game_state*);
+	void (*hold_mino)(struct game_state*);
+	int  (*move_mino)(struct game_state*, int, int, uint8_t);
+	int  (*rotate_mino)(struct game_state*, int);
+};
+
+extern const struct engine *const engines[ENGINE_COUNT];
+extern const struct engine engine_std_engine;
+
+/*
+ * -==+ Standard variant +==-
+ * Called directly on the standard board, the one nearly every game is
+ * played on, instead of through struct engine.
+ */
+void engine_std_draw_board(struct game_state *gs);
+void engine_std_update_lbreak(struct game_state *gs);
+void engine_std_clear_lines(struct game_state *gs);
+void engine_std_hard_drop(struct game_state *gs);
+void engine_std_update_ghost(struct game_state *gs);
+void engine_std_spawn_mino(struct game_state *gs);
+void engine_std_hold_mino(struct game_state *gs);
+int  engine_std_move_mino(struct game_state *gs, int dx, int dy, uint8_t flags);
+int  engine_std_rotate_mino(struct game_state *gs, int dir);
+
+/* 'f' of the variant 'gs' was started with */
+#define ENGINE_CALL(gs, f, ...)	((gs)->engine == &engine_std_engine ? engine_std_##f(__VA_ARGS__) \
+					 : (gs)->engine->f(__VA_ARGS__))
+
+/* -==+ Lookup +==- */
+const struct engine *engine_find(int w, int h, int ghost);
+
+#endif /* ENGINE_H */
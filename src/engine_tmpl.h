@@ -0,0 +1,536 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Engine template, included once per variant by engine.c with these
+ * defined:
+ *	E_NAME	- Suffix for the generated symbols.
+ *	E_W	- Board width.
+ *	E_H	- Board height.
+ *	E_GHOST	- Nonzero to track and draw the ghost tetromino.
+ * and optionally:
+ *	E_EXPORT - Nonzero to give the entry points external linkage, so
+ *		   tetris.c can call the variant without going through
+ *		   struct engine.
+ * Every loop bound is a constant so the compiler unrolls the board
+ * scans, and a variant without ghost drops the drop-distance search
+ * from every move instead of testing a flag for it.
+ *
+ * bigboard.c also defines E_BIG, then E_W and E_H read the size of
+ * 'gs->big' and the board helpers below come from there.
+ */
+
+#ifndef E_BIG
+#define E_BIG	0
+#endif
+
+#ifndef E_EXPORT
+#define E_EXPORT	0
+#endif
+
+#if E_EXPORT
+#define E_ENTRY
+#else
+#define E_ENTRY		static
+#endif
+
+#if !E_BIG
+#if E_W > BOARD_MAX_W || E_H > BOARD_MAX_H
+#error "Engine variant doesn't fit in struct game_state's board"
+#endif
+
+#define E_CELL(gs, x, y)	((gs)->board[y][x])
+#define E_SET(gs, x, y, c)	((gs)->board[y][x] = (c))
+#endif
+
+#define E_CAT2(a, b)	engine_##a##_##b
+#define E_CAT(a, b)	E_CAT2(a, b)
+#define E(f)		E_CAT(E_NAME, f)
+#define E_STR2(s)	#s
+#define E_STR(s)	E_STR2(s)
+
+/* -==+ Check Board state +==- */
+
+/*
+ * 'y' can be lower than 0 and return true but 'x' can't.
+ */
+static inline int
+E(in_range)(const struct game_state *gs, int x, int y)
+{
+	return x >= 0 && x < E_W && y < E_H;
+}
+
+/*
+ * Return if 'm' placed at 'x', 'y' overlaps the walls, the floor or
+ * any locked block.
+ */
+static inline int
+E(collides)(const struct game_state *gs, const struct mino *m, int x, int y)
+{
+	int i, bx, by, hit;
+
+	hit = 0;
+	for (i = 0; i != 4; ++i) {
+		bx = x + m->block_pos[i].x;
+		by = y + m->block_pos[i].y;
+
+		hit |= !E(in_range)(gs, bx, by) || (by >= 0 && E_CELL(gs, bx, by));
+	}
+
+	return hit;
+}
+
+static inline int
+E(line_full)(const struct game_state *gs, int y)
+{
+#if E_BIG
+	return big_row_full(gs->big, y);
+#else
+	int i, full;
+
+	full = 1;
+	for (i = 0; i != E_W; ++i) {
+		full &= gs->board[y][i] != 0;
+	}
+
+	return full;
+#endif
+}
+
+/* -==+ Drawing +==- */
+
+E_ENTRY void
+E(draw_board)(struct game_state *gs)
+{
+#if E_BIG
+	big_draw(gs);
+#else
+	int i, j, c;
+
+	for (i = 0; i != E_H; ++i) {
+		wmove(gs->board_win, i + 1, 1);
+		for (j = 0; j != E_W; ++j) {
+			if ((c = gs->board[i][j])) {
+				wattron(gs->board_win, COLOR_PAIR(c));
+				wprintw(gs->board_win, "%c%c", minos[c - 1].block_left,
+					minos[c - 1].block_right);
+				wattroff(gs->board_win, COLOR_PAIR(c));
+
+			} else {
+				wprintw(gs->board_win, "%s", "  ");
+			}
+		}
+	}
+
+	if (!(gs->flags & BIT(LBREAK))) {
+#if E_GHOST
+		draw_mino(gs->board_win, &gs->curr_mino, gs->curr_mino_pos.x * 2 + 1, gs->ghost_pos + 1, BIT(DRAW_GHOST));
+#endif
+		draw_mino(gs->board_win, &gs->curr_mino, gs->curr_mino_pos.x * 2 + 1, gs->curr_mino_pos.y + 1, 0);
+	}
+
+	box(gs->board_win, 0, 0);
+	wnoutrefresh(gs->board_win);
+#endif
+}
+
+/* -==+ Update Board state +==- */
+
+#if !E_BIG
+/*
+ * Compact the board in a single bottom-up pass, 'lbreak_lines' is
+ * sorted so it's walked backwards alongside.
+ */
+static void
+E(compact)(struct game_state *gs)
+{
+	int src, dst, k;
+
+	k = gs->lbreak_count - 1;
+	for (src = dst = E_H - 1; src >= 0; --src) {
+		if (k >= 0 && gs->lbreak_lines[k] == src) {
+			--k;
+
+		} else {
+			if (src != dst) {
+				memcpy(gs->board[dst], gs->board[src], E_W);
+			}
+
+			--dst;
+		}
+	}
+
+	for (; dst >= 0; --dst) {
+		memset(gs->board[dst], 0, E_W);
+	}
+}
+#endif
+
+E_ENTRY void
+E(clear_lines)(struct game_state *gs)
+{
+	if (!gs->lbreak_count) {
+		return;
+	}
+
+#if E_BIG
+	big_clear_rows(gs->big, gs->lbreak_lines, gs->lbreak_count);
+#else
+	E(compact)(gs);
+#endif
+
+	trace_emit(TR_CLEAR, 0, 0, gs->lbreak_lines[0], gs->lbreak_count);
+
+	gs->score += (gs->level + 1) * score_mult[gs->lbreak_count - 1];
+	gs->lines += gs->lbreak_count;
+	gs->level = gs->lines / 10;
+
+	if (gs->score > gs->hi_score) {
+		gs->hi_score = gs->score;
+	}
+}
+
+/* -==+ Manipulate Tetromino +==- */
+
+E_ENTRY void
+E(update_ghost)(struct game_state *gs)
+{
+#if E_GHOST && E_BIG
+	gs->ghost_pos = gs->curr_mino_pos.y + big_drop(gs->big, &gs->curr_mino, gs->curr_mino_pos.x, gs->curr_mino_pos.y);
+#elif E_GHOST
+	int i;
+
+	for (i = 1; !E(collides)(gs, &gs->curr_mino, gs->curr_mino_pos.x, gs->curr_mino_pos.y + i); ++i)
+		;
+
+	gs->ghost_pos = gs->curr_mino_pos.y + i - 1;
+#else
+	(void)gs;
+#endif
+}
+
+E_ENTRY void
+E(spawn_mino)(struct game_state *gs)
+{
+	int r;
+
+	gs->curr_mino_pos.x = (E_W - 1) / 2;
+	gs->curr_mino_pos.y = 0;
+
+	r = queue_next(&gs->queue);
+	memcpy(&gs->curr_mino, &minos[r], sizeof (struct mino));
+	++gs->mino_count[r];
+	trace_emit(TR_SPAWN, r, gs->curr_mino_pos.x, gs->curr_mino_pos.y, 0);
+
+	if (E(collides)(gs, &gs->curr_mino, gs->curr_mino_pos.x, gs->curr_mino_pos.y)) {
+		game_over(gs);
+	}
+
+	E(update_ghost)(gs);
+
+	gs->flags |= BIT(DRAW_BOARD) | BIT(DRAW_STATS);
+	gs->flags &= ~BIT(BLOCK_HOLD);
+}
+
+E_ENTRY void
+E(update_lbreak)(struct game_state *gs)
+{
+	int i;
+
+	if (replay_clock(gs) - gs->lbreak_timer >= LINE_BREAK_BLOCK_TIMER) {
+		if (gs->lbreak_block == E_W / 2) {
+			E(clear_lines)(gs);
+			E(spawn_mino)(gs);
+			gs->flags ^= BIT(LBREAK);
+
+		} else {
+			log_debug("lines: %d\n", gs->lbreak_count);
+
+			for (i = 0; i != gs->lbreak_count; ++i) {
+				log_debug("\tl%d: %d\n", i, gs->lbreak_lines[i]);
+				E_SET(gs, (E_W - 1) / 2 - gs->lbreak_block, gs->lbreak_lines[i], 0);
+				E_SET(gs, E_W / 2 + gs->lbreak_block, gs->lbreak_lines[i], 0);
+			}
+
+			++gs->lbreak_block;
+			gs->flags |= BIT(DRAW_BOARD);
+			gs->lbreak_timer = replay_clock(gs);
+		}
+	}
+}
+
+E_ENTRY void
+E(hold_mino)(struct game_state *gs)
+{
+	const struct mino *m;
+
+	if (gs->flags & BIT(BLOCK_HOLD)) {
+		return;
+	}
+
+	m = &minos[gs->curr_mino.id];
+	if (gs->hold_mino == NULL) {
+		E(spawn_mino)(gs);
+
+	} else {
+		memcpy(&gs->curr_mino, gs->hold_mino, sizeof (struct mino));
+	}
+
+	gs->hold_mino = m;
+	trace_emit(TR_HOLD, gs->curr_mino.id, 0, 0, m->id);
+
+	gs->curr_mino_pos.x = (E_W - 1) / 2;
+	gs->curr_mino_pos.y = 0;
+
+	E(update_ghost)(gs);
+
+	gs->flags |= BIT(DRAW_BOARD) | BIT(DRAW_HOLD) | BIT(BLOCK_HOLD);
+}
+
+/*
+ * Write the current tetromino into the board and queue the lines it
+ * filled, only its own rows can have become full. A block left above
+ * the board tops the game out.
+ */
+static void
+E(lock_mino)(struct game_state *gs, uint8_t flags)
+{
+	int i, j, y, top_out;
+
+	trace_emit(TR_LOCK, gs->curr_mino.id, gs->curr_mino_pos.x, gs->curr_mino_pos.y, flags);
+
+	gs->lbreak_count = 0;
+	for (i = top_out = 0; i != 4; ++i) {
+		y = gs->curr_mino_pos.y + gs->curr_mino.block_pos[i].y;
+
+		if (y < 0) {
+			top_out = 1;
+			continue;
+		}
+
+		E_SET(gs, gs->curr_mino_pos.x + gs->curr_mino.block_pos[i].x, y, gs->curr_mino.color);
+
+		/* Insert 'y' keeping the list sorted and unique */
+		for (j = 0; j != gs->lbreak_count && gs->lbreak_lines[j] < y; ++j)
+			;
+
+		if (j == gs->lbreak_count || gs->lbreak_lines[j] != y) {
+			memmove(&gs->lbreak_lines[j + 1], &gs->lbreak_lines[j],
+				(gs->lbreak_count - j) * sizeof (int));
+			gs->lbreak_lines[j] = y;
+			++gs->lbreak_count;
+		}
+	}
+
+	/* The game ends on the board as it is, nothing is cleared or spawned */
+	if (top_out) {
+		gs->lbreak_count = 0;
+		gs->score += gs->drop_score;
+		gs->drop_score = 0;
+		game_over(gs);
+		return;
+	}
+
+	/* Keep only the full rows */
+	for (i = j = 0; i != gs->lbreak_count; ++i) {
+		if (E(line_full)(gs, gs->lbreak_lines[i])) {
+			gs->lbreak_lines[j++] = gs->lbreak_lines[i];
+		}
+	}
+	gs->lbreak_count = j;
+
+	/* Wide boards would take ages to wipe block by block */
+	if (!E_BIG && gs->lbreak_count > 0 && !(gs->prof.flags & BIT(CONFIG_FHEADLESS))) {
+		gs->lbreak_timer = replay_clock(gs);
+		gs->lbreak_block = 0;
+		gs->flags |= BIT(LBREAK);
+
+	} else {
+		E(clear_lines)(gs);
+		E(spawn_mino)(gs);
+	}
+
+	gs->score += gs->drop_score;
+	gs->drop_score = 0;
+
+	if (gs->score > gs->hi_score) {
+		gs->hi_score = gs->score;
+	}
+
+	/* Update falling speed */
+	if (gs->level <= 8) {
+		gs->fpc = 48 - (gs->level * 5);
+
+	} else if (gs->level <= 18) {
+		gs->fpc = 9 - (gs->level / 3);
+
+	} else if (gs->level <= 28) {
+		gs->fpc = 2;
+
+	} else {
+		gs->fpc = 1;
+	}
+}
+
+E_ENTRY int
+E(move_mino)(struct game_state *gs, int dx, int dy, uint8_t flags)
+{
+	if (dy == -1) {
+		return FAILURE;
+	}
+
+	if (E(collides)(gs, &gs->curr_mino, gs->curr_mino_pos.x + dx, gs->curr_mino_pos.y + dy)) {
+		/* If collided with something while going downwards */
+		if (dx == 0 && dy == 1) {
+			if (gs->immune) {
+				if (replay_clock(gs) - gs->immune < IMMUNITY_TIMER) {
+					return SUCCESS;
+				}
+
+			} else if (flags == SOFT_DROP) {
+				gs->immune = replay_clock(gs);
+				return SUCCESS;
+			}
+
+			gs->immune = 0;
+			E(lock_mino)(gs, flags);
+		}
+
+		return FAILURE;
+	}
+
+	if (dy == 1) {
+		++gs->drop_score;
+	}
+
+	gs->curr_mino_pos.x += dx;
+	gs->curr_mino_pos.y += dy;
+	trace_emit(TR_MOVE, gs->curr_mino.id, gs->curr_mino_pos.x, gs->curr_mino_pos.y, flags);
+
+	/* A vertical move can't change the ghost */
+	if (dx) {
+		E(update_ghost)(gs);
+	}
+
+	gs->flags |= BIT(DRAW_BOARD);
+
+	return SUCCESS;
+}
+
+E_ENTRY void
+E(hard_drop)(struct game_state *gs)
+{
+#if E_BIG
+	int d;
+
+	/* Tall boards jump straight down instead of moving row by row */
+	d = big_drop(gs->big, &gs->curr_mino, gs->curr_mino_pos.x, gs->curr_mino_pos.y);
+	gs->drop_score += d;
+	gs->curr_mino_pos.y += d;
+	trace_emit(TR_MOVE, gs->curr_mino.id, gs->curr_mino_pos.x, gs->curr_mino_pos.y, HARD_DROP);
+#endif
+
+	/* Locks right away instead of waiting out the lock delay */
+	gs->immune = 0;
+	while (E(move_mino)(gs, 0, 1, HARD_DROP))
+		;
+}
+
+E_ENTRY int
+E(rotate_mino)(struct game_state *gs, int dir)
+{
+	struct mino tmp;
+	struct point *p;
+	int i, z;
+
+	if (gs->curr_mino.flags & BIT(ROTATE_NONE)) {
+		return FAILURE;
+	}
+
+	memcpy(&tmp, &gs->curr_mino, sizeof (struct mino));
+
+	if (gs->curr_mino.flags & BIT(ROTATE_TWICE)) {
+		dir = !(tmp.flags & BIT(ROTATION));
+		tmp.flags ^= BIT(ROTATION);
+	}
+
+	for (i = 0; i != 4; ++i) {
+		p = &tmp.block_pos[i];
+		p->x -= tmp.pivot.x;
+		p->y -= tmp.pivot.y;
+
+		if (dir == CLOCKWISE) {
+			z = p->x;
+			p->x = -p->y;
+			p->y = z;
+
+		} else if (dir == COUNTER_CLOCKWISE) {
+			z = p->y;
+			p->y = -p->x;
+			p->x = z;
+		}
+
+		p->x += tmp.pivot.x;
+		p->y += tmp.pivot.y;
+	}
+
+	if (E(collides)(gs, &tmp, gs->curr_mino_pos.x, gs->curr_mino_pos.y)) {
+		return FAILURE;
+	}
+
+	memcpy(&gs->curr_mino, &tmp, sizeof (struct mino));
+	trace_emit(TR_ROTATE, gs->curr_mino.id, gs->curr_mino_pos.x, gs->curr_mino_pos.y, dir);
+	E(update_ghost)(gs);
+
+	gs->flags |= BIT(DRAW_BOARD);
+
+	return SUCCESS;
+}
+
+const struct engine E(engine) = { E_STR(E_NAME),
+#if E_BIG
+				  0, 0,
+#else
+				  E_W, E_H,
+#endif
+				  E_GHOST,
+				  E(draw_board),
+				  E(update_lbreak),
+				  E(clear_lines),
+				  E(hard_drop),
+				  E(update_ghost),
+				  E(spawn_mino),
+				  E(hold_mino),
+				  E(move_mino),
+				  E(rotate_mino) };
+
+#undef E
+#undef E_STR
+#undef E_STR2
+#undef E_CAT
+#undef E_CAT2
+#undef E_CELL
+#undef E_SET
+#undef E_BIG
+#undef E_EXPORT
+#undef E_ENTRY
+#undef E_NAME
+#undef E_W
+#undef E_H
+#undef E_GHOST
@@ -0,0 +1,344 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Header file */
+#include "history.h"
+/* C library */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+/* POSIX */
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+/* e-type */
+#include "tetris.h"
+#include "scores.h"
+#include "log.h"
+
+#define COLUMN(name, field)	{ name, offsetof(struct history_record, field), \
+				  sizeof (((struct history_record *)0)->field) }
+
+const struct history_column history_columns[HISTORY_COLUMNS] = {
+	COLUMN("time", time),		COLUMN("duration", duration),
+	COLUMN("score", score),		COLUMN("lines", lines),
+	COLUMN("level", level),		COLUMN("mino_I", mino_count[0]),
+	COLUMN("mino_L", mino_count[1]),	COLUMN("mino_J", mino_count[2]),
+	COLUMN("mino_O", mino_count[3]),	COLUMN("mino_S", mino_count[4]),
+	COLUMN("mino_Z", mino_count[5]),	COLUMN("mino_T", mino_count[6]),
+	COLUMN("rng", rng),		COLUMN("seed", seed),
+	COLUMN("player", player) };
+
+int history_fds[HISTORY_COLUMNS];
+int history_open = 0;
+
+/* Records waiting for the writer thread */
+struct history_record history_queue[HISTORY_BATCH];
+int history_queued;
+int history_stop;
+pthread_mutex_t history_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t history_cond = PTHREAD_COND_INITIALIZER;
+pthread_t history_thread;
+
+/*
+ * FNV-1a of the player's name, that's what the player column holds.
+ */
+uint32_t
+history_player_id(const char *name)
+{
+	uint32_t h;
+
+	for (h = 2166136261u; *name; ++name) {
+		h = (h ^ (unsigned char)*name) * 16777619u;
+	}
+
+	return h;
+}
+
+/*
+ * Cut every column back to the rows all of them have, the caller
+ * holds the lock. A crash or a failed write in the middle of a batch
+ * leaves some columns a row or a partial row longer than others.
+ * Returns the rows, -1 if a column can't be looked at.
+ */
+static off_t
+history_cut(void)
+{
+	struct stat st;
+	off_t rows;
+	int c;
+
+	rows = -1;
+	for (c = 0; c != HISTORY_COLUMNS; ++c) {
+		if (fstat(history_fds[c], &st) == -1) {
+			log_error("history: %s: %s\n", history_columns[c].name, strerror(errno));
+			return -1;
+		}
+		if (rows == -1 || st.st_size / (off_t)history_columns[c].size < rows) {
+			rows = st.st_size / history_columns[c].size;
+		}
+	}
+
+	for (c = 0; c != HISTORY_COLUMNS; ++c) {
+		if (fstat(history_fds[c], &st) == 0 && st.st_size != rows * (off_t)history_columns[c].size) {
+			log_warn("history: %s cut back to %ld rows\n", history_columns[c].name, (long)rows);
+			if (ftruncate(history_fds[c], rows * history_columns[c].size) == -1) {
+				log_error("history: %s: %s\n", history_columns[c].name, strerror(errno));
+				return -1;
+			}
+		}
+	}
+
+	return rows;
+}
+
+/*
+ * Append a batch to every column. Columns are written one after the
+ * other under a lock on the first, so games ending at the same time in
+ * other processes don't interleave their rows. The columns are evened
+ * out first, and a batch that can't be written to all of them is taken
+ * back out of the ones it reached, so they always stay row aligned.
+ */
+void
+history_write(const struct history_record *recs, int cnt)
+{
+	uint8_t buf[HISTORY_BATCH * sizeof (uint64_t)];
+	const struct history_column *col;
+	off_t rows;
+	int c, i;
+
+	if (flock(history_fds[0], LOCK_EX) == -1) {
+		log_error("history: lock: %s\n", strerror(errno));
+		return;
+	}
+
+	if ((rows = history_cut()) == -1) {
+		flock(history_fds[0], LOCK_UN);
+		return;
+	}
+
+	for (c = 0; c != HISTORY_COLUMNS; ++c) {
+		col = &history_columns[c];
+
+		for (i = 0; i != cnt; ++i) {
+			memcpy(buf + i * col->size, (const uint8_t *)&recs[i] + col->offset, col->size);
+		}
+
+		if (write(history_fds[c], buf, cnt * col->size) != (ssize_t)(cnt * col->size)) {
+			log_error("history: %s: %s\n", col->name, strerror(errno));
+			break;
+		}
+	}
+
+	/* The batch is lost, the rows before it aren't */
+	if (c != HISTORY_COLUMNS) {
+		for (c = 0; c != HISTORY_COLUMNS; ++c) {
+			if (ftruncate(history_fds[c], rows * history_columns[c].size) == -1) {
+				log_error("history: %s: %s\n", history_columns[c].name, strerror(errno));
+			}
+		}
+	}
+
+	flock(history_fds[0], LOCK_UN);
+}
+
+/*
+ * Even the columns out once at start, for readers that come before the
+ * first batch.
+ */
+static void
+history_trim(void)
+{
+	if (flock(history_fds[0], LOCK_EX) == -1) {
+		return;
+	}
+
+	history_cut();
+	flock(history_fds[0], LOCK_UN);
+}
+
+/*
+ * Writer thread, wakes up when a batch is full or a record has waited
+ * for HISTORY_FLUSH seconds.
+ */
+void *
+history_flush(void *arg)
+{
+	struct history_record batch[HISTORY_BATCH];
+	struct timespec ts;
+	int cnt, stop;
+
+	pthread_mutex_lock(&history_lock);
+
+	for (;;) {
+		while (!history_stop && history_queued != HISTORY_BATCH) {
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec += HISTORY_FLUSH;
+
+			if (pthread_cond_timedwait(&history_cond, &history_lock, &ts) == ETIMEDOUT &&
+			    history_queued) {
+				break;
+			}
+		}
+
+		cnt = history_queued;
+		stop = history_stop;
+		memcpy(batch, history_queue, cnt * sizeof (struct history_record));
+		history_queued = 0;
+
+		pthread_mutex_unlock(&history_lock);
+		history_write(batch, cnt);
+
+		if (stop) {
+			return NULL;
+		}
+
+		pthread_mutex_lock(&history_lock);
+		pthread_cond_broadcast(&history_cond);
+	}
+}
+
+/*
+ * Add the current player to the name dictionary used by queries.
+ */
+void
+history_add_player(const char *dir)
+{
+	char path[PATH_MAX], line[64];
+	unsigned int known;
+	uint32_t id;
+	FILE *fp;
+
+	snprintf(path, sizeof path, "%s/%s", dir, HISTORY_PLAYERS);
+	if ((fp = fopen(path, "a+")) == NULL) {
+		return;
+	}
+
+	id = history_player_id(scores_player());
+	while (fgets(line, sizeof line, fp)) {
+		if (sscanf(line, "%x", &known) == 1 && known == id) {
+			fclose(fp);
+			return;
+		}
+	}
+
+	fprintf(fp, "%08x %s\n", id, scores_player());
+	fclose(fp);
+}
+
+int
+history_init(const char *dir)
+{
+	char path[PATH_MAX];
+	int c;
+
+	if (mkdir(dir, 0777) == -1 && errno != EEXIST) {
+		log_error("%s: %s\n", dir, strerror(errno));
+		return -1;
+	}
+
+	for (c = 0; c != HISTORY_COLUMNS; ++c) {
+		snprintf(path, sizeof path, "%s/%s", dir, history_columns[c].name);
+
+		if ((history_fds[c] = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666)) == -1) {
+			log_error("%s: %s\n", path, strerror(errno));
+
+			while (c--) {
+				close(history_fds[c]);
+			}
+			return -1;
+		}
+	}
+
+	history_trim();
+	history_add_player(dir);
+
+	if (pthread_create(&history_thread, NULL, history_flush, NULL)) {
+		log_error("history: can't start the writer thread\n");
+		for (c = 0; c != HISTORY_COLUMNS; ++c) {
+			close(history_fds[c]);
+		}
+		return -1;
+	}
+
+	history_open = 1;
+
+	return 0;
+}
+
+void
+history_close(void)
+{
+	int c;
+
+	if (history_open) {
+		pthread_mutex_lock(&history_lock);
+		history_stop = 1;
+		pthread_cond_broadcast(&history_cond);
+		pthread_mutex_unlock(&history_lock);
+		pthread_join(history_thread, NULL);
+
+		for (c = 0; c != HISTORY_COLUMNS; ++c) {
+			close(history_fds[c]);
+		}
+
+		history_open = 0;
+	}
+}
+
+/*
+ * Queue the finished game, only waits if the writer thread has a whole
+ * batch pending.
+ */
+void
+history_add(const struct game_state *gs)
+{
+	struct history_record *rec;
+
+	if (!history_open) {
+		return;
+	}
+
+	pthread_mutex_lock(&history_lock);
+
+	while (history_queued == HISTORY_BATCH) {
+		pthread_cond_wait(&history_cond, &history_lock);
+	}
+
+	rec = &history_queue[history_queued++];
+	rec->time = time(NULL);
+	rec->duration = (time_ns() - gs->start_time) / 1000000;
+	rec->score = gs->score;
+	rec->lines = gs->lines;
+	rec->level = gs->level;
+	memcpy(rec->mino_count, gs->mino_count, sizeof rec->mino_count);
+	rec->rng = gs->prof.rng_ind;
+	rec->seed = gs->seed;
+	rec->player = history_player_id(scores_player());
+
+	if (history_queued == HISTORY_BATCH) {
+		pthread_cond_broadcast(&history_cond);
+	}
+
+	pthread_mutex_unlock(&history_lock);
+}
@@ -0,0 +1,65 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#define HISTORY_PATH		"e-type.hist"
+#define HISTORY_COLUMNS		15
+#define HISTORY_BATCH		64	/* Records per write */
+#define HISTORY_FLUSH		1	/* Seconds a lone record may wait */
+#define HISTORY_PLAYERS		"players"
+
+/* C library */
+#include <stdint.h>
+#include <stddef.h>
+
+struct game_state;
+
+/*
+ * -==+ Finished game +==-
+ * One row of the history, each field is stored in its own column file.
+ */
+struct history_record {
+	uint64_t time;
+	uint32_t duration;
+	uint32_t score;
+	uint32_t lines;
+	uint32_t level;
+	uint32_t mino_count[7];
+	uint32_t rng;
+	uint32_t seed;
+	uint32_t player;
+};
+
+/* -==+ Column file layout +==- */
+struct history_column {
+	const char *name;
+	size_t offset;
+	size_t size;
+};
+
+extern const struct history_column history_columns[HISTORY_COLUMNS];
+
+int      history_init(const char *dir);
+void     history_close(void);
+void     history_add(const struct game_state *gs);
+uint32_t history_player_id(const char *name);
+
+#endif /* HISTORY_H */
@@ -0,0 +1,372 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Header file */
+#include "input.h"
+/* C library */
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+/* POSIX */
+#include <unistd.h>
+#include <fcntl.h>
+/* e-type */
+#include "tetris.h"
+#include "log.h"
+
+#define ESC		'\033'
+#define MS		1000000ULL
+
+/* Kitty keyboard protocol: disambiguate, report event types, all keys as escapes */
+#define KITTY_QUERY	"\033[?u"
+#define KITTY_PUSH	"\033[>11u"
+#define KITTY_POP	"\033[<u"
+
+/* Kitty event types */
+#define KITTY_PRESS	1
+#define KITTY_REPEAT	2
+#define KITTY_RELEASE	3
+
+/* -==+ Terminal +==- */
+
+/*
+ * Map a key code (ASCII or Unicode code point) to a logical key, and
+ * to the player of a local match it belongs to: the second one has
+ * the arrows, ',' '.' '/' and enter.
+ */
+static int
+input_map(int c, uint8_t *player)
+{
+	*player = 1;
+
+	switch (c) {
+	case ',': return IN_ROTATE_CCW;
+	case '.': return IN_ROTATE_CW;
+	case '/': return IN_HOLD;
+	case '\r': case '\n': return IN_HARD_DROP;
+	}
+
+	*player = 0;
+
+	switch (c < 128 ? tolower(c) : c) {
+	case 'a': return IN_LEFT;
+	case 'd': return IN_RIGHT;
+	case 'w': return IN_UP;
+	case 's': return IN_SOFT_DROP;
+	case ' ': return IN_HARD_DROP;
+	case 'j': return IN_ROTATE_CW;
+	case 'k': return IN_ROTATE_CCW;
+	case 'l': return IN_HOLD;
+	case 'r': return IN_RESPAWN;
+	case 'p': return IN_PAUSE;
+	case 'o': return IN_OVERLAY;
+	case 'h': return IN_HINT;
+	case 'q': return IN_QUIT;
+	}
+
+	return IN_NONE;
+}
+
+/*
+ * Make stdin non-blocking for input_read() and ask the terminal whether
+ * it speaks the kitty keyboard protocol, the answer comes back through
+ * input_decode() which then turns it on.
+ */
+void
+input_start(struct input_decoder *dec, int kitty)
+{
+	memset(dec, 0, sizeof (*dec));
+
+	if ((dec->fl = fcntl(STDIN_FILENO, F_GETFL)) == -1 ||
+	    fcntl(STDIN_FILENO, F_SETFL, dec->fl | O_NONBLOCK) == -1) {
+		log_warn("fcntl: %s\n", strerror(errno));
+	}
+
+	if (kitty && write(STDOUT_FILENO, KITTY_QUERY, sizeof KITTY_QUERY - 1) == -1) {
+		log_warn("Can't query the keyboard protocol\n");
+	}
+}
+
+void
+input_stop(struct input_decoder *dec)
+{
+	if (dec->kitty && write(STDOUT_FILENO, KITTY_POP, sizeof KITTY_POP - 1) == -1) {
+		log_warn("Can't restore the keyboard protocol\n");
+	}
+
+	/* The terminal is shared with the shell, leave it as it was */
+	if (dec->fl != -1) {
+		fcntl(STDIN_FILENO, F_SETFL, dec->fl);
+	}
+
+	dec->kitty = 0;
+	dec->len = 0;
+}
+
+/*
+ * Decode a complete CSI sequence in 'dec->seq', either an arrow key,
+ * a kitty key event or the answer to the kitty query. Returns the
+ * logical key, or IN_NONE.
+ */
+static int
+decode_csi(struct input_decoder *dec, uint8_t *type, uint8_t *player)
+{
+	char final, *p;
+	int code, event;
+
+	dec->seq[dec->len] = '\0';
+	final = dec->seq[dec->len - 1];
+	p = dec->seq + 2;
+
+	if (*p == '?') {
+		if (final == 'u' && !dec->kitty) {
+			dec->kitty = 1;
+			log_info("Terminal supports the kitty keyboard protocol\n");
+
+			if (write(STDOUT_FILENO, KITTY_PUSH, sizeof KITTY_PUSH - 1) == -1) {
+				dec->kitty = 0;
+			}
+		}
+
+		return IN_NONE;
+	}
+
+	/* 'code[:alternates][;modifiers[:event]]' */
+	code = strtol(p, &p, 10);
+	p = strchr(p, ';');
+	event = p && (p = strchr(p, ':')) ? atoi(p + 1) : KITTY_PRESS;
+
+	*type = !dec->kitty ? IN_TYPED :
+		event == KITTY_RELEASE ? IN_RELEASE :
+		event == KITTY_REPEAT ? IN_REPEAT : IN_PRESS;
+
+	/* Arrows are the second player's */
+	*player = 1;
+
+	switch (final) {
+	case 'u': return input_map(code, player);
+	case 'A': return IN_UP;
+	case 'B': return IN_SOFT_DROP;
+	case 'C': return IN_RIGHT;
+	case 'D': return IN_LEFT;
+	}
+
+	return IN_NONE;
+}
+
+/*
+ * Decode 'len' bytes read at 'now' into at most 'max' events, returns
+ * how many were stored. Incomplete escape sequences are kept for the
+ * next call.
+ */
+int
+input_decode(struct input_decoder *dec, const char *buf, int len, uint64_t now,
+	     struct input_event *ev, int max)
+{
+	uint8_t type, player;
+	int i, n, key;
+	char c;
+
+	for (i = n = 0; i != len && n != max; ++i) {
+		c = buf[i];
+		key = IN_NONE;
+		type = IN_TYPED;
+		player = 0;
+
+		if (dec->len == 0) {
+			if (c == ESC) {
+				dec->seq[dec->len++] = c;
+			} else {
+				key = input_map((unsigned char)c, &player);
+			}
+
+		} else if (dec->len == 1) {
+			/* Anything but CSI is taken as alt + key */
+			if (c == '[') {
+				dec->seq[dec->len++] = c;
+			} else {
+				dec->len = 0;
+				key = input_map((unsigned char)c, &player);
+			}
+
+		} else {
+			dec->seq[dec->len++] = c;
+
+			if (c >= 0x40 && c <= 0x7e) {
+				key = decode_csi(dec, &type, &player);
+				dec->len = 0;
+
+			} else if (dec->len == INPUT_SEQ_MAX - 1) {
+				log_debug("Dropped a long escape sequence\n");
+				dec->len = 0;
+			}
+		}
+
+		if (key != IN_NONE) {
+			ev[n].ts = now;
+			ev[n].key = key;
+			ev[n].type = type;
+			ev[n].player = player;
+			++n;
+		}
+	}
+
+	return n;
+}
+
+/*
+ * Everything the terminal has sent since the last call, read until
+ * it runs dry or 'ev' is full. Each byte makes one event at most, so
+ * a read never asks for more than there is room left for. 'ev' must
+ * hold INPUT_EVENTS_MAX events.
+ */
+int
+input_read(struct input_decoder *dec, struct input_event *ev)
+{
+	char buf[INPUT_EVENTS_MAX];
+	ssize_t len;
+	uint64_t now;
+	int n, want;
+
+	now = time_ns();
+	for (n = 0; n != INPUT_EVENTS_MAX; ) {
+		want = INPUT_EVENTS_MAX - n;
+		if ((len = read(STDIN_FILENO, buf, want)) <= 0) {
+			if (len == -1 && errno != EAGAIN) {
+				log_debug("read: %s\n", strerror(errno));
+			}
+			break;
+		}
+
+		n += input_decode(dec, buf, len, now, ev + n, want);
+		if (len < want) {
+			break;
+		}
+	}
+
+	return n;
+}
+
+/* -==+ Auto-shift +==- */
+
+static void
+shift_release(struct game_state *gs, int i, uint64_t now)
+{
+	struct input_shift *s = &gs->shift;
+
+	s->state[i] = SHIFT_UP;
+
+	/* Fall back to the other direction if it's still down */
+	if (s->dir == i && s->state[!i] != SHIFT_UP) {
+		s->dir = !i;
+		s->next = now + gs->prof.das * MS;
+	}
+}
+
+/*
+ * Feed a left or right key event, the first press always moves once
+ * right away and the rest is up to input_update().
+ */
+void
+input_shift(struct game_state *gs, const struct input_event *ev)
+{
+	struct input_shift *s = &gs->shift;
+	int i;
+
+	i = ev->key == IN_RIGHT;
+
+	switch (ev->type) {
+	case IN_RELEASE:
+		shift_release(gs, i, ev->ts);
+		return;
+
+	case IN_REPEAT:
+		/* The engine repeats on its own */
+		s->last[i] = ev->ts;
+		return;
+
+	case IN_TYPED:
+		if (s->state[i] != SHIFT_UP && ev->ts - s->last[i] <= gs->prof.key_timeout * MS) {
+			/* A terminal repeat, its delay already stood in for DAS */
+			if (s->state[i] == SHIFT_TAPPED) {
+				s->state[i] = SHIFT_REPEATING;
+				s->next = ev->ts;
+			}
+
+			s->last[i] = ev->ts;
+			s->dir = i;
+			return;
+		}
+
+		s->state[i] = SHIFT_TAPPED;
+		break;
+
+	case IN_PRESS:
+		s->state[i] = SHIFT_HELD;
+		break;
+	}
+
+	s->last[i] = ev->ts;
+	s->next = ev->ts + gs->prof.das * MS;
+	s->dir = i;
+
+	move_mino(gs, i ? 1 : -1, 0, SOFT_DROP);
+}
+
+/*
+ * Infer releases and apply every automatic shift due by 'now'. Called
+ * once per tick, so that's the only limit on how soon a shift lands.
+ */
+void
+input_update(struct game_state *gs, uint64_t now)
+{
+	struct input_shift *s = &gs->shift;
+	int i, dx;
+
+	for (i = 0; i != 2; ++i) {
+		if ((s->state[i] == SHIFT_TAPPED || s->state[i] == SHIFT_REPEATING) &&
+		    now - s->last[i] > gs->prof.key_timeout * MS) {
+			shift_release(gs, i, now);
+		}
+	}
+
+	if ((s->state[s->dir] != SHIFT_REPEATING && s->state[s->dir] != SHIFT_HELD) || now < s->next) {
+		return;
+	}
+
+	dx = s->dir ? 1 : -1;
+
+	if (gs->prof.arr == 0) {
+		/* Straight to the wall */
+		while (move_mino(gs, dx, 0, SOFT_DROP) == SUCCESS)
+			;
+		s->next = now;
+		return;
+	}
+
+	while (s->next <= now) {
+		s->next += gs->prof.arr * MS;
+
+		if (move_mino(gs, dx, 0, SOFT_DROP) == FAILURE) {
+			s->next = now + gs->prof.arr * MS;
+			break;
+		}
+	}
+}
@@ -0,0 +1,102 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#define INPUT_EVENTS_MAX	256	/* Events per frame, each byte read makes one at most */
+#define INPUT_SEQ_MAX		32	/* Longest escape sequence kept */
+
+/* Defaults, in milliseconds */
+#define INPUT_DAS		167	/* 10 frames at 60 Hz */
+#define INPUT_ARR		33	/* 2 frames, 0 shifts straight to the wall */
+#define INPUT_KEY_TIMEOUT	50	/* Longer than the usual terminal repeat interval */
+
+/* C library */
+#include <stdint.h>
+
+/* Logical keys, after the keymap */
+typedef enum { IN_NONE, IN_LEFT, IN_RIGHT, IN_UP, IN_SOFT_DROP, IN_HARD_DROP, IN_ROTATE_CW,
+	       IN_ROTATE_CCW, IN_HOLD, IN_RESPAWN, IN_PAUSE, IN_OVERLAY, IN_HINT, IN_QUIT, IN_COUNT } input_key;
+
+/*
+ * Event types, IN_TYPED comes from terminals that don't report releases
+ * and can be either a press or the terminal's own repeat.
+ */
+typedef enum { IN_PRESS, IN_REPEAT, IN_RELEASE, IN_TYPED } input_type;
+
+/* Auto-shift key states */
+typedef enum { SHIFT_UP, SHIFT_TAPPED, SHIFT_REPEATING, SHIFT_HELD } shift_state;
+
+/*
+ * -==+ Input event +==-
+ * A key press as seen by the game, stamped with the time_ns() of
+ * the read that delivered it. 'player' only matters to local matches,
+ * everywhere else both key sets play the one game.
+ */
+struct input_event {
+	uint64_t ts;
+	uint8_t key;
+	uint8_t type;
+	uint8_t player;
+};
+
+/*
+ * -==+ Terminal decoder +==-
+ * Turns the raw bytes of the terminal into input events, escape
+ * sequences can be split between calls.
+ */
+struct input_decoder {
+	char seq[INPUT_SEQ_MAX];
+	int len;
+	/* Terminal answered the kitty keyboard query */
+	int kitty;
+	/* stdin file status flags to restore */
+	int fl;
+};
+
+/*
+ * -==+ Auto-shift state +==-
+ * Left and right keys, and when the next automatic shift is due.
+ * Without release events a key counts as held while the terminal keeps
+ * repeating it faster than the key timeout, and the engine only takes
+ * over the repeating once that has been seen (SHIFT_REPEATING). With
+ * the kitty protocol presses and releases are exact (SHIFT_HELD).
+ */
+struct input_shift {
+	uint64_t last[2];
+	uint64_t next;
+	uint8_t state[2];
+	uint8_t dir;
+};
+
+struct game_state;
+
+/* -==+ Terminal +==- */
+void input_start(struct input_decoder *dec, int kitty);
+void input_stop(struct input_decoder *dec);
+int  input_decode(struct input_decoder *dec, const char *buf, int len, uint64_t now,
+		  struct input_event *ev, int max);
+int  input_read(struct input_decoder *dec, struct input_event *ev);
+
+/* -==+ Auto-shift +==- */
+void input_shift(struct game_state *gs, const struct input_event *ev);
+void input_update(struct game_state *gs, uint64_t now);
+
+#endif /* INPUT_H */
@@ -0,0 +1,213 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Header file */
+#include "live.h"
+/* C library */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+/* POSIX */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+/* e-type */
+#include "log.h"
+
+static struct live_header *live_hdr = NULL;
+static char live_name_buf[64];
+
+/* The segment game 'pid' publishes to under 'name' */
+void
+live_name(char *buf, size_t size, const char *name, pid_t pid)
+{
+	snprintf(buf, size, "%s.%ld", name, (long)pid);
+}
+
+/*
+ * Create the segment for this game, named after its pid so games
+ * running side by side don't share one. One left behind by a crashed
+ * game that had the same pid is replaced.
+ */
+int
+live_init(const char *name)
+{
+	void *mem;
+	int fd;
+
+	live_name(live_name_buf, sizeof live_name_buf, name, getpid());
+	name = live_name_buf;
+
+	if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644)) == -1 && errno == EEXIST) {
+		shm_unlink(name);
+		fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	}
+	if (fd == -1) {
+		log_warn("shm_open %s: %s\n", name, strerror(errno));
+		return -1;
+	}
+
+	if (ftruncate(fd, sizeof (struct live_header)) == -1) {
+		log_warn("ftruncate %s: %s\n", name, strerror(errno));
+		close(fd);
+		shm_unlink(name);
+		return -1;
+	}
+
+	mem = mmap(NULL, sizeof (struct live_header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (mem == MAP_FAILED) {
+		log_warn("mmap %s: %s\n", name, strerror(errno));
+		shm_unlink(name);
+		return -1;
+	}
+
+	live_hdr = mem;
+	live_hdr->size = sizeof (struct live_state);
+	memcpy(live_hdr->magic, LIVE_MAGIC, sizeof live_hdr->magic);
+
+	return 0;
+}
+
+/*
+ * Write what the frame showed straight into the segment between the
+ * two 'seq' stores. Called only on frames that drew something.
+ */
+void
+live_publish(struct game_state *gs)
+{
+	struct live_state *st;
+	uint32_t seq;
+	int i, y;
+
+	if (live_hdr == NULL) {
+		return;
+	}
+
+	st = &live_hdr->state;
+	seq = live_hdr->seq;
+	__atomic_store_n(&live_hdr->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	++st->frame;
+	st->time = time_ns();
+	st->board_w = gs->board_w;
+	st->board_h = gs->board_h;
+	st->flags = !!(gs->flags & BIT(QUIT)) << LIVE_FOVER | !!(gs->flags & BIT(PAUSE)) << LIVE_FPAUSE;
+
+	if (gs->big) {
+		st->flags |= BIT(LIVE_FBIG);
+
+	} else {
+		for (y = 0; y != gs->board_h; ++y) {
+			memcpy(st->board[y], gs->board[y], gs->board_w);
+		}
+	}
+
+	st->pos = gs->curr_mino_pos;
+	memcpy(st->blocks, gs->curr_mino.block_pos, sizeof st->blocks);
+	st->ghost_y = gs->ghost_pos;
+	st->mino = gs->curr_mino.id;
+	st->hold = gs->hold_mino ? gs->hold_mino->id : LIVE_NONE;
+
+	st->preview = gs->prof.preview;
+	for (i = 0; i != PREVIEW_MAX; ++i) {
+		st->next[i] = i < gs->prof.preview ? queue_peek(&gs->queue, i) : LIVE_NONE;
+	}
+
+	st->level = gs->level;
+	st->score = gs->score;
+	st->lines = gs->lines;
+
+	__atomic_store_n(&live_hdr->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/*
+ * Only the segment live_init() created goes away, readers that still
+ * have it mapped keep their copy.
+ */
+void
+live_close(void)
+{
+	if (live_hdr) {
+		munmap(live_hdr, sizeof (struct live_header));
+		shm_unlink(live_name_buf);
+		live_hdr = NULL;
+	}
+}
+
+/*
+ * Map a game's segment read only, NULL if there's no game or it was
+ * published by an incompatible version.
+ */
+const struct live_header *
+live_open(const char *name)
+{
+	struct live_header *hdr;
+	void *mem;
+	int fd;
+
+	if ((fd = shm_open(name, O_RDONLY, 0)) == -1) {
+		return NULL;
+	}
+
+	mem = mmap(NULL, sizeof (struct live_header), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (mem == MAP_FAILED) {
+		return NULL;
+	}
+
+	hdr = mem;
+	if (memcmp(hdr->magic, LIVE_MAGIC, sizeof hdr->magic) || hdr->size != sizeof (struct live_state)) {
+		munmap(mem, sizeof (struct live_header));
+		return NULL;
+	}
+
+	return hdr;
+}
+
+/*
+ * Copy the last published frame into 'st' without a single system
+ * call, retrying while the game is halfway through writing it.
+ * Returns how many tries it took, -1 when 'seq' stayed odd for
+ * LIVE_TRIES of them: the game died while writing, the segment is
+ * stale.
+ */
+int
+live_read(const struct live_header *hdr, struct live_state *st)
+{
+	uint32_t before, after;
+	int tries;
+
+	tries = 0;
+	do {
+		if (++tries > LIVE_TRIES) {
+			return -1;
+		}
+		before = __atomic_load_n(&hdr->seq, __ATOMIC_ACQUIRE);
+		memcpy(st, &hdr->state, sizeof (*st));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		after = __atomic_load_n(&hdr->seq, __ATOMIC_RELAXED);
+	} while ((before & 1) || before != after);
+
+	return tries;
+}
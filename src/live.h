@@ -0,0 +1,87 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LIVE_H
+#define LIVE_H
+
+#define LIVE_NAME	"/e-type-live"	/* POSIX shared memory objects, one per game as NAME.pid */
+#define LIVE_MAGIC	"ELIVE01"
+#define LIVE_NONE	0xff		/* No piece in that slot */
+#define LIVE_TRIES	100000		/* Reads of an odd 'seq' before the game is taken for dead */
+
+/* Live game flags */
+#define LIVE_FOVER	0
+#define LIVE_FPAUSE	1
+#define LIVE_FBIG	2	/* Large board, only its size is exported */
+
+/* C library */
+#include <stddef.h>
+#include <stdint.h>
+/* POSIX */
+#include <sys/types.h>
+
+/* e-type */
+#include "queue.h"
+#include "tetris.h"
+
+/*
+ * -==+ Published game +==-
+ * What a frame showed, cells as in 'board' of struct game_state.
+ * 'frame' counts publications, so readers can tell a new one apart.
+ */
+struct live_state {
+	uint64_t frame;
+	uint64_t time;
+	uint16_t board_w, board_h;
+	uint8_t board[BOARD_MAX_H][BOARD_MAX_W];
+	struct point pos;
+	struct point blocks[4];
+	int16_t ghost_y;
+	uint8_t mino, hold;
+	uint8_t preview;
+	uint8_t next[PREVIEW_MAX];
+	uint8_t level, flags;
+	uint32_t score, lines;
+};
+
+/*
+ * -==+ Segment layout +==-
+ * 'seq' is the seqlock: odd while the game is writing 'state'. A
+ * reader copies 'state' and keeps it only if 'seq' was the same even
+ * number before and after, the game never waits for anybody.
+ */
+struct live_header {
+	char magic[8];
+	uint32_t size;
+	uint32_t seq;
+	struct live_state state;
+};
+
+void live_name(char *buf, size_t size, const char *name, pid_t pid);
+
+/* -==+ Game side +==- */
+int  live_init(const char *name);
+void live_publish(struct game_state *gs);
+void live_close(void);
+
+/* -==+ Reader side +==- */
+const struct live_header *live_open(const char *name);
+int  live_read(const struct live_header *hdr, struct live_state *st);
+
+#endif /* LIVE_H */
@@ -22,31 +22,196 @@
 /* C library */
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+#include <time.h>
+/* POSIX */
+#include <pthread.h>
+
+#define RING_MASK	(LOG_RING_SIZE - 1)
+
+/*
+ * -==+ Log record +==-
+ * One slot of the ring buffer. 'seq' tells who owns the slot: it equals
+ * the slot's position when free, position + 1 once the message is ready.
+ */
+struct log_record {
+	unsigned long seq;
+	int len;
+	char msg[LOG_RECORD_SIZE];
+};
+
+const char *log_level_names[4] = { "error", "warn", "info", "debug" };
+
+int log_level = LOG_LEVEL_MAX;
 
 FILE *fp_log = NULL;
 
+struct log_record log_ring[LOG_RING_SIZE];
+unsigned long log_head;	/* Next slot to be claimed by a writer */
+unsigned long log_tail;	/* Next slot to be flushed */
+unsigned long log_dropped;
+
+pthread_t log_thread;
+int log_stop;
+
+/*
+ * Write every ready record to disk, returns the number of records written.
+ */
+int
+log_drain(void)
+{
+	struct log_record *rec;
+	unsigned long dropped;
+	int cnt;
+
+	for (cnt = 0; ; ++cnt, ++log_tail) {
+		rec = &log_ring[log_tail & RING_MASK];
+		if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != log_tail + 1) {
+			break;
+		}
+
+		fwrite(rec->msg, 1, rec->len, fp_log);
+		__atomic_store_n(&rec->seq, log_tail + LOG_RING_SIZE, __ATOMIC_RELEASE);
+	}
+
+	if ((dropped = __atomic_exchange_n(&log_dropped, 0, __ATOMIC_RELAXED))) {
+		fprintf(fp_log, "[warn] %lu log records dropped\n", dropped);
+	}
+
+	return cnt;
+}
+
+/*
+ * Background thread, the only one that ever touches 'fp_log'.
+ */
+void *
+log_flush(void *arg)
+{
+	struct timespec ts = { 0, LOG_FLUSH_INTERVAL * 1000000L };
+
+	while (!__atomic_load_n(&log_stop, __ATOMIC_ACQUIRE)) {
+		if (log_drain()) {
+			fflush(fp_log);
+		}
+
+		nanosleep(&ts, NULL);
+	}
+
+	log_drain();
+	fflush(fp_log);
+
+	return NULL;
+}
+
 int
 log_init(const char *log_path)
 {
+	int i;
+
 	if (fp_log == NULL) {
 		fp_log = fopen(log_path, "w");
 		if (fp_log == NULL) {
 			perror("fopen");
 			return -1;
 		}
+
+		for (i = 0; i != LOG_RING_SIZE; ++i) {
+			log_ring[i].seq = i;
+		}
+
+		if (pthread_create(&log_thread, NULL, log_flush, NULL)) {
+			perror("pthread_create");
+			fclose(fp_log);
+			fp_log = NULL;
+			return -1;
+		}
+
 		return 1;
 	}
 
 	return 0;
 }
 
+/*
+ * Stop the writer thread after it flushed every pending record.
+ */
+void
+log_close(void)
+{
+	if (fp_log) {
+		__atomic_store_n(&log_stop, 1, __ATOMIC_RELEASE);
+		pthread_join(log_thread, NULL);
+
+		fclose(fp_log);
+		fp_log = NULL;
+	}
+}
+
+/*
+ * Returns the level named by the first 'len' characters of 'str' or -1.
+ */
+int
+log_parse_level(const char *str, int len)
+{
+	int i;
+
+	for (i = 0; i != 4; ++i) {
+		if ((int)strlen(log_level_names[i]) == len && strncmp(str, log_level_names[i], len) == 0) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * Formats the message straight into a free ring slot. Never blocks: if
+ * the writer thread fell behind the record is dropped and counted.
+ */
 void
-log_write(const char *format, ...)
+log_write(int level, const char *format, ...)
 {
+	struct log_record *rec;
+	unsigned long pos, seq;
 	va_list ap;
+	int len;
+
+	if (fp_log == NULL) {
+		return;
+	}
+
+	pos = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+	for (;;) {
+		rec = &log_ring[pos & RING_MASK];
+		seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+
+		if (seq == pos) {
+			if (__atomic_compare_exchange_n(&log_head, &pos, pos + 1, 1,
+							__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+
+		} else if ((long)(seq - pos) < 0) {
+			__atomic_add_fetch(&log_dropped, 1, __ATOMIC_RELAXED);
+			return;
+
+		} else {
+			pos = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+		}
+	}
+
+	len = snprintf(rec->msg, LOG_RECORD_SIZE, "[%s] ", log_level_names[level]);
 
 	va_start(ap, format);
-	vfprintf(fp_log, format, ap);
+	len += vsnprintf(rec->msg + len, LOG_RECORD_SIZE - len, format, ap);
 	va_end(ap);
-}
 
+	/* Truncated messages keep their line break */
+	if (len >= LOG_RECORD_SIZE) {
+		len = LOG_RECORD_SIZE - 1;
+		rec->msg[len - 1] = '\n';
+	}
+
+	rec->len = len;
+	__atomic_store_n(&rec->seq, pos + 1, __ATOMIC_RELEASE);
+}
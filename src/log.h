@@ -20,8 +20,43 @@
 #ifndef LOG_H
 #define LOG_H
 
+/* Log levels */
+#define LOG_ERROR		0
+#define LOG_WARN		1
+#define LOG_INFO		2
+#define LOG_DEBUG		3
+
+/* Levels above this one are compiled out, override with -DLOG_LEVEL_MAX=n */
+#ifndef LOG_LEVEL_MAX
+#define LOG_LEVEL_MAX		LOG_INFO
+#endif
+
+/* Ring buffer between the game and the writer thread */
+#define LOG_RING_SIZE		256	/* Must be a power of 2 */
+#define LOG_RECORD_SIZE		128
+#define LOG_FLUSH_INTERVAL	10	/* Milliseconds */
+
+/* Runtime log level, records above it are never formatted */
+extern int log_level;
+
+/*
+ * Use these instead of calling log_write() directly, disabled levels
+ * don't even evaluate their arguments.
+ */
+#define log_at(level, ...)	do {							\
+					if ((level) <= LOG_LEVEL_MAX && (level) <= log_level) {	\
+						log_write((level), __VA_ARGS__);		\
+					}							\
+				} while (0)
+
+#define log_error(...)		log_at(LOG_ERROR, __VA_ARGS__)
+#define log_warn(...)		log_at(LOG_WARN, __VA_ARGS__)
+#define log_info(...)		log_at(LOG_INFO, __VA_ARGS__)
+#define log_debug(...)		log_at(LOG_DEBUG, __VA_ARGS__)
+
 int  log_init(const char *log_path);
-void log_write(const char *format, ...);
+void log_close(void);
+int  log_parse_level(const char *str, int len);
+void log_write(int level, const char *format, ...);
 
 #endif /* LOG_H */
-
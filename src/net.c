@@ -0,0 +1,282 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Header file */
+#include "net.h"
+/* C library */
+#include <string.h>
+
+static void
+put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static uint32_t
+get32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+int
+net_hello(uint8_t *buf, uint32_t match)
+{
+	memcpy(buf, NET_MAGIC, 4);
+	put32(buf + 4, match);
+
+	return NET_HELLO_SIZE;
+}
+
+/*
+ * -1 if 'buf' isn't a hello at all.
+ */
+int
+net_parse_hello(const uint8_t *buf, uint32_t *match)
+{
+	if (memcmp(buf, NET_MAGIC, 4)) {
+		return -1;
+	}
+
+	*match = get32(buf + 4);
+
+	return 0;
+}
+
+int
+net_msg(uint8_t *buf, int type, const uint8_t *payload, int len)
+{
+	buf[0] = type;
+	buf[1] = len;
+	memcpy(buf + NET_HEADER, payload, len);
+
+	return NET_HEADER + len;
+}
+
+/*
+ * Whole NET_BOARD message for 'gs', two cells per byte. Blocks are
+ * packed as nibbles offset by 2, they never reach further.
+ */
+int
+net_pack_board(uint8_t *buf, const struct game_state *gs, int player)
+{
+	uint8_t *p;
+	int i, x, y;
+
+	buf[0] = NET_BOARD;
+	buf[1] = NET_BOARD_SIZE;
+	p = buf + NET_HEADER;
+
+	p[0] = player;
+	p[1] = !!(gs->flags & BIT(QUIT));
+	p[2] = gs->curr_mino.id;
+	p[3] = gs->curr_mino_pos.x;
+	p[4] = gs->curr_mino_pos.y;
+	for (i = 0; i != 4; ++i) {
+		p[5 + i] = (gs->curr_mino.block_pos[i].x + 2) | (gs->curr_mino.block_pos[i].y + 2) << 4;
+	}
+	put32(p + 9, gs->score);
+	put32(p + 13, gs->lines);
+
+	for (y = 0; y != BOARD_H; ++y) {
+		for (x = 0; x != BOARD_W; x += 2) {
+			p[17 + (y * BOARD_W + x) / 2] = gs->board[y][x] | gs->board[y][x + 1] << 4;
+		}
+	}
+
+	return NET_HEADER + NET_BOARD_SIZE;
+}
+
+/*
+ * -1 if 'payload' is too short to be a board.
+ */
+int
+net_unpack_board(struct net_board *nb, const uint8_t *payload, int len)
+{
+	const uint8_t *p;
+	int i, x, y;
+
+	if (len < NET_BOARD_SIZE) {
+		return -1;
+	}
+
+	p = payload;
+	nb->player = p[0];
+	nb->over = p[1];
+	nb->mino = p[2] % 7;
+	nb->pos.x = (int8_t)p[3];
+	nb->pos.y = (int8_t)p[4];
+	for (i = 0; i != 4; ++i) {
+		nb->blocks[i].x = (p[5 + i] & 0xf) - 2;
+		nb->blocks[i].y = (p[5 + i] >> 4) - 2;
+	}
+	nb->score = get32(p + 9);
+	nb->lines = get32(p + 13);
+
+	for (y = 0; y != BOARD_H; ++y) {
+		for (x = 0; x != BOARD_W; x += 2) {
+			nb->board[y][x] = p[17 + (y * BOARD_W + x) / 2] & 0x7;
+			nb->board[y][x + 1] = p[17 + (y * BOARD_W + x) / 2] >> 4 & 0x7;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Whole NET_START message, 'udp' is the port offset or NET_NO_UDP.
+ */
+int
+net_pack_start(uint8_t *buf, int player, uint32_t seed, int udp, uint32_t token)
+{
+	uint8_t *p;
+
+	buf[0] = NET_START;
+	buf[1] = NET_START_SIZE;
+	p = buf + NET_HEADER;
+
+	p[0] = player;
+	put32(p + 1, seed);
+	p[5] = udp;
+	put32(p + 6, token);
+
+	return NET_HEADER + NET_START_SIZE;
+}
+
+/* -==+ UDP +==- */
+
+/*
+ * -1 when the window is full, the server has been silent for a
+ * while and the key is dropped.
+ */
+int
+net_inputs_push(struct net_inputs *w, uint8_t key)
+{
+	if (w->next - w->acked == NET_INPUT_WINDOW) {
+		return -1;
+	}
+
+	w->keys[w->next++ & (NET_INPUT_WINDOW - 1)] = key;
+
+	return 0;
+}
+
+/* Acknowledgements come out of order too, old ones change nothing */
+void
+net_inputs_ack(struct net_inputs *w, uint32_t ack)
+{
+	if ((int32_t)(ack - w->acked) > 0 && (int32_t)(ack - w->next) <= 0) {
+		w->acked = ack;
+	}
+}
+
+/*
+ * Datagram with every key in flight, none at all makes it a probe.
+ */
+int
+net_pack_inputs(uint8_t *buf, const struct net_inputs *w, uint32_t match, int player, uint32_t token)
+{
+	uint32_t i;
+
+	buf[0] = NET_UDP_INPUTS;
+	put32(buf + 1, match);
+	buf[5] = player;
+	put32(buf + 6, token);
+	put32(buf + 10, w->acked);
+	buf[14] = w->next - w->acked;
+
+	for (i = w->acked; i != w->next; ++i) {
+		buf[NET_INPUT_HEADER + i - w->acked] = w->keys[i & (NET_INPUT_WINDOW - 1)];
+	}
+
+	return NET_INPUT_HEADER + buf[14];
+}
+
+/*
+ * -1 if 'buf' isn't a whole inputs datagram.
+ */
+int
+net_unpack_inputs(struct net_inputs_msg *im, const uint8_t *buf, int len)
+{
+	if (len < NET_INPUT_HEADER || buf[0] != NET_UDP_INPUTS || len < NET_INPUT_HEADER + buf[14]) {
+		return -1;
+	}
+
+	im->match = get32(buf + 1);
+	im->player = buf[5];
+	im->token = get32(buf + 6);
+	im->first = get32(buf + 10);
+	im->count = buf[14];
+	im->keys = buf + NET_INPUT_HEADER;
+
+	return 0;
+}
+
+/*
+ * Receiver side: index of the first key in 'im' not seen before,
+ * 'next' moves past the datagram. Keys older than the window that
+ * never arrived are skipped.
+ */
+int
+net_inputs_new(uint32_t *next, const struct net_inputs_msg *im)
+{
+	uint32_t end;
+	int skip;
+
+	end = im->first + im->count;
+	if ((int32_t)(end - *next) <= 0) {
+		return im->count;
+	}
+
+	skip = (int32_t)(*next - im->first) > 0 ? (int)(*next - im->first) : 0;
+	*next = end;
+
+	return skip;
+}
+
+int
+net_pack_udp_board(uint8_t *buf, uint32_t seq, uint32_t ack, const uint8_t *msg, int len)
+{
+	buf[0] = NET_UDP_BOARD;
+	put32(buf + 1, seq);
+	put32(buf + 5, ack);
+	memcpy(buf + NET_UDP_HEADER, msg, len);
+
+	return NET_UDP_HEADER + len;
+}
+
+/*
+ * -1 if 'buf' isn't a board datagram, the offset of its message
+ * otherwise.
+ */
+int
+net_unpack_udp_board(const uint8_t *buf, int len, uint32_t *seq, uint32_t *ack)
+{
+	if (len < NET_UDP_HEADER + NET_HEADER || buf[0] != NET_UDP_BOARD
+	 || len < NET_UDP_HEADER + NET_HEADER + buf[NET_UDP_HEADER + 1]) {
+		return -1;
+	}
+
+	*seq = get32(buf + 1);
+	*ack = get32(buf + 5);
+
+	return NET_UDP_HEADER;
+}
@@ -0,0 +1,126 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef NET_H
+#define NET_H
+
+#define NET_PORT	"1234"
+#define NET_MAGIC	"ETM1"
+#define NET_HELLO_SIZE	8
+#define NET_HEADER	2	/* Type and payload length */
+#define NET_MSG_MAX	(NET_HEADER + 255)
+#define NET_BOARD_SIZE	(17 + BOARD_W * BOARD_H / 2)
+#define NET_START_SIZE	10
+#define NET_NO_UDP	0xff	/* Port offset of a server without UDP */
+#define NET_INPUT_WINDOW	32	/* Unacknowledged keys a client may have, power of 2 */
+#define NET_INPUT_HEADER	15
+#define NET_UDP_HEADER	9	/* Type, sequence and acknowledgement of a board datagram */
+#define NET_UDP_MAX	(NET_INPUT_HEADER + NET_INPUT_WINDOW > NET_UDP_HEADER + NET_MSG_MAX ? \
+			 NET_INPUT_HEADER + NET_INPUT_WINDOW : NET_UDP_HEADER + NET_MSG_MAX)
+#define NET_RESEND_NS	20000000	/* Unacknowledged keys go out again this often */
+
+/* C library */
+#include <stdint.h>
+
+/* e-type */
+#include "tetris.h"
+
+/*
+ * -==+ Match protocol +==-
+ * The client opens with a hello, NET_MAGIC and the big endian match
+ * id, then sends logical keys (see input.h) one byte each. The server
+ * answers with messages of a type byte, a payload length byte and the
+ * payload. Both players of a match get every message.
+ */
+typedef enum { NET_WAIT,	/* [player], waiting for the opponent */
+	       NET_START,	/* [player][seed, 4][UDP port offset][token, 4] */
+	       NET_BOARD,	/* see net_pack_board() */
+	       NET_OVER		/* [winner], NET_NO_WINNER when nobody won */
+	     } net_type;
+
+#define NET_NO_WINNER	0xff
+
+/*
+ * -==+ UDP inputs +==-
+ * Once a match starts keys can go over UDP instead, to the port of
+ * the TCP connection plus the offset from NET_START. Every key gets
+ * a sequence number and each datagram carries all the keys the
+ * server hasn't acknowledged yet, up to NET_INPUT_WINDOW of them, so
+ * a lost datagram is covered by the next one instead of waiting for
+ * a retransmission. The server acknowledges in the boards it sends
+ * back over UDP anyway, which also skip the TCP stream. Datagrams
+ * without keys are probes, the answer proves UDP works; until then
+ * keys stay on TCP.
+ */
+typedef enum { NET_UDP_INPUTS = 0x80,	/* [match, 4][player][token, 4][first, 4][count][keys] */
+	       NET_UDP_BOARD		/* [sequence, 4][next key expected, 4][NET_BOARD message] */
+	     } net_udp_type;
+
+/* Keys of one datagram, 'keys' points into it */
+struct net_inputs_msg {
+	uint32_t match;
+	uint8_t player;
+	uint32_t token;
+	uint32_t first;
+	uint8_t count;
+	const uint8_t *keys;
+};
+
+/*
+ * -==+ Key window +==-
+ * Sender side: keys from 'acked' up to 'next' are in flight.
+ */
+struct net_inputs {
+	uint32_t next, acked;
+	uint8_t keys[NET_INPUT_WINDOW];
+};
+
+/*
+ * -==+ Board update +==-
+ * A player's standard board and the tetromino in play, colors as in
+ * 'board' of struct game_state.
+ */
+struct net_board {
+	uint8_t player;
+	uint8_t over;
+	uint8_t mino;
+	struct point pos;
+	struct point blocks[4];
+	uint32_t score, lines;
+	uint8_t board[BOARD_H][BOARD_W];
+};
+
+/* -==+ Encoding +==- */
+int  net_hello(uint8_t *buf, uint32_t match);
+int  net_parse_hello(const uint8_t *buf, uint32_t *match);
+int  net_msg(uint8_t *buf, int type, const uint8_t *payload, int len);
+int  net_pack_board(uint8_t *buf, const struct game_state *gs, int player);
+int  net_unpack_board(struct net_board *nb, const uint8_t *payload, int len);
+int  net_pack_start(uint8_t *buf, int player, uint32_t seed, int udp, uint32_t token);
+
+/* -==+ UDP +==- */
+int  net_inputs_push(struct net_inputs *w, uint8_t key);
+void net_inputs_ack(struct net_inputs *w, uint32_t ack);
+int  net_pack_inputs(uint8_t *buf, const struct net_inputs *w, uint32_t match, int player, uint32_t token);
+int  net_unpack_inputs(struct net_inputs_msg *im, const uint8_t *buf, int len);
+int  net_inputs_new(uint32_t *next, const struct net_inputs_msg *im);
+int  net_pack_udp_board(uint8_t *buf, uint32_t seq, uint32_t ack, const uint8_t *msg, int len);
+int  net_unpack_udp_board(const uint8_t *buf, int len, uint32_t *seq, uint32_t *ack);
+
+#endif /* NET_H */
@@ -0,0 +1,880 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Header file */
+#include "pcsolve.h"
+/* C library */
+#include <stdlib.h>
+#include <string.h>
+/* POSIX */
+#include <pthread.h>
+/* e-type */
+#include "arena.h"
+#include "batch.h"
+#include "log.h"
+
+#define AIR		4	/* Free rows above the field, enough to turn anything */
+#define PAD		2	/* Rows above those, rotations can poke into them */
+#define FLOOR		4
+#define WIN_ROWS	(PAD + AIR + PC_MAX_H + FLOOR)
+#define CELLS		((1u << BOARD_W) - 1)
+#define ROW_WALL	(~(CELLS << 4))
+#define MAX_PLACEMENTS	256
+#define MEMO_BITS	18
+
+/*
+ * -==+ Field +==-
+ * What's left of the perfect clear, bottom row first. 'h' shrinks as
+ * rows are cleared, the clear is done when it reaches 0.
+ */
+struct pc_board {
+	uint16_t rows[PC_MAX_H];
+	int h;
+};
+
+/* -==+ Failed positions, per thread +==- */
+struct pc_memo_entry {
+	uint64_t board;
+	uint32_t aux;
+	uint32_t gen;
+};
+
+/*
+ * A thread's table for its whole life, entries of an older search
+ * have an older 'gen' and count as free.
+ */
+struct pc_memo {
+	uint32_t gen;
+	struct pc_memo_entry e[1u << MEMO_BITS];
+};
+
+/*
+ * -==+ Search state +==-
+ * One per thread, they only share the problem and the 'found' and
+ * 'expired' flags. 'deadline' is the time_ns() to give up at, 0 for
+ * never.
+ */
+struct pc_search {
+	const struct pc_problem *p;
+	struct pc_memo *memo;
+	int memo_used;
+	int *found, *expired;
+	uint64_t deadline;
+	struct pc_move path[PC_MAX_PIECES];
+	int depth;
+	uint64_t nodes;
+};
+
+/*
+ * -==+ First level of the search +==-
+ * Subtrees handed out to the threads.
+ */
+struct pc_root {
+	struct pc_board board;
+	struct pc_move move;
+	int i, hold;
+};
+
+/* Shared by the threads of one pc_solve() */
+struct pc_shared {
+	const struct pc_problem *p;
+	struct pc_root *roots;
+	int count;
+	int next;
+	int found, expired;
+	uint64_t deadline;
+	int threads;
+	struct pc_result *r;
+	uint64_t nodes;
+};
+
+/*
+ * -==+ Solver threads +==-
+ * Started once with their memo, they sleep until solve_height() bumps
+ * 'round' and the first 'threads' of them take the job. 'memo[0]'
+ * belongs to the thread calling pc_solve().
+ */
+static struct {
+	pthread_mutex_t solve;
+	pthread_mutex_t lock;
+	pthread_cond_t go, done;
+	struct arena arena;
+	struct pool memos;
+	struct pc_memo *memo[PC_MAX_THREADS];
+	int threads;
+	struct pc_shared *job;
+	uint32_t round;
+	int busy;
+} pc = {
+	.solve = PTHREAD_MUTEX_INITIALIZER,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.go = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER
+};
+
+/* -==+ Placements +==- */
+
+static inline int
+fits(const uint32_t *w, int s, int x, int y)
+{
+	uint32_t hit;
+	int r;
+
+	hit = 0;
+	for (r = 0; r != 4; ++r) {
+		hit |= w[y + batch_top[s] + r] & (batch_shape[s][r] << (x + 2));
+	}
+
+	return !hit;
+}
+
+static uint64_t
+board_key(const struct pc_board *b)
+{
+	uint64_t k;
+	int i;
+
+	k = (uint64_t)b->h << 60;
+	for (i = 0; i != b->h; ++i) {
+		k |= (uint64_t)b->rows[i] << (i * BOARD_W);
+	}
+
+	return k;
+}
+
+/*
+ * Every distinct board 'id' can leave behind when dropped on 'b',
+ * reached with the moves of the game (no kicks) and without any block
+ * above the field.
+ */
+static int
+placements(const struct pc_board *b, int id, struct pc_board *out, struct pc_move *moves)
+{
+	uint32_t buf[WIN_ROWS], *w;
+	uint8_t seen[4][BOARD_W + 2][AIR + PC_MAX_H + PAD + FLOOR];
+	struct { int8_t s, x, y; } queue[4 * (BOARD_W + 2) * (AIR + PC_MAX_H + PAD + FLOOR)], c, t;
+	uint64_t keys[MAX_PLACEMENTS];
+	struct pc_board nb;
+	int head, tail, n, i, r, y, full, k, s;
+
+	w = buf + PAD;
+	for (r = -PAD; r != AIR; ++r) {
+		w[r] = ROW_WALL;
+	}
+	for (r = 0; r != b->h; ++r) {
+		w[AIR + r] = ROW_WALL | (uint32_t)b->rows[b->h - 1 - r] << 4;
+	}
+	for (r = AIR + b->h; r != AIR + b->h + FLOOR; ++r) {
+		w[r] = ~0u;
+	}
+
+	memset(seen, 0, sizeof seen);
+	head = tail = n = 0;
+
+	/* Up in the air every rotation and column can be reached */
+	s = id * 4;
+	do {
+		for (c.x = -1; c.x <= BOARD_W; ++c.x) {
+			c.s = s;
+			c.y = -batch_top[s];
+
+			if (fits(w, c.s, c.x, c.y) && !seen[s - id * 4][c.x + 1][c.y + PAD]) {
+				seen[s - id * 4][c.x + 1][c.y + PAD] = 1;
+				queue[tail++] = c;
+			}
+		}
+
+		s = batch_cw[s];
+	} while (s != id * 4);
+
+	while (head != tail) {
+		c = queue[head++];
+
+		/* Neighbours: left, right, down and both rotations */
+		for (k = 0; k != 5; ++k) {
+			t = c;
+			switch (k) {
+			case 0: --t.x; break;
+			case 1: ++t.x; break;
+			case 2: ++t.y; break;
+			case 3: t.s = batch_cw[c.s]; break;
+			case 4: t.s = batch_ccw[c.s]; break;
+			}
+
+			if (t.x < -1 || t.x > BOARD_W || t.y + batch_top[t.s] < -PAD) {
+				continue;
+			}
+
+			if (!seen[t.s - id * 4][t.x + 1][t.y + PAD] && fits(w, t.s, t.x, t.y)) {
+				seen[t.s - id * 4][t.x + 1][t.y + PAD] = 1;
+				queue[tail++] = t;
+			}
+		}
+
+		/* Locks here, and inside the field? */
+		if (fits(w, c.s, c.x, c.y + 1) || c.y + batch_top[c.s] < AIR) {
+			continue;
+		}
+
+		/* Lock, then clear the full rows */
+		nb.h = 0;
+		full = 0;
+		for (r = b->h - 1; r >= 0; --r) {
+			y = AIR + b->h - 1 - r;
+			i = y - c.y - batch_top[c.s];
+			nb.rows[nb.h] = b->rows[r];
+
+			if (i >= 0 && i < 4) {
+				nb.rows[nb.h] |= (batch_shape[c.s][i] << (c.x + 2)) >> 4;
+			}
+
+			if (nb.rows[nb.h] == CELLS) {
+				++full;
+			} else {
+				++nb.h;
+			}
+		}
+
+		/* Rows were collected top down */
+		for (i = 0; i != nb.h / 2; ++i) {
+			r = nb.rows[i];
+			nb.rows[i] = nb.rows[nb.h - 1 - i];
+			nb.rows[nb.h - 1 - i] = r;
+		}
+
+		keys[n] = board_key(&nb);
+		for (i = 0; i != n && keys[i] != keys[n]; ++i)
+			;
+
+		if (i == n && n != MAX_PLACEMENTS) {
+			out[n] = nb;
+			moves[n].id = id;
+			moves[n].state = c.s;
+			moves[n].x = c.x;
+			moves[n].y = c.y + BOARD_H - b->h - AIR;
+			moves[n].hold = 0;
+			++n;
+		}
+	}
+
+	return n;
+}
+
+/* -==+ Pruning +==- */
+
+/*
+ * Empty cells of each column, bit 'y' for row 'y' of the field.
+ */
+static void
+columns(const struct pc_board *b, uint16_t *col)
+{
+	int x, y;
+
+	for (x = 0; x != BOARD_W; ++x) {
+		col[x] = 0;
+		for (y = 0; y != b->h; ++y) {
+			col[x] |= !(b->rows[y] & 1u << x) << y;
+		}
+	}
+}
+
+/*
+ * Holes are filled by whole tetrominos, but rows clear under them, so
+ * two empty cells of the same column might still end up touching.
+ * Treat each column as connected and join neighbours sharing an empty
+ * row: every such region still needs a multiple of 4 cells.
+ */
+static int
+regions_ok(const uint16_t *col)
+{
+	int x, size;
+
+	size = 0;
+	for (x = 0; x != BOARD_W; ++x) {
+		size += __builtin_popcount(col[x]);
+
+		if (x == BOARD_W - 1 || !(col[x] & col[x + 1])) {
+			if (size % 4) {
+				return 0;
+			}
+			size = 0;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * Colour the columns black and white. L and J always cover 3 of one
+ * and 1 of the other, T covers 2/2 flat or 3/1 standing, I 2/2 or 4/0,
+ * the rest 2/2. Clears remove whole rows, so the imbalance 'd' of the
+ * empty cells must be paid exactly by the pieces used.
+ */
+static int
+parity_ok(int d, const int *n)
+{
+	int lj, t, i;
+
+	lj = n[1] + n[2];
+	t = n[6];
+	i = n[0];
+	d = abs(d) / 2;
+
+	if (d > lj + t + 2 * i) {
+		return 0;
+	}
+
+	/* Without a T the sign of each piece is the only freedom */
+	return t || (d + lj) % 2 == 0;
+}
+
+/*
+ * Every set of tetrominos that could fill the 'need' pieces left,
+ * 'q' lists them in the order they can be used, hold first. Each
+ * of them must be placed except maybe one, skipped by holding it.
+ */
+static int
+pieces_ok(int d, const uint8_t *q, int len, int need)
+{
+	int n[7] = { 0 };
+	int i;
+
+	if (len < need) {
+		return 0;
+	}
+
+	for (i = 0; i != need; ++i) {
+		++n[q[i]];
+	}
+
+	if (parity_ok(d, n)) {
+		return 1;
+	}
+
+	/* Swap the skipped piece, one at a time, with the next one */
+	if (len > need) {
+		++n[q[need]];
+		for (i = 0; i != need; ++i) {
+			--n[q[i]];
+			if (parity_ok(d, n)) {
+				return 1;
+			}
+			++n[q[i]];
+		}
+	}
+
+	return 0;
+}
+
+static int
+prune(const struct pc_search *s, const struct pc_board *b, int i, int hold)
+{
+	uint8_t q[PC_MAX_PIECES + 1];
+	uint16_t col[BOARD_W];
+	int x, d, empty, len;
+
+	columns(b, col);
+
+	d = empty = 0;
+	for (x = 0; x != BOARD_W; ++x) {
+		empty += __builtin_popcount(col[x]);
+		d += x % 2 ? -__builtin_popcount(col[x]) : __builtin_popcount(col[x]);
+	}
+
+	if (empty % 4 || !regions_ok(col)) {
+		return 1;
+	}
+
+	len = 0;
+	if (hold != PC_NO_HOLD) {
+		q[len++] = hold;
+	}
+	for (; i < s->p->count; ++i) {
+		q[len++] = s->p->pieces[i];
+	}
+
+	return !pieces_ok(d, q, len, empty / 4);
+}
+
+/* -==+ Memo +==- */
+
+static struct pc_memo_entry *
+memo_slot(struct pc_memo *memo, uint64_t board, uint32_t aux)
+{
+	struct pc_memo_entry *e;
+	uint64_t h;
+
+	h = (board ^ (uint64_t)aux << 56) * 0x9e3779b97f4a7c15ull;
+	for (h >>= 64 - MEMO_BITS;; h = (h + 1) & ((1u << MEMO_BITS) - 1)) {
+		e = &memo->e[h];
+		if (e->gen != memo->gen || (e->board == board && e->aux == aux)) {
+			return e;
+		}
+	}
+}
+
+/* Forget the previous search, clearing the table once every 2^32 */
+static void
+memo_clear(struct pc_memo *memo)
+{
+	if (!++memo->gen) {
+		memset(memo->e, 0, sizeof memo->e);
+		memo->gen = 1;
+	}
+}
+
+/* -==+ Search +==- */
+
+static int dfs(struct pc_search *s, const struct pc_board *b, int i, int hold);
+
+/*
+ * Try each placement of 'id', then go on with the next piece 'i' and
+ * 'hold' in the hold box.
+ */
+static int
+place(struct pc_search *s, const struct pc_board *b, int id, int hold_key, int i, int hold)
+{
+	struct pc_board out[MAX_PLACEMENTS];
+	struct pc_move moves[MAX_PLACEMENTS];
+	int k, n;
+
+	n = placements(b, id, out, moves);
+	for (k = 0; k != n; ++k) {
+		s->path[s->depth] = moves[k];
+		s->path[s->depth].hold = hold_key;
+		++s->depth;
+
+		if (dfs(s, &out[k], i, hold)) {
+			return 1;
+		}
+
+		--s->depth;
+	}
+
+	return 0;
+}
+
+static int
+dfs(struct pc_search *s, const struct pc_board *b, int i, int hold)
+{
+	const struct pc_problem *p;
+	struct pc_memo_entry *e;
+	uint64_t key;
+	uint32_t aux;
+	int cur;
+
+	if (!b->h) {
+		return 1;
+	}
+
+	if (__atomic_load_n(s->found, __ATOMIC_RELAXED) || __atomic_load_n(s->expired, __ATOMIC_RELAXED)
+	    || prune(s, b, i, hold)) {
+		return 0;
+	}
+
+	key = board_key(b);
+	aux = i << 4 | hold;
+	if (memo_slot(s->memo, key, aux)->gen == s->memo->gen) {
+		return 0;
+	}
+
+	/* The clock is only read every so many nodes, they're cheap */
+	if (!(++s->nodes & 63) && s->deadline && time_ns() >= s->deadline) {
+		__atomic_store_n(s->expired, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	p = s->p;
+
+	if (i < p->count) {
+		cur = p->pieces[i];
+
+		if (place(s, b, cur, 0, i + 1, hold)) {
+			return 1;
+		}
+
+		if (hold == PC_NO_HOLD) {
+			if (i + 1 < p->count && place(s, b, p->pieces[i + 1], 1, i + 2, cur)) {
+				return 1;
+			}
+
+		} else if (hold != cur && place(s, b, hold, 1, i + 1, cur)) {
+			return 1;
+		}
+
+	} else if (hold != PC_NO_HOLD) {
+		/* Swap it with whatever comes next, unknown for now */
+		if (place(s, b, hold, 1, i, PC_NO_HOLD)) {
+			return 1;
+		}
+	}
+
+	/* A full table only costs time, never a wrong answer. A subtree cut short proves nothing */
+	if (!__atomic_load_n(s->found, __ATOMIC_RELAXED) && !__atomic_load_n(s->expired, __ATOMIC_RELAXED)
+	    && s->memo_used < (1 << MEMO_BITS) / 4 * 3) {
+		++s->memo_used;
+		e = memo_slot(s->memo, key, aux);
+		e->board = key;
+		e->aux = aux;
+		e->gen = s->memo->gen;
+	}
+
+	return 0;
+}
+
+/* -==+ Threads +==- */
+
+/*
+ * Take first level subtrees until one of the threads finds a clear or
+ * time runs out, the first one to find it writes the result.
+ */
+static void
+pc_work(struct pc_shared *sh, struct pc_memo *memo)
+{
+	struct pc_search s;
+	struct pc_root *root;
+	int k;
+
+	memset(&s, 0, sizeof s);
+	s.p = sh->p;
+	s.found = &sh->found;
+	s.expired = &sh->expired;
+	s.deadline = sh->deadline;
+	s.memo = memo;
+	memo_clear(memo);
+
+	while ((k = __atomic_fetch_add(&sh->next, 1, __ATOMIC_RELAXED)) < sh->count) {
+		root = &sh->roots[k];
+		s.path[0] = root->move;
+		s.depth = 1;
+
+		if (dfs(&s, &root->board, root->i, root->hold)
+		    && !__atomic_exchange_n(&sh->found, 1, __ATOMIC_RELAXED)) {
+			memcpy(sh->r->moves, s.path, s.depth * sizeof (struct pc_move));
+			sh->r->count = s.depth;
+		}
+
+		if (__atomic_load_n(&sh->found, __ATOMIC_RELAXED) || __atomic_load_n(&sh->expired, __ATOMIC_RELAXED)) {
+			break;
+		}
+	}
+
+	__atomic_fetch_add(&sh->nodes, s.nodes, __ATOMIC_RELAXED);
+}
+
+static void *
+pc_thread(void *arg)
+{
+	struct pc_shared *sh;
+	uint32_t round;
+	int id;
+
+	/* Started before the first round, which may come before it runs */
+	id = (intptr_t)arg;
+	round = 0;
+	pthread_mutex_lock(&pc.lock);
+
+	for (;;) {
+		while (pc.round == round) {
+			pthread_cond_wait(&pc.go, &pc.lock);
+		}
+
+		round = pc.round;
+		sh = pc.job;
+		if (id >= sh->threads) {
+			continue;
+		}
+
+		pthread_mutex_unlock(&pc.lock);
+		pc_work(sh, pc.memo[id]);
+		pthread_mutex_lock(&pc.lock);
+
+		if (!--pc.busy) {
+			pthread_cond_signal(&pc.done);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * The children of the root, same order as dfs() would take them.
+ */
+static int
+roots(const struct pc_problem *p, const struct pc_board *b, struct pc_root *out)
+{
+	struct pc_board boards[MAX_PLACEMENTS];
+	struct pc_move moves[MAX_PLACEMENTS];
+	int opt, id, i, hold, k, n, count;
+
+	count = 0;
+	for (opt = 0; opt != 2; ++opt) {
+		if (!opt) {
+			if (!p->count) {
+				continue;
+			}
+			id = p->pieces[0];
+			i = 1;
+			hold = p->hold;
+
+		} else if (p->hold == PC_NO_HOLD) {
+			if (p->count < 2) {
+				continue;
+			}
+			id = p->pieces[1];
+			i = 2;
+			hold = p->pieces[0];
+
+		} else if (!p->count || p->hold != p->pieces[0]) {
+			id = p->hold;
+			i = !!p->count;
+			hold = p->count ? p->pieces[0] : PC_NO_HOLD;
+
+		} else {
+			continue;
+		}
+
+		n = placements(b, id, boards, moves);
+		for (k = 0; k != n; ++k) {
+			out[count].board = boards[k];
+			out[count].move = moves[k];
+			out[count].move.hold = opt;
+			out[count].i = i;
+			out[count].hold = hold;
+			++count;
+		}
+	}
+
+	return count;
+}
+
+static int
+solve_height(const struct pc_problem *p, const struct pc_board *b, int threads, uint64_t deadline, struct pc_result *r)
+{
+	struct pc_root out[2 * MAX_PLACEMENTS];
+	struct pc_shared sh;
+	struct pc_search s;
+
+	memset(&s, 0, sizeof s);
+	s.p = p;
+	s.found = &sh.found;
+	s.expired = &sh.expired;
+	sh.found = sh.expired = 0;
+	sh.deadline = deadline;
+
+	if (prune(&s, b, 0, p->hold)) {
+		return 0;
+	}
+
+	sh.p = p;
+	sh.roots = out;
+	sh.count = roots(p, b, out);
+	sh.next = 0;
+	sh.r = r;
+	sh.nodes = 1;
+	sh.threads = MIN(threads, pc.threads);
+
+	pthread_mutex_lock(&pc.lock);
+	pc.job = &sh;
+	pc.busy = sh.threads - 1;
+	++pc.round;
+	pthread_cond_broadcast(&pc.go);
+	pthread_mutex_unlock(&pc.lock);
+
+	pc_work(&sh, pc.memo[0]);
+
+	pthread_mutex_lock(&pc.lock);
+	while (pc.busy) {
+		pthread_cond_wait(&pc.done, &pc.lock);
+	}
+	pthread_mutex_unlock(&pc.lock);
+
+	r->nodes += sh.nodes;
+	r->expired = !sh.found && sh.expired;
+
+	return sh.found;
+}
+
+/* -==+ Solving +==- */
+
+/* What pc_init() takes from its arena */
+size_t
+pc_reserve(int threads)
+{
+	return POOL_BYTES(sizeof (struct pc_memo), MAX(1, MIN(threads, PC_MAX_THREADS)));
+}
+
+/*
+ * Carve a memo per thread from 'a' and start the threads, so solving
+ * never allocates. pc_solve() does it on its own arena when nobody
+ * did, with the threads it's asked for.
+ */
+int
+pc_init(struct arena *a, int threads)
+{
+	pthread_t tid;
+	int id;
+
+	if (pc.threads) {
+		return 0;
+	}
+
+	threads = MAX(1, MIN(threads, PC_MAX_THREADS));
+	if (!a) {
+		if (arena_init(&pc.arena, pc_reserve(threads))) {
+			return -1;
+		}
+		a = &pc.arena;
+	}
+
+	if (pool_init(&pc.memos, a, "perfect clear memo", sizeof (struct pc_memo), threads)) {
+		return -1;
+	}
+
+	for (id = 0; id != threads; ++id) {
+		pc.memo[id] = pool_get(&pc.memos);
+		pc.memo[id]->gen = 0;
+	}
+
+	pc.threads = 1;
+	for (id = 1; id != threads; ++id) {
+		if (pthread_create(&tid, NULL, pc_thread, (void *)(intptr_t)id)) {
+			log_error("Can't start solver thread %d\n", id);
+			break;
+		}
+		pthread_detach(tid);
+		++pc.threads;
+	}
+
+	return 0;
+}
+
+/*
+ * Look for a perfect clear using the pieces of 'p', as low as possible
+ * and no taller than 'max_h' rows, for 'budget' ns at most (0 takes
+ * as long as it takes). Returns 1 and fills 'r' when there is one, 0
+ * when there is none or the budget ran out first ('expired') and -1
+ * when 'p' makes no sense or the solver can't start.
+ */
+int
+pc_solve(const struct pc_problem *p, int max_h, int threads, uint64_t budget, struct pc_result *r)
+{
+	struct pc_board b;
+	uint64_t deadline;
+	int h, filled, top, y, x;
+
+	deadline = budget ? time_ns() + budget : 0;
+
+	batch_states();
+	memset(r, 0, sizeof (*r));
+
+	if (p->count < 0 || p->count > PC_MAX_PIECES || (p->hold > 6 && p->hold != PC_NO_HOLD)) {
+		return -1;
+	}
+
+	for (x = 0; x != p->count; ++x) {
+		if (p->pieces[x] > 6) {
+			return -1;
+		}
+	}
+
+	max_h = MIN(max_h, PC_MAX_H);
+	threads = MAX(1, MIN(threads, PC_MAX_THREADS));
+
+	filled = top = 0;
+	for (y = 0; y != PC_MAX_H; ++y) {
+		if (p->rows[y] & ~CELLS || p->rows[y] == CELLS) {
+			return -1;
+		}
+
+		if (p->rows[y]) {
+			filled += __builtin_popcount(p->rows[y]);
+			top = y + 1;
+		}
+	}
+
+	pthread_mutex_lock(&pc.solve);
+	if (pc_init(NULL, threads)) {
+		pthread_mutex_unlock(&pc.solve);
+		return -1;
+	}
+
+	for (h = MAX(top, 1); h <= max_h; ++h) {
+		if ((h * BOARD_W - filled) % 4) {
+			continue;
+		}
+
+		b.h = h;
+		memcpy(b.rows, p->rows, sizeof b.rows);
+
+		if (solve_height(p, &b, threads, deadline, r)) {
+			r->height = h;
+			break;
+		}
+		if (r->expired) {
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&pc.solve);
+
+	return r->height ? 1 : 0;
+}
+
+/*
+ * Copy what the solver needs from a game on the standard board: the
+ * bottom rows, the tetromino in play, the hold box and 'count' pieces
+ * of the queue at most. -1 when the stack is too tall to clear.
+ */
+int
+pc_from_game(struct pc_problem *p, struct game_state *gs, int count)
+{
+	int x, y, r;
+
+	memset(p, 0, sizeof (*p));
+
+	if (gs->board_w != BOARD_W || gs->board_h != BOARD_H) {
+		return -1;
+	}
+
+	for (y = 0; y != gs->board_h; ++y) {
+		for (x = 0; x != gs->board_w; ++x) {
+			if (!gs->board[y][x]) {
+				continue;
+			}
+
+			r = gs->board_h - 1 - y;
+			if (r >= PC_MAX_H) {
+				return -1;
+			}
+
+			p->rows[r] |= 1u << x;
+		}
+	}
+
+	count = MAX(1, MIN(count, PC_MAX_PIECES));
+	p->pieces[0] = gs->curr_mino.id;
+	for (x = 1; x != count; ++x) {
+		p->pieces[x] = queue_peek(&gs->queue, x - 1);
+	}
+
+	p->count = count;
+	p->hold = gs->hold_mino ? gs->hold_mino->id : PC_NO_HOLD;
+
+	return 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PCSOLVE_H
+#define PCSOLVE_H
+
+#define PC_MAX_H	6	/* Tallest perfect clear searched */
+#define PC_MAX_PIECES	16	/* Current tetromino plus what's known of the queue */
+#define PC_NO_HOLD	7
+#define PC_MAX_THREADS	64
+
+/* C library */
+#include <stddef.h>
+#include <stdint.h>
+
+/* e-type */
+#include "tetris.h"
+
+/*
+ * -==+ Perfect clear problem +==-
+ * The bottom rows of a standard board, bit 'x' of 'rows[0]' is the
+ * bottom left cell. 'pieces[0]' is the tetromino in play, the rest is
+ * the queue in order.
+ */
+struct pc_problem {
+	uint16_t rows[PC_MAX_H];
+	uint8_t pieces[PC_MAX_PIECES];
+	int count;
+	uint8_t hold;
+};
+
+/*
+ * -==+ Placement +==-
+ * Where a tetromino locks, in board coordinates like 'curr_mino_pos',
+ * 'state' is the rotation as in batch.h. 'hold' is set when the hold
+ * key has to be pressed first.
+ */
+struct pc_move {
+	uint8_t id;
+	uint8_t state;
+	int8_t x, y;
+	uint8_t hold;
+};
+
+struct pc_result {
+	struct pc_move moves[PC_MAX_PIECES];
+	int count;
+	int height;
+	int expired;
+	uint64_t nodes;
+};
+
+/* -==+ Solving +==- */
+struct arena;
+
+size_t pc_reserve(int threads);
+int  pc_init(struct arena *a, int threads);
+int  pc_from_game(struct pc_problem *p, struct game_state *gs, int count);
+int  pc_solve(const struct pc_problem *p, int max_h, int threads, uint64_t budget, struct pc_result *r);
+
+#endif /* PCSOLVE_H */
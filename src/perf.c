@@ -0,0 +1,264 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Header file */
+#include "perf.h"
+/* C library */
+#include <stdlib.h>
+#include <string.h>
+/* POSIX */
+#include <fcntl.h>
+#include <unistd.h>
+/* e-type */
+#include "arena.h"
+#include "utils.h"
+
+const char *perf_phase_names[PERF_PHASE_COUNT] = { "input", "update", "draw", "frame" };
+
+int perf_overlay = 0;
+
+/* Whole session and current overlay window */
+struct perf_hist perf_total[PERF_PHASE_COUNT];
+struct perf_hist perf_window[PERF_PHASE_COUNT];
+
+uint64_t perf_bytes;		/* Written to the terminal since startup */
+uint64_t perf_frames;		/* Iterations that presented something */
+uint64_t perf_ticks;		/* Game loop iterations */
+
+/* Overlay values, computed when a window closes */
+uint64_t perf_window_start, perf_window_bytes, perf_window_frames, perf_window_ticks;
+uint64_t perf_p50, perf_p99, perf_tps, perf_bpf;
+
+/*
+ * Bytes this thread has written so far, from the kernel's accounting.
+ * Each thread has its own file, opened the first time it asks. 0 if
+ * the kernel doesn't keep count.
+ */
+static uint64_t
+thread_written(void)
+{
+	static __thread int fd = -1;
+	char buf[256], *p;
+	ssize_t n;
+
+	if (fd == -1 && (fd = open("/proc/thread-self/io", O_RDONLY | O_CLOEXEC)) == -1) {
+		fd = -2;
+	}
+
+	if (fd < 0 || (n = pread(fd, buf, sizeof buf - 1, 0)) <= 0) {
+		return 0;
+	}
+
+	buf[n] = '\0';
+	p = strstr(buf, "wchar:");
+
+	return p ? strtoull(p + 6, NULL, 10) : 0;
+}
+
+/*
+ * doupdate() for the game's screen. ncurses flushes its output buffer
+ * with write(2) on the terminal from inside it, so whatever this thread
+ * wrote meanwhile is what the frame cost.
+ */
+void
+perf_refresh(void)
+{
+	uint64_t before;
+
+	before = thread_written();
+	doupdate();
+	perf_bytes += thread_written() - before;
+}
+
+void
+perf_init(void)
+{
+	perf_window_start = time_ns();
+}
+
+/*
+ * Bucket index of 'v': values below PERF_SUB_COUNT get their own bucket,
+ * every other power of 2 is split in PERF_SUB_COUNT linear steps.
+ */
+static inline int
+hist_bucket(uint64_t v)
+{
+	int e;
+
+	if (v < PERF_SUB_COUNT) {
+		return v;
+	}
+
+	e = 63 - __builtin_clzll(v);
+
+	return (e - PERF_SUB_BITS + 1) * PERF_SUB_COUNT + ((v >> (e - PERF_SUB_BITS)) & (PERF_SUB_COUNT - 1));
+}
+
+/*
+ * Highest value that falls in bucket 'b'.
+ */
+static inline uint64_t
+hist_value(int b)
+{
+	int e;
+
+	if (b < PERF_SUB_COUNT) {
+		return b;
+	}
+
+	e = b / PERF_SUB_COUNT + PERF_SUB_BITS - 1;
+
+	return (((uint64_t)(PERF_SUB_COUNT + b % PERF_SUB_COUNT + 1)) << (e - PERF_SUB_BITS)) - 1;
+}
+
+void
+hist_record(struct perf_hist *h, uint64_t v)
+{
+	if (h->count == 0 || v < h->min) {
+		h->min = v;
+	}
+
+	if (v > h->max) {
+		h->max = v;
+	}
+
+	++h->count;
+	h->total += v;
+	++h->buckets[hist_bucket(v)];
+}
+
+/*
+ * Value below which 'p' percent of the samples fall.
+ */
+uint64_t
+hist_percentile(const struct perf_hist *h, double p)
+{
+	uint64_t rank, seen;
+	int i;
+
+	if (h->count == 0) {
+		return 0;
+	}
+
+	rank = p / 100.0 * h->count;
+	if (rank >= h->count) {
+		return h->max;
+	}
+
+	for (i = seen = 0; i != PERF_BUCKETS; ++i) {
+		if ((seen += h->buckets[i]) > rank) {
+			break;
+		}
+	}
+
+	return hist_value(i) < h->max ? hist_value(i) : h->max;
+}
+
+/*
+ * Account one game loop iteration. 't' holds the timestamps taken
+ * before drawing, before input, before updating and at the end.
+ * Returns 1 when the overlay values were refreshed.
+ */
+int
+perf_frame(const uint64_t *t, int presented)
+{
+	int i;
+
+	hist_record(&perf_total[PERF_INPUT], t[2] - t[1]);
+	hist_record(&perf_total[PERF_UPDATE], t[3] - t[2]);
+	hist_record(&perf_window[PERF_INPUT], t[2] - t[1]);
+	hist_record(&perf_window[PERF_UPDATE], t[3] - t[2]);
+
+	if (presented) {
+		hist_record(&perf_total[PERF_DRAW], t[1] - t[0]);
+		hist_record(&perf_total[PERF_FRAME], t[3] - t[0]);
+		hist_record(&perf_window[PERF_DRAW], t[1] - t[0]);
+		hist_record(&perf_window[PERF_FRAME], t[3] - t[0]);
+		++perf_frames;
+	}
+
+	++perf_ticks;
+
+	if (t[3] - perf_window_start < PERF_WINDOW) {
+		return 0;
+	}
+
+	perf_p50 = hist_percentile(&perf_window[PERF_FRAME], 50);
+	perf_p99 = hist_percentile(&perf_window[PERF_FRAME], 99);
+	perf_tps = (perf_ticks - perf_window_ticks) * 1000000000 / (t[3] - perf_window_start);
+	perf_bpf = perf_frames != perf_window_frames ?
+		(perf_bytes - perf_window_bytes) / (perf_frames - perf_window_frames) : 0;
+
+	for (i = 0; i != PERF_PHASE_COUNT; ++i) {
+		memset(&perf_window[i], 0, sizeof (struct perf_hist));
+	}
+
+	perf_window_start = t[3];
+	perf_window_bytes = perf_bytes;
+	perf_window_frames = perf_frames;
+	perf_window_ticks = perf_ticks;
+
+	return 1;
+}
+
+/*
+ * Three lines of numbers from the last closed window, meant for the
+ * bottom of the stats window.
+ */
+void
+perf_draw_overlay(WINDOW *win, int y)
+{
+	mvwprintw(win, y, 2, "frame p50: %luus", (unsigned long)(perf_p50 / 1000));
+	mvwprintw(win, y + 1, 2, "frame p99: %luus", (unsigned long)(perf_p99 / 1000));
+	mvwprintw(win, y + 2, 2, "tps:%luk B/f:%lu", (unsigned long)(perf_tps / 1000), (unsigned long)perf_bpf);
+}
+
+/*
+ * Summary and non-empty buckets of every phase for the whole session.
+ */
+void
+perf_dump(FILE *fp)
+{
+	const struct perf_hist *h;
+	int i, j;
+
+	fprintf(fp, "ticks %lu, frames %lu, terminal bytes %lu (%lu per frame)\n",
+		(unsigned long)perf_ticks, (unsigned long)perf_frames, (unsigned long)perf_bytes,
+		(unsigned long)(perf_frames ? perf_bytes / perf_frames : 0));
+#ifdef ALLOC_DEBUG
+	fprintf(fp, "heap allocations %lu\n", (unsigned long)alloc_count());
+#endif
+
+	for (i = 0; i != PERF_PHASE_COUNT; ++i) {
+		h = &perf_total[i];
+
+		fprintf(fp, "\n%s: count %lu min %lu mean %lu p50 %lu p90 %lu p99 %lu p99.9 %lu max %lu (ns)\n",
+			perf_phase_names[i], (unsigned long)h->count, (unsigned long)h->min,
+			(unsigned long)(h->count ? h->total / h->count : 0),
+			(unsigned long)hist_percentile(h, 50), (unsigned long)hist_percentile(h, 90),
+			(unsigned long)hist_percentile(h, 99), (unsigned long)hist_percentile(h, 99.9),
+			(unsigned long)h->max);
+
+		for (j = 0; j != PERF_BUCKETS; ++j) {
+			if (h->buckets[j]) {
+				fprintf(fp, "\t<= %lu\t%u\n", (unsigned long)hist_value(j), h->buckets[j]);
+			}
+		}
+	}
+}
@@ -0,0 +1,61 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PERF_H
+#define PERF_H
+
+#define PERF_PATH		"e-type.perf"
+#define PERF_SUB_BITS		4	/* 16 linear sub-buckets per power of 2, ~6% error */
+#define PERF_SUB_COUNT		(1 << PERF_SUB_BITS)
+#define PERF_BUCKETS		((64 - PERF_SUB_BITS + 1) * PERF_SUB_COUNT)
+#define PERF_WINDOW		1000000000	/* Overlay refresh period (ns) */
+
+/* C library */
+#include <stdio.h>
+#include <stdint.h>
+
+/* Ncurses */
+#include <ncurses.h>
+
+/* Phases of a game loop iteration */
+typedef enum { PERF_INPUT, PERF_UPDATE, PERF_DRAW, PERF_FRAME, PERF_PHASE_COUNT } perf_phase;
+
+/*
+ * -==+ Latency histogram +==-
+ * HDR style log-linear histogram of nanosecond samples, constant time
+ * recording with a bounded relative error at every magnitude.
+ */
+struct perf_hist {
+	uint64_t count, total, min, max;
+	uint32_t buckets[PERF_BUCKETS];
+};
+
+extern int perf_overlay;
+
+void     perf_init(void);
+void     perf_refresh(void);
+int      perf_frame(const uint64_t *t, int presented);
+void     perf_draw_overlay(WINDOW *win, int y);
+void     perf_dump(FILE *fp);
+
+/* -==+ Histograms +==- */
+void     hist_record(struct perf_hist *h, uint64_t v);
+uint64_t hist_percentile(const struct perf_hist *h, double p);
+
+#endif /* PERF_H */
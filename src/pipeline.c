@@ -0,0 +1,298 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Header file */
+#include "pipeline.h"
+/* C library */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+/* POSIX */
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+/* e-type */
+#include "arena.h"
+#include "live.h"
+#include "log.h"
+#include "perf.h"
+#include "replay.h"
+#include "trace.h"
+
+#define DRAW_MASK	(BIT(DRAW_BOARD) | BIT(DRAW_STATS) | BIT(DRAW_HOLD))
+
+/* Snapshots and queue of the game being played */
+static struct pool pipe_pool;
+
+/* -==+ Input queue +==- */
+
+/*
+ * Whatever doesn't fit is dropped, the simulation would have to be
+ * 256 events behind for that.
+ */
+static int
+ring_push(struct pipe_ring *r, const struct input_event *ev, int n)
+{
+	uint32_t head, tail;
+	int i;
+
+	head = r->head;
+	tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+
+	for (i = 0; i != n && head - tail != PIPE_EVENTS; ++i, ++head) {
+		r->ev[head & (PIPE_EVENTS - 1)] = ev[i];
+	}
+
+	__atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+
+	return i;
+}
+
+static int
+ring_pop(struct pipe_ring *r, struct input_event *ev, int max)
+{
+	uint32_t head, tail;
+	int n;
+
+	tail = r->tail;
+	head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+	for (n = 0; n != max && tail != head; ++n, ++tail) {
+		ev[n] = r->ev[tail & (PIPE_EVENTS - 1)];
+	}
+
+	__atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+
+	return n;
+}
+
+/* -==+ Triple buffer +==- */
+
+/*
+ * The draw flags of a frame cover every frame since the last one the
+ * renderer took, the ones in between were never drawn.
+ */
+static void
+frame_publish(struct pipeline *p, struct game_state *gs, uint64_t input_ns, uint64_t update_ns)
+{
+	struct pipe_frame *f;
+	uint32_t prev;
+
+	p->pending |= gs->flags & DRAW_MASK;
+
+	f = &p->slots[p->back];
+	f->gs = *gs;
+	f->gs.flags = (gs->flags & ~DRAW_MASK) | p->pending;
+	f->input_ns = input_ns;
+	f->update_ns = update_ns;
+
+	prev = __atomic_exchange_n(&p->middle, p->back | PIPE_FRESH, __ATOMIC_ACQ_REL);
+	p->back = prev & ~PIPE_FRESH;
+	if (!(prev & PIPE_FRESH)) {
+		p->pending = 0;
+	}
+
+	gs->flags &= ~DRAW_MASK;
+
+	__atomic_add_fetch(&p->frames, 1, __ATOMIC_RELEASE);
+	syscall(SYS_futex, &p->frames, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+static struct pipe_frame *
+frame_take(struct pipeline *p)
+{
+	uint32_t prev;
+
+	if (!(__atomic_load_n(&p->middle, __ATOMIC_ACQUIRE) & PIPE_FRESH)) {
+		return NULL;
+	}
+
+	prev = __atomic_exchange_n(&p->middle, p->front, __ATOMIC_ACQ_REL);
+	p->front = prev & ~PIPE_FRESH;
+
+	return &p->slots[p->front];
+}
+
+/* -==+ Threads +==- */
+
+/*
+ * Sleeps in poll() until the terminal sends something, so keys reach
+ * the queue as soon as they're typed whatever the other threads do.
+ */
+static void *
+input_thread(void *arg)
+{
+	struct input_event ev[INPUT_EVENTS_MAX];
+	struct pipeline *p;
+	struct pollfd pfd;
+	int n;
+
+	p = arg;
+	pfd.fd = STDIN_FILENO;
+	pfd.events = POLLIN;
+
+	while (!__atomic_load_n(&p->stop, __ATOMIC_ACQUIRE)) {
+		if (poll(&pfd, 1, PIPE_INPUT_WAIT) == 1 && (n = input_read(p->dec, ev))) {
+			if (ring_push(&p->ring, ev, n) != n) {
+				log_warn("Input queue full, dropped keys\n");
+			}
+			syscall(SYS_futex, &p->ring.head, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * The only thread that talks to curses while the pipeline runs. It
+ * draws the newest frame and sleeps when there is none, a slow
+ * terminal only means frames get skipped.
+ */
+static void *
+render_thread(void *arg)
+{
+	struct timespec ts;
+	struct pipe_frame *f;
+	struct pipeline *p;
+	uint64_t t[4];
+	uint32_t seen;
+
+	p = arg;
+	ts.tv_sec = PIPE_RENDER_WAIT / 1000000000;
+	ts.tv_nsec = PIPE_RENDER_WAIT % 1000000000;
+
+	while (!__atomic_load_n(&p->stop, __ATOMIC_ACQUIRE)) {
+		seen = __atomic_load_n(&p->frames, __ATOMIC_ACQUIRE);
+		if ((f = frame_take(p)) == NULL) {
+			syscall(SYS_futex, &p->frames, FUTEX_WAIT_PRIVATE, seen, &ts, NULL, 0);
+			continue;
+		}
+
+		t[0] = time_ns();
+		draw_game(&f->gs);
+		t[1] = time_ns();
+		t[2] = t[1] + f->input_ns;
+		t[3] = t[2] + f->update_ns;
+
+		if (perf_frame(t, 1) && perf_overlay) {
+			f->gs.flags |= BIT(DRAW_STATS);
+			draw_game(&f->gs);
+		}
+	}
+
+	return NULL;
+}
+
+/* Reserve the pipeline from 'a', without it games run on one thread */
+int
+pipeline_init(struct arena *a)
+{
+	return pool_init(&pipe_pool, a, "pipeline", sizeof (struct pipeline), 1);
+}
+
+/*
+ * Plays 'gs' until it's over with input and drawing on their own
+ * threads, the calling thread runs the simulation. 'handle' gets
+ * every input event. Returns -1 without playing if the threads
+ * can't be started.
+ */
+int
+pipeline_run(struct game_state *gs, struct input_decoder *dec,
+	     void (*handle)(struct game_state *gs, const struct input_event *ev))
+{
+	struct input_event ev[PIPE_EVENTS];
+	struct pipeline *p;
+	pthread_t input, render;
+	struct timespec wait;
+	uint64_t t[3];
+	int i, n;
+
+	if ((p = pool_get(&pipe_pool)) == NULL) {
+		return -1;
+	}
+
+	memset(p, 0, sizeof (*p));
+	p->middle = 0;
+	p->back = 1;
+	p->front = 2;
+	p->dec = dec;
+
+	if (pthread_create(&input, NULL, input_thread, p) != 0) {
+		pool_put(&pipe_pool, p);
+		return -1;
+	}
+
+	if (pthread_create(&render, NULL, render_thread, p) != 0) {
+		__atomic_store_n(&p->stop, 1, __ATOMIC_RELEASE);
+		pthread_join(input, NULL);
+		pool_put(&pipe_pool, p);
+		return -1;
+	}
+
+	wait.tv_sec = 0;
+	wait.tv_nsec = PIPE_SIM_WAIT;
+
+	alloc_freeze();
+	while (!(gs->flags & BIT(QUIT))) {
+		trace_loop();
+
+		t[0] = time_ns();
+		replay_tick(gs, t[0]);
+		n = ring_pop(&p->ring, ev, PIPE_EVENTS);
+		for (i = 0; i != n; ++i) {
+			handle(gs, &ev[i]);
+		}
+
+		if (!(gs->flags & (BIT(PAUSE) | BIT(LBREAK)))) {
+			input_update(gs, time_ns());
+		}
+		t[1] = time_ns();
+
+		if (!(gs->flags & BIT(PAUSE))) {
+			if (gs->flags & BIT(LBREAK)) {
+				update_lbreak(gs);
+			} else {
+				update_timing(gs);
+			}
+		}
+		t[2] = time_ns();
+
+		if (gs->flags & DRAW_MASK) {
+			live_publish(gs);
+			frame_publish(p, gs, t[1] - t[0], t[2] - t[1]);
+
+		} else {
+			/* Until a key comes in, or long enough for the timers to be due */
+			syscall(SYS_futex, &p->ring.head, FUTEX_WAIT_PRIVATE, p->ring.tail, &wait, NULL, 0);
+		}
+	}
+	alloc_thaw();
+
+	__atomic_store_n(&p->stop, 1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&p->frames, 1, __ATOMIC_RELEASE);
+	syscall(SYS_futex, &p->frames, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+
+	pthread_join(input, NULL);
+	pthread_join(render, NULL);
+	pool_put(&pipe_pool, p);
+
+	return 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#define PIPE_EVENTS		256		/* Input queue size, power of 2 */
+#define PIPE_INPUT_WAIT		50		/* ms between stop checks of the input thread */
+#define PIPE_RENDER_WAIT	100000000	/* ns between stop checks of the render thread */
+#define PIPE_SIM_WAIT		1000000		/* ns the simulation sleeps without keys, timers are checked as often */
+
+/* C library */
+#include <stdint.h>
+
+/* e-type */
+#include "input.h"
+#include "tetris.h"
+
+/*
+ * -==+ Input queue +==-
+ * Single producer, single consumer ring of input events. Each side
+ * owns one index and only reads the other's, on its own cache line.
+ * The consumer sleeps on 'head' when it's empty.
+ */
+struct pipe_ring {
+	uint32_t head __attribute__ ((aligned(64)));
+	uint32_t tail __attribute__ ((aligned(64)));
+	struct input_event ev[PIPE_EVENTS] __attribute__ ((aligned(64)));
+};
+
+/*
+ * -==+ Frame +==-
+ * The game as the simulation left it, with what it took to get
+ * there. Never changed once published.
+ */
+struct pipe_frame {
+	struct game_state gs;
+	uint64_t input_ns, update_ns;
+};
+
+/*
+ * -==+ Triple buffer +==-
+ * The simulation writes 'back', the renderer reads 'front' and they
+ * trade their slot with 'middle' in a single exchange. PIPE_FRESH in
+ * 'middle' marks a frame the renderer hasn't taken yet. 'frames'
+ * counts publications, the renderer sleeps on it.
+ */
+struct pipeline {
+	struct pipe_ring ring;
+	struct pipe_frame slots[3];
+	uint32_t middle __attribute__ ((aligned(64)));
+	uint32_t frames;
+	int stop;
+	/* [Owned by the simulation] */
+	uint32_t back __attribute__ ((aligned(64)));
+	uint8_t pending;
+	/* [Owned by the renderer] */
+	uint32_t front __attribute__ ((aligned(64)));
+	/* [Owned by the input thread] */
+	struct input_decoder *dec;
+};
+
+#define PIPE_FRESH	4
+
+/* -==+ Game loop +==- */
+struct arena;
+
+int pipeline_init(struct arena *a);
+int pipeline_run(struct game_state *gs, struct input_decoder *dec,
+		 void (*handle)(struct game_state *gs, const struct input_event *ev));
+
+#endif /* PIPELINE_H */
@@ -0,0 +1,58 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Header file */
+#include "queue.h"
+
+void
+queue_init(struct piece_queue *q, int rng_ind, unsigned int seed)
+{
+	q->head = q->tail = 0;
+	q->fill = rand_profiles[rng_ind].fill;
+	rand_profiles[rng_ind].init(&q->rng, seed);
+
+	queue_refill(q);
+}
+
+/*
+ * Generate up to QUEUE_BLOCK pieces in a single call to the RNG profile,
+ * wrapping around the end of the ring if needed.
+ */
+void
+queue_refill(struct piece_queue *q)
+{
+	int n, first;
+
+	n = QUEUE_SIZE - (q->tail - q->head);
+	if (n > QUEUE_BLOCK) {
+		n = QUEUE_BLOCK;
+	}
+
+	first = QUEUE_SIZE - (q->tail & QUEUE_MASK);
+	if (first > n) {
+		first = n;
+	}
+
+	q->fill(&q->rng, q->pieces + (q->tail & QUEUE_MASK), first);
+	if (n > first) {
+		q->fill(&q->rng, q->pieces, n - first);
+	}
+
+	q->tail += n;
+}
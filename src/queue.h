@@ -0,0 +1,76 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#define QUEUE_SIZE		64	/* Must be a power of 2 */
+#define QUEUE_MASK		(QUEUE_SIZE - 1)
+#define QUEUE_BLOCK		16	/* Pieces generated per refill */
+#define PREVIEW_MAX		4
+
+/* C library */
+#include <stdint.h>
+
+/* e-type */
+#include "config.h"
+
+/*
+ * -==+ Piece queue +==-
+ * Ring buffer of upcoming tetromino ids, filled in blocks by the RNG
+ * profile. Everything past 'head' is already decided, so any piece up
+ * to QUEUE_SIZE - 1 ahead can be looked at.
+ */
+struct piece_queue {
+	uint8_t pieces[QUEUE_SIZE];
+	uint32_t head, tail;
+	void (*fill)(void*, uint8_t*, int);
+	union rng_state rng;
+};
+
+void queue_init(struct piece_queue *q, int rng_ind, unsigned int seed);
+void queue_refill(struct piece_queue *q);
+
+/*
+ * Take the next piece out of the queue.
+ */
+static inline int
+queue_next(struct piece_queue *q)
+{
+	if (q->head == q->tail) {
+		queue_refill(q);
+	}
+
+	return q->pieces[q->head++ & QUEUE_MASK];
+}
+
+/*
+ * Look 'k' pieces ahead without taking anything, 0 is the next piece.
+ */
+static inline int
+queue_peek(struct piece_queue *q, int k)
+{
+	while (q->tail - q->head <= (uint32_t)k) {
+		queue_refill(q);
+	}
+
+	return q->pieces[(q->head + k) & QUEUE_MASK];
+}
+
+#endif /* QUEUE_H */
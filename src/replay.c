@@ -0,0 +1,778 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Header file */
+#include "replay.h"
+/* C library */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* POSIX */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+/* e-type */
+#include "engine.h"
+#include "input.h"
+#include "log.h"
+#include "utils.h"
+
+/* Op, argument and a delta of up to 10 bytes */
+#define RECORD_MAX	12
+/* A frame's keys, each a step, then auto-shift to the wall and a fall */
+#define FRAME_STEPS	(INPUT_EVENTS_MAX + BOARD_MAX_W + 2)
+#define MS		1000000
+
+/* -==+ State +==- */
+
+/*
+ * Padding is zeroed, so two keyframes of the same state compare
+ * equal byte for byte.
+ */
+void
+replay_snapshot(struct replay_keyframe *kf, const struct game_state *gs)
+{
+	struct piece_queue q;
+	int i;
+
+	memset(kf, 0, sizeof (*kf));
+
+	memcpy(kf->board, gs->board, sizeof kf->board);
+	kf->curr_mino = gs->curr_mino;
+	kf->curr_mino_pos = gs->curr_mino_pos;
+	kf->ghost_pos = gs->ghost_pos;
+	kf->hold = gs->hold_mino ? gs->hold_mino->id : REPLAY_NO_HOLD;
+	kf->flags = gs->flags & (BIT(QUIT) | BIT(LBREAK) | BIT(BLOCK_HOLD));
+
+	/* Looked at on a copy, refilling it is up to the game */
+	q = gs->queue;
+	kf->head = q.head;
+	for (i = 0; i != REPLAY_UPCOMING; ++i) {
+		kf->upcoming[i] = queue_peek(&q, i);
+	}
+	memcpy(kf->pieces, gs->queue.pieces, sizeof kf->pieces);
+	kf->tail = gs->queue.tail;
+	kf->rng = gs->queue.rng;
+
+	kf->lbreak_block = gs->lbreak_block;
+	kf->lbreak_count = gs->lbreak_count;
+	for (i = 0; i != 4; ++i) {
+		kf->lbreak_lines[i] = gs->lbreak_lines[i];
+	}
+
+	kf->level = gs->level;
+	memcpy(kf->mino_count, gs->mino_count, sizeof kf->mino_count);
+	kf->lines = gs->lines;
+	kf->score = gs->score;
+	kf->drop_score = gs->drop_score;
+
+	kf->timing = gs->clock;
+	kf->immune = gs->immune;
+	kf->lbreak_timer = gs->lbreak_timer;
+	kf->fpc = gs->fpc;
+}
+
+/* 'gs' must have been started on the replay's header */
+static void
+replay_restore(struct game_state *gs, const struct replay_keyframe *kf)
+{
+	int i;
+
+	memcpy(gs->board, kf->board, sizeof gs->board);
+	gs->curr_mino = kf->curr_mino;
+	gs->curr_mino_pos = kf->curr_mino_pos;
+	gs->ghost_pos = kf->ghost_pos;
+	gs->hold_mino = kf->hold < 7 ? &minos[kf->hold] : NULL;
+	gs->flags = kf->flags | BIT(DRAW_BOARD) | BIT(DRAW_STATS) | BIT(DRAW_HOLD);
+
+	memcpy(gs->queue.pieces, kf->pieces, sizeof gs->queue.pieces);
+	gs->queue.head = kf->head;
+	gs->queue.tail = kf->tail;
+	gs->queue.rng = kf->rng;
+
+	gs->lbreak_block = kf->lbreak_block;
+	gs->lbreak_count = kf->lbreak_count;
+	for (i = 0; i != 4; ++i) {
+		gs->lbreak_lines[i] = kf->lbreak_lines[i];
+	}
+
+	gs->level = kf->level;
+	memcpy(gs->mino_count, kf->mino_count, sizeof gs->mino_count);
+	gs->lines = kf->lines;
+	gs->score = kf->score;
+	gs->drop_score = kf->drop_score;
+
+	gs->clock = kf->timing;
+	gs->immune = kf->immune;
+	gs->lbreak_timer = kf->lbreak_timer;
+	gs->fpc = kf->fpc;
+}
+
+int
+replay_same(const struct replay_keyframe *a, const struct replay_keyframe *b)
+{
+	return !memcmp(a->board, b->board, offsetof(struct replay_keyframe, timing) - offsetof(struct replay_keyframe, board));
+}
+
+/* -==+ Recording +==- */
+
+static int
+rec_flush(struct replay_rec *w)
+{
+	ssize_t n;
+	int off;
+
+	for (off = 0; off != w->len; off += n) {
+		if ((n = write(w->fd, w->buf + off, w->len - off)) == -1) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			/* A full disk ends the recording, not the game */
+			log_warn("Replay: %s\n", strerror(errno));
+			close(w->fd);
+			w->fd = -1;
+			w->len = 0;
+			return -1;
+		}
+	}
+
+	w->offset += w->len;
+	w->len = 0;
+
+	return 0;
+}
+
+static int
+rec_put(struct replay_rec *w, const void *p, int len)
+{
+	if (w->len + len > REPLAY_BUF_SIZE && rec_flush(w)) {
+		return -1;
+	}
+
+	memcpy(w->buf + w->len, p, len);
+	w->len += len;
+
+	return 0;
+}
+
+static void
+rec_varint(struct replay_rec *w, uint64_t v)
+{
+	do {
+		w->buf[w->len++] = (v & 0x7f) | (v > 0x7f) << 7;
+		v >>= 7;
+	} while (v);
+}
+
+static int
+rec_keyframe(struct replay_rec *w, const struct game_state *gs)
+{
+	struct replay_keyframe kf;
+	uint8_t op[2] = { RP_KEYFRAME, 0 };
+
+	replay_snapshot(&kf, gs);
+	kf.step = w->step;
+	kf.ms = (w->last_clock - w->start) / MS;
+	kf.clock = w->last_clock;
+
+	if (w->len + (int)(sizeof op + sizeof kf) > REPLAY_BUF_SIZE && rec_flush(w)) {
+		return -1;
+	}
+
+	if (w->count != REPLAY_INDEX_MAX) {
+		w->index[w->count].step = w->step;
+		w->index[w->count].ms = kf.ms;
+		w->index[w->count].offset = w->offset + w->len;
+		++w->count;
+	}
+
+	rec_put(w, op, sizeof op);
+	rec_put(w, &kf, sizeof kf);
+
+	return 0;
+}
+
+/*
+ * Start recording 'gs', just started, into a new file of 'dir'
+ * named after the time and seed. Nothing is allocated, the game may
+ * not allow it. -1 leaves the game unrecorded.
+ */
+int
+replay_record(struct replay_rec *w, struct game_state *gs, const char *dir)
+{
+	struct replay_header hdr;
+	char path[256];
+	struct tm tm;
+	time_t now;
+
+	if (gs->big) {
+		/* Keyframes of the large boards would be megabytes each */
+		return -1;
+	}
+
+	if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+		log_warn("Replay: %s: %s\n", dir, strerror(errno));
+		return -1;
+	}
+
+	now = time(NULL);
+	localtime_r(&now, &tm);
+	snprintf(path, sizeof path, "%s/%04d%02d%02d-%02d%02d%02d-%08x.rep", dir, tm.tm_year + 1900, tm.tm_mon + 1,
+		 tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, gs->seed);
+
+	if ((w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1) {
+		log_warn("Replay: %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	memset(&hdr, 0, sizeof hdr);
+	memcpy(hdr.magic, REPLAY_MAGIC, sizeof hdr.magic);
+	hdr.seed = gs->seed;
+	hdr.keyframe = REPLAY_KEYFRAME;
+	hdr.board_w = gs->board_w;
+	hdr.board_h = gs->board_h;
+	hdr.rng_ind = gs->prof.rng_ind;
+	hdr.preview = gs->prof.preview;
+	hdr.flags = gs->prof.flags;
+	hdr.start = now;
+	hdr.clock = gs->clock;
+
+	w->r.rec = w;
+	w->r.clock = gs->clock;
+	w->offset = w->len = 0;
+	w->step = w->count = 0;
+	w->start = w->last_clock = gs->clock;
+
+	if (rec_put(w, &hdr, sizeof hdr) || rec_keyframe(w, gs)) {
+		return -1;
+	}
+	gs->replay = &w->r;
+
+	log_info("Recording %s\n", path);
+
+	return 0;
+}
+
+/*
+ * Write down the step about to run at the frame's time, after the
+ * keyframe when one is due.
+ */
+void
+replay_append(struct game_state *gs, int op, int arg)
+{
+	struct replay_rec *w;
+
+	w = gs->replay->rec;
+	if (w->fd == -1) {
+		return;
+	}
+
+	if ((w->step && w->step % REPLAY_KEYFRAME == 0 && rec_keyframe(w, gs))
+	    || (w->len + RECORD_MAX > REPLAY_BUF_SIZE && rec_flush(w))) {
+		/* The file is closed, the game goes on unrecorded */
+		gs->replay = NULL;
+		return;
+	}
+
+	w->buf[w->len++] = op;
+	w->buf[w->len++] = arg;
+	rec_varint(w, w->r.clock - w->last_clock);
+
+	w->last_clock = w->r.clock;
+	++w->step;
+}
+
+/*
+ * Index and claims at the end, then the game goes on unrecorded.
+ */
+int
+replay_finish(struct game_state *gs)
+{
+	struct replay_trailer tr;
+	struct replay_rec *w;
+	int err;
+
+	if (!gs->replay || !(w = gs->replay->rec)) {
+		return 0;
+	}
+
+	memset(&tr, 0, sizeof tr);
+	tr.steps = w->step;
+	tr.ms = (w->last_clock - w->start) / MS;
+	tr.score = gs->score;
+	tr.lines = gs->lines;
+	tr.level = gs->level;
+	memcpy(tr.mino_count, gs->mino_count, sizeof tr.mino_count);
+	tr.count = w->count;
+	memcpy(tr.magic, REPLAY_INDEX_MAGIC, sizeof tr.magic);
+
+	gs->replay = NULL;
+	if (w->fd == -1 || rec_flush(w)) {
+		return -1;
+	}
+
+	err = 0;
+	if (write(w->fd, w->index, w->count * sizeof (*w->index)) != (ssize_t)(w->count * sizeof (*w->index))
+	    || write(w->fd, &tr, sizeof tr) != sizeof tr) {
+		log_warn("Replay: %s\n", strerror(errno));
+		err = -1;
+	}
+
+	close(w->fd);
+	w->fd = -1;
+
+	return err;
+}
+
+/* -==+ Reading +==- */
+
+/*
+ * One record at 'off', -1 if it runs past 'end'. Keyframes aren't
+ * decoded, their size is known.
+ */
+static int
+record_read(const uint8_t *data, size_t end, size_t *off, int *op, int *arg, uint64_t *dclock)
+{
+	uint64_t x;
+	size_t p;
+	int shift;
+
+	p = *off;
+	if (p + 2 > end) {
+		return -1;
+	}
+
+	*op = data[p];
+	*arg = data[p + 1];
+	p += 2;
+
+	if (*op == RP_KEYFRAME) {
+		if (p + sizeof (struct replay_keyframe) > end) {
+			return -1;
+		}
+		*off = p + sizeof (struct replay_keyframe);
+		return 0;
+	}
+
+	if (*op > RP_KEYFRAME) {
+		return -1;
+	}
+
+	x = 0;
+	shift = 0;
+	do {
+		if (p == end || shift > 63) {
+			return -1;
+		}
+		x |= (uint64_t)(data[p] & 0x7f) << shift;
+		shift += 7;
+	} while (data[p++] & 0x80);
+
+	*dclock = x;
+	*off = p;
+
+	return 0;
+}
+
+/*
+ * Index of a file without one: every keyframe, read up to the first
+ * record that's cut short.
+ */
+static int
+replay_scan(struct replay_file *f)
+{
+	uint64_t dclock;
+	size_t off, size;
+	uint32_t step;
+	int op, arg;
+
+	f->count = 0;
+	size = 0;
+	step = 0;
+
+	for (off = sizeof f->hdr; record_read(f->data, f->size, &off, &op, &arg, &dclock) == 0; ) {
+		if (op != RP_KEYFRAME) {
+			++step;
+			f->end = off;
+			continue;
+		}
+
+		if (f->count == size) {
+			size = size ? 2 * size : 64;
+			if ((f->index = realloc(f->index, size * sizeof (*f->index))) == NULL) {
+				return -1;
+			}
+		}
+
+		f->index[f->count].offset = off - 2 - sizeof (struct replay_keyframe);
+		memcpy(&f->index[f->count].step, f->data + f->index[f->count].offset + 2, sizeof (uint32_t));
+		memcpy(&f->index[f->count].ms, f->data + f->index[f->count].offset + 2 + sizeof (uint32_t), sizeof (uint32_t));
+		++f->count;
+		f->end = off;
+	}
+
+	f->own_index = 1;
+
+	return f->count ? 0 : -1;
+}
+
+/*
+ * Replay in memory, mapped or not, 'data' has to stay around. -1
+ * if it isn't one.
+ */
+int
+replay_map(struct replay_file *f, const uint8_t *data, size_t size)
+{
+	const struct replay_trailer *tr;
+	const struct engine *e;
+	size_t tail;
+
+	f->data = data;
+	f->size = size;
+	f->trailer = NULL;
+	f->index = NULL;
+	f->count = 0;
+	f->own_index = 0;
+
+	if (size < sizeof f->hdr) {
+		return -1;
+	}
+
+	memcpy(&f->hdr, data, sizeof f->hdr);
+	if (memcmp(f->hdr.magic, REPLAY_MAGIC, sizeof f->hdr.magic) || !f->hdr.keyframe) {
+		return -1;
+	}
+
+	/* Only boards of a compiled engine are recorded, keyframes hold nothing larger */
+	e = engine_find(f->hdr.board_w, f->hdr.board_h, f->hdr.flags & BIT(CONFIG_FGHOST));
+	if (e == NULL || !e->w) {
+		return -1;
+	}
+
+	/* The index is written right after the records, it's aligned if they are */
+	tr = (const struct replay_trailer *)(data + size - sizeof (*tr));
+	if (size >= sizeof f->hdr + sizeof (*tr) && !memcmp(tr->magic, REPLAY_INDEX_MAGIC, sizeof tr->magic)) {
+		tail = sizeof (*tr) + (size_t)tr->count * sizeof (struct replay_index);
+		if (tail <= size - sizeof f->hdr && tr->count) {
+			f->trailer = tr;
+			f->count = tr->count;
+			f->end = size - tail;
+			if ((f->index = malloc(f->count * sizeof (*f->index))) == NULL) {
+				return -1;
+			}
+			memcpy(f->index, data + f->end, f->count * sizeof (*f->index));
+			f->own_index = 1;
+			return 0;
+		}
+	}
+
+	return replay_scan(f);
+}
+
+int
+replay_open(struct replay_file *f, const char *path)
+{
+	struct stat st;
+	void *data;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+		return -1;
+	}
+
+	if (fstat(fd, &st) == -1 || st.st_size == 0
+	 || (data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	if (replay_map(f, data, st.st_size) == -1) {
+		munmap(data, st.st_size);
+		free(f->index);
+		f->index = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Only for files from replay_open() */
+void
+replay_close(struct replay_file *f)
+{
+	if (f->own_index) {
+		free(f->index);
+	}
+	munmap((void *)f->data, f->size);
+}
+
+/* Keyframe 'i' of the index */
+int
+replay_keyframe(const struct replay_file *f, uint32_t i, struct replay_keyframe *kf)
+{
+	if (i >= f->count || f->index[i].offset > f->size || f->size - f->index[i].offset < 2 + sizeof (*kf)
+	 || f->data[f->index[i].offset] != RP_KEYFRAME) {
+		return -1;
+	}
+
+	memcpy(kf, f->data + f->index[i].offset + 2, sizeof (*kf));
+
+	return 0;
+}
+
+/* -==+ Playback +==- */
+
+/* Load keyframe 'i' into the cursor's game */
+static int
+cursor_load(struct replay_cursor *c, uint32_t i)
+{
+	struct replay_keyframe kf;
+	struct config_prof prof;
+	const struct replay_header *h;
+
+	if (replay_keyframe(c->f, i, &kf) == -1) {
+		return -1;
+	}
+
+	h = &c->f->hdr;
+	memset(&prof, 0, sizeof prof);
+	prof.rng_ind = h->rng_ind % RAND_COUNT;
+	prof.preview = h->preview;
+	prof.board_w = h->board_w;
+	prof.board_h = h->board_h;
+	prof.flags = h->flags;
+
+	init_game(c->gs, &prof, h->seed);
+	replay_restore(c->gs, &kf);
+	c->gs->replay = &c->r;
+
+	c->off = c->f->index[i].offset + 2 + sizeof kf;
+	c->step = kf.step;
+	c->ms = kf.ms;
+	c->clock = kf.clock;
+	c->timed = 0;
+	c->frame_steps = 0;
+
+	return 0;
+}
+
+/*
+ * Play 'f' in 'gs' from the start. 'gs' needs no windows unless it's
+ * drawn.
+ */
+int
+replay_start(struct replay_cursor *c, const struct replay_file *f, struct game_state *gs)
+{
+	memset(c, 0, sizeof (*c));
+	c->f = f;
+	c->gs = gs;
+
+	return cursor_load(c, 0);
+}
+
+/*
+ * Whether the game's own loop could have made step 'op' 'dclock'
+ * after the last one: a frame with its fall due ends with the fall,
+ * nothing falls before it's due, and a frame doesn't hold more steps
+ * than the keys it read can make. Gravity is only what was recorded,
+ * this keeps a game from leaving it out or stopping the clock.
+ */
+static int
+timers_kept(struct replay_cursor *c, int op, uint64_t dclock)
+{
+	if (dclock) {
+		if (c->timed && gravity_due(c->gs, c->clock)) {
+			return 0;
+		}
+		c->frame_steps = 0;
+	}
+
+	if (++c->frame_steps > FRAME_STEPS) {
+		return 0;
+	}
+
+	return op != RP_GRAVITY || gravity_due(c->gs, c->clock + dclock);
+}
+
+/*
+ * Play one step, with the engine clock where it was. 0 at the end of
+ * the game, -1 if the record is broken, -2 if it's out of time with
+ * the game's timers while the cursor is strict.
+ */
+int
+replay_next(struct replay_cursor *c)
+{
+	struct game_state *gs;
+	uint64_t dclock;
+	int op, arg;
+
+	gs = c->gs;
+
+	do {
+		if (c->off >= c->f->end) {
+			return 0;
+		}
+		if (record_read(c->f->data, c->f->end, &c->off, &op, &arg, &dclock) == -1) {
+			return -1;
+		}
+	} while (op == RP_KEYFRAME);
+
+	/* Nothing the player couldn't have done, moves are a cell at most */
+	if ((op == RP_MOVE && ((arg & 3) > 2 || (arg >> 2 & 3) > 2 || arg >> 4 > AUTO_DROP))
+	 || (op == RP_ROTATE && arg > COUNTER_CLOCKWISE) || (op == RP_PAUSE && arg > 1)) {
+		return -1;
+	}
+
+	if (c->strict && !timers_kept(c, op, dclock)) {
+		return -2;
+	}
+
+	c->clock += dclock;
+	c->ms = (c->clock - c->f->hdr.clock) / MS;
+	c->r.clock = c->clock;
+	++c->step;
+
+	switch (op) {
+	case RP_MOVE:
+		move_mino(gs, (arg & 3) - 1, (arg >> 2 & 3) - 1, arg >> 4);
+		break;
+
+	case RP_ROTATE:
+		rotate_mino(gs, arg);
+		break;
+
+	case RP_HOLD:
+		hold_mino(gs);
+		break;
+
+	case RP_HARD_DROP:
+		hard_drop(gs);
+		break;
+
+	case RP_SPAWN:
+		spawn_mino(gs);
+		break;
+
+	case RP_GRAVITY:
+		gravity_drop(gs);
+		break;
+
+	case RP_LBREAK:
+		update_lbreak(gs);
+		break;
+
+	case RP_PAUSE:
+		if (arg) {
+			resume_game(gs);
+		} else {
+			pause_game(gs);
+		}
+		break;
+	}
+
+	/* Paused and line break frames don't run the fall timer */
+	c->timed = op != RP_LBREAK && !(gs->flags & (BIT(PAUSE) | BIT(LBREAK)));
+
+	return 1;
+}
+
+/* Last keyframe at or before 'target', a step or a time, by bisection */
+static uint32_t
+index_find(const struct replay_file *f, uint32_t target, int by_ms)
+{
+	uint32_t lo, hi, mid;
+
+	lo = 0;
+	hi = f->count;
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if ((by_ms ? f->index[mid].ms : f->index[mid].step) <= target) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+/*
+ * Go to 'step', forward or back: from the last keyframe before it,
+ * or from where the cursor is when that's closer. Stops at the end
+ * of the game, -1 only when a record is broken.
+ */
+int
+replay_seek(struct replay_cursor *c, uint32_t step)
+{
+	uint32_t k;
+	int r;
+
+	k = index_find(c->f, step, 0);
+	if (step < c->step || c->f->index[k].step > c->step) {
+		if (cursor_load(c, k) == -1) {
+			return -1;
+		}
+	}
+
+	while (c->step < step) {
+		if ((r = replay_next(c)) <= 0) {
+			return r;
+		}
+	}
+
+	return 0;
+}
+
+/* Go to the last step at or before 'ms' into the game */
+int
+replay_seek_ms(struct replay_cursor *c, uint32_t ms)
+{
+	uint64_t dclock;
+	size_t off;
+	uint32_t k;
+	int op, arg, r;
+
+	k = index_find(c->f, ms, 1);
+	if (ms < c->ms || c->f->index[k].step > c->step) {
+		if (cursor_load(c, k) == -1) {
+			return -1;
+		}
+	}
+
+	/* Peek at the next step's time before playing it */
+	for (;;) {
+		off = c->off;
+		do {
+			if (off >= c->f->end || record_read(c->f->data, c->f->end, &off, &op, &arg, &dclock) == -1) {
+				return 0;
+			}
+		} while (op == RP_KEYFRAME);
+
+		if ((c->clock + dclock - c->f->hdr.clock) / MS > ms) {
+			return 0;
+		}
+		if ((r = replay_next(c)) <= 0) {
+			return r;
+		}
+	}
+}
@@ -0,0 +1,237 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#define REPLAY_DIR		"e-type.replays"
+#define REPLAY_MAGIC		"EREPLAY3"
+#define REPLAY_INDEX_MAGIC	"ERINDEX1"
+#define REPLAY_KEYFRAME		256	/* Steps between two keyframes */
+#define REPLAY_BUF_SIZE		65536	/* Bytes written at once */
+#define REPLAY_INDEX_MAX	65536	/* Keyframes indexed, later ones are only in the stream */
+#define REPLAY_NO_HOLD		0xff
+#define REPLAY_UPCOMING		16	/* Tetrominos ahead two games are compared on */
+
+/* C library */
+#include <stddef.h>
+#include <stdint.h>
+
+/* e-type */
+#include "queue.h"
+#include "tetris.h"
+
+/*
+ * -==+ Replay file +==-
+ * A header, then one record per step: everything that changed the
+ * game went through one of the calls below, so playing them back on
+ * the same seed gives the same game. Records are the op, its argument
+ * and an unsigned LEB128 delta of the engine clock in ns, the time
+ * into the game follows from it. Every 'keyframe' steps there is a whole state
+ * record instead, and a finished file ends with the index of all of
+ * them and the trailer, so a seek loads the last keyframe before the
+ * step and plays at most 'keyframe' steps from there.
+ */
+typedef enum { RP_MOVE,		/* [dx + 1 | (dy + 1) << 2 | flags << 4] */
+	       RP_ROTATE,	/* [direction] */
+	       RP_HOLD,
+	       RP_HARD_DROP,
+	       RP_SPAWN,
+	       RP_GRAVITY,
+	       RP_LBREAK,	/* One step of the line break animation */
+	       RP_PAUSE,	/* [1 to resume], the pause is taken off the fall timer */
+	       RP_KEYFRAME	/* Followed by struct replay_keyframe */
+	     } replay_op;
+
+#define REPLAY_MOVE_ARG(dx, dy, flags)	(((dx) + 1) | ((dy) + 1) << 2 | (flags) << 4)
+
+struct replay_header {
+	char magic[8];
+	uint32_t seed;
+	uint32_t keyframe;
+	uint16_t board_w, board_h;
+	uint8_t rng_ind, preview, flags, pad;
+	int64_t start;		/* Wall clock, seconds */
+	uint64_t clock;		/* Engine clock at the start */
+};
+
+/*
+ * -==+ Keyframe +==-
+ * Everything the engine looks at, the state from 'board' up to
+ * 'timing' is what two games are compared on. The rest differs
+ * between two plays of the same game: timing, and how far ahead the
+ * queue was filled, which depends on what was drawn.
+ */
+struct replay_keyframe {
+	uint32_t step, ms;
+	uint64_t clock;
+	/* [Board state] */
+	uint8_t board[BOARD_MAX_H][BOARD_MAX_W];
+	struct mino curr_mino;
+	struct point curr_mino_pos;
+	uint16_t ghost_pos;
+	uint8_t hold;
+	uint8_t flags;
+	/* [Upcoming tetrominos] */
+	uint32_t head;
+	uint8_t upcoming[REPLAY_UPCOMING];
+	/* [Line break animation] */
+	int32_t lbreak_block, lbreak_count;
+	int32_t lbreak_lines[4];
+	/* [Statistics] */
+	uint32_t level;
+	uint32_t mino_count[7];
+	uint32_t lines, score, drop_score;
+	/* [Timing] */
+	uint64_t timing;
+	uint64_t immune, lbreak_timer;
+	double fpc;
+	/* [Queue as filled so far] */
+	uint8_t pieces[QUEUE_SIZE];
+	uint32_t tail;
+	union rng_state rng;
+};
+
+struct replay_index {
+	uint32_t step, ms;
+	uint64_t offset;	/* Of the keyframe record */
+};
+
+/* What the game ended with, the last thing in the file */
+struct replay_trailer {
+	uint32_t steps, ms;
+	uint32_t score, lines, level;
+	uint32_t mino_count[7];
+	uint32_t count;		/* Index entries right before the trailer */
+	char magic[8];
+};
+
+struct replay_rec;
+
+/*
+ * -==+ Replay handle +==-
+ * What a game being recorded or played back points to. 'clock' is
+ * what the engine sees as the time during a step, so a step does
+ * exactly the same when played back. While recording it's the time
+ * of the frame the step happened in, see replay_tick().
+ */
+struct replay {
+	uint64_t clock;
+	struct replay_rec *rec;		/* NULL while playing back */
+};
+
+/* -==+ Recorder +==- */
+struct replay_rec {
+	struct replay r;
+	int fd;
+	uint64_t offset;		/* Of buf[0] in the file */
+	uint32_t step;
+	uint64_t start, last_clock;
+	int len;
+	uint8_t buf[REPLAY_BUF_SIZE];
+	uint32_t count;
+	struct replay_index index[REPLAY_INDEX_MAX];
+};
+
+/*
+ * -==+ Mapped replay +==-
+ * 'trailer' is NULL for a game that never finished writing, its
+ * index comes from a scan of the records then.
+ */
+struct replay_file {
+	const uint8_t *data;
+	size_t size;
+	struct replay_header hdr;
+	const struct replay_trailer *trailer;
+	struct replay_index *index;
+	uint32_t count;
+	size_t end;			/* Of the records */
+	uint8_t own_index;
+};
+
+/*
+ * -==+ Playback +==-
+ * A game driven by the records of 'f', 'step' of them played so far.
+ * With 'strict' set, the steps are also held to the game's timers.
+ */
+struct replay_cursor {
+	struct replay r;
+	const struct replay_file *f;
+	struct game_state *gs;
+	size_t off;
+	uint32_t step, ms;
+	uint64_t clock;
+	uint8_t strict;
+	uint8_t timed;			/* The frame ends with the fall timer run */
+	uint32_t frame_steps;
+};
+
+/* -==+ Recording +==- */
+int  replay_record(struct replay_rec *w, struct game_state *gs, const char *dir);
+void replay_append(struct game_state *gs, int op, int arg);
+int  replay_finish(struct game_state *gs);
+
+/* -==+ Reading +==- */
+int  replay_open(struct replay_file *f, const char *path);
+int  replay_map(struct replay_file *f, const uint8_t *data, size_t size);
+void replay_close(struct replay_file *f);
+int  replay_keyframe(const struct replay_file *f, uint32_t i, struct replay_keyframe *kf);
+
+/* -==+ Playback +==- */
+int  replay_start(struct replay_cursor *c, const struct replay_file *f, struct game_state *gs);
+int  replay_next(struct replay_cursor *c);
+int  replay_seek(struct replay_cursor *c, uint32_t step);
+int  replay_seek_ms(struct replay_cursor *c, uint32_t ms);
+
+/* -==+ State +==- */
+void replay_snapshot(struct replay_keyframe *kf, const struct game_state *gs);
+int  replay_same(const struct replay_keyframe *a, const struct replay_keyframe *b);
+
+/*
+ * Time as the engine sees it: frozen for the step while a replay is
+ * recorded or played back.
+ */
+static inline uint64_t
+replay_clock(const struct game_state *gs)
+{
+	return gs->replay ? gs->replay->clock : time_ns();
+}
+
+/*
+ * A recorded game's frame starts at 'now', the time the loop read
+ * anyway. Its steps all happen then, so recording needs no clock.
+ */
+static inline void
+replay_tick(struct game_state *gs, uint64_t now)
+{
+	if (gs->replay && gs->replay->rec) {
+		gs->replay->clock = now;
+	}
+}
+
+/* Every step of a recorded game goes through here */
+static inline void
+replay_log(struct game_state *gs, int op, int arg)
+{
+	if (gs->replay && gs->replay->rec) {
+		replay_append(gs, op, arg);
+	}
+}
+
+#endif /* REPLAY_H */
@@ -21,6 +21,7 @@
 #include "rng_bag.h"
 /* C library */
 #include <stdlib.h>
+#include <string.h>
 
 void
 swap(uint8_t *a, uint8_t *b)
@@ -33,28 +34,29 @@ swap(uint8_t *a, uint8_t *b)
 }
 
 void
-scramble(uint8_t *arr, int size)
+scramble(uint8_t *arr, int size, unsigned int *seed)
 {
 	int i;
 
 	for (i = 0; i != size; ++i) {
-		swap(&arr[i], &arr[rand() % size]);
+		swap(&arr[i], &arr[rand_r(seed) % size]);
 	}
 }
 
 void
-bag_init(void *arg)
+bag_init(void *arg, unsigned int seed)
 {
 	int i;
 	struct rng_bag *bag;
 
 	bag = arg;
 
+	bag->seed = seed;
 	bag->bag_ind = 0;
 	for (i = 0; i != 7; ++i) {
 		bag->bag[i] = i;
 	}
-	bag->bag[7] = rand() % 7;
+	bag->bag[7] = rand_r(&bag->seed) % 7;
 	bag_refill(bag);
 }
 
@@ -70,9 +72,9 @@ bag_refill(void *arg)
 		;
 
 	swap(&bag->bag[0], &bag->bag[i]);
-	scramble(bag->bag + 1, 7 - 1);
+	scramble(bag->bag + 1, 7 - 1, &bag->seed);
 
-	bag->bag[7] = rand() % 7;
+	bag->bag[7] = rand_r(&bag->seed) % 7;
 	bag->bag_ind = 0;
 }
 
@@ -104,3 +106,31 @@ bag_peek(void *arg)
 	return bag->bag[bag->bag_ind];
 }
 
+
+/*
+ * Copy 'n' pieces out of the bag, refilling it as many times as needed.
+ */
+void
+bag_fill(void *arg, uint8_t *out, int n)
+{
+	struct rng_bag *bag;
+	int cnt;
+
+	bag = arg;
+
+	while (n) {
+		if (bag->bag_ind == 7) {
+			bag_refill(bag);
+		}
+
+		cnt = 7 - bag->bag_ind;
+		if (cnt > n) {
+			cnt = n;
+		}
+
+		memcpy(out, bag->bag + bag->bag_ind, cnt);
+		bag->bag_ind += cnt;
+		out += cnt;
+		n -= cnt;
+	}
+}
@@ -26,12 +26,14 @@
 struct rng_bag {
 	uint8_t	bag[7 + 1];
 	int bag_ind;
+	unsigned int seed;
 };
 
-void bag_init(void *arg);
+void bag_init(void *arg, unsigned int seed);
 void bag_refill(void *arg);
 int  bag_next(void *arg);
 int  bag_peek(void *arg);
+void bag_fill(void *arg, uint8_t *out, int n);
 
 #endif /* RNG_BAG_H */
 
@@ -23,8 +23,12 @@
 #include <stdlib.h>
 
 void
-simple_init(void *rng)
+simple_init(void *rng, unsigned int seed)
 {
+	struct rng_simple *simple;
+
+	simple = rng;
+	simple->seed = seed;
 	simple_next(rng);
 }
 
@@ -36,7 +40,7 @@ simple_next(void *rng)
 
 	simple = rng;
 	tmp = simple->next;
-	simple->next = rand() % 7;
+	simple->next = rand_r(&simple->seed) % 7;
 
 	return tmp;
 }
@@ -51,3 +55,13 @@ simple_peek(void *rng)
 	return simple->next;
 }
 
+
+void
+simple_fill(void *rng, uint8_t *out, int n)
+{
+	int i;
+
+	for (i = 0; i != n; ++i) {
+		out[i] = simple_next(rng);
+	}
+}
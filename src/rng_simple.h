@@ -20,12 +20,17 @@
 #ifndef RNG_SIMPLE
 #define RNG_SIMPLE
 
+/* C library */
+#include <stdint.h>
+
 struct rng_simple {
 	int next;
+	unsigned int seed;
 };
 
-void simple_init(void *rng);
+void simple_init(void *rng, unsigned int seed);
 int  simple_next(void *rng);
 int  simple_peek(void *rng);
+void simple_fill(void *rng, uint8_t *out, int n);
 
 #endif /* RNG_SIMPLE */
@@ -0,0 +1,307 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Header file */
+#include "scores.h"
+/* C library */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+/* POSIX */
+#include <fcntl.h>
+#include <unistd.h>
+#include <pwd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+/* e-type */
+#include "log.h"
+
+struct score_file *scores_map = NULL;
+int scores_fd = -1;
+char scores_name[SCORES_NAME];
+
+/*
+ * Player slot for 'name', or the empty slot it would go in. NULL when
+ * the table is full.
+ */
+struct score_player *
+scores_find(const char *name)
+{
+	const unsigned char *p;
+	uint32_t h, i;
+	struct score_player *pl;
+
+	for (h = 2166136261u, p = (const unsigned char *)name; *p; ++p) {
+		h = (h ^ *p) * 16777619u;
+	}
+
+	for (i = 0; i != SCORES_PLAYERS; ++i) {
+		pl = &scores_map->player[(h + i) & (SCORES_PLAYERS - 1)];
+
+		if (pl->name[0] == '\0' || strncmp(pl->name, name, SCORES_NAME) == 0) {
+			return pl;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Insert an entry in a sorted table, dropping the lowest one.
+ */
+void
+scores_insert(struct score_table *t, const struct score_entry *e)
+{
+	int i;
+
+	for (i = 0; i != SCORES_TOP && t->top[i].score >= e->score; ++i)
+		;
+
+	if (i != SCORES_TOP) {
+		memmove(&t->top[i + 1], &t->top[i], (SCORES_TOP - i - 1) * sizeof (struct score_entry));
+		t->top[i] = *e;
+	}
+}
+
+/*
+ * The following must be called with the file locked.
+ */
+void
+scores_write_begin(void)
+{
+	__atomic_add_fetch(&scores_map->seq, 1, __ATOMIC_ACQ_REL);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void
+scores_write_end(void)
+{
+	__atomic_add_fetch(&scores_map->seq, 1, __ATOMIC_RELEASE);
+}
+
+void
+scores_add(int ruleset, const char *name, uint32_t score, uint32_t lines, int level)
+{
+	struct score_player *pl;
+	struct score_entry e;
+
+	memset(&e, 0, sizeof e);
+	e.date = time(NULL);
+	e.score = score;
+	e.lines = lines;
+	e.level = level;
+	strncpy(e.name, name, SCORES_NAME - 1);
+
+	scores_insert(&scores_map->global[ruleset], &e);
+
+	if ((pl = scores_find(e.name))) {
+		if (pl->name[0] == '\0') {
+			memcpy(pl->name, e.name, SCORES_NAME);
+			++scores_map->players;
+		}
+
+		++pl->games;
+		scores_insert(&pl->tables[ruleset], &e);
+	}
+}
+
+/*
+ * Map the leaderboard, creating it if needed. A file holding a single
+ * score is the old e-type.dat format, that score is kept.
+ */
+int
+scores_open(const char *path)
+{
+	struct stat st;
+	uint32_t legacy;
+	void *mem;
+	int fd;
+
+	if ((fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666)) == -1) {
+		log_error("%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	if (flock(fd, LOCK_EX) == -1 || fstat(fd, &st) == -1) {
+		log_error("%s: %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	legacy = 0;
+	if (st.st_size == sizeof legacy && pread(fd, &legacy, sizeof legacy, 0) != sizeof legacy) {
+		legacy = 0;
+	}
+
+	if ((size_t)st.st_size < sizeof (struct score_file) && ftruncate(fd, sizeof (struct score_file)) == -1) {
+		log_error("%s: %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	if ((mem = mmap(NULL, sizeof (struct score_file), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		log_error("%s: %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	scores_map = mem;
+	scores_fd = fd;
+
+	if (scores_map->magic != SCORES_MAGIC) {
+		memset(scores_map, 0, sizeof (struct score_file));
+		scores_map->version = SCORES_VERSION;
+
+		if (legacy) {
+			scores_add(0, scores_player(), legacy, 0, 0);
+		}
+
+		__atomic_store_n(&scores_map->magic, SCORES_MAGIC, __ATOMIC_RELEASE);
+
+	} else if (scores_map->seq & 1) {
+		/* A writer died halfway through, nobody else holds the lock */
+		log_warn("%s: recovering from an interrupted update\n", path);
+		scores_write_end();
+	}
+
+	flock(fd, LOCK_UN);
+
+	return 0;
+}
+
+void
+scores_close(void)
+{
+	if (scores_map) {
+		munmap(scores_map, sizeof (struct score_file));
+		close(scores_fd);
+		scores_map = NULL;
+		scores_fd = -1;
+	}
+}
+
+/*
+ * Name the scores are saved under: $USER or the login name.
+ */
+const char *
+scores_player(void)
+{
+	const struct passwd *pw;
+	const char *name;
+
+	if (scores_name[0] == '\0') {
+		if ((name = getenv("USER")) == NULL || *name == '\0') {
+			name = (pw = getpwuid(getuid())) ? pw->pw_name : "player";
+		}
+
+		strncpy(scores_name, name, SCORES_NAME - 1);
+	}
+
+	return scores_name;
+}
+
+/*
+ * Record a finished game in the global and the player's table.
+ */
+int
+scores_submit(int ruleset, const char *name, uint32_t score, uint32_t lines, int level)
+{
+	if (scores_map == NULL || ruleset < 0 || ruleset >= SCORES_RULESETS) {
+		return -1;
+	}
+
+	if (flock(scores_fd, LOCK_EX) == -1) {
+		log_error("flock: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (scores_map->seq & 1) {
+		/* A writer died halfway through since the file was opened */
+		log_warn("scores: recovering from an interrupted update\n");
+		scores_write_end();
+	}
+
+	scores_write_begin();
+	scores_add(ruleset, name, score, lines, level);
+	scores_write_end();
+
+	flock(scores_fd, LOCK_UN);
+
+	return 0;
+}
+
+/*
+ * Copy the 'n' best entries of a table (the global one if 'name' is
+ * NULL) without taking any lock. Returns the number of entries read.
+ */
+int
+scores_read(int ruleset, const char *name, struct score_entry *out, int n)
+{
+	const struct score_table *t;
+	struct score_player *pl;
+	uint32_t seq;
+	int tries, i;
+
+	if (scores_map == NULL || ruleset < 0 || ruleset >= SCORES_RULESETS ||
+	    __atomic_load_n(&scores_map->magic, __ATOMIC_ACQUIRE) != SCORES_MAGIC) {
+		return 0;
+	}
+
+	if (n > SCORES_TOP) {
+		n = SCORES_TOP;
+	}
+
+	for (tries = 0; tries != SCORES_READ_TRIES; ++tries) {
+		if ((seq = __atomic_load_n(&scores_map->seq, __ATOMIC_ACQUIRE)) & 1) {
+			continue;
+		}
+
+		if (name) {
+			pl = scores_find(name);
+			t = pl && pl->name[0] ? &pl->tables[ruleset] : NULL;
+		} else {
+			t = &scores_map->global[ruleset];
+		}
+
+		for (i = 0; t && i != n && t->top[i].score; ++i) {
+			out[i] = t->top[i];
+		}
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&scores_map->seq, __ATOMIC_RELAXED) == seq) {
+			return t ? i : 0;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Best score of a table, 0 if it's empty.
+ */
+uint32_t
+scores_best(int ruleset, const char *name)
+{
+	struct score_entry e;
+
+	return scores_read(ruleset, name, &e, 1) ? e.score : 0;
+}
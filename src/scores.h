@@ -0,0 +1,85 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SCORES_H
+#define SCORES_H
+
+#define SCORES_MAGIC		0x42535445	/* "ETSB" */
+#define SCORES_VERSION		1
+#define SCORES_TOP		10	/* Entries per table */
+#define SCORES_PLAYERS		1024	/* Player slots, must be a power of 2 */
+#define SCORES_NAME		16
+#define SCORES_RULESETS		RAND_COUNT
+#define SCORES_READ_TRIES	1000	/* Give up on a torn read after this many retries */
+
+/* C library */
+#include <stdint.h>
+
+/* e-type */
+#include "config.h"
+
+/*
+ * -==+ Leaderboard entry +==-
+ */
+struct score_entry {
+	uint64_t date;
+	uint32_t score;
+	uint32_t lines;
+	uint16_t level;
+	char name[SCORES_NAME];
+};
+
+/*
+ * -==+ Top N table +==-
+ * Sorted by score, unused entries have a score of 0.
+ */
+struct score_table {
+	struct score_entry top[SCORES_TOP];
+};
+
+struct score_player {
+	char name[SCORES_NAME];
+	uint32_t games;
+	struct score_table tables[SCORES_RULESETS];
+};
+
+/*
+ * -==+ Leaderboard file +==-
+ * Mapped as is by every running instance. Writers serialize with
+ * flock() and bump 'seq' around every update (odd while writing), so
+ * readers copy straight out of the mapping and retry on a torn read.
+ * Players are found by hashing their name into 'player'.
+ */
+struct score_file {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t seq;
+	uint32_t players;
+	struct score_table global[SCORES_RULESETS];
+	struct score_player player[SCORES_PLAYERS];
+};
+
+int         scores_open(const char *path);
+void        scores_close(void);
+const char *scores_player(void);
+int         scores_submit(int ruleset, const char *name, uint32_t score, uint32_t lines, int level);
+uint32_t    scores_best(int ruleset, const char *name);
+int         scores_read(int ruleset, const char *name, struct score_entry *out, int n);
+
+#endif /* SCORES_H */
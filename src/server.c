@@ -0,0 +1,1235 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* accept4(), SO_REUSEPORT, recvmmsg() and thread affinity */
+#define _GNU_SOURCE
+
+/* Header file */
+#include "server.h"
+/* C library */
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+/* POSIX */
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+/* Sockets */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+/* e-type */
+#include "arena.h"
+#include "bigboard.h"
+#include "input.h"
+#include "log.h"
+#include "net.h"
+#include "tetris.h"
+#include "utils.h"
+#include "wheel.h"
+
+#define CONTAINER_OF(p, type, member)	((type *)((char *)(p) - offsetof(type, member)))
+
+/* Only the owning thread writes, plain stores are enough for readers */
+#define STAT_ADD(s, field, n)	__atomic_store_n(&(s)->stats.field, (s)->stats.field + (n), __ATOMIC_RELAXED)
+
+#define LOCK_TICKS	((uint64_t)IMMUNITY_TIMER / SERVER_TICK_NS)
+
+/* Datagrams taken per recvmmsg() */
+#define UDP_BATCH	32
+
+struct match;
+struct shard;
+
+/*
+ * -==+ Connection +==-
+ * Owned by one shard, part of no match until its hello is in. Dead
+ * ones are freed at the end of the loop iteration, events for them
+ * may still be pending in it.
+ */
+struct conn {
+	int fd;
+	struct shard *shard;
+	struct match *match;
+	int player;
+	uint8_t hello[NET_HELLO_SIZE];
+	int hello_len;
+	uint8_t out[SERVER_OUT_SIZE];
+	int out_len;
+	uint8_t writing, closing, dead;
+	struct conn *prev, *next;
+};
+
+/*
+ * -==+ Player +==-
+ * Authoritative headless game, its gravity and lock delay are timers
+ * of the shard instead of clock() checks. 'addr' is where the last
+ * good datagram came from, boards go there once there is one.
+ */
+struct player {
+	struct game_state gs;
+	struct match *match;
+	struct conn *conn;
+	struct wheel_timer gravity, lock;
+	struct player *dirty_next;
+	uint8_t dirty;
+	/* [UDP] */
+	uint32_t token;
+	uint32_t key_next;
+	uint32_t board_seq;
+	struct sockaddr_storage addr;
+	socklen_t addr_len;
+};
+
+struct match {
+	uint32_t id;
+	struct match *next;
+	struct shard *shard;
+	struct player players[2];
+	int joined;
+	uint8_t started, over;
+};
+
+/* What goes through a shard's pipe, 'fd' -1 only wakes it up */
+struct handoff {
+	int fd;
+	uint32_t match;
+};
+
+/*
+ * -==+ Shard +==-
+ * One event loop, the matches whose id maps to it and everything
+ * they need. Connections and matches come from pools of its own
+ * arena, only the pages they use are committed. Nothing in here is
+ * touched by other threads but the counters, read only, and the pipe.
+ */
+struct shard {
+	struct server *srv;
+	int id;
+	int epfd, listen_fd, udp_fd, handoff[2];
+	uint64_t start;
+	uint64_t tokens;
+	struct wheel wheel;
+	struct match *buckets[SERVER_BUCKETS];
+	struct conn *conns, *dead;
+	struct match *dead_matches;
+	struct player *dirty;
+	struct arena arena;
+	struct pool conn_pool, match_pool;
+	pthread_t thread;
+	struct server_stats stats __attribute__ ((aligned(64)));
+};
+
+struct server {
+	struct shard *shards;
+	int count;
+	int running;
+	int stop;
+	struct config_prof prof;
+};
+
+static void match_end(struct match *m, int winner);
+
+/* -==+ Connections +==- */
+
+static uint64_t
+shard_now(const struct shard *s)
+{
+	return (time_ns() - s->start) / SERVER_TICK_NS;
+}
+
+static void
+conn_events(struct conn *c, uint32_t events)
+{
+	struct epoll_event ev;
+
+	ev.events = events;
+	ev.data.ptr = c;
+	epoll_ctl(c->shard->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+	c->writing = !!(events & EPOLLOUT);
+}
+
+static struct conn *
+conn_new(struct shard *s, int fd)
+{
+	struct epoll_event ev;
+	struct conn *c;
+	int one;
+
+	if ((c = pool_get(&s->conn_pool)) == NULL) {
+		log_warn("Shard %d: %d connections, turning one away\n", s->id, SERVER_CONNS);
+		close(fd);
+		return NULL;
+	}
+	memset(c, 0, sizeof (*c));
+
+	c->fd = fd;
+	c->shard = s;
+	c->player = -1;
+
+	one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = c;
+	if (epoll_ctl(s->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		log_error("epoll_ctl: %s\n", strerror(errno));
+		close(fd);
+		pool_put(&s->conn_pool, c);
+		return NULL;
+	}
+
+	if ((c->next = s->conns)) {
+		c->next->prev = c;
+	}
+	s->conns = c;
+
+	STAT_ADD(s, conns, 1);
+
+	return c;
+}
+
+/*
+ * Close 'c' and leave its match, which ends it. 'keep_fd' is for
+ * connections handed to another shard.
+ */
+static void
+conn_kill(struct conn *c, int keep_fd)
+{
+	struct shard *s;
+	struct match *m;
+
+	if (c->dead) {
+		return;
+	}
+
+	s = c->shard;
+	c->dead = 1;
+	epoll_ctl(s->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	if (!keep_fd) {
+		close(c->fd);
+	}
+
+	if ((m = c->match)) {
+		m->players[c->player].conn = NULL;
+		c->match = NULL;
+		match_end(m, m->started ? !c->player : NET_NO_WINNER);
+	}
+
+	/* Off the live list, onto the dead one */
+	if (c->prev) {
+		c->prev->next = c->next;
+	} else {
+		s->conns = c->next;
+	}
+	if (c->next) {
+		c->next->prev = c->prev;
+	}
+
+	c->next = s->dead;
+	s->dead = c;
+}
+
+/*
+ * Send right away, whatever doesn't fit in the socket waits for
+ * EPOLLOUT. Too much waiting means the client can't keep up.
+ */
+static void
+conn_send(struct conn *c, const uint8_t *buf, int len)
+{
+	ssize_t n;
+
+	if (!c || c->dead) {
+		return;
+	}
+
+	n = 0;
+	if (!c->out_len && (n = send(c->fd, buf, len, MSG_NOSIGNAL | MSG_DONTWAIT)) == -1) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			conn_kill(c, 0);
+			return;
+		}
+		n = 0;
+	}
+
+	STAT_ADD(c->shard, msgs, 1);
+
+	if (n == len) {
+		return;
+	}
+
+	if (c->out_len + len - n > SERVER_OUT_SIZE) {
+		log_warn("Dropping a client that doesn't keep up\n");
+		conn_kill(c, 0);
+		return;
+	}
+
+	memcpy(c->out + c->out_len, buf + n, len - n);
+	c->out_len += len - n;
+
+	if (!c->writing) {
+		conn_events(c, EPOLLIN | EPOLLOUT);
+	}
+}
+
+static void
+conn_flush(struct conn *c)
+{
+	ssize_t n;
+
+	if ((n = send(c->fd, c->out, c->out_len, MSG_NOSIGNAL | MSG_DONTWAIT)) == -1) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			conn_kill(c, 0);
+		}
+		return;
+	}
+
+	memmove(c->out, c->out + n, c->out_len - n);
+	c->out_len -= n;
+
+	if (!c->out_len) {
+		if (c->closing) {
+			conn_kill(c, 0);
+		} else {
+			conn_events(c, EPOLLIN);
+		}
+	}
+}
+
+/* Close once everything queued is out */
+static void
+conn_close(struct conn *c)
+{
+	if (!c || c->dead) {
+		return;
+	}
+
+	c->match = NULL;
+	c->closing = 1;
+	if (!c->out_len) {
+		conn_kill(c, 0);
+	}
+}
+
+/* -==+ Matches +==- */
+
+static struct match **
+match_slot(struct shard *s, uint32_t id)
+{
+	struct match **m;
+
+	for (m = &s->buckets[(id * 2654435761u) >> 20 & (SERVER_BUCKETS - 1)]; *m && (*m)->id != id; m = &(*m)->next)
+		;
+
+	return m;
+}
+
+static void
+match_send(struct match *m, int type, const uint8_t *payload, int len)
+{
+	uint8_t buf[NET_MSG_MAX];
+
+	len = net_msg(buf, type, payload, len);
+	conn_send(m->players[0].conn, buf, len);
+	conn_send(m->players[1].conn, buf, len);
+}
+
+static void
+player_dirty(struct player *p)
+{
+	struct shard *s;
+
+	if (!p->dirty) {
+		s = p->match->shard;
+		p->dirty = 1;
+		p->dirty_next = s->dirty;
+		s->dirty = p;
+	}
+}
+
+/*
+ * Both players get the last boards and the result, then the match
+ * leaves the table so the id can be used again.
+ */
+static void
+match_end(struct match *m, int winner)
+{
+	struct shard *s;
+	uint8_t buf[NET_MSG_MAX], w;
+	int i, len;
+
+	if (m->over) {
+		return;
+	}
+
+	s = m->shard;
+	m->over = 1;
+
+	for (i = 0; i != 2; ++i) {
+		wheel_del(&s->wheel, &m->players[i].gravity);
+		wheel_del(&s->wheel, &m->players[i].lock);
+	}
+
+	if (m->started) {
+		for (i = 0; i != 2; ++i) {
+			len = net_pack_board(buf, &m->players[i].gs, i);
+			conn_send(m->players[0].conn, buf, len);
+			conn_send(m->players[1].conn, buf, len);
+		}
+	}
+
+	w = winner;
+	match_send(m, NET_OVER, &w, 1);
+
+	conn_close(m->players[0].conn);
+	conn_close(m->players[1].conn);
+	m->players[0].conn = m->players[1].conn = NULL;
+
+	*match_slot(s, m->id) = m->next;
+
+	/* Freed with the dead connections, dirty lists may still point here */
+	m->next = s->dead_matches;
+	s->dead_matches = m;
+}
+
+/*
+ * Whatever a player did, see if it ended the game, whether the lock
+ * delay started or ended and get the board sent.
+ */
+static void
+player_update(struct player *p)
+{
+	struct match *m;
+	struct shard *s;
+
+	m = p->match;
+	s = m->shard;
+
+	if (p->gs.flags & BIT(QUIT)) {
+		match_end(m, p == &m->players[0]);
+		return;
+	}
+
+	if (p->gs.immune && !wheel_pending(&p->lock)) {
+		wheel_add(&s->wheel, &p->lock, s->wheel.now + LOCK_TICKS);
+
+	} else if (!p->gs.immune) {
+		wheel_del(&s->wheel, &p->lock);
+	}
+
+	player_dirty(p);
+}
+
+static uint64_t
+gravity_ticks(const struct game_state *gs)
+{
+	return gs->fpc / 60.0 * 1000000000 / SERVER_TICK_NS;
+}
+
+/* During the lock delay only the lock timer moves the tetromino down */
+static void
+on_gravity(struct wheel_timer *t)
+{
+	struct player *p;
+	struct shard *s;
+
+	p = CONTAINER_OF(t, struct player, gravity);
+	s = p->match->shard;
+
+	if (!p->gs.immune && move_mino(&p->gs, 0, 1, AUTO_DROP) == SUCCESS) {
+		--p->gs.drop_score;
+	}
+
+	player_update(p);
+
+	if (!p->match->over) {
+		wheel_add(&s->wheel, &p->gravity, s->wheel.now + gravity_ticks(&p->gs));
+	}
+}
+
+static void
+on_lock(struct wheel_timer *t)
+{
+	struct player *p;
+
+	p = CONTAINER_OF(t, struct player, lock);
+	p->gs.immune = 0;
+
+	if (move_mino(&p->gs, 0, 1, AUTO_DROP) == SUCCESS) {
+		--p->gs.drop_score;
+	}
+
+	player_update(p);
+}
+
+static void
+player_key(struct player *p, int key)
+{
+	struct game_state *gs;
+
+	gs = &p->gs;
+	STAT_ADD(p->match->shard, inputs, 1);
+
+	switch (key) {
+	case IN_LEFT:
+		move_mino(gs, -1, 0, SOFT_DROP);
+		break;
+
+	case IN_RIGHT:
+		move_mino(gs, 1, 0, SOFT_DROP);
+		break;
+
+	case IN_SOFT_DROP:
+		move_mino(gs, 0, 1, SOFT_DROP);
+		break;
+
+	case IN_HARD_DROP:
+		hard_drop(gs);
+		break;
+
+	case IN_ROTATE_CW:
+		rotate_mino(gs, CLOCKWISE);
+		break;
+
+	case IN_ROTATE_CCW:
+		rotate_mino(gs, COUNTER_CLOCKWISE);
+		break;
+
+	case IN_HOLD:
+		hold_mino(gs);
+		break;
+
+	default:
+		return;
+	}
+
+	player_update(p);
+}
+
+/*
+ * Both players start on the same seed, so they get the same pieces.
+ */
+static void
+match_start(struct match *m)
+{
+	struct shard *s;
+	struct player *p;
+	uint8_t buf[NET_MSG_MAX];
+	uint32_t seed;
+	int i, len;
+
+	s = m->shard;
+	seed = m->id * 2654435761u ^ (uint32_t)time_ns();
+	m->started = 1;
+
+	for (i = 0; i != 2; ++i) {
+		p = &m->players[i];
+		init_game(&p->gs, &s->srv->prof, seed);
+		spawn_mino(&p->gs);
+
+		p->gravity.fn = on_gravity;
+		p->lock.fn = on_lock;
+		wheel_add(&s->wheel, &p->gravity, s->wheel.now + gravity_ticks(&p->gs));
+
+		/* Not a secret, keeps stray datagrams out of the game */
+		s->tokens ^= s->tokens << 13;
+		s->tokens ^= s->tokens >> 7;
+		s->tokens ^= s->tokens << 17;
+		p->token = s->tokens >> 32;
+
+		len = net_pack_start(buf, i, seed, s->udp_fd != -1 ? s->id : NET_NO_UDP, p->token);
+		conn_send(p->conn, buf, len);
+		player_dirty(p);
+	}
+
+	STAT_ADD(s, matches, 1);
+}
+
+/*
+ * First hello for an id creates the match, the second one starts it,
+ * a third connection is turned away.
+ */
+static void
+match_join(struct shard *s, struct conn *c, uint32_t id)
+{
+	struct match **slot, *m;
+	uint8_t buf[NET_MSG_MAX], who;
+	int len;
+
+	slot = match_slot(s, id);
+	if ((m = *slot) == NULL) {
+		if ((m = pool_get(&s->match_pool)) == NULL) {
+			log_warn("Shard %d: %d matches, turning one away\n", s->id, SERVER_CONNS);
+			conn_kill(c, 0);
+			return;
+		}
+		memset(m, 0, sizeof (*m));
+		m->id = id;
+		m->shard = s;
+		m->players[0].match = m->players[1].match = m;
+		*slot = m;
+
+	} else if (m->joined == 2) {
+		who = NET_NO_WINNER;
+		len = net_msg(buf, NET_OVER, &who, 1);
+		conn_send(c, buf, len);
+		conn_close(c);
+		return;
+	}
+
+	c->match = m;
+	c->player = m->joined;
+	m->players[m->joined++].conn = c;
+
+	who = c->player;
+	len = net_msg(buf, NET_WAIT, &who, 1);
+	conn_send(c, buf, len);
+
+	if (m->joined == 2) {
+		match_start(m);
+	}
+}
+
+/* -==+ Shards +==- */
+
+/*
+ * The owner of a match is picked by its id, so both players end up
+ * in the same shard no matter where the kernel put them.
+ */
+static void
+conn_hello(struct conn *c)
+{
+	struct shard *s, *owner;
+	struct handoff h;
+	uint32_t id;
+
+	s = c->shard;
+	if (net_parse_hello(c->hello, &id) == -1) {
+		log_warn("Bad hello\n");
+		conn_kill(c, 0);
+		return;
+	}
+
+	owner = &s->srv->shards[id % s->srv->count];
+	if (owner == s) {
+		match_join(s, c, id);
+		return;
+	}
+
+	h.fd = c->fd;
+	h.match = id;
+	conn_kill(c, 1);
+	if (write(owner->handoff[1], &h, sizeof h) != sizeof h) {
+		log_error("Handoff: %s\n", strerror(errno));
+		close(h.fd);
+		return;
+	}
+
+	STAT_ADD(s, handoffs, 1);
+}
+
+/*
+ * Up to the hello only the hello is taken from the socket, whatever
+ * follows stays queued for the shard that ends up owning it.
+ */
+static void
+conn_read(struct conn *c)
+{
+	uint8_t buf[256];
+	ssize_t n, i;
+	size_t want;
+
+	want = sizeof buf;
+	if (c->hello_len < NET_HELLO_SIZE) {
+		want = NET_HELLO_SIZE - c->hello_len;
+	}
+
+	if ((n = recv(c->fd, buf, want, MSG_DONTWAIT)) <= 0) {
+		if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+			conn_kill(c, 0);
+		}
+		return;
+	}
+
+	if (c->hello_len < NET_HELLO_SIZE) {
+		memcpy(c->hello + c->hello_len, buf, n);
+		c->hello_len += n;
+		if (c->hello_len == NET_HELLO_SIZE) {
+			conn_hello(c);
+		}
+		return;
+	}
+
+	for (i = 0; i < n && !c->dead && c->match && c->match->started; ++i) {
+		player_key(&c->match->players[c->player], buf[i]);
+	}
+}
+
+static void
+shard_accept(struct shard *s)
+{
+	int fd;
+
+	while ((fd = accept4(s->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+		conn_new(s, fd);
+	}
+
+	if (errno != EAGAIN && errno != EWOULDBLOCK) {
+		log_warn("accept4: %s\n", strerror(errno));
+	}
+}
+
+static void
+shard_handoffs(struct shard *s)
+{
+	struct handoff h[64];
+	struct conn *c;
+	ssize_t n;
+	int i;
+
+	while ((n = read(s->handoff[0], h, sizeof h)) > 0) {
+		for (i = 0; i != n / (ssize_t)sizeof (*h); ++i) {
+			if (h[i].fd != -1 && (c = conn_new(s, h[i].fd))) {
+				c->hello_len = NET_HELLO_SIZE;
+				match_join(s, c, h[i].match);
+			}
+		}
+	}
+}
+
+/*
+ * A board for player 'to' of 'm', as a datagram when it has sent
+ * one, acknowledging its keys. A lost one is fine, the next board
+ * has everything.
+ */
+static void
+board_send(struct match *m, int to, const uint8_t *msg, int len)
+{
+	uint8_t buf[NET_UDP_MAX];
+	struct player *r;
+
+	r = &m->players[to];
+	if (!r->addr_len) {
+		conn_send(r->conn, msg, len);
+		return;
+	}
+
+	len = net_pack_udp_board(buf, ++r->board_seq, r->key_next, msg, len);
+	sendto(m->shard->udp_fd, buf, len, MSG_DONTWAIT, (struct sockaddr *)&r->addr, r->addr_len);
+	STAT_ADD(m->shard, msgs, 1);
+}
+
+/* One board message per player that changed, both players get it */
+static void
+shard_flush(struct shard *s)
+{
+	uint8_t buf[NET_MSG_MAX];
+	struct player *p;
+	struct match *m;
+	int len;
+
+	while ((p = s->dirty)) {
+		s->dirty = p->dirty_next;
+		p->dirty = 0;
+		m = p->match;
+		if (m->over) {
+			continue;
+		}
+
+		len = net_pack_board(buf, &p->gs, p - m->players);
+		board_send(m, 0, buf, len);
+		board_send(m, 1, buf, len);
+	}
+}
+
+/*
+ * Keys over UDP: only the ones not seen yet count, whatever the
+ * datagram repeats is skipped. Every good datagram gets a board
+ * back, which carries the acknowledgement.
+ */
+static void
+shard_udp(struct shard *s)
+{
+	struct mmsghdr msgs[UDP_BATCH];
+	struct iovec iov[UDP_BATCH];
+	struct sockaddr_storage addrs[UDP_BATCH];
+	uint8_t bufs[UDP_BATCH][NET_UDP_MAX];
+	struct net_inputs_msg im;
+	struct match *m;
+	struct player *p;
+	int i, n, k;
+
+	do {
+		for (i = 0; i != UDP_BATCH; ++i) {
+			iov[i].iov_base = bufs[i];
+			iov[i].iov_len = sizeof bufs[i];
+			memset(&msgs[i].msg_hdr, 0, sizeof msgs[i].msg_hdr);
+			msgs[i].msg_hdr.msg_name = &addrs[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof addrs[i];
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		if ((n = recvmmsg(s->udp_fd, msgs, UDP_BATCH, MSG_DONTWAIT, NULL)) <= 0) {
+			return;
+		}
+
+		STAT_ADD(s, datagrams, n);
+
+		for (i = 0; i != n; ++i) {
+			if (net_unpack_inputs(&im, bufs[i], msgs[i].msg_len) == -1 || im.player > 1
+			 || (m = *match_slot(s, im.match)) == NULL || !m->started || m->over
+			 || im.token != m->players[im.player].token) {
+				continue;
+			}
+
+			p = &m->players[im.player];
+			memcpy(&p->addr, &addrs[i], msgs[i].msg_hdr.msg_namelen);
+			p->addr_len = msgs[i].msg_hdr.msg_namelen;
+
+			for (k = net_inputs_new(&p->key_next, &im); k < im.count && !m->over; ++k) {
+				player_key(p, im.keys[k]);
+			}
+
+			if (!m->over) {
+				player_dirty(p);
+			}
+		}
+	} while (n == UDP_BATCH);
+}
+
+static void
+shard_reap(struct shard *s)
+{
+	struct conn *c;
+	struct match *m;
+
+	while ((c = s->dead)) {
+		s->dead = c->next;
+		pool_put(&s->conn_pool, c);
+	}
+
+	while ((m = s->dead_matches)) {
+		s->dead_matches = m->next;
+		big_free(m->players[0].gs.big);
+		big_free(m->players[1].gs.big);
+		pool_put(&s->match_pool, m);
+	}
+}
+
+/*
+ * One round of the loop: wait for sockets or the next timer,
+ * handle what came in, run the timers that are due and send out
+ * whatever changed.
+ */
+static int
+shard_poll(struct shard *s, int timeout)
+{
+	struct epoll_event ev[SERVER_EVENTS];
+	int64_t next;
+	int i, n;
+
+	next = wheel_next(&s->wheel);
+	if (next != -1 && (timeout == -1 || next * SERVER_TICK_NS / 1000000 < (uint64_t)timeout)) {
+		timeout = (next * SERVER_TICK_NS + 999999) / 1000000;
+	}
+
+	if ((n = epoll_wait(s->epfd, ev, SERVER_EVENTS, timeout)) == -1) {
+		if (errno != EINTR) {
+			log_error("epoll_wait: %s\n", strerror(errno));
+			return -1;
+		}
+		n = 0;
+	}
+
+	for (i = 0; i != n; ++i) {
+		struct conn *c;
+
+		if (ev[i].data.ptr == &s->listen_fd) {
+			shard_accept(s);
+
+		} else if (ev[i].data.ptr == s->handoff) {
+			shard_handoffs(s);
+
+		} else if (ev[i].data.ptr == &s->udp_fd) {
+			shard_udp(s);
+
+		} else if (!(c = ev[i].data.ptr)->dead) {
+			if (ev[i].events & (EPOLLERR | EPOLLHUP)) {
+				conn_kill(c, 0);
+				continue;
+			}
+			if (ev[i].events & EPOLLOUT) {
+				conn_flush(c);
+			}
+			if (!c->dead && ev[i].events & EPOLLIN) {
+				conn_read(c);
+			}
+		}
+	}
+
+	STAT_ADD(s, timers, wheel_advance(&s->wheel, shard_now(s)));
+	shard_flush(s);
+	shard_reap(s);
+
+	return n;
+}
+
+static void *
+shard_thread(void *arg)
+{
+	struct shard *s;
+	cpu_set_t set;
+
+	s = arg;
+
+	/* One shard per core, when there are enough of them */
+	CPU_ZERO(&set);
+	CPU_SET(s->id % CPU_SETSIZE, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+
+	while (!__atomic_load_n(&s->srv->stop, __ATOMIC_RELAXED)) {
+		if (shard_poll(s, -1) == -1) {
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Every shard listens on the same port, SO_REUSEPORT has the kernel
+ * spread the connections among them.
+ */
+static int
+shard_listen(const char *port)
+{
+	struct addrinfo hints, *res, *ai;
+	int fd, one, err;
+
+	memset(&hints, 0, sizeof hints);
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+
+	if ((err = getaddrinfo(NULL, port, &hints, &res)) != 0) {
+		log_error("getaddrinfo: %s\n", gai_strerror(err));
+		return -1;
+	}
+
+	fd = -1;
+	for (ai = res; ai; ai = ai->ai_next) {
+		if ((fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol)) == -1) {
+			continue;
+		}
+
+		one = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+		setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof one);
+
+		if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0) {
+			break;
+		}
+
+		close(fd);
+		fd = -1;
+	}
+
+	freeaddrinfo(res);
+
+	if (fd == -1) {
+		log_error("Can't listen on port %s: %s\n", port, strerror(errno));
+	}
+
+	return fd;
+}
+
+/*
+ * Keys of the matches in shard 'id' come to UDP port 'port' + 'id',
+ * so they get to the owner without handoffs. Without it the shard
+ * simply stays on TCP.
+ */
+static int
+shard_bind_udp(const char *port, int id)
+{
+	struct sockaddr_in sin;
+	char *end;
+	long n;
+	int fd;
+
+	n = strtol(port, &end, 10);
+	if (*end || n < 1 || n + id > 65535) {
+		log_warn("No UDP for shard %d, port %s isn't a number\n", id, port);
+		return -1;
+	}
+
+	if ((fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1) {
+		return -1;
+	}
+
+	memset(&sin, 0, sizeof sin);
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_ANY);
+	sin.sin_port = htons(n + id);
+
+	if (bind(fd, (struct sockaddr *)&sin, sizeof sin) == -1) {
+		log_warn("No UDP for shard %d: port %ld: %s\n", id, n + id, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static int
+shard_init(struct server *srv, struct shard *s, int id, const char *port)
+{
+	struct epoll_event ev;
+
+	s->srv = srv;
+	s->id = id;
+	s->start = time_ns();
+	s->tokens = s->start * 2654435761u | 1;
+	s->listen_fd = s->udp_fd = s->handoff[0] = s->handoff[1] = -1;
+	wheel_init(&s->wheel, 0);
+
+	if (arena_init(&s->arena, POOL_BYTES(sizeof (struct conn), SERVER_CONNS)
+				  + POOL_BYTES(sizeof (struct match), SERVER_CONNS))
+	 || pool_init(&s->conn_pool, &s->arena, "connection", sizeof (struct conn), SERVER_CONNS)
+	 || pool_init(&s->match_pool, &s->arena, "match", sizeof (struct match), SERVER_CONNS)) {
+		return -1;
+	}
+
+	if ((s->epfd = epoll_create1(EPOLL_CLOEXEC)) == -1
+	 || (s->listen_fd = shard_listen(port)) == -1
+	 || pipe2(s->handoff, O_NONBLOCK | O_CLOEXEC) == -1) {
+		return -1;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = &s->listen_fd;
+	if (epoll_ctl(s->epfd, EPOLL_CTL_ADD, s->listen_fd, &ev) == -1) {
+		return -1;
+	}
+
+	if ((s->udp_fd = shard_bind_udp(port, id)) != -1) {
+		ev.data.ptr = &s->udp_fd;
+		if (epoll_ctl(s->epfd, EPOLL_CTL_ADD, s->udp_fd, &ev) == -1) {
+			return -1;
+		}
+	}
+
+	ev.data.ptr = s->handoff;
+	return epoll_ctl(s->epfd, EPOLL_CTL_ADD, s->handoff[0], &ev);
+}
+
+static void
+shard_free(struct shard *s)
+{
+	struct match *m;
+	int i;
+
+	while (s->conns) {
+		conn_kill(s->conns, 0);
+	}
+	shard_reap(s);
+
+	/* Matches still waiting for a player, they have no connection now */
+	for (i = 0; i != SERVER_BUCKETS; ++i) {
+		while ((m = s->buckets[i])) {
+			s->buckets[i] = m->next;
+			pool_put(&s->match_pool, m);
+		}
+	}
+
+	if (s->listen_fd != -1) {
+		close(s->listen_fd);
+	}
+	if (s->udp_fd != -1) {
+		close(s->udp_fd);
+	}
+	if (s->handoff[0] != -1) {
+		close(s->handoff[0]);
+		close(s->handoff[1]);
+	}
+	if (s->epfd != -1) {
+		close(s->epfd);
+	}
+
+	arena_free(&s->arena);
+}
+
+/* -==+ Start/Stop +==- */
+
+/*
+ * Listen on 'port' with 'shards' event loops, nothing runs until
+ * server_start() or server_poll().
+ */
+struct server *
+server_new(const char *port, int shards)
+{
+	struct server *srv;
+	int i;
+
+	if (shards < 1 || shards > SERVER_SHARDS_MAX) {
+		return NULL;
+	}
+
+	if ((srv = calloc(1, sizeof (*srv))) == NULL) {
+		return NULL;
+	}
+
+	if (posix_memalign((void **)&srv->shards, 64, shards * sizeof (*srv->shards)) != 0) {
+		free(srv);
+		return NULL;
+	}
+	memset(srv->shards, 0, shards * sizeof (*srv->shards));
+	srv->count = shards;
+
+	/* Standard board and bag, no ghost to waste time on */
+	srv->prof.rng_ind = 1;
+	srv->prof.flags = BIT(CONFIG_FHEADLESS);
+	srv->prof.board_w = BOARD_W;
+	srv->prof.board_h = BOARD_H;
+
+	for (i = 0; i != shards; ++i) {
+		srv->shards[i].epfd = -1;
+		if (shard_init(srv, &srv->shards[i], i, port) == -1) {
+			log_error("Shard %d: %s\n", i, strerror(errno));
+			srv->count = i + 1;
+			server_free(srv);
+			return NULL;
+		}
+	}
+
+	return srv;
+}
+
+/* A thread per shard */
+int
+server_start(struct server *srv)
+{
+	int i;
+
+	for (i = 0; i != srv->count; ++i) {
+		if (pthread_create(&srv->shards[i].thread, NULL, shard_thread, &srv->shards[i]) != 0) {
+			srv->running = i;
+			server_stop(srv);
+			return -1;
+		}
+	}
+
+	srv->running = srv->count;
+
+	return 0;
+}
+
+/*
+ * Run every shard once from the calling thread, for servers hosted
+ * inside something else's loop. Waits up to 'timeout' ms in the
+ * first shard only.
+ */
+int
+server_poll(struct server *srv, int timeout)
+{
+	int i, n, r;
+
+	n = 0;
+	for (i = 0; i != srv->count; ++i) {
+		if ((r = shard_poll(&srv->shards[i], i ? 0 : timeout)) == -1) {
+			return -1;
+		}
+		n += r;
+	}
+
+	return n;
+}
+
+/* Wakes every shard thread and waits for them */
+void
+server_stop(struct server *srv)
+{
+	struct handoff h;
+	int i;
+
+	__atomic_store_n(&srv->stop, 1, __ATOMIC_RELAXED);
+
+	h.fd = -1;
+	h.match = 0;
+	for (i = 0; i != srv->running; ++i) {
+		if (write(srv->shards[i].handoff[1], &h, sizeof h) != sizeof h) {
+			log_warn("Can't wake shard %d\n", i);
+		}
+	}
+
+	for (i = 0; i != srv->running; ++i) {
+		pthread_join(srv->shards[i].thread, NULL);
+	}
+
+	srv->running = 0;
+}
+
+void
+server_free(struct server *srv)
+{
+	int i;
+
+	if (!srv) {
+		return;
+	}
+
+	if (srv->running) {
+		server_stop(srv);
+	}
+
+	for (i = 0; i != srv->count; ++i) {
+		shard_free(&srv->shards[i]);
+	}
+
+	free(srv->shards);
+	free(srv);
+}
+
+/* -==+ Statistics +==- */
+
+int
+server_shards(const struct server *srv)
+{
+	return srv->count;
+}
+
+void
+server_stats(const struct server *srv, int shard, struct server_stats *st)
+{
+	const struct server_stats *src;
+
+	src = &srv->shards[shard].stats;
+	st->conns = __atomic_load_n(&src->conns, __ATOMIC_RELAXED);
+	st->handoffs = __atomic_load_n(&src->handoffs, __ATOMIC_RELAXED);
+	st->matches = __atomic_load_n(&src->matches, __ATOMIC_RELAXED);
+	st->inputs = __atomic_load_n(&src->inputs, __ATOMIC_RELAXED);
+	st->timers = __atomic_load_n(&src->timers, __ATOMIC_RELAXED);
+	st->msgs = __atomic_load_n(&src->msgs, __ATOMIC_RELAXED);
+	st->datagrams = __atomic_load_n(&src->datagrams, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,61 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#define SERVER_SHARDS_MAX	64
+#define SERVER_TICK_NS		1000000	/* Timer wheel resolution */
+#define SERVER_OUT_SIZE		4096	/* Unsent bytes a connection may pile up before it's dropped */
+#define SERVER_BUCKETS		4096	/* Match hash buckets per shard, power of 2 */
+#define SERVER_EVENTS		256
+#define SERVER_CONNS		8192	/* Connections and matches per shard at most, reserved up front */
+
+/* C library */
+#include <stdint.h>
+
+/*
+ * -==+ Shard counters +==-
+ * Written by the shard's own thread only, read by anybody.
+ */
+struct server_stats {
+	uint64_t conns;
+	uint64_t handoffs;
+	uint64_t matches;
+	uint64_t inputs;
+	uint64_t timers;
+	uint64_t msgs;
+	uint64_t datagrams;
+};
+
+/* Match server, see server.c */
+struct server;
+
+/* -==+ Start/Stop +==- */
+struct server *server_new(const char *port, int shards);
+int  server_start(struct server *srv);
+int  server_poll(struct server *srv, int timeout);
+void server_stop(struct server *srv);
+void server_free(struct server *srv);
+
+/* -==+ Statistics +==- */
+int  server_shards(const struct server *srv);
+void server_stats(const struct server *srv, int shard, struct server_stats *st);
+
+#endif /* SERVER_H */
@@ -23,7 +23,15 @@
 #include <string.h>
 #include <stdlib.h>
 /* e-type */
+#include "arena.h"
 #include "log.h"
+#include "trace.h"
+#include "perf.h"
+#include "scores.h"
+#include "history.h"
+#include "bigboard.h"
+#include "engine.h"
+#include "replay.h"
 
 /*
  * This gets applied to the standard Tetris scoring formula
@@ -106,52 +114,128 @@ const struct mino minos[7] = { { '<', '>',
 /* -==+ Start/End +==- */
 
 /*
- * Initialize everyting, read config file.
+ * Reset everything but the windows and pick the engine variant for
+ * 'prof', falling back to the standard board. Doesn't touch the
+ * screen or any file so tools can run games on their own. 'gs' must
+ * be zeroed or come from an earlier init_game(), which owns the heap
+ * board of the large engine.
  */
 void
-new_game(struct game_state *gs) 
+init_game(struct game_state *gs, const struct config_prof *prof, uint32_t seed)
 {
+	struct big_board *big;
+	int ghost;
+
+	big = gs->big;
 	memset(gs, 0, sizeof (*gs) - 3 * sizeof (WINDOW *));
-	gs->clock = clock();
+	gs->clock = time_ns();
 	gs->flags = BIT(DRAW_BOARD) | BIT(DRAW_STATS) | BIT(DRAW_HOLD);
 	gs->fpc = INITIAL_SPEED;
 
-	config_default(&gs->prof);
-	config_read("e-type.conf", &gs->prof);
+	gs->start_time = time_ns();
+	gs->seed = seed;
+	gs->prof = *prof;
+
+	ghost = prof->flags & BIT(CONFIG_FGHOST);
+	if ((gs->engine = engine_find(prof->board_w, prof->board_h, ghost)) == NULL) {
+		log_warn("No engine for a %dx%d board\n", prof->board_w, prof->board_h);
+		gs->engine = engine_find(BOARD_W, BOARD_H, ghost);
+	}
 
-	printf("config done\n");
-	gs->prof.rand_init(gs->prof.rng);
+	/* Sizes without a compiled variant live on the heap */
+	if (gs->engine->w) {
+		big_free(big);
 
-	if ((gs->scores = fopen(HI_SCORES, "rb"))) {
-		fread(&gs->hi_score, sizeof gs->hi_score, 1, gs->scores);
-		fclose(gs->scores);
+	} else if ((gs->big = big_alloc(big, prof->board_w, prof->board_h)) == NULL) {
+		gs->engine = engine_find(BOARD_W, BOARD_H, ghost);
 	}
 
+	gs->board_w = gs->big ? gs->big->w : gs->engine->w;
+	gs->board_h = gs->big ? gs->big->h : gs->engine->h;
+
+	queue_init(&gs->queue, prof->rng_ind, seed);
+}
+
+/*
+ * Initialize everyting, the config comes from the parsed cache.
+ */
+void
+new_game(struct game_state *gs) 
+{
+	struct config_prof prof;
+
+	config_get(&prof);
+	init_game(gs, &prof, rand());
+	trace_loop_reset();
+
+	gs->hi_score = scores_best(gs->prof.rng_ind, NULL);
+
+	place_windows(gs);
 	spawn_mino(gs);
 }
 
 /*
- * Write hiscore to file and set 'quit' flag
+ * Submit the score to the leaderboard and set 'quit' flag
  */
 void
 game_over(struct game_state *gs)
 {
-	if (gs->score > gs->hi_score) {
-		gs->hi_score = gs->score;
+	/* A top-out can be found more than once, it's saved once */
+	if (gs->flags & BIT(QUIT)) {
+		return;
 	}
 
-	if ((gs->scores = fopen(HI_SCORES, "wb"))) {
-		fwrite(&gs->hi_score, sizeof(gs->hi_score), 1, gs->scores);
-		fclose(gs->scores);
+	/* Saving the game may allocate, it isn't being played anymore */
+	alloc_thaw();
+
+	/* A replay being played back was saved when it was played */
+	if (gs->prof.flags & BIT(CONFIG_FHEADLESS) || (gs->replay && !gs->replay->rec)) {
+		gs->flags |= BIT(QUIT);
+		return;
 	}
 
-	config_free(&gs->prof);
+	if (gs->score > gs->hi_score) {
+		gs->hi_score = gs->score;
+	}
+
+	scores_submit(gs->prof.rng_ind, scores_player(), gs->score, gs->lines, gs->level);
+	history_add(gs);
 
 	gs->flags |= BIT(QUIT);
 }
 
 /* -==+ Drawing +==- */
 
+/*
+ * Size the board window for the current variant and lay the hold and
+ * stats windows out around it.
+ */
+void
+place_windows(struct game_state *gs)
+{
+	int w, h, x, y;
+
+	/* Large boards get what the hold (14) and stats (22) windows leave */
+	if (gs->big) {
+		big_viewport(gs->big, (COLS - 14 - 22 - 4) / 2 - 1, LINES - 2);
+	}
+
+	w = (gs->big ? gs->big->view_w : gs->board_w) * 2 + 2;
+	h = (gs->big ? gs->big->view_h : gs->board_h) + 2;
+	y = (LINES - MAX(h, BOARD_H + 2)) / 2;
+	x = COLS / 2 - w / 2 - 3;
+
+	/* Neither moving nor resizing works if the result is off screen */
+	mvwin(gs->board_win, 0, 0);
+	wresize(gs->board_win, h, w);
+	mvwin(gs->board_win, y, x);
+	mvwin(gs->hold_win, y, x - 14);
+	mvwin(gs->stats_win, y, x + w);
+
+	clear();
+	refresh();
+}
+
 /*
  * Draws tetromino at specified location. The 'win' argument is used
  * to simplify printing to the main grid, the next mino or to the 
@@ -180,20 +264,53 @@ draw_mino(WINDOW *win, const struct mino *m, int x, int y, uint8_t flags)
 }
 
 /*
- * Calls necessary drawing functions.
+ * Empty board and hold box with the board saying so.
+ */
+static void
+draw_pause(struct game_state *gs)
+{
+	int w, h;
+
+	wclear(gs->board_win);
+	wclear(gs->hold_win);
+
+	box(gs->board_win, 0, 0);
+	box(gs->hold_win, 0, 0);
+
+	getmaxyx(gs->board_win, h, w);
+	mvwprintw(gs->board_win, h / 2, w / 2 - 3, "PAUSE");
+
+	wnoutrefresh(gs->board_win);
+	wnoutrefresh(gs->hold_win);
+}
+
+/*
+ * Calls necessary drawing functions. Every window that changed is
+ * drawn, then the terminal gets them all in a single update.
  */
 void
 draw_game(struct game_state *gs)
 {
+	if (!(gs->flags & (BIT(DRAW_BOARD) | BIT(DRAW_STATS) | BIT(DRAW_HOLD)))) {
+		return;
+	}
+
+	if (gs->flags & BIT(PAUSE)) {
+		draw_pause(gs);
+		gs->flags &= ~(BIT(DRAW_BOARD) | BIT(DRAW_HOLD));
+	}
+
 	if (gs->flags & BIT(DRAW_BOARD)) {
 		draw_board(gs);
-		gs->flags ^= BIT(DRAW_BOARD);
+		trace_emit(TR_FRAME, 0, 0, 0, DRAW_BOARD);
+	}
 
-	} else if (gs->flags & BIT(DRAW_STATS)) {
+	if (gs->flags & BIT(DRAW_STATS)) {
 	   	draw_stats(gs);
-	   	gs->flags ^= BIT(DRAW_STATS);
+		trace_emit(TR_FRAME, 0, 0, 0, DRAW_STATS);
+	}
 
-	} else if (gs->flags & BIT(DRAW_HOLD)) {
+	if (gs->flags & BIT(DRAW_HOLD)) {
 		wclear(gs->hold_win);
 
 		if (gs->hold_mino) {
@@ -201,10 +318,25 @@ draw_game(struct game_state *gs)
 		}
 
 		box(gs->hold_win, 0, 0);
-		wrefresh(gs->hold_win);
+		wnoutrefresh(gs->hold_win);
+		trace_emit(TR_FRAME, 0, 0, 0, DRAW_HOLD);
+	}
+
+	gs->flags &= ~(BIT(DRAW_BOARD) | BIT(DRAW_STATS) | BIT(DRAW_HOLD));
+	perf_refresh();
+}
 
-		gs->flags ^= BIT(DRAW_HOLD);
+uint32_t
+pieces_played(const struct game_state *gs)
+{
+	uint32_t n;
+	int i;
+
+	for (n = i = 0; i != 7; ++i) {
+		n += gs->mino_count[i];
 	}
+
+	return n;
 }
 
 /*
@@ -214,16 +346,19 @@ draw_game(struct game_state *gs)
 void
 draw_stats(struct game_state *gs)
 {
-	int i;
-	const struct mino *next_mino;
+	int i, n;
 
 	wclear(gs->stats_win);
 
 	/* Game stats */
 	mvwprintw(gs->stats_win, 1, 2, "score: %d", gs->score);
-	mvwprintw(gs->stats_win, 2, 2, "hi-score: %d", gs->hi_score);
+	mvwprintw(gs->stats_win, 2, 2, "hi-score: %d", MAX(gs->hi_score, scores_best(gs->prof.rng_ind, NULL)));
+	mvwprintw(gs->stats_win, 3, 2, "best: %d", MAX(gs->score, scores_best(gs->prof.rng_ind, scores_player())));
 	mvwprintw(gs->stats_win, 4, 2, "lines: %d", gs->lines);
 	mvwprintw(gs->stats_win, 5, 2, "level: %d", gs->level);
+	if (gs->status[0]) {
+		mvwprintw(gs->stats_win, 6, 2, "%s", gs->status);
+	}
 
 	/* Tetromino frequency */
 	for (i = 0; i != 7; ++i) {
@@ -234,13 +369,31 @@ draw_stats(struct game_state *gs)
 		wattroff(gs->stats_win, COLOR_PAIR(minos[i].color));
 	}
 			
-	/* Next tetromino */
-	next_mino = &minos[gs->prof.rand_peek(gs->prof.rng)];
-	draw_mino(gs->stats_win, next_mino, BOARD_W, 16, 0);
+	/* Next tetrominos, a single one centered or a 2x2 grid */
+	n = perf_overlay ? MIN(gs->prof.preview, 2) : gs->prof.preview;
+	if (n == 1) {
+		draw_mino(gs->stats_win, &minos[queue_peek(&gs->queue, 0)], BOARD_W, 16, 0);
+
+	} else {
+		for (i = 0; i != n; ++i) {
+			draw_mino(gs->stats_win, &minos[queue_peek(&gs->queue, i)],
+				  i & 1 ? BOARD_W + 5 : BOARD_W - 5, 16 + (i / 2) * 3, 0);
+		}
+	}
+
+	/* Perfect clear hint, for the tetromino it was asked for */
+	if (gs->hint[0] && gs->hint_piece == pieces_played(gs)) {
+		mvwprintw(gs->stats_win, 14, 2, "%s", gs->hint);
+	}
+
+	/* Performance overlay */
+	if (perf_overlay) {
+		perf_draw_overlay(gs->stats_win, 18);
+	}
 
 	/* Draw border and refresh screen */
 	box(gs->stats_win, 0, 0);
-	wrefresh(gs->stats_win);
+	wnoutrefresh(gs->stats_win);
 }
 
 /*
@@ -249,37 +402,7 @@ draw_stats(struct game_state *gs)
 void
 draw_board(struct game_state *gs)
 {
-	int i, j, c;
-
-	/* Draw board */
-	for (i = 0; i != BOARD_H; ++i) {
-		wmove(gs->board_win, i + 1, 1);
-		for (j = 0; j != BOARD_W; ++j) {
-			if ((c = gs->board[i][j])) {
-				wattron(gs->board_win, COLOR_PAIR(c));
-				wprintw(gs->board_win, "%c%c", minos[c - 1].block_left,
-					minos[c - 1].block_right);
-				wattroff(gs->board_win, COLOR_PAIR(c));
-
-			} else {
-				wprintw(gs->board_win, "%s", "  ");
-			}
-		}
-	}
-
-	if (!(gs->flags & BIT(LBREAK))) {
-		/* Draw ghost tetromino */
-		if (gs->prof.flags & BIT(CONFIG_FGHOST)) {
-			draw_mino(gs->board_win, &gs->curr_mino, gs->curr_mino_pos.x * 2 + 1, gs->ghost_pos + 1, BIT(DRAW_GHOST));
-		}
-		
-		/* Draw current tetromino */
-		draw_mino(gs->board_win, &gs->curr_mino, gs->curr_mino_pos.x * 2 + 1, gs->curr_mino_pos.y + 1, 0);
-	}
-
-	/* Draw border and refresh screen */
-	box(gs->board_win, 0, 0);
-	wrefresh(gs->board_win);
+	ENGINE_CALL(gs, draw_board, gs);
 }
 
 /* -==+ Timing +==- */
@@ -287,126 +410,85 @@ draw_board(struct game_state *gs)
 void
 pause_game(struct game_state *gs)
 {
-	gs->flags |= BIT(PAUSE);
-	gs->pause_clock = clock();
-
-	wclear(gs->board_win);
-	wclear(gs->hold_win);
-
-	box(gs->board_win, 0, 0);
-	box(gs->hold_win, 0, 0);
-
-	mvwprintw(gs->board_win, 11, 11 - 3, "PAUSE");
-
-	wrefresh(gs->board_win);
-	wrefresh(gs->hold_win);
+	/* Drawn by draw_game(), which may run on another thread */
+	replay_log(gs, RP_PAUSE, 0);
+	gs->flags |= BIT(PAUSE) | BIT(DRAW_BOARD) | BIT(DRAW_HOLD);
+	gs->pause_clock = replay_clock(gs);
+	memset(&gs->shift, 0, sizeof (gs->shift));
 }
 
 void
 resume_game(struct game_state *gs)
 {
+	replay_log(gs, RP_PAUSE, 1);
 	gs->flags |= BIT(DRAW_BOARD) | BIT(DRAW_HOLD);
 	gs->flags &= ~BIT(PAUSE);
 
-	/* Update piece falling timer */
-	gs->clock += gs->pause_clock - clock();
+	/* The pause doesn't count towards the next fall */
+	gs->clock += replay_clock(gs) - gs->pause_clock;
 }
 
 /*
- * Update tetromino falling timer.
+ * Whether the tetromino is due to fall at 'now', 'fpc' frames at 60
+ * per second after it last did.
  */
-void
-update_timing(struct game_state *gs)
+int
+gravity_due(const struct game_state *gs, uint64_t now)
 {
-	if ((double)(clock() - gs->clock) / CLOCKS_PER_SEC > (gs->fpc / 60.0)) {
-		gs->clock = clock();
-		if (move_mino(gs, 0, 1, AUTO_DROP) == SUCCESS) {
-			--gs->drop_score;
-		}
-	}
+	return now - gs->clock > gs->fpc * 1000000000 / 60;
 }
 
 /*
- * This gets called on every frame of the line break animation
+ * Update tetromino falling timer.
  */
 void
-update_lbreak(struct game_state *gs)
+update_timing(struct game_state *gs)
 {
-	int i;
-	
-	if ((double)(clock() - gs->lbreak_timer) / CLOCKS_PER_SEC >= LINE_BREAK_BLOCK_TIMER) {
-		if (gs->lbreak_block == BOARD_W / 2) {
-			clear_lines(gs);
-			spawn_mino(gs);
-			gs->flags ^= BIT(LBREAK);
-
-		} else {
-			log_write("lines: %d\n", gs->lbreak_count);
-
-			for (i = 0; i != gs->lbreak_count; ++i) {
-				log_write("\tl%d: %d\n", i, gs->lbreak_lines[i]);
-				gs->board[gs->lbreak_lines[i]][(BOARD_W - 1) / 2 - gs->lbreak_block] = 0;
-				gs->board[gs->lbreak_lines[i]][(BOARD_W) / 2 + gs->lbreak_block] = 0;
-			}
-
-			++gs->lbreak_block;
-			gs->flags |= BIT(DRAW_BOARD);
-			gs->lbreak_timer = clock();
-		}
+	if (gravity_due(gs, replay_clock(gs))) {
+		replay_log(gs, RP_GRAVITY, 0);
+		gravity_drop(gs);
 	}
 }
 
-/* -==+ Check/Update Board state +==- */
-
 /*
- * Return if 'x' and 'y' are lower than the board limits (normally 10x20).
- * 'y' can be lower than 0 and return true but 'x' can't.
+ * The tetromino falls a row, or locks once the lock delay is over.
  */
-int
-in_range(int x, int y)
+void
+gravity_drop(struct game_state *gs)
 {
-	return x >= 0 && x < BOARD_W && y < BOARD_H;
+	gs->clock = replay_clock(gs);
+	trace_emit(TR_GRAVITY, gs->curr_mino.id, gs->curr_mino_pos.x, gs->curr_mino_pos.y, gs->fpc);
+	if (ENGINE_CALL(gs, move_mino, gs, 0, 1, AUTO_DROP) == SUCCESS) {
+		--gs->drop_score;
+	}
 }
 
 /*
- * Move line data to the line below it, blanking former.
+ * This gets called on every frame of the line break animation, only
+ * the frames that move it on are part of a replay.
  */
 void
-line_down(struct game_state *gs, int y)
+update_lbreak(struct game_state *gs)
 {
-	int i;
-
-	for (i = 0; i != BOARD_W; ++i) {
-		gs->board[y + 1][i] = gs->board[y][i];
-		gs->board[y][i] = 0;
+	if (gs->replay && gs->replay->rec) {
+		if (replay_clock(gs) - gs->lbreak_timer < LINE_BREAK_BLOCK_TIMER) {
+			return;
+		}
+		replay_log(gs, RP_LBREAK, 0);
 	}
+
+	ENGINE_CALL(gs, update_lbreak, gs);
 }
 
+/* -==+ Check/Update Board state +==- */
+
 /*
  * Clears the board.
  */
 void
 clear_lines(struct game_state *gs)
 {
-	int i, j;
-
-	if (gs->lbreak_count) {
-		/* Loop though all lines in the board */
-		for (i = 0; i != gs->lbreak_count; ++i) {
-			for (j = gs->lbreak_lines[i] - 1; j >= 0; --j) {
-				line_down(gs, j);
-			}
-		}
-		
-		/* If at least 1 line was cleared, update score */
-		gs->score += (gs->level + 1) * score_mult[gs->lbreak_count - 1];
-		gs->lines += gs->lbreak_count;
-		gs->level = gs->lines / 10;
-
-		if (gs->score > gs->hi_score) {
-			gs->hi_score = gs->score;
-		}
-	}
+	ENGINE_CALL(gs, clear_lines, gs);
 }
 
 /*
@@ -416,8 +498,8 @@ clear_lines(struct game_state *gs)
 void
 hard_drop(struct game_state *gs)
 {
-	while (move_mino(gs, 0, 1, HARD_DROP))
-		;
+	replay_log(gs, RP_HARD_DROP, 0);
+	ENGINE_CALL(gs, hard_drop, gs);
 }
 
 /* -==+ Manipulate Tetromino +==- */
@@ -429,22 +511,7 @@ hard_drop(struct game_state *gs)
 void
 update_ghost(struct game_state *gs)
 {
-	int i, j, x, y;
-
-	i = 0;
-	do {
-		for (j = 0; j != 4; ++j) {
-			x = gs->curr_mino_pos.x + gs->curr_mino.block_pos[j].x;
-			y = gs->curr_mino_pos.y + gs->curr_mino.block_pos[j].y + i;
-
-			if (y >= 0 && (!in_range(x, y) || gs->board[y][x])) {
-				break;
-			}
-		}
-
-	} while (j == 4 && ++i);
-
-	gs->ghost_pos = gs->curr_mino_pos.y + i - 1;
+	ENGINE_CALL(gs, update_ghost, gs);
 }
 
 /*
@@ -453,28 +520,8 @@ update_ghost(struct game_state *gs)
 void
 spawn_mino(struct game_state *gs)
 {
-	int r;
-
-	/* Initial tetromino position */
-	gs->curr_mino_pos.x = (BOARD_W - 1) / 2;
-	gs->curr_mino_pos.y = 0;
-
-	/* Choose random tetromino */
-	r = gs->prof.rand_next(gs->prof.rng);
-	memcpy(&gs->curr_mino, &minos[r], sizeof(struct mino));
-	++gs->mino_count[r];
-
-	/* Quit game if spawn location is already occupied. (calling move_mino(game, 0, 0) might be better) */
-	for (r = 0; r != 4; ++r) {
-		if (gs->board[gs->curr_mino.block_pos[r].y + gs->curr_mino_pos.y][gs->curr_mino.block_pos[r].x + gs->curr_mino_pos.x]) {
-			game_over(gs);
-		}
-	}
-
-	update_ghost(gs);
-
-	gs->flags |= BIT(DRAW_BOARD) | BIT(DRAW_STATS);
-	gs->flags &= ~BIT(BLOCK_HOLD);
+	replay_log(gs, RP_SPAWN, 0);
+	ENGINE_CALL(gs, spawn_mino, gs);
 }
 
 /*
@@ -484,29 +531,8 @@ spawn_mino(struct game_state *gs)
 void
 hold_mino(struct game_state *gs)
 {
-	const struct mino *m;
-
-	if (gs->flags & BIT(BLOCK_HOLD)) {
-		return;
-	}
-
-	m = &minos[gs->curr_mino.id];
-	if (gs->hold_mino == NULL) {
-		spawn_mino(gs);
-
-	} else {
-		memcpy(&gs->curr_mino, gs->hold_mino, sizeof (struct mino));
-	}
-
-	gs->hold_mino = m;
-
-	/* Initial tetromino position */
-	gs->curr_mino_pos.x = (BOARD_W - 1) / 2;
-	gs->curr_mino_pos.y = 0;
-
-	update_ghost(gs);
-
-	gs->flags |= BIT(DRAW_BOARD) | BIT(DRAW_HOLD) | BIT(BLOCK_HOLD);
+	replay_log(gs, RP_HOLD, 0);
+	ENGINE_CALL(gs, hold_mino, gs);
 }
 
 /*
@@ -515,100 +541,8 @@ hold_mino(struct game_state *gs)
 int
 move_mino(struct game_state *gs, int dx, int dy, uint8_t flags)
 {
-	int i, j, k, x, y;
-
-	/*
-	log_write("%d, %d\n", gs->curr_mino.block_pos[0].x, gs->curr_mino.block_pos[0].y);
-	log_write("%d, %d\n", gs->curr_mino.block_pos[1].x, gs->curr_mino.block_pos[1].y);
-	log_write("%d, %d\n", gs->curr_mino.block_pos[2].x, gs->curr_mino.block_pos[2].y);
-	log_write("%d, %d\n", gs->curr_mino.block_pos[3].x, gs->curr_mino.block_pos[3].y);
-	log_write("-------------------------------------------\n");
-	*/
-
-	for (i = 0; i != 4; ++i) {
-		x = gs->curr_mino_pos.x + gs->curr_mino.block_pos[i].x;
-		y = gs->curr_mino_pos.y + gs->curr_mino.block_pos[i].y;
-		
-		/* Check if moving mino causes it to go out of bounds */
-		if (!in_range(x + dx, y + dy) ||
-		    (y >= 0 && gs->board[y + dy][x + dx] && !gs->board[y][x]) ||
-		    dy == -1) {
-			/* If collided with something while going downwards */
-			if (dx == 0 && dy == 1) {
-				if (gs->immune) {
-					if (((double)clock() - gs->immune) / CLOCKS_PER_SEC < IMMUNITY_TIMER) {
-						return SUCCESS;
-					}
-
-				} else if (flags == SOFT_DROP) {
-					gs->immune = clock();
-					return SUCCESS;
-				}
-
-				gs->immune = 0;
-
-				for (i = 0; i != 4; ++i) {
-					gs->board[gs->curr_mino.block_pos[i].y + gs->curr_mino_pos.y]
-						[gs->curr_mino.block_pos[i].x + gs->curr_mino_pos.x] = gs->curr_mino.color;
-				}
-
-				gs->lbreak_count = 0;
-				for (j = 0; j != BOARD_H; ++j) {
-					for (k = 0; k != BOARD_W && gs->board[j][k]; ++k)
-						;
-
-					if (k == BOARD_W) {
-						gs->lbreak_lines[gs->lbreak_count++] = j;
-					}
-				}
-
-				if (gs->lbreak_count > 0) {
-					gs->lbreak_timer = clock();
-					gs->lbreak_block = 0;
-					gs->flags |= BIT(LBREAK);
-
-				} else {
-					spawn_mino(gs);
-				}
-
-				gs->score += gs->drop_score;
-				gs->drop_score = 0;
-				
-				if (gs->score > gs->hi_score) {
-					gs->hi_score = gs->score;
-				}
-
-				/* Update falling speed */
-				if (gs->level <= 8) {
-					gs->fpc = 48 - (gs->level * 5);
-
-				} else if (gs->level <= 18) {
-					gs->fpc = 9 - (gs->level / 3);
-
-				} else if (gs->level <= 28) {
-					gs->fpc = 2;
-
-				} else {
-					gs->fpc = 1;
-				}
-			}
-
-			return FAILURE;
-		}
-	}
-
-	if (dy == 1) {
-		++gs->drop_score;
-	}
-
-	gs->curr_mino_pos.x += dx;
-	gs->curr_mino_pos.y += dy;
-
-	update_ghost(gs);
-
-	gs->flags |= BIT(DRAW_BOARD);
-
-	return SUCCESS;
+	replay_log(gs, RP_MOVE, REPLAY_MOVE_ARG(dx, dy, flags));
+	return ENGINE_CALL(gs, move_mino, gs, dx, dy, flags);
 }
 
 /*
@@ -617,53 +551,7 @@ move_mino(struct game_state *gs, int dx, int dy, uint8_t flags)
 int
 rotate_mino(struct game_state *gs, int dir)
 {
-	struct mino tmp;
-	struct point *p;
-	int abs_x, abs_y, i, z;
-
-	if (gs->curr_mino.flags & BIT(ROTATE_NONE)) {
-		return FAILURE;
-	}
-
-	memcpy(&tmp, &gs->curr_mino, sizeof(struct mino));
-
-	if (gs->curr_mino.flags & BIT(ROTATE_TWICE)) {
-		dir = !(tmp.flags & BIT(ROTATION));
-		tmp.flags ^= BIT(ROTATION);
-	}
-
-	for (i = 0; i != 4; ++i) {
-		p = &tmp.block_pos[i];
-		p->x -= tmp.pivot.x;
-		p->y -= tmp.pivot.y;
-
-		if (dir == CLOCKWISE) {
-			z = p->x;
-			p->x = -p->y;
-			p->y = z;
-
-		} else if (dir == COUNTER_CLOCKWISE) {
-			z = p->y;
-			p->y = -p->x;
-			p->x = z;
-		}
-
-		p->x += tmp.pivot.x;
-		p->y += tmp.pivot.y;
-
-		abs_x = p->x + gs->curr_mino_pos.x;
-		abs_y = p->y + gs->curr_mino_pos.y;
-
-		if (abs_y >= 0 && (!in_range(abs_x, abs_y) || gs->board[abs_y][abs_x])) {
-			return FAILURE;
-		}
-	}
-
-	memcpy(&gs->curr_mino, &tmp, sizeof(struct mino));
-	update_ghost(gs);
-
-	gs->flags |= BIT(DRAW_BOARD);
-
-	return SUCCESS;
+	replay_log(gs, RP_ROTATE, dir);
+	return ENGINE_CALL(gs, rotate_mino, gs, dir);
 }
 
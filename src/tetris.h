@@ -23,11 +23,14 @@
 /* Standard Tetris */
 #define BOARD_H			20
 #define BOARD_W			10
+/* Storage for every compiled board size, see engine.c */
+#define BOARD_MAX_H		24
+#define BOARD_MAX_W		16
 #define BOARD_SX		1
 #define BOARD_SY		1
 #define INITIAL_SPEED		48
-#define IMMUNITY_TIMER		0.2
-#define LINE_BREAK_BLOCK_TIMER	0.1
+#define IMMUNITY_TIMER		200000000	/* ns */
+#define LINE_BREAK_BLOCK_TIMER	100000000	/* ns */
 
 /* Rotation */
 #define CLOCKWISE		0
@@ -51,6 +54,8 @@
 
 /* e-type */
 #include "config.h"
+#include "input.h"
+#include "queue.h"
 #include "utils.h"
 
 
@@ -75,7 +80,7 @@ typedef enum { QUIT, PAUSE, DRAW_BOARD, DRAW_STATS, DRAW_HOLD, LBREAK, BLOCK_HOL
  * Basic coordinate, reduces ammount of loose variables
  */
 struct point {
-	int8_t x, y;
+	int16_t x, y;
 };
 
 /*
@@ -95,6 +100,13 @@ struct mino {
 	uint8_t id;
 };
 
+/* Board logic variant, see engine.h */
+struct engine;
+/* Heap board of the large variants, see bigboard.h */
+struct big_board;
+/* Recording or playback, see replay.h */
+struct replay;
+
 /*
  * -==+ Current game state +==-
  * Contain all necessary information of the current game state,
@@ -103,14 +115,21 @@ struct mino {
  */
 struct game_state {
 	/* [Board state] */
-	uint8_t board[BOARD_H][BOARD_W];
+	const struct engine *engine;
+	uint8_t board[BOARD_MAX_H][BOARD_MAX_W];
+	struct big_board *big;
+	uint16_t board_w, board_h;
 	uint8_t flags;
-	uint8_t ghost_pos;
+	uint16_t ghost_pos;
 	struct mino curr_mino;
 	const struct mino *hold_mino;
 	struct point curr_mino_pos;
+	/* [Upcoming tetrominos] */
+	struct piece_queue queue;
+	/* [Auto-shift] */
+	struct input_shift shift;
 	/* [Line break animation] */
-	clock_t lbreak_timer;
+	uint64_t lbreak_timer;
 	int lbreak_block;
 	int lbreak_lines[4];
 	int lbreak_count;
@@ -121,12 +140,20 @@ struct game_state {
 	uint32_t hi_score;
 	uint32_t score;
 	uint32_t drop_score;
-	FILE *scores;
+	uint32_t seed;
 	/* [Timing] */
-	clock_t pause_clock;
-	clock_t	clock;
-	clock_t	immune;
+	uint64_t start_time;
+	uint64_t pause_clock;
+	uint64_t clock;
+	uint64_t immune;
 	double fpc;
+	/* [Replay being recorded or played back, NULL otherwise] */
+	struct replay *replay;
+	/* [Perfect clear hint, good until the next piece] */
+	char hint[20];
+	uint32_t hint_piece;
+	/* [Multiplayer status line, empty outside of it] */
+	char status[20];
 	/* [Config] */
 	struct config_prof prof;
 	/* [Drawing] */
@@ -134,25 +161,35 @@ struct game_state {
 };
 
 
+/* Tetromino blueprints, indexed by their id */
+extern const struct mino minos[7];
+extern const int score_mult[4];
+
+
 /* -==+ Start/End +==- */
+void init_game(struct game_state *gs, const struct config_prof *prof, uint32_t seed);
 void new_game(struct game_state *gs);
 void game_over(struct game_state *gs);
 
 /* -==+ Drawing +==- */
+void place_windows(struct game_state *gs);
 void draw_mino(WINDOW *win, const struct mino *m, int x, int y, uint8_t flags);
 void draw_game(struct game_state *gs);
 void draw_stats(struct game_state *gs);
 void draw_board(struct game_state *gs);
 
+/* -==+ Statistics +==- */
+uint32_t pieces_played(const struct game_state *gs);
+
 /* -==+ Timing +==- */
 void pause_game(struct game_state *gs);
 void resume_game(struct game_state *gs);
+int  gravity_due(const struct game_state *gs, uint64_t now);
 void update_timing(struct game_state *gs);
+void gravity_drop(struct game_state *gs);
 void update_lbreak(struct game_state *gs);
 
 /* -==+ Check/Update Board state +==- */
-int  in_range(int x, int y);
-void line_down(struct game_state *gs, int y);
 void clear_lines(struct game_state *gs);
 void hard_drop(struct game_state *gs);
 
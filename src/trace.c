@@ -0,0 +1,141 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Header file */
+#include "trace.h"
+/* C library */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+/* POSIX */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define TRACE_FILE_SIZE	(sizeof (struct trace_header) + 2 * TRACE_RING_SIZE * sizeof (struct trace_record))
+
+struct trace_header *trace_hdr = NULL;
+struct trace_record *trace_ring = NULL;
+
+/*
+ * Map the trace file, the mapping is shared so whatever got written
+ * survives the process even if it crashes. The one left by the last
+ * run, maybe the crash being looked into, is kept as 'path'.1.
+ */
+int
+trace_init(const char *path)
+{
+	char old[256];
+	void *mem;
+	int fd;
+
+	snprintf(old, sizeof old, "%s.1", path);
+	if (rename(path, old) == -1 && errno != ENOENT) {
+		perror("rename");
+	}
+
+	if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1) {
+		perror("open");
+		return -1;
+	}
+
+	if (ftruncate(fd, TRACE_FILE_SIZE) == -1) {
+		perror("ftruncate");
+		close(fd);
+		return -1;
+	}
+
+	mem = mmap(NULL, TRACE_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (mem == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+
+	trace_hdr = mem;
+	memcpy(trace_hdr->magic, TRACE_MAGIC, sizeof trace_hdr->magic);
+	trace_hdr->record_size = sizeof (struct trace_record);
+	trace_hdr->ring_size = TRACE_RING_SIZE;
+	trace_ring = (struct trace_record *)(trace_hdr + 1);
+
+	return 0;
+}
+
+void
+trace_close(void)
+{
+	if (trace_hdr) {
+		trace_ring = NULL;
+		munmap(trace_hdr, TRACE_FILE_SIZE);
+		trace_hdr = NULL;
+	}
+}
+
+/*
+ * Copy the live ring into the snapshot area, so the events leading to
+ * a stutter aren't overwritten by the ones after it.
+ */
+void
+trace_snapshot(uint64_t ts)
+{
+	if (trace_ring == NULL ||
+	    (trace_hdr->snap_head && ts - trace_hdr->snap_ts < TRACE_SNAP_INTERVAL)) {
+		return;
+	}
+
+	memcpy(trace_ring + TRACE_RING_SIZE, trace_ring, TRACE_RING_SIZE * sizeof (struct trace_record));
+	trace_hdr->snap_head = trace_hdr->head;
+	trace_hdr->snap_ts = ts;
+}
+
+/*
+ * Called once per main loop iteration, a long gap between two calls
+ * means something stalled the game and gets recorded as a stutter.
+ */
+void
+trace_loop(void)
+{
+	uint64_t ts, prev;
+
+	if (trace_ring == NULL) {
+		return;
+	}
+
+	ts = time_ns();
+	prev = trace_hdr->loop_ts;
+	trace_hdr->loop_ts = ts;
+
+	if (prev && ts - prev > TRACE_STUTTER) {
+		trace_emit(TR_STUTTER, 0, 0, 0, (ts - prev) / 1000);
+		trace_snapshot(ts);
+	}
+}
+
+/*
+ * Forget the last iteration, so time spent outside a game (menus) isn't
+ * reported as a stutter.
+ */
+void
+trace_loop_reset(void)
+{
+	if (trace_hdr) {
+		trace_hdr->loop_ts = 0;
+	}
+}
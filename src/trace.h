@@ -0,0 +1,106 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#define TRACE_PATH		"e-type.trace"
+#define TRACE_MAGIC		"ETRACE1"
+#define TRACE_RING_SIZE		65536		/* Records, must be a power of 2 */
+#define TRACE_STUTTER		50000000	/* Loop stalls longer than this (ns) freeze the ring */
+#define TRACE_SNAP_INTERVAL	1000000000	/* Minimum time (ns) between two snapshots */
+
+/* C library */
+#include <stdint.h>
+
+/* e-type */
+#include "utils.h"
+
+
+/* Engine events */
+typedef enum { TR_SPAWN, TR_MOVE, TR_ROTATE, TR_LOCK, TR_CLEAR,
+	       TR_HOLD, TR_GRAVITY, TR_FRAME, TR_STUTTER, TR_EVENT_COUNT } trace_event;
+
+/*
+ * -==+ Trace record +==-
+ * Fixed size binary record, the meaning of 'x', 'y' and 'arg' depends
+ * on the event. (See trace-dump for the details)
+ */
+struct trace_record {
+	uint64_t ts;
+	uint8_t event;
+	uint8_t mino;
+	int8_t x, y;
+	uint32_t arg;
+};
+
+/*
+ * -==+ Trace file header +==-
+ * The file is this header followed by the live ring and a snapshot of
+ * the ring taken on the last detected stutter. 'head' counts every
+ * record ever written, so the oldest record lives at 'head % ring_size'.
+ */
+struct trace_header {
+	char magic[8];
+	uint32_t record_size;
+	uint32_t ring_size;
+	uint64_t head;
+	uint64_t snap_head;
+	uint64_t snap_ts;
+	uint64_t loop_ts;
+	uint8_t pad[4096 - 48];
+};
+
+extern struct trace_header *trace_hdr;
+extern struct trace_record *trace_ring;
+
+int  trace_init(const char *path);
+void trace_close(void);
+void trace_loop(void);
+void trace_loop_reset(void);
+void trace_snapshot(uint64_t ts);
+
+#ifdef NO_TRACE
+static inline void
+trace_emit(int event, int mino, int x, int y, uint32_t arg)
+{
+}
+#else
+/*
+ * Append a record to the ring, this is all an event costs: a clock read,
+ * an atomic increment and a 16 byte store into the page cache.
+ */
+static inline void
+trace_emit(int event, int mino, int x, int y, uint32_t arg)
+{
+	struct trace_record *rec;
+
+	if (trace_ring) {
+		rec = &trace_ring[__atomic_fetch_add(&trace_hdr->head, 1, __ATOMIC_RELAXED) & (TRACE_RING_SIZE - 1)];
+		rec->ts = time_ns();
+		rec->event = event;
+		rec->mino = mino;
+		rec->x = x;
+		rec->y = y;
+		rec->arg = arg;
+	}
+}
+#endif /* NO_TRACE */
+
+#endif /* TRACE_H */
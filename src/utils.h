@@ -17,6 +17,33 @@
  *
  */
 
+#ifndef UTILS_H
+#define UTILS_H
+
 /* Bit manipulation */
 #define BIT(n)			(1 << n)
 
+/* Comparison */
+#define MAX(a, b)		((a) > (b) ? (a) : (b))
+#define MIN(a, b)		((a) < (b) ? (a) : (b))
+
+/* C library */
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Monotonic wall time in nanoseconds, cheap enough (vDSO) to call from
+ * the hot paths.
+ */
+static inline uint64_t
+time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#endif /* UTILS_H */
+
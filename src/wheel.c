@@ -0,0 +1,197 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Header file */
+#include "wheel.h"
+/* C library */
+#include <stddef.h>
+#include <string.h>
+
+/*
+ * Link 't' into the lowest level that reaches 't->expires'. Timers
+ * too far ahead wait in the last slot they can reach and are placed
+ * again when it comes around.
+ */
+static void
+place(struct wheel *w, struct wheel_timer *t)
+{
+	struct wheel_timer **head;
+	uint64_t at, delta;
+	int level;
+
+	at = t->expires;
+	delta = at - w->now;
+	if (delta >= WHEEL_SPAN) {
+		delta = WHEEL_SPAN - 1;
+		at = w->now + delta;
+	}
+
+	for (level = 0; delta >> (WHEEL_BITS * (level + 1)); ++level)
+		;
+
+	t->level = level;
+	t->slot = (at >> (WHEEL_BITS * level)) & WHEEL_MASK;
+
+	head = &w->slots[level][t->slot];
+	if ((t->next = *head)) {
+		t->next->prev = &t->next;
+	}
+	t->prev = head;
+	*head = t;
+
+	w->occupied[level] |= 1ull << t->slot;
+}
+
+/*
+ * Take a whole slot out of the wheel. The list head lives in the
+ * caller, timers in it can still be removed while it's walked.
+ */
+static struct wheel_timer *
+detach(struct wheel *w, int level, int slot, struct wheel_timer **list)
+{
+	*list = w->slots[level][slot];
+	w->slots[level][slot] = NULL;
+	w->occupied[level] &= ~(1ull << slot);
+
+	if (*list) {
+		(*list)->prev = list;
+	}
+
+	return *list;
+}
+
+static void
+cascade(struct wheel *w, int level, int slot)
+{
+	struct wheel_timer *list, *t;
+
+	detach(w, level, slot, &list);
+	while ((t = list)) {
+		if ((list = t->next)) {
+			list->prev = &list;
+		}
+		place(w, t);
+	}
+}
+
+void
+wheel_init(struct wheel *w, uint64_t now)
+{
+	memset(w, 0, sizeof (*w));
+	w->now = now;
+}
+
+/*
+ * Schedule 't' for tick 'expires', at the earliest the next one. A
+ * pending timer is moved.
+ */
+void
+wheel_add(struct wheel *w, struct wheel_timer *t, uint64_t expires)
+{
+	if (wheel_pending(t)) {
+		wheel_del(w, t);
+	}
+
+	t->expires = expires > w->now ? expires : w->now + 1;
+	place(w, t);
+	++w->count;
+}
+
+void
+wheel_del(struct wheel *w, struct wheel_timer *t)
+{
+	if (!wheel_pending(t)) {
+		return;
+	}
+
+	if ((*t->prev = t->next)) {
+		t->next->prev = t->prev;
+	}
+
+	if (!w->slots[t->level][t->slot]) {
+		w->occupied[t->level] &= ~(1ull << t->slot);
+	}
+
+	t->prev = NULL;
+	--w->count;
+}
+
+/*
+ * Run every timer up to tick 'now', returns how many fired. Timers
+ * can add and remove timers, themselves included.
+ */
+uint32_t
+wheel_advance(struct wheel *w, uint64_t now)
+{
+	struct wheel_timer *list, *t;
+	uint64_t tick;
+	uint32_t fired;
+	int level;
+
+	fired = 0;
+	while (w->now < now) {
+		if (!w->count) {
+			w->now = now;
+			break;
+		}
+
+		tick = ++w->now;
+
+		/* Every level below 'level' just wrapped around */
+		for (level = 1; level != WHEEL_LEVELS && !(tick & ((1ull << (WHEEL_BITS * level)) - 1)); ++level)
+			;
+		while (--level) {
+			cascade(w, level, (tick >> (WHEEL_BITS * level)) & WHEEL_MASK);
+		}
+
+		detach(w, 0, tick & WHEEL_MASK, &list);
+		while ((t = list)) {
+			if ((list = t->next)) {
+				list->prev = &list;
+			}
+
+			t->prev = NULL;
+			--w->count;
+			++fired;
+			t->fn(t);
+		}
+	}
+
+	return fired;
+}
+
+/*
+ * Ticks until wheel_advance() has something to do, either a timer or
+ * a cascade, -1 when there are no timers at all.
+ */
+int64_t
+wheel_next(const struct wheel *w)
+{
+	uint64_t ahead;
+	int cur;
+
+	if (!w->count) {
+		return -1;
+	}
+
+	cur = w->now & WHEEL_MASK;
+	ahead = cur == WHEEL_MASK ? 0 : w->occupied[0] >> (cur + 1);
+
+	return ahead ? __builtin_ctzll(ahead) + 1 : WHEEL_SLOTS - cur;
+}
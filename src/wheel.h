@@ -0,0 +1,75 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef WHEEL_H
+#define WHEEL_H
+
+#define WHEEL_BITS	6
+#define WHEEL_SLOTS	(1 << WHEEL_BITS)
+#define WHEEL_MASK	(WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS	4	/* 64^4 ticks, over 4 hours of 1 ms ticks */
+#define WHEEL_SPAN	(1ull << (WHEEL_BITS * WHEEL_LEVELS))
+
+/* C library */
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * -==+ Timer +==-
+ * Embedded in whatever owns the deadline, 'fn' gets it back when it
+ * expires. 'prev' points at whatever points at it, so removing it
+ * doesn't need to know the slot.
+ */
+struct wheel_timer {
+	struct wheel_timer *next, **prev;
+	uint64_t expires;
+	void (*fn)(struct wheel_timer *t);
+	uint8_t level, slot;
+};
+
+/*
+ * -==+ Hierarchical timer wheel +==-
+ * Level 'l' has 64 slots of 64^l ticks each. A timer goes in the
+ * lowest level that reaches its tick and moves down a level every
+ * time the one below wraps around, so adding, removing and expiring
+ * are all constant time. 'occupied' has a bit per non-empty slot.
+ */
+struct wheel {
+	uint64_t now;
+	struct wheel_timer *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+	uint64_t occupied[WHEEL_LEVELS];
+	uint32_t count;
+};
+
+void     wheel_init(struct wheel *w, uint64_t now);
+void     wheel_add(struct wheel *w, struct wheel_timer *t, uint64_t expires);
+void     wheel_del(struct wheel *w, struct wheel_timer *t);
+uint32_t wheel_advance(struct wheel *w, uint64_t now);
+int64_t  wheel_next(const struct wheel *w);
+
+/*
+ * Whether 't' is waiting in a wheel.
+ */
+static inline int
+wheel_pending(const struct wheel_timer *t)
+{
+	return t->prev != NULL;
+}
+
+#endif /* WHEEL_H */
@@ -0,0 +1,247 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * e-type-batch - Throughput of the batched game stepper
+ *
+ * usage: e-type-batch [-n games] [-t threads] [-s steps] [-k kernel] [-c]
+ *
+ * Steps 'games' standard games with random actions, split over
+ * 'threads', and prints the result as a JSON object. '-c' instead
+ * steps the same games with every kernel and checks they agree.
+ */
+
+/* C library */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* POSIX */
+#include <unistd.h>
+#include <pthread.h>
+/* e-type */
+#include "batch.h"
+#include "utils.h"
+
+#define ACTION_ROWS	64	/* Steps of actions generated up front, then reused */
+#define SPLIT		16	/* Games per cache line worth of rows */
+
+/*
+ * -==+ Worker +==-
+ * A slice of the batch, stepped by one thread.
+ */
+struct worker {
+	pthread_t thread;
+	struct batch *b;
+	uint8_t *actions;
+	int lo, hi;
+	long steps;
+};
+
+struct batch games;
+
+/*
+ * Mostly moves and rotations, about one hard drop every eight actions
+ * so games keep locking pieces and clearing lines.
+ */
+void
+fill_actions(uint8_t *actions, int n, unsigned int seed)
+{
+	int i, r;
+
+	for (i = 0; i != n; ++i) {
+		r = rand_r(&seed) % 16;
+		actions[i] = r < 2 ? BA_HARD_DROP : r < 5 ? BA_SOFT_DROP : 1 + r % (BA_SOFT_DROP - 1);
+	}
+}
+
+void *
+run_worker(void *arg)
+{
+	struct worker *w = arg;
+	long i;
+
+	for (i = 0; i != w->steps; ++i) {
+		batch_step(w->b, w->actions + (i % ACTION_ROWS) * w->b->n, w->lo, w->hi);
+	}
+
+	return NULL;
+}
+
+/*
+ * Step the same games with every kernel and compare everything after
+ * each step.
+ */
+int
+check(int n, long steps)
+{
+	struct batch ref, other;
+	uint8_t *actions;
+	const char *names[] = { "scalar", "avx2" };
+	long i;
+	int k;
+
+	actions = malloc(ACTION_ROWS * ((n + BATCH_LANES - 1) / BATCH_LANES * BATCH_LANES));
+	batch_init(&ref, n, 1, 1);
+	fill_actions(actions, ACTION_ROWS * ref.n, 1);
+
+	for (k = 1; k != sizeof names / sizeof names[0]; ++k) {
+		batch_free(&ref);
+		batch_init(&ref, n, 1, 1);
+		batch_init(&other, n, 1, 1);
+
+		if (batch_use(names[k]) == -1) {
+			printf("{\"check\":\"%s\",\"result\":\"unsupported\"}\n", names[k]);
+			batch_free(&other);
+			continue;
+		}
+
+		for (i = 0; i != steps; ++i) {
+			batch_use(names[0]);
+			batch_step(&ref, actions + (i % ACTION_ROWS) * ref.n, 0, ref.n);
+			batch_use(names[k]);
+			batch_step(&other, actions + (i % ACTION_ROWS) * ref.n, 0, ref.n);
+
+			if (memcmp(ref.rows, other.rows, BATCH_ROWS * ref.n * sizeof (uint32_t)) ||
+			    memcmp(ref.x, other.x, ref.n * sizeof (int32_t)) ||
+			    memcmp(ref.y, other.y, ref.n * sizeof (int32_t)) ||
+			    memcmp(ref.state, other.state, ref.n * sizeof (int32_t)) ||
+			    memcmp(ref.lines, other.lines, ref.n * sizeof (uint32_t)) ||
+			    memcmp(ref.reward, other.reward, ref.n * sizeof (int32_t)) ||
+			    memcmp(ref.done, other.done, ref.n)) {
+				printf("{\"check\":\"%s\",\"result\":\"mismatch\",\"step\":%ld}\n", names[k], i);
+				return 1;
+			}
+		}
+
+		printf("{\"check\":\"%s\",\"result\":\"ok\",\"games\":%d,\"steps\":%ld}\n", names[k], ref.n, steps);
+		batch_free(&other);
+	}
+
+	batch_free(&ref);
+	free(actions);
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct worker *workers;
+	const char *kernel;
+	uint64_t start, elapsed, drops, lines;
+	long steps;
+	int opt, n, threads, checking, per, i, g;
+
+	n = 4096;
+	threads = sysconf(_SC_NPROCESSORS_ONLN);
+	steps = 10000;
+	kernel = NULL;
+	checking = 0;
+
+	while ((opt = getopt(argc, argv, "n:t:s:k:c")) != -1) {
+		switch (opt) {
+		case 'n':
+			n = atoi(optarg);
+			break;
+
+		case 't':
+			threads = atoi(optarg);
+			break;
+
+		case 's':
+			steps = atol(optarg);
+			break;
+
+		case 'k':
+			kernel = optarg;
+			break;
+
+		case 'c':
+			checking = 1;
+			break;
+
+		default:
+			fprintf(stderr, "usage: %s [-n games] [-t threads] [-s steps] [-k kernel] [-c]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (n < 1 || threads < 1 || steps < 1) {
+		fprintf(stderr, "%s: games, threads and steps must be positive\n", argv[0]);
+		return 1;
+	}
+
+	if (checking) {
+		return check(n, steps);
+	}
+
+	if (batch_init(&games, n, 1, 1) == -1) {
+		return 1;
+	}
+
+	if (kernel && batch_use(kernel) == -1) {
+		fprintf(stderr, "%s: kernel %s isn't available\n", argv[0], kernel);
+		return 1;
+	}
+
+	/* Whole cache lines per thread */
+	per = (games.n / threads + SPLIT - 1) / SPLIT * SPLIT;
+	per = MAX(per, SPLIT);
+
+	workers = calloc(threads, sizeof (struct worker));
+	workers[0].actions = malloc(ACTION_ROWS * games.n);
+	fill_actions(workers[0].actions, ACTION_ROWS * games.n, 2);
+
+	start = time_ns();
+	for (i = 0; i != threads; ++i) {
+		workers[i].b = &games;
+		workers[i].actions = workers[0].actions;
+		workers[i].lo = MIN(i * per, games.n);
+		workers[i].hi = MIN((i + 1) * per, games.n);
+		workers[i].steps = steps;
+		pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]);
+	}
+
+	for (i = 0; i != threads; ++i) {
+		pthread_join(workers[i].thread, NULL);
+	}
+	elapsed = time_ns() - start;
+
+	/* Every hard drop locks a tetromino */
+	drops = 0;
+	for (i = 0; i != ACTION_ROWS * games.n; ++i) {
+		drops += (steps / ACTION_ROWS + (i / games.n < steps % ACTION_ROWS)) *
+			 (workers[0].actions[i] == BA_HARD_DROP);
+	}
+
+	lines = 0;
+	for (g = 0; g != games.n; ++g) {
+		lines += games.lines[g];
+	}
+
+	printf("{\"kernel\":\"%s\",\"games\":%d,\"threads\":%d,\"steps\":%ld,\"seconds\":%.3f,"
+	       "\"steps_per_sec\":%.0f,\"hard_drops\":%lu,\"lines_in_play\":%lu}\n",
+	       batch_kernel_name(), games.n, threads, steps, elapsed / 1e9,
+	       (double)games.n * steps / (elapsed / 1e9), (unsigned long)drops, (unsigned long)lines);
+
+	free(workers[0].actions);
+	free(workers);
+	batch_free(&games);
+
+	return 0;
+}
@@ -0,0 +1,395 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * e-type-bench - Microbenchmarks for the engine's hot functions
+ *
+ * usage: e-type-bench [-r repetitions] [-b batch] [-w warmup] [filter]
+ *
+ * Every benchmark runs against a set of board fixtures, from an empty
+ * board to one that is about to top out. Each repetition times a batch
+ * of calls, the results are printed as one JSON object per line.
+ */
+
+/* C library */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+/* POSIX */
+#include <unistd.h>
+/* e-type */
+#include "tetris.h"
+#include "bot.h"
+#include "compose.h"
+#include "rng_bag.h"
+#include "rng_simple.h"
+#include "utils.h"
+
+#define FIXTURE_COUNT	4
+#define MAX_BATCH	4096
+#define MAX_REPS	10000
+
+/*
+ * -==+ Benchmark +==-
+ * 'fresh' benchmarks modify the board in a way that can't be repeated,
+ * they get a new copy of the fixture for every call.
+ */
+struct bench {
+	const char *name;
+	void (*prepare)(struct game_state *gs);
+	void (*run)(struct game_state *gs, int i);
+	int fresh;
+	int fixtures;
+};
+
+const char *fixture_names[FIXTURE_COUNT] = { "empty", "low", "mid", "high" };
+const int fixture_heights[FIXTURE_COUNT] = { 0, 4, 10, BOARD_H - 3 };
+
+struct game_state fixtures[FIXTURE_COUNT];
+struct game_state states[MAX_BATCH];
+struct rng_bag bag;
+struct rng_simple simple;
+struct piece_queue queue;
+volatile int sink;
+
+/* A full lobby of bots on an 80x24 screen */
+struct compositor comp;
+struct bot_board lobby[COMP_MAX];
+struct bot_game lobby_games[COMP_MAX];
+
+/* -==+ Benchmarked calls +==- */
+
+void
+run_move(struct game_state *gs, int i)
+{
+	sink += move_mino(gs, i & 1 ? 1 : -1, 0, SOFT_DROP);
+}
+
+void
+run_rotate(struct game_state *gs, int i)
+{
+	sink += rotate_mino(gs, CLOCKWISE);
+}
+
+void
+run_ghost(struct game_state *gs, int i)
+{
+	update_ghost(gs);
+}
+
+void
+run_hard_drop(struct game_state *gs, int i)
+{
+	hard_drop(gs);
+}
+
+void
+run_clear_lines(struct game_state *gs, int i)
+{
+	clear_lines(gs);
+}
+
+void
+run_spawn(struct game_state *gs, int i)
+{
+	spawn_mino(gs);
+}
+
+void
+run_bag_next(struct game_state *gs, int i)
+{
+	sink += bag_next(&bag);
+}
+
+void
+run_simple_next(struct game_state *gs, int i)
+{
+	sink += simple_next(&simple);
+}
+
+void
+run_queue_next(struct game_state *gs, int i)
+{
+	sink += queue_next(&queue);
+}
+
+void
+run_draw_board(struct game_state *gs, int i)
+{
+	draw_board(gs);
+	doupdate();
+}
+
+/*
+ * One tetromino of one bot, then the frame: what a lobby costs when a
+ * single board changes.
+ */
+void
+run_compose(struct game_state *gs, int i)
+{
+	struct bot_move m;
+	int k;
+
+	k = i % COMP_MAX;
+	if (!bot_best(&lobby[k], queue_next(&queue), bot_default_weights, &m)) {
+		bot_clear(&lobby[k]);
+	} else {
+		lobby_games[k].lines += bot_place(&lobby[k], &m);
+		++lobby_games[k].pieces;
+	}
+
+	comp_tile_bot(&comp.tiles[k], &lobby[k], &lobby_games[k], "bot", 1 + k % 7, 0);
+	sink += comp_draw(&comp);
+}
+
+void
+prepare_compose(struct game_state *gs)
+{
+	int k;
+
+	for (k = 0; k != COMP_MAX; ++k) {
+		bot_clear(&lobby[k]);
+		comp_tile_bot(&comp.tiles[k], &lobby[k], &lobby_games[k], "bot", 1 + k % 7, 0);
+	}
+
+	comp_layout(&comp, COMP_MAX, 24, 80);
+	clear();
+	comp_draw(&comp);
+}
+
+/*
+ * Fill the four bottom rows and queue them for clearing.
+ */
+void
+prepare_clear(struct game_state *gs)
+{
+	int i, j;
+
+	for (i = 0; i != 4; ++i) {
+		for (j = 0; j != BOARD_W; ++j) {
+			gs->board[BOARD_H - 4 + i][j] = 1 + (i + j) % 7;
+		}
+
+		gs->lbreak_lines[i] = BOARD_H - 4 + i;
+	}
+
+	gs->lbreak_count = 4;
+}
+
+const struct bench benches[] = {
+	{ "move_mino",   NULL,          run_move,        0, 1 },
+	{ "rotate_mino", NULL,          run_rotate,      0, 1 },
+	{ "update_ghost",NULL,          run_ghost,       0, 1 },
+	{ "hard_drop",   NULL,          run_hard_drop,   1, 1 },
+	{ "clear_lines", prepare_clear, run_clear_lines, 1, 1 },
+	{ "spawn_mino",  NULL,          run_spawn,       0, 1 },
+	{ "bag_next",    NULL,          run_bag_next,    0, 0 },
+	{ "simple_next", NULL,          run_simple_next, 0, 0 },
+	{ "queue_next",  NULL,          run_queue_next,  0, 0 },
+	{ "draw_board",  NULL,          run_draw_board,  0, 1 },
+	{ "compose_8",   prepare_compose, run_compose,   0, 0 } };
+
+/*
+ * Build the board fixtures: 'height' rows of garbage with one or two
+ * holes each, so no line is ever complete, and a T piece spawned on top.
+ */
+void
+make_fixtures(WINDOW *win)
+{
+	struct game_state *gs;
+	struct config_prof prof;
+	int f, i, j;
+
+	srand(1);
+	config_default(&prof);
+	prof.flags |= BIT(CONFIG_FHEADLESS);
+
+	for (f = 0; f != FIXTURE_COUNT; ++f) {
+		gs = &fixtures[f];
+		init_game(gs, &prof, 1);
+		gs->board_win = gs->stats_win = gs->hold_win = win;
+
+		for (i = BOARD_H - fixture_heights[f]; i != BOARD_H; ++i) {
+			for (j = 0; j != BOARD_W; ++j) {
+				gs->board[i][j] = 1 + rand() % 7;
+			}
+
+			gs->board[i][rand() % BOARD_W] = 0;
+			gs->board[i][rand() % BOARD_W] = 0;
+		}
+
+		spawn_mino(gs);
+		gs->curr_mino = minos[6];
+		update_ghost(gs);
+	}
+}
+
+int
+cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * Time 'reps' batches of 'batch' calls after 'warmup' untimed batches
+ * and print the per call statistics.
+ */
+void
+run_bench(const struct bench *b, int f, int reps, int batch, int warmup)
+{
+	static double samples[MAX_REPS];
+	struct game_state tmpl;
+	uint64_t t0, t1;
+	double mean, var;
+	int r, i;
+
+	memcpy(&tmpl, &fixtures[f < 0 ? 0 : f], sizeof tmpl);
+	if (b->prepare) {
+		b->prepare(&tmpl);
+	}
+
+	for (r = -warmup; r != reps; ++r) {
+		if (b->fresh) {
+			for (i = 0; i != batch; ++i) {
+				memcpy(&states[i], &tmpl, sizeof tmpl);
+			}
+
+			t0 = time_ns();
+			for (i = 0; i != batch; ++i) {
+				b->run(&states[i], i);
+			}
+			t1 = time_ns();
+
+		} else {
+			memcpy(&states[0], &tmpl, sizeof tmpl);
+
+			t0 = time_ns();
+			for (i = 0; i != batch; ++i) {
+				b->run(&states[0], i);
+			}
+			t1 = time_ns();
+		}
+
+		if (r >= 0) {
+			samples[r] = (double)(t1 - t0) / batch;
+		}
+	}
+
+	for (r = 0, mean = 0; r != reps; ++r) {
+		mean += samples[r];
+	}
+	mean /= reps;
+
+	for (r = 0, var = 0; r != reps; ++r) {
+		var += (samples[r] - mean) * (samples[r] - mean);
+	}
+	var /= reps > 1 ? reps - 1 : 1;
+
+	qsort(samples, reps, sizeof (double), cmp_double);
+
+	printf("{\"bench\":\"%s\",\"fixture\":\"%s\",\"reps\":%d,\"batch\":%d,"
+	       "\"min_ns\":%.2f,\"median_ns\":%.2f,\"mean_ns\":%.2f,\"stddev_ns\":%.2f,"
+	       "\"p90_ns\":%.2f,\"max_ns\":%.2f}\n",
+	       b->name, f < 0 ? "none" : fixture_names[f], reps, batch,
+	       samples[0], samples[reps / 2], mean, sqrt(var),
+	       samples[reps * 9 / 10], samples[reps - 1]);
+	fflush(stdout);
+}
+
+int
+main(int argc, char **argv)
+{
+	SCREEN *scr;
+	FILE *null_out, *null_in;
+	WINDOW *win;
+	int opt, reps, batch, warmup, i, f;
+
+	reps = 200;
+	batch = 256;
+	warmup = 20;
+
+	while ((opt = getopt(argc, argv, "r:b:w:")) != -1) {
+		switch (opt) {
+		case 'r':
+			reps = atoi(optarg);
+			break;
+
+		case 'b':
+			batch = atoi(optarg);
+			break;
+
+		case 'w':
+			warmup = atoi(optarg);
+			break;
+
+		default:
+			fprintf(stderr, "usage: %s [-r repetitions] [-b batch] [-w warmup] [filter]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (reps < 1 || reps > MAX_REPS || batch < 1 || batch > MAX_BATCH || warmup < 0) {
+		fprintf(stderr, "%s: repetitions must be 1-%d and batch 1-%d\n", argv[0], MAX_REPS, MAX_BATCH);
+		return 1;
+	}
+
+	/* Drawing goes through a real curses screen that writes to /dev/null */
+	if ((null_out = fopen("/dev/null", "w")) == NULL || (null_in = fopen("/dev/null", "r")) == NULL) {
+		perror("/dev/null");
+		return 1;
+	}
+
+	if ((scr = newterm("xterm", null_out, null_in)) == NULL) {
+		fprintf(stderr, "%s: can't create the curses screen\n", argv[0]);
+		return 1;
+	}
+
+	start_color();
+	win = newwin(BOARD_H + 2, BOARD_W * 2 + 2, 0, 0);
+
+	make_fixtures(win);
+	bag_init(&bag, 1);
+	simple_init(&simple, 1);
+	queue_init(&queue, 1, 1);
+
+	printf("{\"compiler\":\"%s\",\"reps\":%d,\"batch\":%d,\"warmup\":%d}\n", __VERSION__, reps, batch, warmup);
+
+	for (i = 0; i != sizeof benches / sizeof benches[0]; ++i) {
+		if (optind < argc && strstr(benches[i].name, argv[optind]) == NULL) {
+			continue;
+		}
+
+		if (benches[i].fixtures) {
+			for (f = 0; f != FIXTURE_COUNT; ++f) {
+				run_bench(&benches[i], f, reps, batch, warmup);
+			}
+
+		} else {
+			run_bench(&benches[i], -1, reps, batch, warmup);
+		}
+	}
+
+	endwin();
+	delscreen(scr);
+
+	return 0;
+}
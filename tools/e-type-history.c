@@ -0,0 +1,510 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * e-type-history - Query the history of finished games
+ *
+ * usage: e-type-history [-d dir] [-p player] [-r rng] [-s days] command [args]
+ *	summary			Games played and score/lines/duration distribution
+ *	percentile col p...	Percentiles of a column
+ *	trend col [days]	Mean and best of a column per period of 'days'
+ *	players			Games, best and mean score of every player
+ *
+ *	-d	History directory (default e-type.hist)
+ *	-p	Only games of this player
+ *	-r	Only games using this randomizer index
+ *	-s	Only games from the last 'days' days
+ *
+ * Columns are memory mapped and scanned directly, nothing is loaded
+ * into memory except the values a command needs.
+ */
+
+/* C library */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+/* POSIX */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+/* e-type */
+#include "history.h"
+#include "utils.h"
+
+#define MAX_PLAYERS	4096	/* Must be a power of 2 */
+
+struct player_stats {
+	uint32_t id;
+	uint64_t games, total, best;
+};
+
+const char *dir = HISTORY_PATH;
+const void *columns[HISTORY_COLUMNS];
+size_t rows;
+
+/* Rows passing the filters */
+uint32_t *selected;
+size_t selected_cnt;
+
+/* Column time_cmp() sorts on */
+int col_time;
+
+struct player_stats players[MAX_PLAYERS];
+
+static inline uint64_t
+value(int col, size_t row)
+{
+	if (history_columns[col].size == sizeof (uint64_t)) {
+		return ((const uint64_t *)columns[col])[row];
+	}
+
+	return ((const uint32_t *)columns[col])[row];
+}
+
+int
+find_column(const char *name)
+{
+	int c;
+
+	for (c = 0; c != HISTORY_COLUMNS; ++c) {
+		if (strcmp(history_columns[c].name, name) == 0) {
+			return c;
+		}
+	}
+
+	fprintf(stderr, "unknown column '%s', valid columns are:", name);
+	for (c = 0; c != HISTORY_COLUMNS; ++c) {
+		fprintf(stderr, " %s", history_columns[c].name);
+	}
+	fputc('\n', stderr);
+
+	exit(1);
+}
+
+/*
+ * Map every column, the number of complete rows is the length of the
+ * shortest one.
+ */
+int
+map_columns(void)
+{
+	char path[PATH_MAX];
+	struct stat st;
+	size_t n;
+	int c, fd;
+
+	rows = SIZE_MAX;
+	for (c = 0; c != HISTORY_COLUMNS; ++c) {
+		snprintf(path, sizeof path, "%s/%s", dir, history_columns[c].name);
+
+		if ((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+			perror(path);
+			return -1;
+		}
+
+		n = st.st_size / history_columns[c].size;
+		rows = MIN(rows, n);
+
+		if (st.st_size == 0) {
+			columns[c] = NULL;
+
+		} else if ((columns[c] = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+			perror(path);
+			return -1;
+
+		} else {
+			madvise((void *)columns[c], st.st_size, MADV_SEQUENTIAL);
+		}
+
+		close(fd);
+	}
+
+	return 0;
+}
+
+void
+select_rows(int player, uint32_t player_id, int rng, uint64_t since)
+{
+	int col_player, col_rng, col_time;
+	size_t r;
+
+	col_player = find_column("player");
+	col_rng = find_column("rng");
+	col_time = find_column("time");
+
+	if ((selected = malloc(rows * sizeof *selected + 1)) == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+
+	for (r = selected_cnt = 0; r != rows; ++r) {
+		if ((!player || value(col_player, r) == player_id) &&
+		    (rng < 0 || value(col_rng, r) == (uint64_t)rng) &&
+		    value(col_time, r) >= since) {
+			selected[selected_cnt++] = r;
+		}
+	}
+}
+
+/*
+ * Copy the selected values of a column, for the commands that reorder them.
+ */
+uint64_t *
+gather(int col)
+{
+	uint64_t *vals;
+	size_t i;
+
+	if ((vals = malloc(selected_cnt * sizeof *vals + 1)) == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+
+	for (i = 0; i != selected_cnt; ++i) {
+		vals[i] = value(col, selected[i]);
+	}
+
+	return vals;
+}
+
+/*
+ * Hoare's selection: puts the k-th smallest value at vals[k] in linear
+ * expected time.
+ */
+uint64_t
+select_kth(uint64_t *vals, size_t n, size_t k)
+{
+	long lo, hi, i, j;
+	uint64_t pivot, tmp;
+
+	lo = 0;
+	hi = n - 1;
+	while (lo < hi) {
+		pivot = vals[lo + (hi - lo) / 2];
+		i = lo;
+		j = hi;
+
+		while (i <= j) {
+			while (vals[i] < pivot) {
+				++i;
+			}
+			while (vals[j] > pivot) {
+				--j;
+			}
+
+			if (i <= j) {
+				tmp = vals[i];
+				vals[i] = vals[j];
+				vals[j] = tmp;
+				++i;
+				--j;
+			}
+		}
+
+		/* Signed, 'j' goes below 'lo' when the pivot is the smallest */
+		if ((long)k <= j) {
+			hi = j;
+		} else if ((long)k >= i) {
+			lo = i;
+		} else {
+			break;
+		}
+	}
+
+	return vals[k];
+}
+
+uint64_t
+percentile(uint64_t *vals, size_t n, double p)
+{
+	size_t k;
+
+	k = p / 100.0 * n;
+
+	return select_kth(vals, n, MIN(k, n - 1));
+}
+
+void
+describe(const char *name)
+{
+	uint64_t *vals, total, max;
+	size_t i;
+	int col;
+
+	col = find_column(name);
+	vals = gather(col);
+
+	for (i = total = max = 0; i != selected_cnt; ++i) {
+		total += vals[i];
+		max = MAX(max, vals[i]);
+	}
+
+	printf("%-10s mean %10.1f  p50 %8lu  p90 %8lu  p99 %8lu  max %8lu\n", name,
+	       (double)total / selected_cnt,
+	       (unsigned long)percentile(vals, selected_cnt, 50),
+	       (unsigned long)percentile(vals, selected_cnt, 90),
+	       (unsigned long)percentile(vals, selected_cnt, 99),
+	       (unsigned long)max);
+
+	free(vals);
+}
+
+void
+cmd_summary(void)
+{
+	printf("%lu games\n", (unsigned long)selected_cnt);
+
+	if (selected_cnt) {
+		describe("score");
+		describe("lines");
+		describe("level");
+		describe("duration");
+	}
+}
+
+void
+cmd_percentile(int argc, char **argv)
+{
+	uint64_t *vals;
+	int col, i;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: percentile column p...\n");
+		exit(1);
+	}
+
+	col = find_column(argv[0]);
+	vals = gather(col);
+
+	for (i = 1; i != argc; ++i) {
+		printf("p%s %lu\n", argv[i], selected_cnt ?
+		       (unsigned long)percentile(vals, selected_cnt, atof(argv[i])) : 0UL);
+	}
+
+	free(vals);
+}
+
+/* Rows by the time their game ended, then by where they are */
+int
+time_cmp(const void *a, const void *b)
+{
+	uint32_t ra, rb;
+	uint64_t ta, tb;
+
+	ra = *(const uint32_t *)a;
+	rb = *(const uint32_t *)b;
+	ta = value(col_time, ra);
+	tb = value(col_time, rb);
+
+	if (ta != tb) {
+		return ta < tb ? -1 : 1;
+	}
+
+	return ra < rb ? -1 : ra > rb;
+}
+
+void
+cmd_trend(int argc, char **argv)
+{
+	uint64_t period, bucket, cur, v, total, best, games;
+	char date[32];
+	time_t t;
+	size_t i;
+	int col;
+
+	if (argc < 1) {
+		fprintf(stderr, "usage: trend column [days]\n");
+		exit(1);
+	}
+
+	col = find_column(argv[0]);
+	col_time = find_column("time");
+	period = (argc > 1 ? atoi(argv[1]) : 1) * 86400ULL;
+	period = MAX(period, 1);
+
+	/* Batches written by several games at once interleave their rows */
+	qsort(selected, selected_cnt, sizeof (*selected), time_cmp);
+
+	games = total = best = 0;
+	cur = UINT64_MAX;
+	for (i = 0; i <= selected_cnt; ++i) {
+		bucket = i != selected_cnt ? value(col_time, selected[i]) / period : UINT64_MAX;
+
+		if (bucket != cur && games) {
+			t = cur * period;
+			strftime(date, sizeof date, "%Y-%m-%d", gmtime(&t));
+			printf("%s  games %8lu  mean %10.1f  best %8lu\n", date, (unsigned long)games,
+			       (double)total / games, (unsigned long)best);
+			games = total = best = 0;
+		}
+
+		if (i != selected_cnt) {
+			cur = bucket;
+			v = value(col, selected[i]);
+			++games;
+			total += v;
+			best = MAX(best, v);
+		}
+	}
+}
+
+/*
+ * Name of a player id, from the dictionary kept next to the columns.
+ */
+const char *
+player_name(uint32_t id)
+{
+	static char name[64];
+	char path[PATH_MAX], line[128];
+	unsigned int known;
+	FILE *fp;
+
+	snprintf(name, sizeof name, "%08x", id);
+	snprintf(path, sizeof path, "%s/%s", dir, HISTORY_PLAYERS);
+
+	if ((fp = fopen(path, "r"))) {
+		while (fgets(line, sizeof line, fp)) {
+			if (sscanf(line, "%x %63s", &known, name) == 2 && known == id) {
+				break;
+			}
+			snprintf(name, sizeof name, "%08x", id);
+		}
+		fclose(fp);
+	}
+
+	return name;
+}
+
+void
+cmd_players(void)
+{
+	struct player_stats *p;
+	uint32_t id, h;
+	uint64_t score;
+	size_t i;
+	int col_player, col_score;
+
+	col_player = find_column("player");
+	col_score = find_column("score");
+
+	for (i = 0; i != selected_cnt; ++i) {
+		id = value(col_player, selected[i]);
+		score = value(col_score, selected[i]);
+
+		for (h = id; h != id + MAX_PLAYERS; ++h) {
+			p = &players[h & (MAX_PLAYERS - 1)];
+			if (p->games == 0 || p->id == id) {
+				break;
+			}
+		}
+
+		if (h == id + MAX_PLAYERS) {
+			fprintf(stderr, "players: more than %d players, the rest are left out\n", MAX_PLAYERS);
+			break;
+		}
+
+		p->id = id;
+		++p->games;
+		p->total += score;
+		p->best = MAX(p->best, score);
+	}
+
+	for (i = 0; i != MAX_PLAYERS; ++i) {
+		p = &players[i];
+		if (p->games) {
+			printf("%-16s games %8lu  best %8lu  mean %10.1f\n", player_name(p->id),
+			       (unsigned long)p->games, (unsigned long)p->best, (double)p->total / p->games);
+		}
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *player;
+	uint64_t start, since;
+	int opt, rng;
+
+	player = NULL;
+	rng = -1;
+	since = 0;
+
+	while ((opt = getopt(argc, argv, "d:p:r:s:")) != -1) {
+		switch (opt) {
+		case 'd':
+			dir = optarg;
+			break;
+
+		case 'p':
+			player = optarg;
+			break;
+
+		case 'r':
+			rng = atoi(optarg);
+			break;
+
+		case 's':
+			since = time(NULL) - atoi(optarg) * 86400LL;
+			break;
+
+		default:
+			optind = argc;
+			break;
+		}
+	}
+
+	if (optind == argc) {
+		fprintf(stderr, "usage: %s [-d dir] [-p player] [-r rng] [-s days] "
+			"summary | percentile col p... | trend col [days] | players\n", argv[0]);
+		return 1;
+	}
+
+	start = time_ns();
+
+	if (map_columns() == -1) {
+		return 1;
+	}
+
+	select_rows(player != NULL, player ? history_player_id(player) : 0, rng, since);
+
+	if (strcmp(argv[optind], "summary") == 0) {
+		cmd_summary();
+
+	} else if (strcmp(argv[optind], "percentile") == 0) {
+		cmd_percentile(argc - optind - 1, argv + optind + 1);
+
+	} else if (strcmp(argv[optind], "trend") == 0) {
+		cmd_trend(argc - optind - 1, argv + optind + 1);
+
+	} else if (strcmp(argv[optind], "players") == 0) {
+		cmd_players();
+
+	} else {
+		fprintf(stderr, "%s: unknown command '%s'\n", argv[0], argv[optind]);
+		return 1;
+	}
+
+	fprintf(stderr, "%lu of %lu games in %.2f ms\n", (unsigned long)selected_cnt,
+		(unsigned long)rows, (time_ns() - start) / 1e6);
+
+	return 0;
+}
@@ -0,0 +1,228 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * e-type-live - Watch a running game through its shared memory export
+ *
+ * usage: e-type-live [-p pid] [-r hz] [-n count] [-b]
+ *	-p	Game to watch (default the last one started that's running)
+ *	-r	Reads per second, 0 spins as fast as it can (default 10)
+ *	-n	Stop after this many reads, 0 never stops
+ *	-b	Benchmark: spin reading and report reads/s and retries
+ */
+
+/* C library */
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+/* POSIX */
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+/* e-type */
+#include "live.h"
+#include "utils.h"
+
+const char mino_names[7] = { 'I', 'L', 'J', 'O', 'S', 'Z', 'T' };
+
+char
+piece_name(uint8_t id)
+{
+	return id < 7 ? mino_names[id] : '-';
+}
+
+void
+print_state(const struct live_state *st)
+{
+	char row[BOARD_MAX_W + 1];
+	int i, x, y;
+
+	printf("frame %lu  score %u  lines %u  level %u  %s%s\n", st->frame, st->score, st->lines, st->level,
+	       st->flags & BIT(LIVE_FPAUSE) ? "paused " : "", st->flags & BIT(LIVE_FOVER) ? "over" : "");
+	printf("piece %c at %d,%d  hold %c  next ", piece_name(st->mino), st->pos.x, st->pos.y, piece_name(st->hold));
+	for (i = 0; i != st->preview && i != PREVIEW_MAX; ++i) {
+		putchar(piece_name(st->next[i]));
+	}
+	putchar('\n');
+
+	if (st->flags & BIT(LIVE_FBIG)) {
+		printf("%ux%u board\n\n", st->board_w, st->board_h);
+		return;
+	}
+
+	for (y = 0; y != st->board_h && y != BOARD_MAX_H; ++y) {
+		for (x = 0; x != st->board_w && x != BOARD_MAX_W; ++x) {
+			row[x] = st->board[y][x] ? '#' : '.';
+		}
+
+		/* The tetromino in play isn't part of the board yet */
+		for (i = 0; i != 4; ++i) {
+			if (st->pos.y + st->blocks[i].y == y && st->mino < 7
+			 && st->pos.x + st->blocks[i].x >= 0 && st->pos.x + st->blocks[i].x < st->board_w) {
+				row[st->pos.x + st->blocks[i].x] = piece_name(st->mino);
+			}
+		}
+
+		row[x] = '\0';
+		printf("%s\n", row);
+	}
+	putchar('\n');
+}
+
+/*
+ * The most recently created segment whose game is still running, the
+ * ones crashed games left behind are skipped. Linux keeps them in
+ * /dev/shm. 0 if there's none.
+ */
+pid_t
+find_game(void)
+{
+	char prefix[64], path[512];
+	struct dirent *de;
+	struct stat sb;
+	time_t newest;
+	pid_t pid, best;
+	size_t len;
+	DIR *dir;
+
+	if ((dir = opendir("/dev/shm")) == NULL) {
+		return 0;
+	}
+
+	snprintf(prefix, sizeof prefix, "%s.", LIVE_NAME + 1);
+	len = strlen(prefix);
+	best = 0;
+	newest = 0;
+
+	while ((de = readdir(dir))) {
+		if (strncmp(de->d_name, prefix, len) || (pid = atoi(de->d_name + len)) <= 0) {
+			continue;
+		}
+		if (kill(pid, 0) == -1 && errno == ESRCH) {
+			continue;
+		}
+
+		snprintf(path, sizeof path, "/dev/shm/%s", de->d_name);
+		if (stat(path, &sb) == 0 && (!best || sb.st_mtime >= newest)) {
+			newest = sb.st_mtime;
+			best = pid;
+		}
+	}
+
+	closedir(dir);
+
+	return best;
+}
+
+void
+stale(const char *prog, const char *name)
+{
+	fprintf(stderr, "%s: %s is stale, the game stopped halfway through a frame\n", prog, name);
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	const struct live_header *hdr;
+	struct live_state st;
+	struct timespec ts;
+	uint64_t start, reads, tries, frames, last;
+	char name[64];
+	int opt, hz, count, bench, n;
+	pid_t pid;
+
+	pid = 0;
+	hz = 10;
+	count = 0;
+	bench = 0;
+
+	while ((opt = getopt(argc, argv, "p:r:n:b")) != -1) {
+		switch (opt) {
+		case 'p':
+			pid = atoi(optarg);
+			break;
+
+		case 'r':
+			hz = atoi(optarg);
+			break;
+
+		case 'n':
+			count = atoi(optarg);
+			break;
+
+		case 'b':
+			bench = 1;
+			break;
+
+		default:
+			fprintf(stderr, "usage: %s [-p pid] [-r hz] [-n count] [-b]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (!pid && !(pid = find_game())) {
+		fprintf(stderr, "%s: no game running (%s.*)\n", argv[0], LIVE_NAME);
+		return 1;
+	}
+
+	live_name(name, sizeof name, LIVE_NAME, pid);
+	if ((hdr = live_open(name)) == NULL) {
+		fprintf(stderr, "%s: no game running (%s)\n", argv[0], name);
+		return 1;
+	}
+
+	if (bench) {
+		reads = tries = frames = last = 0;
+		start = time_ns();
+		while (time_ns() - start < 1000000000) {
+			if ((n = live_read(hdr, &st)) == -1) {
+				stale(argv[0], name);
+			}
+			tries += n;
+			frames += st.frame != last;
+			last = st.frame;
+			++reads;
+		}
+
+		printf("%lu reads/s, %.4f tries per read, %lu new frames\n", reads, (double)tries / reads, frames);
+		return 0;
+	}
+
+	ts.tv_sec = hz ? 1 / hz : 0;
+	ts.tv_nsec = hz ? 1000000000 / hz % 1000000000 : 0;
+
+	while (1) {
+		if (live_read(hdr, &st) == -1) {
+			stale(argv[0], name);
+		}
+		print_state(&st);
+		fflush(stdout);
+
+		if (count && !--count) {
+			break;
+		}
+		nanosleep(&ts, NULL);
+	}
+
+	return 0;
+}
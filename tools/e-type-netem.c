@@ -0,0 +1,815 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * e-type-netem - Lossy, slow network between a match client and server
+ *
+ * usage: e-type-netem [-l port] [-s [host:]port] [-u ports] [-d ms] [-j ms] [-L %] [-R %] [-T seconds]
+ *
+ * Listens on 'l' and forwards TCP to 's', and UDP from ports l + n
+ * to s + n for the first 'u' shards. Everything is delayed by 'd'
+ * plus or minus 'j' ms. A lost datagram ('L') is gone, another 'R'
+ * percent are held back one more delay so later ones overtake them.
+ * TCP can't lose anything here, so a lost segment arrives one
+ * retransmission timeout late instead, and holds up everything sent
+ * after it, like the kernel's would.
+ *
+ * Measures how long the keys take from the client to the server,
+ * both ways, and prints percentiles every second and at the end.
+ */
+
+/* C library */
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* POSIX */
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+/* Sockets */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+/* e-type */
+#include "net.h"
+#include "server.h"
+#include "utils.h"
+
+#define FLOWS_MAX	4096
+#define FLOW_IDLE_NS	10000000000ull
+#define CHUNK_MAX	4096
+#define RTO_MIN_NS	200000000ull	/* Linux TCP_RTO_MIN */
+#define EMIT_RING	(2 * NET_INPUT_WINDOW)
+
+typedef enum { EP_LISTEN, EP_CONNECT, EP_TCP, EP_UDP_LISTEN, EP_UDP_FLOW } endpoint_kind;
+
+/* What epoll hands back */
+struct endpoint {
+	endpoint_kind kind;
+	int fd;
+	int index;
+	void *owner;
+};
+
+/*
+ * -==+ TCP pair +==-
+ * The client and the connection to the server, [0] is the client.
+ * The client isn't read until the server end is connected (EP_CONNECT
+ * until then). Chunks in flight keep it alive after both are closed.
+ */
+struct pair {
+	struct endpoint ends[2];
+	uint64_t last_due[2];
+	int hello;
+	int refs;
+	uint8_t dead;
+};
+
+/*
+ * -==+ UDP flow +==-
+ * One client address on one of the ports, with its own socket to
+ * the server so the answers find their way back. 'emit' is when
+ * each key showed up first, by sequence number.
+ */
+struct flow {
+	struct endpoint up;
+	int port;
+	struct sockaddr_storage client;
+	socklen_t client_len;
+	uint64_t last;
+	uint32_t seen, done;
+	uint64_t emit[EMIT_RING];
+};
+
+typedef enum { PKT_UP, PKT_DOWN, PKT_TCP, PKT_CLOSE } packet_kind;
+
+/* Something on its way, 'born' and 'keys' for the latency */
+struct packet {
+	uint64_t due, born;
+	packet_kind kind;
+	struct flow *flow;
+	struct pair *pair;
+	int to;
+	uint32_t first;
+	int keys;
+	int len;
+	uint8_t data[];
+};
+
+/* Latencies of the keys in ns, 'from' is where the current second started */
+struct samples {
+	uint64_t *v;
+	size_t n, size, from;
+};
+
+volatile sig_atomic_t stop;
+
+struct addrinfo *server;
+int server_port, epfd, udp_ports;
+struct endpoint listener, *udp_listeners;
+struct flow flows[FLOWS_MAX];
+uint64_t delay, jitter, rng;
+double loss, reorder;
+
+struct packet **heap;
+size_t heap_n, heap_size;
+
+struct samples tcp_keys, udp_keys;
+uint64_t dropped, held, retransmits;
+
+void
+on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+double
+chance(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 7;
+	rng ^= rng << 17;
+
+	return (rng >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* 'delay' give or take 'jitter' */
+uint64_t
+transit(void)
+{
+	return delay - jitter + (uint64_t)(chance() * (2 * jitter + 1));
+}
+
+void
+sample(struct samples *s, uint64_t ns)
+{
+	if (s->n == s->size) {
+		s->size = s->size ? 2 * s->size : 4096;
+		if ((s->v = realloc(s->v, s->size * sizeof (*s->v))) == NULL) {
+			perror("e-type-netem");
+			exit(1);
+		}
+	}
+
+	s->v[s->n++] = ns;
+}
+
+int
+cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* p50, p99 and the worst of the samples from 'from' on, in ms */
+void
+print_samples(const char *name, struct samples *s, size_t from)
+{
+	uint64_t *v;
+	size_t n;
+
+	n = s->n - from;
+	if (n == 0) {
+		printf("%s %7s", name, "-");
+		return;
+	}
+
+	if ((v = malloc(n * sizeof (*v))) == NULL) {
+		return;
+	}
+	memcpy(v, s->v + from, n * sizeof (*v));
+	qsort(v, n, sizeof (*v), cmp_u64);
+
+	printf("%s %7zu keys p50 %7.1f p99 %7.1f max %7.1f ms", name, n,
+	       v[n / 2] / 1e6, v[n * 99 / 100] / 1e6, v[n - 1] / 1e6);
+	free(v);
+}
+
+/* -==+ Heap of packets by due time +==- */
+
+void
+heap_push(struct packet *p)
+{
+	size_t i;
+
+	if (heap_n == heap_size) {
+		heap_size = heap_size ? 2 * heap_size : 1024;
+		if ((heap = realloc(heap, heap_size * sizeof (*heap))) == NULL) {
+			perror("e-type-netem");
+			exit(1);
+		}
+	}
+
+	for (i = heap_n++; i && heap[(i - 1) / 2]->due > p->due; i = (i - 1) / 2) {
+		heap[i] = heap[(i - 1) / 2];
+	}
+	heap[i] = p;
+}
+
+struct packet *
+heap_pop(void)
+{
+	struct packet *top, *last;
+	size_t i, c;
+
+	top = heap[0];
+	last = heap[--heap_n];
+
+	for (i = 0; (c = 2 * i + 1) < heap_n; i = c) {
+		if (c + 1 < heap_n && heap[c + 1]->due < heap[c]->due) {
+			++c;
+		}
+		if (heap[c]->due >= last->due) {
+			break;
+		}
+		heap[i] = heap[c];
+	}
+	heap[i] = last;
+
+	return top;
+}
+
+struct packet *
+packet_new(packet_kind kind, const uint8_t *data, int len)
+{
+	struct packet *p;
+
+	if ((p = calloc(1, sizeof (*p) + len)) == NULL) {
+		perror("e-type-netem");
+		exit(1);
+	}
+
+	p->kind = kind;
+	p->born = time_ns();
+	p->len = len;
+	memcpy(p->data, data, len);
+
+	return p;
+}
+
+void
+watch(struct endpoint *e)
+{
+	struct epoll_event ev;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = e;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, e->fd, &ev);
+}
+
+/* -==+ TCP +==- */
+
+void
+pair_close(struct pair *p)
+{
+	if (!p->dead) {
+		close(p->ends[0].fd);
+		close(p->ends[1].fd);
+		p->dead = 1;
+	}
+
+	if (!p->refs) {
+		free(p);
+	}
+}
+
+void
+tcp_accept(void)
+{
+	struct epoll_event ev;
+	struct pair *p;
+	int fd;
+
+	while ((fd = accept(listener.fd, NULL, NULL)) != -1) {
+		if ((p = calloc(1, sizeof (*p))) == NULL) {
+			close(fd);
+			continue;
+		}
+
+		/* The loop doesn't wait for it, tcp_connected() finishes it */
+		p->ends[0].fd = fd;
+		if ((p->ends[1].fd = socket(server->ai_family, SOCK_STREAM | SOCK_NONBLOCK, 0)) == -1
+		 || (connect(p->ends[1].fd, server->ai_addr, server->ai_addrlen) == -1 && errno != EINPROGRESS)) {
+			fprintf(stderr, "e-type-netem: can't reach the server: %s\n", strerror(errno));
+			if (p->ends[1].fd != -1) {
+				close(p->ends[1].fd);
+			}
+			close(fd);
+			free(p);
+			continue;
+		}
+
+		p->ends[0].kind = EP_TCP;
+		p->ends[1].kind = EP_CONNECT;
+		p->ends[0].owner = p->ends[1].owner = p;
+		p->ends[0].index = 0;
+		p->ends[1].index = 1;
+
+		ev.events = EPOLLOUT;
+		ev.data.ptr = &p->ends[1];
+		epoll_ctl(epfd, EPOLL_CTL_ADD, p->ends[1].fd, &ev);
+	}
+}
+
+/*
+ * The server end became writable: connected, or failed and the client
+ * is turned away. Both ends are read from here on, and written without
+ * MSG_DONTWAIT like the accepted client's, so the server end blocks too.
+ */
+void
+tcp_connected(struct endpoint *e)
+{
+	struct pair *p;
+	socklen_t size;
+	int err, one;
+
+	p = e->owner;
+	size = sizeof err;
+	if (getsockopt(e->fd, SOL_SOCKET, SO_ERROR, &err, &size) == -1 || err) {
+		fprintf(stderr, "e-type-netem: can't reach the server: %s\n", strerror(err ? err : errno));
+		epoll_ctl(epfd, EPOLL_CTL_DEL, e->fd, NULL);
+		pair_close(p);
+		return;
+	}
+
+	fcntl(e->fd, F_SETFL, fcntl(e->fd, F_GETFL) & ~O_NONBLOCK);
+
+	one = 1;
+	setsockopt(p->ends[0].fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+	setsockopt(p->ends[1].fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+	epoll_ctl(epfd, EPOLL_CTL_DEL, e->fd, NULL);
+	e->kind = EP_TCP;
+	watch(&p->ends[0]);
+	watch(&p->ends[1]);
+}
+
+/*
+ * Whatever came in goes to the other end in one piece, never before
+ * what came earlier. Each loss costs it a timeout, which doubles.
+ */
+void
+tcp_read(struct endpoint *e)
+{
+	uint8_t buf[CHUNK_MAX];
+	struct packet *pk;
+	struct pair *p;
+	uint64_t due, rto;
+	ssize_t n;
+	int to, hello;
+
+	p = e->owner;
+	if (p->dead) {
+		return;
+	}
+
+	to = !e->index;
+	n = recv(e->fd, buf, sizeof buf, MSG_DONTWAIT);
+	if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		return;
+	}
+
+	if (n <= 0) {
+		epoll_ctl(epfd, EPOLL_CTL_DEL, p->ends[0].fd, NULL);
+		epoll_ctl(epfd, EPOLL_CTL_DEL, p->ends[1].fd, NULL);
+		pk = packet_new(PKT_CLOSE, buf, 0);
+		pk->due = MAX(p->last_due[0], p->last_due[1]);
+	} else {
+		pk = packet_new(PKT_TCP, buf, n);
+		pk->due = pk->born + transit();
+		for (rto = RTO_MIN_NS + 2 * delay; chance() < loss; rto *= 2) {
+			pk->due += rto;
+			++retransmits;
+		}
+	}
+
+	due = MAX(pk->due, p->last_due[to]);
+	pk->due = p->last_due[to] = due;
+	pk->pair = p;
+	pk->to = to;
+
+	/* Past the hello, every byte to the server is a key */
+	if (to == 1 && n > 0) {
+		hello = MIN(n, NET_HELLO_SIZE - p->hello);
+		p->hello += hello;
+		pk->keys = n - hello;
+	}
+
+	++p->refs;
+	heap_push(pk);
+}
+
+/* -==+ UDP +==- */
+
+struct flow *
+flow_find(int port, const struct sockaddr_storage *sa, socklen_t len, uint64_t now)
+{
+	struct sockaddr_storage to;
+	struct flow *f, *idle;
+	uint16_t *sport;
+	int i;
+
+	idle = NULL;
+	for (i = 0; i != FLOWS_MAX; ++i) {
+		f = &flows[i];
+		if (f->client_len == len && f->port == port && !memcmp(&f->client, sa, len)) {
+			return f;
+		}
+		if (!idle && (!f->client_len || now - f->last > FLOW_IDLE_NS)) {
+			idle = f;
+		}
+	}
+
+	if ((f = idle) == NULL) {
+		return NULL;
+	}
+
+	if (f->client_len) {
+		epoll_ctl(epfd, EPOLL_CTL_DEL, f->up.fd, NULL);
+		close(f->up.fd);
+	}
+	memset(f, 0, sizeof (*f));
+
+	memcpy(&to, server->ai_addr, server->ai_addrlen);
+	sport = to.ss_family == AF_INET6 ? &((struct sockaddr_in6 *)&to)->sin6_port : &((struct sockaddr_in *)&to)->sin_port;
+	*sport = htons(server_port + port);
+
+	if ((f->up.fd = socket(to.ss_family, SOCK_DGRAM | SOCK_NONBLOCK, 0)) == -1
+	 || connect(f->up.fd, (struct sockaddr *)&to, server->ai_addrlen) == -1) {
+		if (f->up.fd != -1) {
+			close(f->up.fd);
+		}
+		return NULL;
+	}
+
+	f->up.kind = EP_UDP_FLOW;
+	f->up.owner = f;
+	f->port = port;
+	memcpy(&f->client, sa, len);
+	f->client_len = len;
+	watch(&f->up);
+
+	return f;
+}
+
+/* Lost, late or on time, every datagram gets the same treatment */
+void
+udp_queue(struct packet *pk)
+{
+	if (chance() < loss) {
+		++dropped;
+		free(pk);
+		return;
+	}
+
+	pk->due = pk->born + transit();
+	if (chance() < reorder) {
+		pk->due += MAX(delay, 1000000);
+		++held;
+	}
+
+	heap_push(pk);
+}
+
+void
+udp_from_client(struct endpoint *e)
+{
+	struct sockaddr_storage sa;
+	struct net_inputs_msg im;
+	uint8_t buf[NET_UDP_MAX];
+	struct packet *pk;
+	struct flow *f;
+	socklen_t len;
+	uint64_t now;
+	uint32_t s;
+	ssize_t n;
+
+	for (len = sizeof sa; (n = recvfrom(e->fd, buf, sizeof buf, MSG_DONTWAIT, (struct sockaddr *)&sa, &len)) > 0; len = sizeof sa) {
+		now = time_ns();
+		if ((f = flow_find(e->index, &sa, len, now)) == NULL) {
+			continue;
+		}
+		f->last = now;
+
+		pk = packet_new(PKT_UP, buf, n);
+		pk->flow = f;
+
+		/* Keys count from the first datagram that had them */
+		if (net_unpack_inputs(&im, buf, n) == 0) {
+			for (s = f->seen; (int32_t)(im.first + im.count - s) > 0; ++s) {
+				f->emit[s % EMIT_RING] = now;
+			}
+			if ((int32_t)(im.first + im.count - f->seen) > 0) {
+				f->seen = im.first + im.count;
+			}
+			pk->first = im.first;
+			pk->keys = im.count;
+		}
+
+		udp_queue(pk);
+	}
+}
+
+void
+udp_from_server(struct endpoint *e)
+{
+	uint8_t buf[NET_UDP_MAX];
+	struct packet *pk;
+	struct flow *f;
+	ssize_t n;
+
+	f = e->owner;
+	while ((n = recv(e->fd, buf, sizeof buf, MSG_DONTWAIT)) > 0) {
+		pk = packet_new(PKT_DOWN, buf, n);
+		pk->flow = f;
+		udp_queue(pk);
+	}
+}
+
+/* -==+ Delivery +==- */
+
+void
+deliver(struct packet *pk, uint64_t now)
+{
+	struct flow *f;
+	struct pair *p;
+	uint32_t s;
+	int i;
+
+	switch (pk->kind) {
+	case PKT_UP:
+		f = pk->flow;
+		send(f->up.fd, pk->data, pk->len, MSG_DONTWAIT);
+
+		/* Keys already delivered by an earlier datagram don't count again */
+		for (s = (int32_t)(f->done - pk->first) > 0 ? f->done : pk->first; (int32_t)(pk->first + pk->keys - s) > 0; ++s) {
+			sample(&udp_keys, now - f->emit[s % EMIT_RING]);
+		}
+		if ((int32_t)(pk->first + pk->keys - f->done) > 0) {
+			f->done = pk->first + pk->keys;
+		}
+		break;
+
+	case PKT_DOWN:
+		f = pk->flow;
+		sendto(udp_listeners[f->port].fd, pk->data, pk->len, MSG_DONTWAIT, (struct sockaddr *)&f->client, f->client_len);
+		break;
+
+	case PKT_TCP:
+		p = pk->pair;
+		if (!p->dead && send(p->ends[pk->to].fd, pk->data, pk->len, MSG_NOSIGNAL) == pk->len) {
+			for (i = 0; i != pk->keys; ++i) {
+				sample(&tcp_keys, now - pk->born);
+			}
+		}
+		--p->refs;
+		if (p->dead && !p->refs) {
+			free(p);
+		}
+		break;
+
+	case PKT_CLOSE:
+		p = pk->pair;
+		--p->refs;
+		pair_close(p);
+		break;
+	}
+
+	free(pk);
+}
+
+int
+parse_server(const char *arg, char *host, size_t size, const char **port)
+{
+	const char *colon;
+
+	if ((colon = strrchr(arg, ':')) == NULL) {
+		snprintf(host, size, "localhost");
+		*port = arg;
+		return 0;
+	}
+
+	snprintf(host, size, "%.*s", (int)(colon - arg), arg);
+	*port = colon + 1;
+
+	return 0;
+}
+
+int
+bind_port(int type, int port)
+{
+	struct sockaddr_in sin;
+	int fd, one;
+
+	if ((fd = socket(AF_INET, type | SOCK_NONBLOCK, 0)) == -1) {
+		return -1;
+	}
+
+	one = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+
+	memset(&sin, 0, sizeof sin);
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_ANY);
+	sin.sin_port = htons(port);
+
+	if (bind(fd, (struct sockaddr *)&sin, sizeof sin) == -1 || (type == SOCK_STREAM && listen(fd, SOMAXCONN) == -1)) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct addrinfo hints;
+	struct epoll_event ev[256];
+	struct endpoint *e;
+	char host[256];
+	const char *port;
+	uint64_t start, now, last, seconds;
+	size_t tcp_from, udp_from;
+	int opt, listen_port, timeout, i, n, err;
+
+	listen_port = 1240;
+	parse_server(NET_PORT, host, sizeof host, &port);
+	udp_ports = MIN(sysconf(_SC_NPROCESSORS_ONLN), SERVER_SHARDS_MAX);
+	delay = 20000000;
+	jitter = 5000000;
+	loss = 0.02;
+	reorder = 0.01;
+	seconds = 0;
+
+	while ((opt = getopt(argc, argv, "l:s:u:d:j:L:R:T:")) != -1) {
+		switch (opt) {
+		case 'l':
+			listen_port = atoi(optarg);
+			break;
+
+		case 's':
+			parse_server(optarg, host, sizeof host, &port);
+			break;
+
+		case 'u':
+			udp_ports = atoi(optarg);
+			break;
+
+		case 'd':
+			delay = atof(optarg) * 1000000;
+			break;
+
+		case 'j':
+			jitter = atof(optarg) * 1000000;
+			break;
+
+		case 'L':
+			loss = atof(optarg) / 100;
+			break;
+
+		case 'R':
+			reorder = atof(optarg) / 100;
+			break;
+
+		case 'T':
+			seconds = atoi(optarg);
+			break;
+
+		default:
+			fprintf(stderr, "usage: %s [-l port] [-s [host:]port] [-u ports] [-d ms] [-j ms] [-L %%] [-R %%] [-T seconds]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (jitter > delay || loss < 0 || loss >= 1 || udp_ports < 0 || udp_ports > SERVER_SHARDS_MAX) {
+		fprintf(stderr, "%s: jitter can't be over the delay, loss needs to be under 100%%\n", argv[0]);
+		return 1;
+	}
+
+	memset(&hints, 0, sizeof hints);
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	if ((err = getaddrinfo(host, port, &hints, &server)) != 0) {
+		fprintf(stderr, "%s: %s: %s\n", argv[0], host, gai_strerror(err));
+		return 1;
+	}
+	server_port = atoi(port);
+
+	if ((epfd = epoll_create1(0)) == -1
+	 || (listener.fd = bind_port(SOCK_STREAM, listen_port)) == -1
+	 || (udp_listeners = calloc(MAX(udp_ports, 1), sizeof (*udp_listeners))) == NULL) {
+		fprintf(stderr, "%s: can't listen on port %d: %s\n", argv[0], listen_port, strerror(errno));
+		return 1;
+	}
+	listener.kind = EP_LISTEN;
+	watch(&listener);
+
+	for (i = 0; i != udp_ports; ++i) {
+		if ((udp_listeners[i].fd = bind_port(SOCK_DGRAM, listen_port + i)) == -1) {
+			fprintf(stderr, "%s: can't bind UDP port %d: %s\n", argv[0], listen_port + i, strerror(errno));
+			return 1;
+		}
+		udp_listeners[i].kind = EP_UDP_LISTEN;
+		udp_listeners[i].index = i;
+		watch(&udp_listeners[i]);
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	rng = time_ns() | 1;
+	printf("Port %d to %s:%s, UDP %d ports, %.1f +- %.1f ms, %.1f%% lost, %.1f%% reordered\n", listen_port, host, port,
+	       udp_ports, delay / 1e6, jitter / 1e6, loss * 100, reorder * 100);
+	fflush(stdout);
+
+	start = last = time_ns();
+	tcp_from = udp_from = 0;
+
+	while (!stop && (!seconds || time_ns() - start < seconds * 1000000000)) {
+		now = time_ns();
+		timeout = 100;
+		if (heap_n) {
+			timeout = heap[0]->due > now ? (heap[0]->due - now + 999999) / 1000000 : 0;
+		}
+
+		if ((n = epoll_wait(epfd, ev, 256, MIN(timeout, 100))) == -1 && errno != EINTR) {
+			perror(argv[0]);
+			break;
+		}
+
+		for (i = 0; i < n; ++i) {
+			e = ev[i].data.ptr;
+			switch (e->kind) {
+			case EP_LISTEN:
+				tcp_accept();
+				break;
+
+			case EP_CONNECT:
+				tcp_connected(e);
+				break;
+
+			case EP_TCP:
+				tcp_read(e);
+				break;
+
+			case EP_UDP_LISTEN:
+				udp_from_client(e);
+				break;
+
+			case EP_UDP_FLOW:
+				udp_from_server(e);
+				break;
+			}
+		}
+
+		now = time_ns();
+		while (heap_n && heap[0]->due <= now) {
+			deliver(heap_pop(), now);
+		}
+
+		if (now - last >= 1000000000) {
+			print_samples("tcp", &tcp_keys, tcp_from);
+			print_samples(" | udp", &udp_keys, udp_from);
+			printf(" | %" PRIu64 " lost %" PRIu64 " held %" PRIu64 " retransmits\n", dropped, held, retransmits);
+			fflush(stdout);
+			tcp_from = tcp_keys.n;
+			udp_from = udp_keys.n;
+			last = now;
+		}
+	}
+
+	printf("\n");
+	print_samples("tcp", &tcp_keys, 0);
+	printf("\n");
+	print_samples("udp", &udp_keys, 0);
+	printf("\n");
+
+	freeaddrinfo(server);
+
+	return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * e-type-pc - Perfect clear solver
+ *
+ * usage: e-type-pc [-t threads] [-h height] [-H hold] [-b ms] pieces < board
+ *
+ * Reads the bottom of a standard board from stdin, one row per line
+ * with '.' for empty cells and anything else for blocks, and looks for
+ * a perfect clear using 'pieces' in order, the first one in play.
+ * Pieces and the hold box are given by letter: ILJOSZT. '-b' gives up
+ * after that many milliseconds, the way the in-game hint does.
+ */
+
+/* C library */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* POSIX */
+#include <unistd.h>
+/* e-type */
+#include "pcsolve.h"
+#include "utils.h"
+
+const char letters[] = "ILJOSZT";
+
+int
+piece_id(char c)
+{
+	const char *p;
+
+	p = c ? strchr(letters, c) : NULL;
+
+	return p ? p - letters : -1;
+}
+
+/*
+ * Rows come top down, the last one read is the bottom of the board.
+ */
+int
+read_board(struct pc_problem *p)
+{
+	char line[64];
+	uint16_t rows[PC_MAX_H];
+	int n, x;
+
+	n = 0;
+	while (fgets(line, sizeof line, stdin)) {
+		if (line[0] == '\n' || line[0] == '#') {
+			continue;
+		}
+
+		if (n == PC_MAX_H) {
+			return -1;
+		}
+
+		rows[n] = 0;
+		for (x = 0; x != BOARD_W && line[x] && line[x] != '\n'; ++x) {
+			rows[n] |= (line[x] != '.') << x;
+		}
+		++n;
+	}
+
+	for (x = 0; x != n; ++x) {
+		p->rows[x] = rows[n - 1 - x];
+	}
+
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct pc_problem p;
+	struct pc_result r;
+	uint64_t start, elapsed, budget;
+	int opt, threads, height, found, i;
+
+	memset(&p, 0, sizeof p);
+	p.hold = PC_NO_HOLD;
+	threads = sysconf(_SC_NPROCESSORS_ONLN);
+	height = 4;
+	budget = 0;
+
+	while ((opt = getopt(argc, argv, "t:h:H:b:")) != -1) {
+		switch (opt) {
+		case 't':
+			threads = atoi(optarg);
+			break;
+
+		case 'h':
+			height = atoi(optarg);
+			break;
+
+		case 'H':
+			if ((i = piece_id(optarg[0])) == -1) {
+				fprintf(stderr, "%s: unknown piece %s\n", argv[0], optarg);
+				return 1;
+			}
+			p.hold = i;
+			break;
+
+		case 'b':
+			budget = strtoull(optarg, NULL, 10) * 1000000;
+			break;
+
+		default:
+			fprintf(stderr, "usage: %s [-t threads] [-h height] [-H hold] [-b ms] pieces < board\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind != argc - 1 || strlen(argv[optind]) > PC_MAX_PIECES) {
+		fprintf(stderr, "usage: %s [-t threads] [-h height] [-H hold] [-b ms] pieces < board\n", argv[0]);
+		return 1;
+	}
+
+	for (i = 0; argv[optind][i]; ++i) {
+		if ((p.pieces[i] = piece_id(argv[optind][i])) == (uint8_t)-1) {
+			fprintf(stderr, "%s: unknown piece %c\n", argv[0], argv[optind][i]);
+			return 1;
+		}
+	}
+	p.count = i;
+
+	if (read_board(&p) == -1) {
+		fprintf(stderr, "%s: at most %d rows\n", argv[0], PC_MAX_H);
+		return 1;
+	}
+
+	start = time_ns();
+	found = pc_solve(&p, height, threads, budget, &r);
+	elapsed = time_ns() - start;
+
+	if (found == -1) {
+		fprintf(stderr, "%s: the board has full rows\n", argv[0]);
+		return 1;
+	}
+
+	for (i = 0; i != r.count; ++i) {
+		printf("%s%c state %d at %d,%d\n", r.moves[i].hold ? "hold, " : "",
+		       letters[r.moves[i].id], r.moves[i].state % 4, r.moves[i].x, r.moves[i].y);
+	}
+
+	printf("%s in %d rows, %lu nodes, %.1f ms\n", found ? "clear" : r.expired ? "gave up" : "no clear", found ? r.height : height,
+	       (unsigned long)r.nodes, elapsed / 1e6);
+
+	return !found;
+}
@@ -0,0 +1,490 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * e-type-replay - Look into recorded games
+ *
+ * usage: e-type-replay [view] file
+ *	  e-type-replay info file...
+ *	  e-type-replay show file step|m:ss
+ *	  e-type-replay diff a b
+ *
+ *	view	Play it back, see below for the keys
+ *	info	Header, claims and index, and how long a seek takes
+ *	show	The board at a step, or at a time into the game
+ *	diff	First step where two games differ, by bisection
+ *
+ * Viewer keys: space plays and pauses, left/right step, [ and ] go
+ * 10 seconds back and forward, { and } a minute, g and G to the
+ * start and end, + and - change the speed, q quits. Every jump loads
+ * the keyframe before it and plays at most a keyframe interval of
+ * steps from there.
+ */
+
+/* C library */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* POSIX */
+#include <unistd.h>
+/* Ncurses */
+#include <ncurses.h>
+/* e-type */
+#include "compose.h"
+#include "replay.h"
+#include "tetris.h"
+#include "utils.h"
+
+#define SEEK_SAMPLES	1000
+
+struct game_state gs, gs_b;
+struct compositor comp;
+
+void
+usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [view] file\n"
+			"       %s info file...\n"
+			"       %s show file step|m:ss\n"
+			"       %s diff a b\n", name, name, name, name);
+}
+
+int
+open_or_complain(struct replay_file *f, const char *path)
+{
+	if (replay_open(f, path) == -1) {
+		fprintf(stderr, "%s: not a replay\n", path);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Steps and length of a game, from the trailer or the last keyframe */
+void
+game_length(const struct replay_file *f, uint32_t *steps, uint32_t *ms)
+{
+	struct replay_cursor c;
+
+	if (f->trailer) {
+		*steps = f->trailer->steps;
+		*ms = f->trailer->ms;
+		return;
+	}
+
+	replay_start(&c, f, &gs);
+	replay_seek(&c, UINT32_MAX);
+	*steps = c.step;
+	*ms = c.ms;
+}
+
+/*
+ * Play every step from the start, not from the keyframes a seek
+ * would load, and hold the end against what the trailer says.
+ */
+void
+check_claims(const struct replay_file *f)
+{
+	struct replay_cursor c;
+	int r;
+
+	if (!f->trailer) {
+		return;
+	}
+
+	replay_start(&c, f, &gs);
+	while ((r = replay_next(&c)) == 1)
+		;
+	if (r == -1 || c.step != f->trailer->steps) {
+		printf("  played:    broken record after step %u\n", c.step);
+
+	} else if (gs.score != f->trailer->score || gs.lines != f->trailer->lines
+		|| memcmp(gs.mino_count, f->trailer->mino_count, sizeof gs.mino_count)) {
+		printf("  played:    score %u, lines %u, not what it claims\n", gs.score, gs.lines);
+
+	} else {
+		printf("  played:    as claimed\n");
+	}
+}
+
+/* Random seeks, the time of each */
+void
+time_seeks(const struct replay_file *f, uint32_t steps)
+{
+	struct replay_cursor c;
+	uint64_t t, total, worst;
+	uint32_t lcg;
+	int i;
+
+	if (!steps) {
+		return;
+	}
+
+	replay_start(&c, f, &gs);
+	lcg = 1;
+	total = worst = 0;
+	for (i = 0; i != SEEK_SAMPLES; ++i) {
+		lcg = lcg * 1103515245 + 12345;
+		t = time_ns();
+		replay_seek(&c, (lcg >> 8) % steps);
+		t = time_ns() - t;
+		total += t;
+		worst = MAX(worst, t);
+	}
+
+	printf("  seeks:     %.1f us mean, %.1f us worst over %d random steps\n", total / 1e3 / SEEK_SAMPLES, worst / 1e3,
+	       SEEK_SAMPLES);
+}
+
+int
+cmd_info(int argc, char **argv)
+{
+	struct replay_file f;
+	uint32_t steps, ms;
+	int i, k;
+
+	for (i = 0; i != argc; ++i) {
+		if (open_or_complain(&f, argv[i]) == -1) {
+			continue;
+		}
+
+		game_length(&f, &steps, &ms);
+		printf("%s: %zu bytes, seed %08x, %ux%u board, rng %u\n", argv[i], f.size, f.hdr.seed, f.hdr.board_w,
+		       f.hdr.board_h, f.hdr.rng_ind);
+		printf("  steps:     %u over %u:%02u.%03u, keyframe every %u, %u keyframes%s\n", steps, ms / 60000,
+		       ms / 1000 % 60, ms % 1000, f.hdr.keyframe, f.count, f.trailer ? "" : " (no index, scanned)");
+
+		if (f.trailer) {
+			printf("  claims:    score %u, lines %u, level %u, pieces", f.trailer->score, f.trailer->lines,
+			       f.trailer->level);
+			for (k = 0; k != 7; ++k) {
+				printf(" %c%u", minos[k].symbol, f.trailer->mino_count[k]);
+			}
+			printf("\n");
+		}
+
+		check_claims(&f);
+		time_seeks(&f, steps);
+		replay_close(&f);
+	}
+
+	return 0;
+}
+
+/* "m:ss" is a time, anything else a step */
+int
+parse_target(const char *s, uint32_t *v, int *by_ms)
+{
+	unsigned m, sec;
+
+	if (sscanf(s, "%u:%u", &m, &sec) == 2) {
+		*v = (m * 60 + sec) * 1000;
+		*by_ms = 1;
+		return 0;
+	}
+
+	*by_ms = 0;
+	return sscanf(s, "%u", v) == 1 ? 0 : -1;
+}
+
+/* Tile cells are colors, shown as the letter of the tetromino of that color */
+char
+cell_char(uint8_t cell)
+{
+	int i;
+
+	if (cell & COMP_GHOST) {
+		return '.';
+	}
+	for (i = 0; cell && i != 7; ++i) {
+		if (minos[i].color == cell) {
+			return minos[i].symbol;
+		}
+	}
+
+	return cell ? '#' : ' ';
+}
+
+/* The whole board of 'g' as text, the tetromino in play included */
+void
+print_board(const struct game_state *g, const struct game_state *h)
+{
+	struct comp_tile a, b;
+	int x, y;
+
+	memset(&a, 0, sizeof a);
+	memset(&b, 0, sizeof b);
+	comp_tile_game(&a, g, "");
+	if (h) {
+		comp_tile_game(&b, h, "");
+	}
+
+	for (y = 0; y != a.h; ++y) {
+		printf("  |");
+		for (x = 0; x != a.w; ++x) {
+			putchar(cell_char(a.cells[y][x]));
+		}
+		printf("|");
+
+		if (h) {
+			printf("    |");
+			for (x = 0; x != b.w; ++x) {
+				putchar(cell_char(b.cells[y][x]));
+			}
+			printf("|%s", memcmp(a.cells[y], b.cells[y], a.w) ? " <" : "");
+		}
+		printf("\n");
+	}
+}
+
+int
+cmd_show(int argc, char **argv)
+{
+	struct replay_file f;
+	struct replay_cursor c;
+	uint32_t target;
+	int by_ms;
+
+	if (argc != 2 || parse_target(argv[1], &target, &by_ms) == -1) {
+		return -1;
+	}
+	if (open_or_complain(&f, argv[0]) == -1) {
+		return 1;
+	}
+
+	replay_start(&c, &f, &gs);
+	if ((by_ms ? replay_seek_ms(&c, target) : replay_seek(&c, target)) == -1) {
+		fprintf(stderr, "%s: broken record after step %u\n", argv[0], c.step);
+	}
+
+	printf("step %u at %u:%02u.%03u: score %u, lines %u, level %u%s\n", c.step, c.ms / 60000, c.ms / 1000 % 60,
+	       c.ms % 1000, gs.score, gs.lines, gs.level, gs.flags & BIT(QUIT) ? ", over" : "");
+	print_board(&gs, NULL);
+	replay_close(&f);
+
+	return 0;
+}
+
+/*
+ * Bisection on the keyframes both games have, once two of them
+ * differ the games hardly ever come back together. Then both are
+ * played a step at a time from the last keyframe they share.
+ */
+int
+cmd_diff(int argc, char **argv)
+{
+	struct replay_file fa, fb;
+	struct replay_cursor ca, cb;
+	struct replay_keyframe ka, kb;
+	uint32_t lo, hi, mid;
+	int ra, rb, probes;
+
+	if (argc != 2) {
+		return -1;
+	}
+	if (open_or_complain(&fa, argv[0]) == -1 || open_or_complain(&fb, argv[1]) == -1) {
+		return 1;
+	}
+
+	/* Keyframe 'lo' is known to be the same, 'hi' is the first that may not be */
+	lo = 0;
+	hi = MIN(fa.count, fb.count);
+	for (probes = 0; hi - lo > 1; ++probes) {
+		mid = lo + (hi - lo) / 2;
+		if (replay_keyframe(&fa, mid, &ka) == 0 && replay_keyframe(&fb, mid, &kb) == 0
+		 && ka.step == kb.step && replay_same(&ka, &kb)) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	replay_start(&ca, &fa, &gs);
+	replay_start(&cb, &fb, &gs_b);
+	replay_seek(&ca, fa.index[lo].step);
+	replay_seek(&cb, fb.index[lo].step);
+
+	for (;;) {
+		replay_snapshot(&ka, &gs);
+		replay_snapshot(&kb, &gs_b);
+		if (!replay_same(&ka, &kb)) {
+			break;
+		}
+
+		ra = replay_next(&ca);
+		rb = replay_next(&cb);
+		if (ra != 1 || rb != 1) {
+			printf("Same game for all of %u steps%s\n", ca.step, ra != rb ? ", then one of them goes on" : "");
+			return 0;
+		}
+	}
+
+	printf("First difference at step %u (%u:%02u.%03u / %u:%02u.%03u), found in %d probes and %u steps\n", ca.step,
+	       ca.ms / 60000, ca.ms / 1000 % 60, ca.ms % 1000, cb.ms / 60000, cb.ms / 1000 % 60, cb.ms % 1000, probes,
+	       ca.step - fa.index[lo].step);
+	printf("  score %u / %u, lines %u / %u\n", gs.score, gs_b.score, gs.lines, gs_b.lines);
+	print_board(&gs, &gs_b);
+
+	replay_close(&fa);
+	replay_close(&fb);
+
+	return 0;
+}
+
+/* -==+ Viewer +==- */
+
+void
+view_draw(const struct replay_cursor *c, uint32_t steps, uint32_t ms, int playing, int speed)
+{
+	comp_tile_game(&comp.tiles[0], c->gs, "replay");
+	comp_layout(&comp, 1, LINES - 1, COLS);
+	comp_draw(&comp);
+
+	mvprintw(LINES - 1, 0, "step %u/%u  %u:%02u/%u:%02u  score %u  lines %u  %s x%d", c->step, steps,
+		 c->ms / 60000, c->ms / 1000 % 60, ms / 60000, ms / 1000 % 60, c->gs->score, c->gs->lines,
+		 playing ? "playing" : "paused ", speed);
+	clrtoeol();
+	refresh();
+}
+
+int
+cmd_view(const char *path)
+{
+	struct replay_file f;
+	struct replay_cursor c;
+	uint32_t steps, ms, target, from;
+	uint64_t t0;
+	int playing, speed, key, i;
+
+	if (open_or_complain(&f, path) == -1) {
+		return 1;
+	}
+	game_length(&f, &steps, &ms);
+
+	initscr();
+	cbreak();
+	noecho();
+	curs_set(0);
+	keypad(stdscr, TRUE);
+	timeout(16);
+	start_color();
+	use_default_colors();
+	for (i = RED; i <= WHITE; ++i) {
+		init_pair(i, COLOR_RED + i - RED, -1);
+	}
+
+	replay_start(&c, &f, &gs);
+	playing = 0;
+	speed = 1;
+	from = 0;
+	t0 = time_ns();
+
+	while ((key = getch()) != 'q') {
+		target = c.ms;
+
+		switch (key) {
+		case ' ':
+			playing = !playing;
+			break;
+
+		case KEY_RIGHT:
+			playing = 0;
+			replay_seek(&c, c.step + 1);
+			break;
+
+		case KEY_LEFT:
+			playing = 0;
+			replay_seek(&c, c.step ? c.step - 1 : 0);
+			break;
+
+		case '[': case '{':
+			replay_seek_ms(&c, c.ms > (key == '[' ? 10000u : 60000u) ? c.ms - (key == '[' ? 10000 : 60000) : 0);
+			break;
+
+		case ']': case '}':
+			replay_seek_ms(&c, c.ms + (key == ']' ? 10000 : 60000));
+			break;
+
+		case 'g':
+			replay_seek(&c, 0);
+			break;
+
+		case 'G':
+			replay_seek(&c, steps);
+			break;
+
+		case '+':
+			speed = MIN(speed * 2, 64);
+			break;
+
+		case '-':
+			speed = MAX(speed / 2, 1);
+			break;
+		}
+
+		/* Playing follows the clock from wherever it was started or moved to */
+		if (key != ERR || !playing) {
+			from = c.ms;
+			t0 = time_ns();
+		} else {
+			target = from + (time_ns() - t0) / 1000000 * speed;
+			replay_seek_ms(&c, target);
+			if (c.step >= steps) {
+				playing = 0;
+			}
+		}
+
+		view_draw(&c, steps, ms, playing, speed);
+	}
+
+	endwin();
+	replay_close(&f);
+
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	int r;
+
+	r = -1;
+	if (argc == 2) {
+		r = cmd_view(argv[1]);
+
+	} else if (argc > 2 && strcmp(argv[1], "view") == 0) {
+		r = argc == 3 ? cmd_view(argv[2]) : -1;
+
+	} else if (argc > 2 && strcmp(argv[1], "info") == 0) {
+		r = cmd_info(argc - 2, argv + 2);
+
+	} else if (argc > 2 && strcmp(argv[1], "show") == 0) {
+		r = cmd_show(argc - 2, argv + 2);
+
+	} else if (argc > 2 && strcmp(argv[1], "diff") == 0) {
+		r = cmd_diff(argc - 2, argv + 2);
+	}
+
+	if (r == -1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	return r;
+}
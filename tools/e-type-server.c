@@ -0,0 +1,128 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * e-type-server - Match server
+ *
+ * usage: e-type-server [-p port] [-t shards] [-l log]
+ *
+ * Hosts two player matches, see net.h for the protocol, with one
+ * event loop per shard. Shard n also takes keys on UDP port + n. Prints what every shard did each second
+ * until interrupted.
+ */
+
+/* C library */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* POSIX */
+#include <unistd.h>
+/* e-type */
+#include "log.h"
+#include "net.h"
+#include "server.h"
+
+volatile sig_atomic_t stop;
+
+void
+on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct server_stats st, prev[SERVER_SHARDS_MAX], total;
+	struct server *srv;
+	const char *port, *log_path;
+	int opt, shards, i;
+
+	port = NET_PORT;
+	log_path = NULL;
+	shards = sysconf(_SC_NPROCESSORS_ONLN);
+	if (shards > SERVER_SHARDS_MAX) {
+		shards = SERVER_SHARDS_MAX;
+	}
+
+	while ((opt = getopt(argc, argv, "p:t:l:")) != -1) {
+		switch (opt) {
+		case 'p':
+			port = optarg;
+			break;
+
+		case 't':
+			shards = atoi(optarg);
+			break;
+
+		case 'l':
+			log_path = optarg;
+			break;
+
+		default:
+			fprintf(stderr, "usage: %s [-p port] [-t shards] [-l log]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (log_path && log_init(log_path) == -1) {
+		fprintf(stderr, "%s: can't open %s\n", argv[0], log_path);
+		return 1;
+	}
+
+	if ((srv = server_new(port, shards)) == NULL || server_start(srv) == -1) {
+		fprintf(stderr, "%s: can't start %d shards on port %s\n", argv[0], shards, port);
+		server_free(srv);
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	printf("Listening on port %s, %d shards\n", port, shards);
+	memset(prev, 0, sizeof prev);
+
+	while (!stop) {
+		sleep(1);
+
+		memset(&total, 0, sizeof total);
+		for (i = 0; i != shards; ++i) {
+			server_stats(srv, i, &st);
+			printf("shard %2d: %6lu conns %6lu handoffs %6lu matches %8lu inputs/s %8lu timers/s %8lu msgs/s %8lu dgrams/s\n", i,
+			       st.conns, st.handoffs, st.matches, st.inputs - prev[i].inputs, st.timers - prev[i].timers,
+			       st.msgs - prev[i].msgs, st.datagrams - prev[i].datagrams);
+
+			total.inputs += st.inputs - prev[i].inputs;
+			total.timers += st.timers - prev[i].timers;
+			total.msgs += st.msgs - prev[i].msgs;
+			total.datagrams += st.datagrams - prev[i].datagrams;
+			prev[i] = st;
+		}
+		printf("total:    %8lu inputs/s %8lu timers/s %8lu msgs/s %8lu dgrams/s\n\n",
+		       total.inputs, total.timers, total.msgs, total.datagrams);
+		fflush(stdout);
+	}
+
+	server_free(srv);
+	log_close();
+
+	return 0;
+}
@@ -0,0 +1,386 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * e-type-swarm - Load generator for e-type-server
+ *
+ * usage: e-type-swarm [-H host] [-p port] [-m matches] [-r keys/s] [-d seconds] [-u]
+ *
+ * Plays 'matches' matches at once, two connections each, pressing
+ * random keys 'r' times a second per player. A finished match is
+ * started again under a new id. Prints what came back each second.
+ * With -u keys go over UDP like the game's, see net.h.
+ */
+
+/* C library */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* POSIX */
+#include <unistd.h>
+#include <sys/epoll.h>
+/* Sockets */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+/* e-type */
+#include "input.h"
+#include "net.h"
+#include "utils.h"
+
+struct player {
+	int fd;
+	uint32_t match;
+	uint8_t in[4096];
+	int in_len;
+	uint64_t next_key;
+	/* [UDP] */
+	int udp_fd;
+	uint8_t udp_ok, player;
+	uint32_t token;
+	struct net_inputs inputs;
+	uint64_t sent;
+};
+
+const uint8_t keys[] = { IN_LEFT, IN_RIGHT, IN_ROTATE_CW, IN_ROTATE_CCW, IN_SOFT_DROP, IN_HARD_DROP, IN_HOLD };
+
+struct addrinfo *addr;
+struct player *players;
+int epfd, udp;
+uint64_t msgs, bytes, boards, overs, failures, datagrams;
+
+/* Event data: the player's index, the low bit tells UDP from TCP */
+#define EV_PLAYER(c, is_udp)	((uint64_t)((c) - players) << 1 | (is_udp))
+
+int
+player_open(struct player *c, uint32_t match)
+{
+	struct epoll_event ev;
+	uint8_t hello[NET_HELLO_SIZE];
+	int one;
+
+	c->match = match;
+	c->in_len = 0;
+	c->udp_fd = -1;
+	c->udp_ok = 0;
+	memset(&c->inputs, 0, sizeof c->inputs);
+
+	if ((c->fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol)) == -1) {
+		return -1;
+	}
+
+	/* Blocking connect and hello, then the socket only gets polled */
+	if (connect(c->fd, addr->ai_addr, addr->ai_addrlen) == -1
+	 || send(c->fd, hello, net_hello(hello, match), MSG_NOSIGNAL) != NET_HELLO_SIZE) {
+		close(c->fd);
+		c->fd = -1;
+		return -1;
+	}
+
+	one = 1;
+	setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+	ev.events = EPOLLIN;
+	ev.data.u64 = EV_PLAYER(c, 0);
+	epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev);
+
+	return 0;
+}
+
+void
+player_close(struct player *c)
+{
+	if (c->fd != -1) {
+		close(c->fd);
+		c->fd = -1;
+	}
+	if (c->udp_fd != -1) {
+		close(c->udp_fd);
+		c->udp_fd = -1;
+	}
+}
+
+void
+player_udp_send(struct player *c)
+{
+	uint8_t buf[NET_UDP_MAX];
+
+	if (send(c->udp_fd, buf, net_pack_inputs(buf, &c->inputs, c->match, c->player, c->token), MSG_DONTWAIT) > 0) {
+		++datagrams;
+	}
+	c->sent = time_ns();
+}
+
+/* Same host and port as the connection, plus the offset from NET_START */
+void
+player_udp_open(struct player *c, const uint8_t *start)
+{
+	struct sockaddr_storage sa;
+	struct epoll_event ev;
+	socklen_t len;
+	uint16_t *port;
+
+	if (start[5] == NET_NO_UDP) {
+		return;
+	}
+
+	memcpy(&sa, addr->ai_addr, addr->ai_addrlen);
+	len = addr->ai_addrlen;
+	port = sa.ss_family == AF_INET6 ? &((struct sockaddr_in6 *)&sa)->sin6_port : &((struct sockaddr_in *)&sa)->sin_port;
+	*port = htons(ntohs(*port) + start[5]);
+
+	if ((c->udp_fd = socket(sa.ss_family, SOCK_DGRAM | SOCK_NONBLOCK, 0)) == -1) {
+		return;
+	}
+	if (connect(c->udp_fd, (struct sockaddr *)&sa, len) == -1) {
+		close(c->udp_fd);
+		c->udp_fd = -1;
+		return;
+	}
+
+	c->player = start[0];
+	c->token = (uint32_t)start[6] << 24 | start[7] << 16 | start[8] << 8 | start[9];
+
+	ev.events = EPOLLIN;
+	ev.data.u64 = EV_PLAYER(c, 1);
+	epoll_ctl(epfd, EPOLL_CTL_ADD, c->udp_fd, &ev);
+
+	player_udp_send(c);
+}
+
+/* Boards only matter for the acknowledgement they carry */
+void
+player_udp_read(struct player *c)
+{
+	uint8_t buf[NET_UDP_MAX];
+	uint32_t seq, ack;
+	ssize_t n;
+
+	while (c->udp_fd != -1 && (n = recv(c->udp_fd, buf, sizeof buf, MSG_DONTWAIT)) > 0) {
+		if (net_unpack_udp_board(buf, n, &seq, &ack) == -1) {
+			continue;
+		}
+
+		++msgs;
+		++boards;
+		bytes += n;
+		c->udp_ok = 1;
+		net_inputs_ack(&c->inputs, ack);
+	}
+}
+
+/* Over UDP once the server has answered there */
+int
+player_key(struct player *c, uint8_t key)
+{
+	if (c->udp_ok) {
+		if (net_inputs_push(&c->inputs, key) == -1) {
+			return -1;
+		}
+		player_udp_send(c);
+		return 0;
+	}
+
+	return send(c->fd, &key, 1, MSG_NOSIGNAL | MSG_DONTWAIT) == 1 ? 0 : -1;
+}
+
+/*
+ * Both players of a match see NET_OVER, so both come back with the
+ * same new id.
+ */
+void
+player_read(struct player *c, uint32_t matches)
+{
+	ssize_t n;
+	int off, len;
+
+	if ((n = recv(c->fd, c->in + c->in_len, sizeof c->in - c->in_len, MSG_DONTWAIT)) <= 0) {
+		if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+			++failures;
+			player_close(c);
+		}
+		return;
+	}
+
+	bytes += n;
+	c->in_len += n;
+
+	for (off = 0; c->in_len - off >= NET_HEADER; off += len) {
+		len = NET_HEADER + c->in[off + 1];
+		if (c->in_len - off < len) {
+			break;
+		}
+
+		++msgs;
+		if (c->in[off] == NET_BOARD) {
+			++boards;
+
+		} else if (c->in[off] == NET_START && udp && len >= NET_HEADER + NET_START_SIZE && c->udp_fd == -1) {
+			player_udp_open(c, c->in + off + NET_HEADER);
+
+		} else if (c->in[off] == NET_OVER) {
+			++overs;
+			player_close(c);
+			if (player_open(c, c->match + matches) == -1) {
+				++failures;
+			}
+			return;
+		}
+	}
+
+	memmove(c->in, c->in + off, c->in_len - off);
+	c->in_len -= off;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct addrinfo hints;
+	struct epoll_event ev[256];
+	struct player *c;
+	const char *host, *port;
+	uint64_t start, now, last, period, prev_msgs, prev_bytes, keys_sent;
+	int opt, matches, rate, seconds, i, n, err;
+	uint8_t key;
+
+	host = "localhost";
+	port = NET_PORT;
+	matches = 100;
+	rate = 10;
+	seconds = 10;
+
+	while ((opt = getopt(argc, argv, "H:p:m:r:d:u")) != -1) {
+		switch (opt) {
+		case 'H':
+			host = optarg;
+			break;
+
+		case 'p':
+			port = optarg;
+			break;
+
+		case 'm':
+			matches = atoi(optarg);
+			break;
+
+		case 'r':
+			rate = atoi(optarg);
+			break;
+
+		case 'd':
+			seconds = atoi(optarg);
+			break;
+
+		case 'u':
+			udp = 1;
+			break;
+
+		default:
+			fprintf(stderr, "usage: %s [-H host] [-p port] [-m matches] [-r keys/s] [-d seconds] [-u]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (matches < 1 || rate < 1) {
+		fprintf(stderr, "%s: need at least a match and a key a second\n", argv[0]);
+		return 1;
+	}
+
+	memset(&hints, 0, sizeof hints);
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if ((err = getaddrinfo(host, port, &hints, &addr)) != 0) {
+		fprintf(stderr, "%s: %s\n", argv[0], gai_strerror(err));
+		return 1;
+	}
+
+	if ((players = calloc(2 * matches, sizeof (*players))) == NULL || (epfd = epoll_create1(0)) == -1) {
+		perror(argv[0]);
+		return 1;
+	}
+
+	srand(time_ns());
+	period = 1000000000 / rate;
+	start = time_ns();
+
+	for (i = 0; i != 2 * matches; ++i) {
+		/* Spread the keys out instead of sending them all together */
+		players[i].next_key = start + rand() % period;
+		if (player_open(&players[i], i / 2) == -1) {
+			fprintf(stderr, "%s: can't connect to %s:%s: %s\n", argv[0], host, port, strerror(errno));
+			return 1;
+		}
+	}
+
+	printf("%d matches, %d connections up in %.1f ms\n", matches, 2 * matches, (time_ns() - start) / 1e6);
+
+	last = start = time_ns();
+	prev_msgs = prev_bytes = keys_sent = 0;
+
+	while ((now = time_ns()) - start < (uint64_t)seconds * 1000000000) {
+		n = epoll_wait(epfd, ev, 256, 1);
+		for (i = 0; i < n; ++i) {
+			c = &players[ev[i].data.u64 >> 1];
+			if (ev[i].data.u64 & 1) {
+				player_udp_read(c);
+			} else if (c->fd != -1) {
+				player_read(c, matches);
+			}
+		}
+
+		for (i = 0; i != 2 * matches; ++i) {
+			c = &players[i];
+			if (c->fd != -1 && now >= c->next_key) {
+				c->next_key += period;
+				key = keys[rand() % sizeof keys];
+				if (player_key(c, key) == 0) {
+					++keys_sent;
+				}
+			}
+
+			/* The probe until UDP works, then whatever isn't acknowledged */
+			if (c->udp_fd != -1 && (!c->udp_ok || c->inputs.next != c->inputs.acked) && now - c->sent >= NET_RESEND_NS) {
+				player_udp_send(c);
+			}
+		}
+
+		if (now - last >= 1000000000) {
+			printf("%8.0f msgs/s %8.0f KiB/s %8lu keys %8lu boards %6lu overs %4lu failures %8lu datagrams\n",
+			       (msgs - prev_msgs) * 1e9 / (now - last), (bytes - prev_bytes) * 1e9 / 1024 / (now - last),
+			       keys_sent, boards, overs, failures, datagrams);
+			fflush(stdout);
+			prev_msgs = msgs;
+			prev_bytes = bytes;
+			last = now;
+		}
+	}
+
+	printf("%.0f msgs/s on average\n", msgs * 1e9 / (time_ns() - start));
+
+	for (i = 0; i != 2 * matches; ++i) {
+		player_close(&players[i]);
+	}
+	free(players);
+	freeaddrinfo(addr);
+
+	return 0;
+}
@@ -0,0 +1,326 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * e-type-train - Profile training workload
+ *
+ * usage: e-type-train [-g games] [-p pieces] [-r dir]
+ *
+ * Plays a fixed corpus of games headless, the same every run, on
+ * every board the engine has a compiled variant for and on a large
+ * one. The player tries each rotation and column of a tetromino on
+ * copies of the game and keeps the landing with the best board, then
+ * rotates, shifts, soft drops and hard drops it there for real,
+ * holding now and then and drawing every frame to a curses screen on
+ * /dev/null, so games run hundreds of pieces and clear lines like
+ * real play. Large boards share their cells between copies and get
+ * a scripted player instead. The bot plays its own games on top. It's
+ * what `make pgo` runs to collect the profile. With -r every game but
+ * the large board and bot ones is recorded into 'dir', with the
+ * tetromino falling as it would at 60 frames a second.
+ */
+
+/* C library */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* POSIX */
+#include <unistd.h>
+/* e-type */
+#include "bot.h"
+#include "replay.h"
+#include "tetris.h"
+#include "utils.h"
+
+/* Every compiled variant (engine.c) and a large board, the standard one gets the most games */
+const struct { uint16_t w, h; uint8_t ghost; } boards[] = {
+	{ 10, 20, 1 }, { 6, 20, 1 }, { 10, 20, 0 }, { 16, 20, 1 },
+	{ 10, 20, 1 }, { 10, 24, 1 }, { 6, 20, 0 }, { 10, 20, 1 },
+	{ 16, 20, 0 }, { 10, 24, 0 }, { 10, 20, 1 }, { 40, 100, 1 },
+};
+
+#define BOARD_COUNT	(sizeof boards / sizeof boards[0])
+
+/* Bot games played on top of the corpus, for bot.c */
+#define BOT_GAMES	8
+
+struct game_state gs;
+struct replay_rec recorder;
+uint32_t lcg;
+
+int
+script_next(int n)
+{
+	lcg = lcg * 1103515245 + 12345;
+
+	return (lcg >> 16) % n;
+}
+
+/*
+ * Whatever the engine flagged, like the game loop would, and the next
+ * frame starts. A recorded game also runs the fall timer, on a 60 Hz
+ * clock of its own so it's still the same every run.
+ */
+void
+frame(void)
+{
+	draw_game(&gs);
+
+	if (gs.replay) {
+		if (!(gs.flags & BIT(QUIT))) {
+			update_timing(&gs);
+		}
+		replay_tick(&gs, gs.replay->clock + 1000000000 / 60);
+	}
+}
+
+/*
+ * How good the board of 'g' looks, weights of the usual height, lines,
+ * holes and bumpiness player. A game that's over is the worst.
+ */
+double
+rate(const struct game_state *g, uint32_t lines)
+{
+	int x, y, h, prev, height, holes, bumps;
+
+	if (g->flags & BIT(QUIT)) {
+		return -1e9;
+	}
+
+	height = holes = bumps = 0;
+	prev = -1;
+	for (x = 0; x != g->board_w; ++x) {
+		for (y = 0; y != g->board_h && !g->board[y][x]; ++y)
+			;
+		h = g->board_h - y;
+		for (; y != g->board_h; ++y) {
+			holes += !g->board[y][x];
+		}
+
+		height += h;
+		bumps += prev == -1 ? 0 : abs(h - prev);
+		prev = h;
+	}
+
+	return 0.76 * (g->lines - lines) - 0.51 * height - 0.36 * holes - 0.18 * bumps;
+}
+
+/*
+ * Where the tetromino in play lands best: 'turns' clockwise rotations
+ * from where it is, then column 'best_x'. Every landing is a hard drop
+ * on a copy of the game, reached the way play_piece() moves it.
+ */
+void
+plan_piece(int *turns, int *best_x)
+{
+	static struct game_state spun, moved, dropped;
+	double score, best;
+	int r;
+
+	best = -1e18;
+	*turns = 0;
+	*best_x = gs.curr_mino_pos.x;
+
+	/* The copies are tries, not part of a recording */
+	spun = gs;
+	spun.replay = NULL;
+	for (r = 0; r != 4; ++r) {
+		if (r && rotate_mino(&spun, CLOCKWISE) == FAILURE) {
+			break;
+		}
+
+		moved = spun;
+		while (move_mino(&moved, -1, 0, SOFT_DROP) == SUCCESS)
+			;
+
+		do {
+			dropped = moved;
+			hard_drop(&dropped);
+			if ((score = rate(&dropped, gs.lines)) > best) {
+				best = score;
+				*turns = r;
+				*best_x = moved.curr_mino_pos.x;
+			}
+		} while (move_mino(&moved, 1, 0, SOFT_DROP) == SUCCESS);
+	}
+}
+
+/*
+ * One tetromino: maybe hold it, then take it where plan_piece() says,
+ * turning back and forth now and then, and let it fall a little
+ * before the hard drop. Returns 0 once the game is over.
+ */
+int
+play_piece(void)
+{
+	int i, turns, best_x;
+
+	if (script_next(16) == 0) {
+		hold_mino(&gs);
+		frame();
+	}
+
+	if (script_next(4) == 0) {
+		rotate_mino(&gs, COUNTER_CLOCKWISE);
+		frame();
+		rotate_mino(&gs, CLOCKWISE);
+		frame();
+	}
+
+	plan_piece(&turns, &best_x);
+	for (i = 0; i != turns; ++i) {
+		rotate_mino(&gs, CLOCKWISE);
+		frame();
+	}
+
+	while (gs.curr_mino_pos.x != best_x && move_mino(&gs, gs.curr_mino_pos.x < best_x ? 1 : -1, 0, SOFT_DROP) == SUCCESS) {
+		frame();
+	}
+
+	for (i = script_next(4); i-- && move_mino(&gs, 0, 1, AUTO_DROP) == SUCCESS; ) {
+		frame();
+	}
+
+	hard_drop(&gs);
+	frame();
+
+	return !(gs.flags & BIT(QUIT));
+}
+
+/*
+ * Large boards keep their cells out of the game state, so there's no
+ * copy to try landings on: turn the tetromino at random and drop it
+ * at a random column.
+ */
+int
+play_scripted(void)
+{
+	int i, turns, x;
+
+	turns = script_next(4);
+	for (i = 0; i != turns; ++i) {
+		rotate_mino(&gs, script_next(3) ? CLOCKWISE : COUNTER_CLOCKWISE);
+		frame();
+	}
+
+	x = script_next(gs.board_w);
+	while (gs.curr_mino_pos.x != x && move_mino(&gs, gs.curr_mino_pos.x < x ? 1 : -1, 0, SOFT_DROP) == SUCCESS) {
+		frame();
+	}
+
+	hard_drop(&gs);
+	frame();
+
+	return !(gs.flags & BIT(QUIT));
+}
+
+int
+main(int argc, char **argv)
+{
+	struct config_prof prof;
+	struct bot_game bg;
+	FILE *null_out, *null_in;
+	const char *dir;
+	uint64_t start, pieces, lines;
+	int opt, games, max_pieces, g, p;
+
+	games = 36;
+	max_pieces = 300;
+	dir = NULL;
+
+	while ((opt = getopt(argc, argv, "g:p:r:")) != -1) {
+		switch (opt) {
+		case 'g':
+			games = atoi(optarg);
+			break;
+
+		case 'p':
+			max_pieces = atoi(optarg);
+			break;
+
+		case 'r':
+			dir = optarg;
+			break;
+
+		default:
+			fprintf(stderr, "usage: %s [-g games] [-p pieces] [-r dir]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if ((null_out = fopen("/dev/null", "w")) == NULL || (null_in = fopen("/dev/null", "r")) == NULL) {
+		perror("/dev/null");
+		return 1;
+	}
+
+	if (newterm("xterm", null_out, null_in) == NULL) {
+		fprintf(stderr, "%s: can't create the curses screen\n", argv[0]);
+		return 1;
+	}
+
+	start_color();
+	gs.hold_win = newwin(8, 14, 0, 0);
+	gs.board_win = newwin(BOARD_H + 2, BOARD_W * 2 + 2, 0, 0);
+	gs.stats_win = newwin(BOARD_H + 2, BOARD_W * 2 + 2, 0, 0);
+
+	memset(&prof, 0, sizeof prof);
+	pieces = lines = 0;
+	start = time_ns();
+
+	for (g = 0; g != games; ++g) {
+		prof.board_w = boards[g % BOARD_COUNT].w;
+		prof.board_h = boards[g % BOARD_COUNT].h;
+		prof.rng_ind = g & 1;
+		prof.preview = 1 + g % 4;
+		prof.flags = BIT(CONFIG_FHEADLESS) | boards[g % BOARD_COUNT].ghost << CONFIG_FGHOST;
+		lcg = g + 1;
+
+		init_game(&gs, &prof, g + 1);
+		place_windows(&gs);
+		spawn_mino(&gs);
+		if (dir) {
+			replay_record(&recorder, &gs, dir);
+		}
+
+		/* Large boards take long to draw and hardly ever top out */
+		if (gs.big) {
+			for (p = 0; p != max_pieces / 8 && play_scripted(); ++p)
+				;
+		} else {
+			for (p = 0; p != max_pieces && play_piece(); ++p)
+				;
+		}
+		replay_finish(&gs);
+		pieces += p;
+		lines += gs.lines;
+	}
+
+	for (g = 0; g != BOT_GAMES; ++g) {
+		bot_play(bot_default_weights, g & 1, g + 1, max_pieces, &bg);
+		pieces += bg.pieces;
+		lines += bg.lines;
+	}
+
+	endwin();
+	fprintf(stderr, "%d games, %" PRIu64 " pieces, %" PRIu64 " lines in %.2f s\n", games + BOT_GAMES, pieces, lines,
+		(time_ns() - start) / 1e9);
+
+	return 0;
+}
@@ -0,0 +1,526 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * e-type-tune - Genetic tuner of the bot's evaluator weights
+ *
+ * usage: e-type-tune [-n population] [-g games] [-p pieces] [-G generations]
+ *                    [-t threads] [-r rand_engine] [-s seed] [-c checkpoint] [-o results]
+ *
+ * Each generation every candidate plays the same 'games' seeded games
+ * of at most 'pieces' tetrominos, spread over 'threads', and its
+ * fitness is the mean score. The best eighth goes on unchanged, the
+ * rest are children of tournament winners: a fitness weighted average
+ * of the parents with some genes mutated. Weights are kept at unit
+ * length, the evaluator only cares about their direction.
+ *
+ * The population is saved to 'checkpoint' after every generation and
+ * a run that finds one picks up from there, with the settings it was
+ * started with. Every generation appends a line to 'results'.
+ */
+
+/* C library */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* POSIX */
+#include <unistd.h>
+#include <pthread.h>
+/* e-type */
+#include "bot.h"
+#include "batch.h"
+#include "config.h"
+#include "utils.h"
+
+#define CHECKPOINT_MAGIC	"e-type-tune 1"
+#define TOURNAMENT		3
+#define MUTATION_RATE		0.25
+#define MUTATION_SIGMA		0.15
+
+struct candidate {
+	double w[BF_COUNT];
+	double fitness;
+};
+
+/*
+ * -==+ Run +==-
+ * Everything the checkpoint has to bring back.
+ */
+struct tune {
+	int pop, games, rng_ind;
+	uint64_t pieces;
+	uint32_t seed;
+	int generation;
+	uint64_t rng;
+	struct candidate *c;
+	struct candidate best;
+};
+
+/* -==+ Generation being played +==- */
+struct tune run;
+uint32_t *seeds;
+uint64_t *scores, played;
+int next_job;
+
+/* -==+ Random numbers +==- */
+
+uint64_t
+splitmix(uint64_t *x)
+{
+	uint64_t z;
+
+	z = (*x += 0x9e3779b97f4a7c15ull);
+	z = (z ^ z >> 30) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ z >> 27) * 0x94d049bb133111ebull;
+
+	return z ^ z >> 31;
+}
+
+double
+uniform(void)
+{
+	return (splitmix(&run.rng) >> 11) * 0x1p-53;
+}
+
+double
+gaussian(void)
+{
+	return sqrt(-2 * log(1 - uniform())) * cos(2 * M_PI * uniform());
+}
+
+void
+normalize(double *w)
+{
+	double len;
+	int i;
+
+	len = 0;
+	for (i = 0; i != BF_COUNT; ++i) {
+		len += w[i] * w[i];
+	}
+
+	len = len > 0 ? sqrt(len) : 1;
+	for (i = 0; i != BF_COUNT; ++i) {
+		w[i] /= len;
+	}
+}
+
+/* -==+ Evaluation +==- */
+
+void *
+play_jobs(void *arg)
+{
+	struct bot_game g;
+	uint64_t pieces;
+	int j;
+
+	pieces = 0;
+	while ((j = __atomic_fetch_add(&next_job, 1, __ATOMIC_RELAXED)) < run.pop * run.games) {
+		bot_play(run.c[j / run.games].w, run.rng_ind, seeds[j % run.games], run.pieces, &g);
+		scores[j] = g.score;
+		pieces += g.pieces;
+	}
+
+	__atomic_fetch_add(&played, pieces, __ATOMIC_RELAXED);
+
+	return NULL;
+}
+
+/*
+ * Every candidate plays the same games, drawn anew each generation so
+ * nobody gets good at a particular set of seeds.
+ */
+void
+evaluate(int threads)
+{
+	pthread_t tid[threads];
+	uint64_t x, sum;
+	int i, j, started;
+
+	x = (uint64_t)run.seed << 32 | run.generation;
+	for (i = 0; i != run.games; ++i) {
+		seeds[i] = splitmix(&x);
+	}
+
+	next_job = 0;
+	played = 0;
+	for (started = 0; started != threads - 1; ++started) {
+		if (pthread_create(&tid[started], NULL, play_jobs, NULL)) {
+			break;
+		}
+	}
+
+	play_jobs(NULL);
+
+	for (i = 0; i != started; ++i) {
+		pthread_join(tid[i], NULL);
+	}
+
+	for (i = 0; i != run.pop; ++i) {
+		sum = 0;
+		for (j = 0; j != run.games; ++j) {
+			sum += scores[i * run.games + j];
+		}
+
+		run.c[i].fitness = (double)sum / run.games;
+	}
+}
+
+/* -==+ Breeding +==- */
+
+int
+by_fitness(const void *a, const void *b)
+{
+	const struct candidate *x = a, *y = b;
+
+	return (x->fitness < y->fitness) - (x->fitness > y->fitness);
+}
+
+const struct candidate *
+tournament(const struct candidate *sorted)
+{
+	int i, k, pick;
+
+	/* Sorted best first, the lowest index wins */
+	pick = run.pop;
+	for (i = 0; i != TOURNAMENT; ++i) {
+		k = splitmix(&run.rng) % run.pop;
+		pick = MIN(pick, k);
+	}
+
+	return &sorted[pick];
+}
+
+/*
+ * Replace the population, sorted best first, with the next one.
+ */
+void
+breed(struct candidate *next)
+{
+	const struct candidate *a, *b;
+	double fa, fb;
+	int elite, i, k;
+
+	elite = MAX(1, run.pop / 8);
+	memcpy(next, run.c, elite * sizeof (*next));
+
+	for (i = elite; i != run.pop; ++i) {
+		a = tournament(run.c);
+		b = tournament(run.c);
+		fa = a->fitness + 1;
+		fb = b->fitness + 1;
+
+		for (k = 0; k != BF_COUNT; ++k) {
+			next[i].w[k] = (fa * a->w[k] + fb * b->w[k]) / (fa + fb);
+
+			if (uniform() < MUTATION_RATE) {
+				next[i].w[k] += MUTATION_SIGMA * gaussian();
+			}
+		}
+
+		normalize(next[i].w);
+	}
+
+	memcpy(run.c, next, run.pop * sizeof (*next));
+}
+
+/* -==+ Checkpoints +==- */
+
+void
+write_weights(FILE *fp, const double *w)
+{
+	int k;
+
+	for (k = 0; k != BF_COUNT; ++k) {
+		fprintf(fp, " %.17g", w[k]);
+	}
+	fputc('\n', fp);
+}
+
+int
+read_weights(FILE *fp, double *w)
+{
+	int k;
+
+	for (k = 0; k != BF_COUNT; ++k) {
+		if (fscanf(fp, "%lf", &w[k]) != 1) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Written next to 'path' and renamed over it, a run killed halfway
+ * leaves the previous one.
+ */
+int
+save(const char *path)
+{
+	char tmp[4096];
+	FILE *fp;
+	int i;
+
+	snprintf(tmp, sizeof tmp, "%s.tmp", path);
+	if ((fp = fopen(tmp, "w")) == NULL) {
+		perror(tmp);
+		return -1;
+	}
+
+	fprintf(fp, "%s\n", CHECKPOINT_MAGIC);
+	fprintf(fp, "settings %d %d %llu %s %u\n", run.pop, run.games, (unsigned long long)run.pieces,
+		rand_profiles[run.rng_ind].name, run.seed);
+	fprintf(fp, "generation %d\nrng %llu\n", run.generation, (unsigned long long)run.rng);
+	fprintf(fp, "best %.17g", run.best.fitness);
+	write_weights(fp, run.best.w);
+
+	for (i = 0; i != run.pop; ++i) {
+		fprintf(fp, "candidate");
+		write_weights(fp, run.c[i].w);
+	}
+
+	if (fclose(fp) || rename(tmp, path)) {
+		perror(path);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * 1 when 'path' had a run to resume, 0 when there's no such file and
+ * -1 when it can't be used.
+ */
+int
+load(const char *path)
+{
+	unsigned long long pieces, rng;
+	char magic[32], engine[16];
+	FILE *fp;
+	int i, ok;
+
+	if ((fp = fopen(path, "r")) == NULL) {
+		return 0;
+	}
+
+	ok = fgets(magic, sizeof magic, fp) && strncmp(magic, CHECKPOINT_MAGIC "\n", sizeof magic) == 0
+	     && fscanf(fp, " settings %d %d %llu %15s %u", &run.pop, &run.games, &pieces, engine, &run.seed) == 5
+	     && fscanf(fp, " generation %d rng %llu best %lf", &run.generation, &rng, &run.best.fitness) == 3
+	     && read_weights(fp, run.best.w) == 0 && run.pop > 0 && run.games > 0;
+
+	for (run.rng_ind = 0; ok && run.rng_ind != RAND_COUNT; ++run.rng_ind) {
+		if (strcmp(engine, rand_profiles[run.rng_ind].name) == 0) {
+			break;
+		}
+	}
+
+	ok = ok && run.rng_ind != RAND_COUNT && (run.c = calloc(run.pop, sizeof (*run.c)));
+	for (i = 0; ok && i != run.pop; ++i) {
+		ok = fscanf(fp, " candidate") == 0 && read_weights(fp, run.c[i].w) == 0;
+	}
+
+	fclose(fp);
+
+	if (!ok) {
+		fprintf(stderr, "%s: not a usable checkpoint\n", path);
+		return -1;
+	}
+
+	run.pieces = pieces;
+	run.rng = rng;
+
+	return 1;
+}
+
+/* -==+ Results +==- */
+
+void
+report(FILE *out, const struct candidate *sorted, double seconds)
+{
+	double mean;
+	int i;
+
+	mean = 0;
+	for (i = 0; i != run.pop; ++i) {
+		mean += sorted[i].fitness / run.pop;
+	}
+
+	fprintf(out, "%d\t%.1f\t%.1f\t%.1f\t%.0f", run.generation, sorted[0].fitness, mean, seconds, played / seconds);
+	for (i = 0; i != BF_COUNT; ++i) {
+		fprintf(out, "\t%.6f", sorted[0].w[i]);
+	}
+	fputc('\n', out);
+	fflush(out);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *checkpoint, *results, *engine;
+	struct candidate *next;
+	uint64_t start;
+	double seconds;
+	FILE *out;
+	int opt, generations, threads, resumed, i, k;
+
+	memset(&run, 0, sizeof run);
+	run.pop = 48;
+	run.games = 16;
+	run.pieces = 10000;
+	run.seed = 1;
+	generations = 100;
+	threads = sysconf(_SC_NPROCESSORS_ONLN);
+	engine = "bag";
+	checkpoint = "e-type-tune.ckpt";
+	results = "e-type-tune.tsv";
+
+	while ((opt = getopt(argc, argv, "n:g:p:G:t:r:s:c:o:")) != -1) {
+		switch (opt) {
+		case 'n':
+			run.pop = atoi(optarg);
+			break;
+
+		case 'g':
+			run.games = atoi(optarg);
+			break;
+
+		case 'p':
+			run.pieces = strtoull(optarg, NULL, 10);
+			break;
+
+		case 'G':
+			generations = atoi(optarg);
+			break;
+
+		case 't':
+			threads = atoi(optarg);
+			break;
+
+		case 'r':
+			engine = optarg;
+			break;
+
+		case 's':
+			run.seed = strtoul(optarg, NULL, 10);
+			break;
+
+		case 'c':
+			checkpoint = optarg;
+			break;
+
+		case 'o':
+			results = optarg;
+			break;
+
+		default:
+			fprintf(stderr, "usage: %s [-n population] [-g games] [-p pieces] [-G generations]\n"
+					"       [-t threads] [-r rand_engine] [-s seed] [-c checkpoint] [-o results]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	for (run.rng_ind = 0; run.rng_ind != RAND_COUNT; ++run.rng_ind) {
+		if (strcmp(engine, rand_profiles[run.rng_ind].name) == 0) {
+			break;
+		}
+	}
+
+	if (run.pop < 2 || run.games < 1 || run.pieces < 1 || threads < 1 || run.rng_ind == RAND_COUNT) {
+		fprintf(stderr, "%s: bad population, games, pieces, threads or rand_engine\n", argv[0]);
+		return 1;
+	}
+
+	if ((resumed = load(checkpoint)) == -1) {
+		return 1;
+	}
+
+	if (resumed) {
+		fprintf(stderr, "%s: resuming %s at generation %d\n", argv[0], checkpoint, run.generation);
+
+	} else {
+		/* The published weights and random directions around them */
+		run.c = calloc(run.pop, sizeof (*run.c));
+		run.rng = run.seed;
+		run.best.fitness = -1;
+
+		for (i = 0; i != run.pop; ++i) {
+			for (k = 0; k != BF_COUNT; ++k) {
+				run.c[i].w[k] = bot_default_weights[k] + (i ? 20 * gaussian() : 0);
+			}
+			normalize(run.c[i].w);
+		}
+	}
+
+	next = calloc(run.pop, sizeof (*next));
+	seeds = calloc(run.games, sizeof (*seeds));
+	scores = calloc((size_t)run.pop * run.games, sizeof (*scores));
+	if (!run.c || !next || !seeds || !scores) {
+		perror("calloc");
+		return 1;
+	}
+
+	if ((out = fopen(results, "a")) == NULL) {
+		perror(results);
+		return 1;
+	}
+
+	if (ftell(out) == 0) {
+		fprintf(out, "generation\tbest\tmean\tseconds\tpieces_per_sec");
+		for (k = 0; k != BF_COUNT; ++k) {
+			fprintf(out, "\t%s", bot_feature_names[k]);
+		}
+		fputc('\n', out);
+	}
+
+	batch_states();
+
+	while (run.generation < generations) {
+		start = time_ns();
+		evaluate(threads);
+		qsort(run.c, run.pop, sizeof (*run.c), by_fitness);
+		seconds = (time_ns() - start) / 1e9;
+
+		if (run.c[0].fitness > run.best.fitness) {
+			run.best = run.c[0];
+		}
+
+		report(out, run.c, seconds);
+		report(stderr, run.c, seconds);
+
+		/* The checkpoint holds the generation to play next */
+		breed(next);
+		++run.generation;
+		if (save(checkpoint)) {
+			return 1;
+		}
+	}
+
+	printf("best %.1f", run.best.fitness);
+	write_weights(stdout, run.best.w);
+
+	fclose(out);
+	free(scores);
+	free(seeds);
+	free(next);
+	free(run.c);
+
+	return 0;
+}
@@ -0,0 +1,420 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * e-type-verify - Replay corpus verifier
+ *
+ * usage: e-type-verify [-j threads] [-v] dir|file...
+ *
+ * Plays every replay (*.rep in each directory) again from a new game
+ * of its seed, on all cores, and checks that:
+ *
+ *	- the first keyframe is that new game, nothing was set up
+ *	- every keyframe along the way is the state the records lead to
+ *	- the tetromino fell whenever the engine clock had it due and
+ *	  only then, and no frame holds more steps than its keys make
+ *	- the game ends at the recorded step with the score, lines,
+ *	  level and pieces the trailer claims
+ *
+ * Keyframes are 256 steps apart, so a divergence is placed between
+ * the last one that matched and the first that didn't. `e-type-replay
+ * diff` narrows it to the step against a good recording of the game.
+ * Files are mapped, not read. Exits with 1 if any replay failed.
+ */
+
+/* C library */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* POSIX */
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+/* e-type */
+#include "replay.h"
+#include "tetris.h"
+#include "utils.h"
+
+/* Verdicts, worst last */
+typedef enum { V_OK, V_UNCLAIMED, V_CLAIMS, V_DIVERGED, V_TIMING, V_START, V_BROKEN, V_UNREADABLE } verdict;
+
+const char *verdict_names[] = { "ok", "unfinished", "claims", "diverged", "timing", "start", "broken", "unreadable" };
+
+struct result {
+	verdict v;
+	uint32_t steps;
+	uint32_t good, bad;		/* Last keyframe step that matched, first that didn't */
+	uint32_t score, lines, level;	/* What playing it gave */
+	uint32_t mino_count[7];
+	size_t bytes;
+};
+
+/* -==+ Corpus +==- */
+char **paths;
+struct result *results;
+int path_count, path_size;
+int next_job;
+
+void
+add_path(const char *dir, const char *name)
+{
+	size_t n;
+
+	if (path_count == path_size) {
+		path_size = path_size ? 2 * path_size : 1024;
+		if ((paths = realloc(paths, path_size * sizeof (*paths))) == NULL) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+
+	n = (dir ? strlen(dir) + 1 : 0) + strlen(name) + 1;
+	if ((paths[path_count] = malloc(n)) == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+	snprintf(paths[path_count], n, "%s%s%s", dir ? dir : "", dir ? "/" : "", name);
+
+	++path_count;
+}
+
+/* A file as it is, a directory for its replays */
+int
+add_arg(const char *arg)
+{
+	struct dirent *e;
+	struct stat st;
+	size_t n;
+	DIR *d;
+
+	if (stat(arg, &st) == -1) {
+		perror(arg);
+		return -1;
+	}
+
+	if (!S_ISDIR(st.st_mode)) {
+		add_path(NULL, arg);
+		return 0;
+	}
+
+	if ((d = opendir(arg)) == NULL) {
+		perror(arg);
+		return -1;
+	}
+
+	while ((e = readdir(d)) != NULL) {
+		n = strlen(e->d_name);
+		if (n > 4 && strcmp(e->d_name + n - 4, ".rep") == 0) {
+			add_path(arg, e->d_name);
+		}
+	}
+	closedir(d);
+
+	return 0;
+}
+
+int
+path_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* -==+ Verification +==- */
+
+/*
+ * Whether the first keyframe is a game just started on the header,
+ * before or after its first tetromino came in.
+ */
+int
+fresh_start(struct game_state *gs, const struct replay_file *f)
+{
+	struct replay_keyframe kf, now;
+	struct config_prof prof;
+	uint32_t pieces;
+	int i;
+
+	if (replay_keyframe(f, 0, &kf) == -1 || kf.step) {
+		return 0;
+	}
+
+	memset(&prof, 0, sizeof prof);
+	prof.rng_ind = f->hdr.rng_ind % RAND_COUNT;
+	prof.preview = f->hdr.preview;
+	prof.board_w = f->hdr.board_w;
+	prof.board_h = f->hdr.board_h;
+	prof.flags = f->hdr.flags;
+	init_game(gs, &prof, f->hdr.seed);
+
+	for (pieces = i = 0; i != 7; ++i) {
+		pieces += kf.mino_count[i];
+	}
+	if (pieces == 1) {
+		spawn_mino(gs);
+	}
+
+	replay_snapshot(&now, gs);
+
+	return replay_same(&now, &kf);
+}
+
+void
+verify(struct game_state *gs, const char *path, struct result *res)
+{
+	struct replay_file f;
+	struct replay_cursor c;
+	struct replay_keyframe kf, now;
+	const struct replay_trailer *tr;
+	uint32_t k;
+	int r;
+
+	memset(res, 0, sizeof (*res));
+	if (replay_open(&f, path) == -1) {
+		res->v = V_UNREADABLE;
+		return;
+	}
+	madvise((void *)f.data, f.size, MADV_SEQUENTIAL);
+	res->bytes = f.size;
+
+	if (!fresh_start(gs, &f)) {
+		res->v = V_START;
+		replay_close(&f);
+		return;
+	}
+
+	replay_start(&c, &f, gs);
+	c.strict = 1;
+	res->bad = UINT32_MAX;
+	k = 1;
+
+	while ((r = replay_next(&c)) == 1) {
+		if (k == f.count || c.step != f.index[k].step) {
+			continue;
+		}
+
+		if (res->bad == UINT32_MAX) {
+			replay_snapshot(&now, gs);
+			if (replay_keyframe(&f, k, &kf) == 0 && kf.step == c.step && replay_same(&now, &kf)) {
+				res->good = c.step;
+			} else {
+				res->bad = c.step;
+			}
+		}
+		++k;
+	}
+
+	res->steps = c.step;
+	res->score = gs->score;
+	res->lines = gs->lines;
+	res->level = gs->level;
+	memcpy(res->mino_count, gs->mino_count, sizeof res->mino_count);
+	tr = f.trailer;
+
+	if (r == -1) {
+		res->v = V_BROKEN;
+
+	} else if (r == -2) {
+		res->v = V_TIMING;
+
+	} else if (res->bad != UINT32_MAX) {
+		res->v = V_DIVERGED;
+
+	} else if (!tr) {
+		res->v = V_UNCLAIMED;
+
+	} else if (c.step != tr->steps || gs->score != tr->score || gs->lines != tr->lines || gs->level != tr->level
+		|| memcmp(gs->mino_count, tr->mino_count, sizeof gs->mino_count)) {
+		res->v = V_CLAIMS;
+	}
+
+	replay_close(&f);
+}
+
+void *
+verify_jobs(void *arg)
+{
+	struct game_state *gs;
+	int j;
+
+	(void)arg;
+	if ((gs = calloc(1, sizeof (*gs))) == NULL) {
+		return NULL;
+	}
+
+	while ((j = __atomic_fetch_add(&next_job, 1, __ATOMIC_RELAXED)) < path_count) {
+		verify(gs, paths[j], &results[j]);
+	}
+
+	free(gs);
+
+	return NULL;
+}
+
+/* -==+ Report +==- */
+
+void
+report_claim(const char *what, uint32_t played, uint32_t claimed)
+{
+	if (played != claimed) {
+		printf(" %s %u, claims %u", what, played, claimed);
+	}
+}
+
+void
+report(int i)
+{
+	const struct result *res;
+	struct replay_file f;
+	int k;
+
+	res = &results[i];
+	printf("%-10s %s", verdict_names[res->v], paths[i]);
+
+	switch (res->v) {
+	case V_DIVERGED:
+		printf(": matched up to step %u, not at %u\n", res->good, res->bad);
+		break;
+
+	case V_CLAIMS:
+		/* Only the failures are opened again, for what they claimed */
+		if (replay_open(&f, paths[i]) == 0) {
+			printf(":");
+			report_claim("steps", res->steps, f.trailer->steps);
+			report_claim("score", res->score, f.trailer->score);
+			report_claim("lines", res->lines, f.trailer->lines);
+			report_claim("level", res->level, f.trailer->level);
+			for (k = 0; k != 7; ++k) {
+				if (res->mino_count[k] != f.trailer->mino_count[k]) {
+					printf(" %c pieces %u, claims %u", minos[k].symbol, res->mino_count[k],
+					       f.trailer->mino_count[k]);
+				}
+			}
+			replay_close(&f);
+		}
+		printf("\n");
+		break;
+
+	case V_BROKEN:
+		printf(": bad record after step %u\n", res->steps);
+		break;
+
+	case V_TIMING:
+		printf(": out of time with the fall timer after step %u\n", res->steps);
+		break;
+
+	case V_START:
+		printf(": doesn't start as a new game of seed\n");
+		break;
+
+	default:
+		if (res->v == V_OK || res->v == V_UNCLAIMED) {
+			printf(": %u steps, score %u, lines %u", res->steps, res->score, res->lines);
+		}
+		printf("\n");
+		break;
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	uint64_t start, elapsed, steps, bytes;
+	int counts[V_UNREADABLE + 1];
+	int opt, threads, verbose, failed, started, i;
+
+	threads = sysconf(_SC_NPROCESSORS_ONLN);
+	verbose = 0;
+
+	while ((opt = getopt(argc, argv, "j:v")) != -1) {
+		switch (opt) {
+		case 'j':
+			threads = atoi(optarg);
+			break;
+
+		case 'v':
+			verbose = 1;
+			break;
+
+		default:
+			fprintf(stderr, "usage: %s [-j threads] [-v] dir|file...\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind == argc) {
+		fprintf(stderr, "usage: %s [-j threads] [-v] dir|file...\n", argv[0]);
+		return 1;
+	}
+
+	for (i = optind; i != argc; ++i) {
+		add_arg(argv[i]);
+	}
+	if (path_count == 0) {
+		fprintf(stderr, "%s: no replays\n", argv[0]);
+		return 1;
+	}
+
+	qsort(paths, path_count, sizeof (*paths), path_cmp);
+	if ((results = calloc(path_count, sizeof (*results))) == NULL) {
+		perror("calloc");
+		return 1;
+	}
+
+	threads = MAX(MIN(threads, path_count), 1);
+	pthread_t tid[threads];
+
+	start = time_ns();
+	for (started = 0; started != threads - 1; ++started) {
+		if (pthread_create(&tid[started], NULL, verify_jobs, NULL)) {
+			break;
+		}
+	}
+
+	verify_jobs(NULL);
+
+	for (i = 0; i != started; ++i) {
+		pthread_join(tid[i], NULL);
+	}
+	elapsed = MAX(time_ns() - start, 1);
+
+	memset(counts, 0, sizeof counts);
+	steps = bytes = 0;
+	for (i = 0; i != path_count; ++i) {
+		++counts[results[i].v];
+		steps += results[i].steps;
+		bytes += results[i].bytes;
+		if (verbose || (results[i].v != V_OK && results[i].v != V_UNCLAIMED)) {
+			report(i);
+		}
+	}
+
+	failed = path_count - counts[V_OK] - counts[V_UNCLAIMED];
+	printf("%d replays on %d threads in %.2f s: %.0f replays/s, %.1f M steps/s, %.1f MB/s\n", path_count, started + 1,
+	       elapsed / 1e9, path_count * 1e9 / elapsed, steps * 1e3 / elapsed, bytes * 1e3 / elapsed);
+	printf("%d ok, %d unfinished, %d failed", counts[V_OK], counts[V_UNCLAIMED], failed);
+	for (i = V_CLAIMS; i <= V_UNREADABLE; ++i) {
+		if (counts[i]) {
+			printf(", %d %s", counts[i], verdict_names[i]);
+		}
+	}
+	printf("\n");
+
+	return failed != 0;
+}
@@ -0,0 +1,178 @@
+/*
+ * e-type - Tetris clone for your terminal
+ * Copyright (C) 2017  Edgar Mendoza
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * trace-dump - Decode an e-type flight recorder file
+ *
+ * usage: trace-dump [-j] [-s] [file]
+ *	-j	Output Chrome trace JSON (chrome://tracing, Perfetto)
+ *	-s	Decode the snapshot taken on the last stutter instead of the live ring
+ */
+
+/* C library */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* POSIX */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+/* e-type */
+#include "trace.h"
+
+const char *event_names[TR_EVENT_COUNT] = { "spawn", "move", "rotate", "lock", "clear",
+					       "hold", "gravity", "frame", "stutter" };
+
+const char mino_names[7] = { 'I', 'L', 'J', 'O', 'S', 'Z', 'T' };
+
+void
+print_text(const struct trace_record *rec, uint64_t t0)
+{
+	printf("%12.6f  %-8s", (double)(rec->ts - t0) / 1e9, event_names[rec->event]);
+
+	switch (rec->event) {
+	case TR_SPAWN: case TR_MOVE: case TR_ROTATE: case TR_LOCK: case TR_GRAVITY:
+		printf("  %c at %d,%d  arg=%u", mino_names[rec->mino % 7], rec->x, rec->y, rec->arg);
+		break;
+
+	case TR_HOLD:
+		printf("  %c <-> %c", mino_names[rec->mino % 7], mino_names[rec->arg % 7]);
+		break;
+
+	case TR_CLEAR:
+		printf("  %u lines from row %d", rec->arg, rec->y);
+		break;
+
+	case TR_FRAME:
+		printf("  window %u", rec->arg);
+		break;
+
+	case TR_STUTTER:
+		printf("  stalled for %u us", rec->arg);
+		break;
+	}
+
+	putchar('\n');
+}
+
+void
+print_json(const struct trace_record *rec, uint64_t t0, int first)
+{
+	printf("%s\n{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,", first ? "" : ",",
+	       event_names[rec->event], rec->event == TR_STUTTER ? "X" : "i",
+	       (double)(rec->ts - t0) / 1e3 - (rec->event == TR_STUTTER ? rec->arg : 0));
+
+	if (rec->event == TR_STUTTER) {
+		printf("\"dur\":%u,", rec->arg);
+	} else {
+		printf("\"s\":\"t\",");
+	}
+
+	printf("\"pid\":1,\"tid\":%d,\"args\":{\"mino\":\"%c\",\"x\":%d,\"y\":%d,\"arg\":%u}}",
+	       rec->event == TR_FRAME ? 2 : 1, mino_names[rec->mino % 7], rec->x, rec->y, rec->arg);
+}
+
+int
+main(int argc, char **argv)
+{
+	const struct trace_header *hdr;
+	const struct trace_record *ring, *rec;
+	const char *path;
+	struct stat st;
+	uint64_t head, i, start, t0;
+	int fd, opt, json, snap, printed;
+
+	json = snap = 0;
+	while ((opt = getopt(argc, argv, "js")) != -1) {
+		switch (opt) {
+		case 'j':
+			json = 1;
+			break;
+
+		case 's':
+			snap = 1;
+			break;
+
+		default:
+			fprintf(stderr, "usage: %s [-j] [-s] [file]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	path = optind < argc ? argv[optind] : TRACE_PATH;
+
+	if ((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+		perror(path);
+		return 1;
+	}
+
+	if ((size_t)st.st_size < sizeof *hdr ||
+	    (hdr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		fprintf(stderr, "%s: not a trace file\n", path);
+		return 1;
+	}
+
+	if (memcmp(hdr->magic, TRACE_MAGIC, sizeof hdr->magic) ||
+	    hdr->record_size != sizeof (struct trace_record) ||
+	    (size_t)st.st_size < sizeof *hdr + 2 * (size_t)hdr->ring_size * hdr->record_size) {
+		fprintf(stderr, "%s: not a trace file\n", path);
+		return 1;
+	}
+
+	ring = (const struct trace_record *)(hdr + 1);
+	head = hdr->head;
+
+	if (snap) {
+		if (hdr->snap_head == 0) {
+			fprintf(stderr, "%s: no stutter snapshot\n", path);
+			return 1;
+		}
+
+		ring += hdr->ring_size;
+		head = hdr->snap_head;
+	}
+
+	start = head > hdr->ring_size ? head - hdr->ring_size : 0;
+	t0 = start != head ? ring[start % hdr->ring_size].ts : 0;
+
+	if (json) {
+		printf("{\"traceEvents\":[");
+	}
+
+	for (i = start, printed = 0; i != head; ++i) {
+		rec = &ring[i % hdr->ring_size];
+
+		if (rec->event >= TR_EVENT_COUNT) {
+			continue;
+		}
+
+		if (json) {
+			print_json(rec, t0, !printed++);
+		} else {
+			print_text(rec, t0);
+		}
+	}
+
+	if (json) {
+		printf("\n]}\n");
+	}
+
+	return 0;
+}